@@ -5,7 +5,7 @@
  * This file contains the main application logic for the 3D streamline visualization
  * tool, including initialization, rendering loop, event handling, and GUI.
  */
-#if defined(_POSIX_VERSION)
+#if defined(_POSIX_VERSION) || defined(__linux__)
 #include <unistd.h>
 #endif
 
@@ -23,6 +23,19 @@
 
 #include <string>
 #include <cmath>
+#include <chrono>
+#include <map>
+#include <deque>
+#include <limits>
+#include <random>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <iterator>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 #include "include/Constants.h"
 #include "include/Shader.h"
@@ -30,6 +43,20 @@
 #include "include/VectorField.h"
 #include "include/StreamlineTracer.h"
 #include "include/StreamlineRenderer.h"
+#include "include/StreamlineFilter.h"
+#include "include/StreamlineBVH.h"
+#include "include/Kernels.h"
+#include "include/VolumeAllocator.h"
+#include "include/SessionSnapshot.h"
+#include "include/DatasetManager.h"
+#include "include/InputRecorder.h"
+#include "include/LatencyStats.h"
+#include "include/InteractionLatency.h"
+#include "include/JobScheduler.h"
+#include "include/DatasetSnapshot.h"
+#include "include/SliceSeedIndex.h"
+#include "include/DistributedTracer.h"
+#include "include/AppSession.h"
 
 // Camera settings
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
@@ -46,10 +73,6 @@ bool firstMouse = true;
 glm::mat4 projection;
 glm::mat4 view;
 
-// Data variables
-float* globalScalarData = nullptr;
-int scalarDimX = 0, scalarDimY = 0, scalarDimZ = 0;
-
 const unsigned int SCR_WIDTH = 900;
 const unsigned int SCR_HEIGHT = 900;
 
@@ -64,26 +87,50 @@ const char* currentVectorFile = BRAIN_VECTOR_PATH;
 const char* currentTensorFile = BRAIN_TENSORS_PATH;
 
 bool useTensors = false;
+bool lazyTensorDecomposition = true; //decompose tensor bricks on first touch, float storage only
+VectorFieldStorage vectorStorage = VECTOR_STORAGE_FLOAT32;
 
 // Streamline parameters
-float stepSize = 0.5f;
-float maxLength = 500.0f;
-int maxSteps = 1;
 float maxAngleDegrees = 45;
-float maxAngle = maxAngleDegrees * (std::_Pi_val / 180); //about 45 degrees
-const char* integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+
+/**
+ * The tracer settings the application starts with.
+ */
+TracerParams getInitialTracerParams()
+{
+    TracerParams params;
+    params.stepSize = 0.5f;
+    params.maxLength = 500.0f;
+    params.maxSteps = 1;
+    params.maxAngle = maxAngleDegrees * (std::_Pi_val / 180); //about 45 degrees
+    return params;
+}
+
+// The active dataset and the tracer settings, the only state shared with worker threads
+AppSession session(getInitialTracerParams());
+TracerParams tracedParams; //settings the current streamlines were traced with
 
 float lineWidth = 1.0f;
+StreamlineRenderMode streamlineRenderMode = RENDER_MODE_OPAQUE;
+bool densityOpacity = true;     //derive the line opacity from the number of line layers per pixel
+float targetOpacity = 0.9f;     //coverage of an average pixel with density-aware opacity
+float streamlineOpacity = 0.2f; //line opacity without density-aware opacity
+int densityResolutionIndex = 0; //density map resolution, index into densityResolutions
+const float densityResolutions[] = { 1.0f, 0.5f, 0.25f };
+const char* densityResolutionNames[] = { "Full", "Half", "Quarter" };
+float densitySaturation = 32.0f; //overlapping lines at the top of the colormap
+int densityFrames = 1;           //frames a density accumulation is spread over
+double visibleStreamlineLength = 0.0; //total length of the drawn streamlines in voxels
 
 // Global objects
-VectorField* vectorField = nullptr;
-StreamlineTracer* streamlineTracer = nullptr;
-StreamlineRenderer* streamlineRenderer = nullptr;
+StreamlineRenderer* streamlineRenderer = nullptr; //renderer of the active dataset
 Shader* sliceShader = nullptr;
 Shader* streamlineShader = nullptr;
+Shader* oitCompositeShader = nullptr;
+Shader* densityResolveShader = nullptr;
 Shader* glyphShader = nullptr;
 int dimX = 0, dimY = 0, dimZ = 0;
-unsigned int texture = 0;
+unsigned int texture = 0; //background texture of the active dataset
 unsigned int sliceVAO = 0, sliceVBO = 0, sliceEBO = 0;
 
 //threedimensional
@@ -96,10 +143,117 @@ int selectedAxis = AXIS_Z; //0 = x, 1 = y, 2 = z
 glm::vec3 mouseSeedLoc;
 bool useMouseSeeding = false;
 bool paramsChanged = false; //for the gui
+
+// Coarse preview tracing on the vector field pyramid
+bool livePreview = false;   //trace on previewLevel while parameters change
+int previewLevel = 2;
+bool previewShown = false;  //the current streamlines are a preview
+double lastTraceMs = 0.0;
+int lastTraceLevel = 0;
+bool lastTraceIncremental = false; //the last trace updated the previous one instead of tracing from the seeds
+
+// Full resolution trace of the settings a preview shows, run as an interactive job once they stop changing
+struct PreviewRefinement {
+    explicit PreviewRefinement(std::shared_ptr<const DatasetSnapshot> dataset) : dataset(dataset), tracer(dataset) {}
+
+    std::shared_ptr<const DatasetSnapshot> dataset;
+    StreamlineTracer tracer;
+    TracerParams params;
+    std::vector<Point3D> seeds;
+    std::atomic<size_t> tracedSeeds{ 0 };
+    std::vector<std::vector<Point3D>> streamlines;
+    StreamlineAttributes attributes;
+    std::chrono::steady_clock::time_point start;
+};
+std::shared_ptr<PreviewRefinement> previewRefinement; //written by the job until it is done
+JobHandle previewRefinementJob;
+const size_t REFINEMENT_CHUNK_SEEDS = 2048; //the job can be cancelled or outranked between chunks
+
+// Incremental updates when only the limits change
+bool incrementalUpdates = true;
+TraceState traceState; //where every half of the last full resolution trace ended
 bool viewAxisChanged = false;
 int mouseSeedDensity = 1;
 float mouseSeedRadius = 3;
 
+// Volume seeding
+bool useVolumeSeeding = false;
+VolumeSeedingOptions volumeSeedingOptions;
+VolumeBuffer<bool> roiMask; //optional region of interest for volume seeding
+char roiMaskPath[256] = "";
+
+// Streamline filtering
+StreamlineAttributes streamlineAttributes; //attributes of the currently rendered streamlines
+StreamlineFilter streamlineFilter;
+std::vector<unsigned char> visibleStreamlines;  //mask of the drawn streamlines, from the filter and the isolated bundle
+std::vector<unsigned char> isolatedStreamlines; //bundle selected by clicking a streamline, empty if none is isolated
+
+// Picking
+StreamlineBVH* streamlineBVH = nullptr; //segments of the current streamlines
+int hoveredStreamline = -1;
+SegmentHit hoveredHit;
+double lastPickMicroseconds = 0.0;
+float pickRadiusPixels = 4.0f;
+float bundleRadius = 2.0f;              //voxels
+float bundleFraction = 0.8f;            //part of the picked streamline a bundle member has to follow
+
+// Prepared datasets kept resident for instant switching, the session and the globals above point into the active one
+DatasetManager datasetManager((size_t)DATASET_MEMORY_BUDGET_MB * 1024 * 1024);
+ResidentDataset* activeDataset = nullptr;
+int datasetBudgetMB = DATASET_MEMORY_BUDGET_MB;
+
+// Input recording and replay
+InputRecorder inputRecorder;
+char inputRecordingPath[256] = "input-recording.txt";
+
+/**
+ * The part of the application state that user actions change, compared every frame while recording.
+ */
+struct RecordedState {
+    float stepSize, maxLength, maxAngleDegrees, lineWidth;
+    int maxSteps, sliceX, sliceY, sliceZ, axis, dataset, useTensors, integrationMethod;
+    int flipX, flipY, flipZ, useMouseSeeding, useVolumeSeeding;
+};
+RecordedState lastRecordedState;
+
+// Frame time comparison of the render modes (--benchmark-rendering)
+int renderBenchmarkFrames = 0;  //measured frames per mode, 0 when not benchmarking
+const int RENDER_BENCHMARK_WARMUP = 10;
+int renderBenchmarkMode = 0;
+int renderBenchmarkFrame = 0;
+std::chrono::steady_clock::time_point renderBenchmarkLast;
+LatencyStats renderBenchmarkTimes[NUM_RENDER_MODES];
+
+// Soak test of the dataset lifecycle (--soak)
+int soakIterations = 0; //dataset switches, 0 when not soaking
+
+bool replaying = false;
+std::vector<InputAction> replayActions;
+size_t replayNext = 0;
+std::chrono::steady_clock::time_point replayStart;
+
+// Input-to-display latency, replayed actions are tagged with the time they were due
+InteractionTracker interactions;
+JobClassStats jobStats[NUM_JOB_CLASSES]; //queue waits taken from the scheduler every frame
+std::chrono::steady_clock::time_point inputTime = std::chrono::steady_clock::now(); //when the events handled in this frame were polled
+char latencyDumpPath[256] = "interaction-latency.csv";
+bool frameShowsInteractions = false; //the frame being drawn closes interactions once it finished
+
+/**
+ * A presented frame with interactions, waiting for the GPU. The fence says when the GPU got past
+ * the frame and the timestamp query when exactly, so polling late doesn't add to the latency.
+ */
+struct InteractionFence {
+    GLsync sync = nullptr;
+    GLuint timestamp = 0;
+};
+std::deque<InteractionFence> interactionFences; //oldest first, like the frames in the tracker
+
+// Session snapshots
+char sessionSnapshotPath[256] = "session.vcpsnap";
+std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+double timeToFirstFrameMs = -1.0;
+
 //------------------------------------------------------------------------------
 // Function declarations
 //------------------------------------------------------------------------------
@@ -111,113 +265,145 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 
-// Data handling functions
-float sampleScalarData(float x, float y, float z);
-
 void updatePVMatrices();
 
 /**
- * Load the data files into memory and generate the corresponding 3d texture.
+ * Release the loaded dataset. The dataset stays resident in the dataset manager, which owns
+ * its resources; only the globals pointing into it are detached.
  */
-void loadCurrentDataFiles()
+void releaseDataset()
 {
-    std::cout << "Starting loading data file for  " << currentDataset << std::endl;
-
-    // Clean up old resources
-    if (vectorField) {
-        delete vectorField;
-        vectorField = nullptr;
-    }
-    if (globalScalarData) {
-        delete[] globalScalarData;
-        globalScalarData = nullptr;
-    }
-    if (streamlineRenderer) {
-        delete streamlineRenderer;
-        streamlineRenderer = nullptr;
+    //the region of interest belongs to the previous dataset
+    roiMask.reset();
+    volumeSeedingOptions.roiMask = nullptr;
+
+    if (activeDataset) {
+        //remember the state that belongs to the dataset for when it is activated again
+        activeDataset->attributes = std::move(streamlineAttributes);
+        streamlineAttributes.clear();
+        activeDataset->currentSliceX = currentSliceX;
+        activeDataset->currentSliceY = currentSliceY;
+        activeDataset->currentSliceZ = currentSliceZ;
+        activeDataset->tracedParams = tracedParams;
+        activeDataset = nullptr;
     }
-    if (streamlineTracer) {
-        delete streamlineTracer;
-        streamlineTracer = nullptr;
+
+    //the volumes are freed once nothing else (e.g. a background save or an evicted entry) holds the dataset
+    session.setDataset(nullptr);
+    streamlineRenderer = nullptr;
+    streamlineBVH = nullptr;
+    hoveredStreamline = -1;
+    isolatedStreamlines.clear();
+    visibleStreamlines.clear();
+    texture = 0;
+}
+
+/**
+ * Create the 3d background texture from interleaved (intensity, alpha) texels.
+ */
+GLObject createSliceTexture(const float* texels)
+{
+    GLObject sliceTexture(GL_OBJECT_TEXTURE);
+    glBindTexture(GL_TEXTURE_3D, sliceTexture.get());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    float borderColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    if (USE_SMOOTH_BACKGROUND)
+    {
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
-    if (texture) {
-        glDeleteTextures(1, &texture);
-        texture = 0;
+    else
+    {
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG, dimX, dimY, dimZ, 0, GL_RG, GL_FLOAT, texels);
+    return sliceTexture;
+}
+
+/**
+ * Load the data files into memory and generate the corresponding 3d texture.
+ * @return The prepared dataset without streamlines, or nullptr if loading failed; nothing leaks either way
+ */
+std::unique_ptr<ResidentDataset> loadCurrentDataFiles()
+{
+    std::cout << "Starting loading data file for  " << currentDataset << std::endl;
+
+    releaseDataset();
 
     //load the scalar data
-    if (readData(currentScalarFile, globalScalarData, dimX, dimY, dimZ) != EXIT_SUCCESS) {
+    float* scalarData = nullptr;
+    if (readData(currentScalarFile, scalarData, dimX, dimY, dimZ) != EXIT_SUCCESS) {
         std::cerr << "Failed to read scalar data from " << currentScalarFile << std::endl;
-        return;
+        return nullptr;
     }
-
-    // Store dimensions for global access
-    scalarDimX = dimX;
-    scalarDimY = dimY;
-    scalarDimZ = dimZ;
+    std::shared_ptr<const float> scalars = shareVolume(scalarData);
 
     std::cout << "Loaded scalar data: " << dimX << "x" << dimY << "x" << dimZ << std::endl;
 
     //loading vector data
+    std::unique_ptr<VectorField> vectorField;
     try {
         if (useTensors)
         {
             float* tensorData;
             int tensorDimX, tensorDimY, tensorDimZ;
 
-            readTensorData(currentTensorFile, tensorData, tensorDimX, tensorDimY, tensorDimZ);
-            vectorField = new VectorField(tensorData, dimX, dimY, dimZ);
-            delete[] tensorData;
+            if (readTensorData(currentTensorFile, tensorData, tensorDimX, tensorDimY, tensorDimZ) != EXIT_SUCCESS) {
+                std::cerr << "Failed to read tensor data from " << currentTensorFile << std::endl;
+                return nullptr;
+            }
+            //freed when it goes out of scope, also if the decomposition throws
+            VolumeBuffer<float> tensors(tensorData);
+            if (tensorDimX != dimX || tensorDimY != dimY || tensorDimZ != dimZ) {
+                std::cerr << "Tensor dimensions do not match the scalar data" << std::endl;
+                return nullptr;
+            }
+            if (lazyTensorDecomposition && vectorStorage == VECTOR_STORAGE_FLOAT32)
+            {
+                //the field keeps the tensors, so the pointer stays valid for building the pyramid
+                const float* tensorField = tensors.get();
+                vectorField.reset(new VectorField(std::move(tensors), dimX, dimY, dimZ));
+                vectorField->buildPyramid(VECTOR_PYRAMID_LEVELS, tensorField);
+            }
+            else
+            {
+                vectorField.reset(new VectorField(tensors.get(), dimX, dimY, dimZ, vectorStorage));
+                vectorField->buildPyramid(VECTOR_PYRAMID_LEVELS, tensors.get());
+            }
         }
         else 
         {
-            vectorField = new VectorField(currentVectorFile); //todo why is this a pointer in the first place?
+            vectorField.reset(new VectorField(currentVectorFile, vectorStorage));
+            vectorField->buildPyramid(VECTOR_PYRAMID_LEVELS);
         }
     } catch (const std::exception& e) {
         std::cerr << "Error loading vector field: " << e.what() << std::endl;
-        return;
+        return nullptr;
     }
 
     std::cout << "Loaded vector data" << std::endl;
 
     //calculate an image texture of the scalar data with opacity 0 where the vector field has a zero vector
-    bool* zeroMask = vectorField->getZeroMask(dimX, dimY, dimZ);
-    float* imagedata = new float[dimX * dimY * dimZ * 2]; //two components per voxel
-    for (size_t x = 0; x < dimX; x++)
-    {
-        for (size_t y = 0; y < dimY; y++)
-        {
-            for (size_t z = 0; z < dimZ; z++)
-            {
-                int imgIndex = 2 * x + 2 * dimX * y + 2 * dimX * dimY * z;
-                imagedata[imgIndex] = globalScalarData[x + y * dimX + z * dimX * dimY];
-                imagedata[imgIndex + 1] = zeroMask[x + y * dimX + z * dimX * dimY] ? 1.0f : 0.0f;
-            }
-        }
-    }
+    const bool* zeroMask = vectorField->getZeroMask(dimX, dimY, dimZ);
+    VolumeBuffer<float> imagedata = allocateVolumeBuffer<float>((size_t)dimX * dimY * dimZ * 2); //two components per voxel
+    getKernels().packScalarMaskTexture(scalars.get(), zeroMask, imagedata.get(), (size_t)dimX * dimY * dimZ);
+
+    //from here on the volumes don't change anymore
+    std::unique_ptr<ResidentDataset> entry(new ResidentDataset());
+    entry->data = std::make_shared<const DatasetSnapshot>(currentDataset, useTensors, scalars, dimX, dimY, dimZ,
+        std::unique_ptr<const VectorField>(std::move(vectorField)));
+    session.setDataset(entry->data);
+    std::cout << "Indexed " << entry->data->getSeedIndex()->getVoxelCount() << " masked voxels per slice in "
+              << entry->data->getSeedIndex()->getBuildMs() << " ms" << std::endl;
 
     // Setup or update the 3D texture
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_3D, texture);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    float borderColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    if (USE_SMOOTH_BACKGROUND)
-    {
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    }
-    else
-    {
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    }
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG, dimX, dimY, dimZ, 0, GL_RG, GL_FLOAT, imagedata);
-
-    delete[] imagedata;
-    imagedata = nullptr;
+    entry->texture = createSliceTexture(imagedata.get());
+    texture = entry->texture.get();
+    imagedata.reset();
 
     std::cout << "Generated 3d texture" << std::endl;
 
@@ -227,6 +413,37 @@ void loadCurrentDataFiles()
 
     // Initialize camera position based on data dimensions
     updatePVMatrices();
+    return entry;
+}
+
+/**
+ * Load a region of interest mask for volume seeding, every nonzero voxel is part of the region.
+ */
+void loadRoiMask(const char* filename)
+{
+    float* roiData;
+    int roiDimX, roiDimY, roiDimZ;
+    if (readData(filename, roiData, roiDimX, roiDimY, roiDimZ) != EXIT_SUCCESS)
+    {
+        std::cerr << "Failed to read ROI mask from " << filename << std::endl;
+        return;
+    }
+    VolumeBuffer<float> roi(roiData);
+
+    if (roiDimX != dimX || roiDimY != dimY || roiDimZ != dimZ)
+    {
+        std::cerr << "ROI mask dimensions do not match the dataset" << std::endl;
+        return;
+    }
+
+    roiMask = allocateVolumeBuffer<bool>((size_t)dimX * dimY * dimZ);
+    for (int i = 0; i < dimX * dimY * dimZ; i++)
+    {
+        roiMask[i] = roi[i] != 0.0f;
+    }
+
+    volumeSeedingOptions.roiMask = roiMask.get();
+    std::cout << "Loaded ROI mask from " << filename << std::endl;
 }
 
 /**
@@ -292,12 +509,64 @@ void initImgPlane()
     glBindVertexArray(0); //unbind vertex array
 }
 
+/**
+ * Tag a live input for latency tracking. Replayed actions are tagged when they are applied instead.
+ */
+void beginInteraction(const char* name)
+{
+    if (!replaying) interactions.begin(name, inputTime);
+}
+
+/**
+ * Generates the seeds for the current seeding mode
+ * @param storage Holds the seeds of the modes that generate new ones, slice seeds are looked up in the seed index
+ * @return The seeds, valid as long as storage and the tracer's dataset are
+ */
+SeedSpan generateSeeds(const StreamlineTracer& tracer, std::vector<Point3D>& storage)
+{
+    //todo give different options for seeding
+    if (useVolumeSeeding)
+    {
+        storage = tracer.generateVolumeSeeds(volumeSeedingOptions);
+    }
+    else if (useMouseSeeding)
+    {
+        storage = tracer.generateMouseSeeds(currentSliceX, currentSliceY, currentSliceZ, selectedAxis, mouseSeedLoc, mouseSeedRadius, mouseSeedDensity);
+    }
+    else
+    {
+        return tracer.getSliceSeeds(currentSliceX, currentSliceY, currentSliceZ, selectedAxis);
+    }
+    return storage;
+}
+
+/**
+ * Estimate the number of seeds of the current slice or volume seeding settings from the seed index
+ * @return Seed count of the slice, an upper bound for volume seeding (the thresholds and the ROI are not applied), 0 for mouse seeding
+ */
+size_t estimateSeedCount()
+{
+    std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+    const SliceSeedIndex* index = dataset ? dataset->getSeedIndex() : nullptr;
+    if (!index || useMouseSeeding) return 0;
+
+    if (useVolumeSeeding)
+    {
+        size_t count = index->getVoxelCount() * (size_t)std::max(1, volumeSeedingOptions.seedsPerVoxel);
+        return volumeSeedingOptions.maxSeeds > 0 ? std::min(count, (size_t)volumeSeedingOptions.maxSeeds) : count;
+    }
+    int slice = selectedAxis == AXIS_X ? currentSliceX : (selectedAxis == AXIS_Y ? currentSliceY : currentSliceZ);
+    return index->getSliceCount(selectedAxis, slice);
+}
+
 /**
  * Generates streamlines
+ * @param params Settings to trace with
  */
-std::vector<std::vector<Point3D>> generateStreamlines()
+std::vector<std::vector<Point3D>> generateStreamlines(const TracerParams& params)
 {
-    if (!vectorField)
+    std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+    if (!dataset)
     {
         throw std::runtime_error("No vectorfield initialized when trying to generate streamlines");
     }
@@ -305,31 +574,47 @@ std::vector<std::vector<Point3D>> generateStreamlines()
     std::vector<std::vector<Point3D>> streamlines;
     try
     {
+        StreamlineTracer tracer(dataset);
         std::cout << "Started seeding" << std::endl;
 
-        std::vector<Point3D> seeds;
-
-        //todo give different options for seeding
-        if (useMouseSeeding)
-        {
-            seeds = streamlineTracer->generateMouseSeeds(currentSliceX, currentSliceY, currentSliceZ, selectedAxis, mouseSeedLoc, mouseSeedRadius, mouseSeedDensity);
-        }
-        else
-        {
-            seeds = streamlineTracer->generateSliceGridSeeds(currentSliceX, currentSliceY, currentSliceZ, selectedAxis);
-            //todo remove after testing
-            //seeds = { Point3D(19.0f, 21.0f, 1.0f) };
-        }
-        std::cout << "Seeded " << seeds.size() << " seeds from the current slice" << std::endl;
+        std::vector<Point3D> seedStorage;
+        SeedSpan seeds = generateSeeds(tracer, seedStorage);
+        interactions.mark(STAGE_SEEDED);
+        std::cout << "Seeded " << seeds.size << " seeds from the current slice" << std::endl;
     
         if (!seeds.empty()) 
         {
-            streamlines = streamlineTracer->traceAllStreamlines(seeds);
+            //only full resolution traces are recorded, so a preview doesn't replace the state the final trace updates
+            if (!incrementalUpdates) traceState.clear();
+            TraceState* state = incrementalUpdates && params.level == 0 ? &traceState : nullptr;
+            bool incremental = state && tracer.canUpdateStreamlines(*state, seeds, params);
+            size_t resumed = 0;
+
+            auto traceStart = std::chrono::steady_clock::now();
+            //the user waits for this trace, so it runs right here with all cores instead of waiting for a
+            //worker; saves and other background jobs are held to their thread limits meanwhile
+            if (incremental) streamlines = tracer.updateStreamlines(*state, params, &streamlineAttributes, nullptr, &resumed);
+            else streamlines = tracer.traceAllStreamlines(seeds, params, &streamlineAttributes, nullptr, nullptr, state);
             //streamlines = tracer.traceVectors(seeds);
-            std::cout << "Generated " << streamlines.size() << " streamlines" << std::endl;
+            double traceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - traceStart).count();
+            interactions.mark(STAGE_TRACED);
+            lastTraceMs = traceSeconds * 1000.0;
+            lastTraceLevel = params.level;
+            lastTraceIncremental = incremental;
+            if (incremental)
+            {
+                std::cout << "Updated " << streamlines.size() << " streamlines to the new limits in " << traceSeconds * 1000.0 << " ms ("
+                          << resumed << " of " << 2 * seeds.size << " halves traced further)" << std::endl;
+            }
+            else
+            {
+                std::cout << "Generated " << streamlines.size() << " streamlines in " << traceSeconds * 1000.0 << " ms ("
+                          << (traceSeconds > 0.0 ? seeds.size / traceSeconds : 0.0) << " seeds/s)" << std::endl;
+            }
         }
         else 
         {
+            streamlineAttributes.clear();
             std::cout << "No seeds generated, skipping streamline tracing" << std::endl;
         }
         return streamlines;
@@ -342,211 +627,1083 @@ std::vector<std::vector<Point3D>> generateStreamlines()
 }
 
 /**
- * (Possibly) update parameters and call generateStreamlines()
- */
-void regenerateStreamLines()
-{
-    paramsChanged = false;
-    if (streamlineTracer)
-    {
-        streamlineTracer->maxAngle = maxAngle;
-        streamlineTracer->maxLength = maxLength;
-        streamlineTracer->maxSteps = maxSteps;
-        streamlineTracer->stepSize = stepSize;
-        streamlineTracer->integrationMethod = integrationMethod;
-    }
-
-    if (vectorField && streamlineRenderer) {
-        std::vector<std::vector<Point3D>> streamlines = generateStreamlines();
-        streamlineRenderer->prepareStreamlines(streamlines);
-    }
-}
-
-/**
- * Update the perspective and view matrices.
+ * Hide the streamlines that don't pass the current filter, without tracing or uploading them again
  */
-void updatePVMatrices()
+void applyStreamlineFilter()
 {
-    //can keep a similar zoom level axis view, so long as the dimensions are al fairly similar
-    xFov = 0.0f;
-    yFov = 0.0f;
+    if (!streamlineRenderer) return;
 
-    // Initialize camera position based on data dimensions
-    if (selectedAxis == AXIS_X)
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned char>& visible = visibleStreamlines;
+    computeVisibleStreamlines(streamlineAttributes, streamlineFilter, visible);
+    if (!isolatedStreamlines.empty())
     {
-        cameraPos = glm::vec3(dimX, -dimY / 2.0f, -dimZ / 2.0f);
-        cameraFront = glm::vec3(-1.0f, 0.0f, 0.0f);
-        cameraUp = glm::vec3(0.0f, 0.0f, 1.0f);
-        projection = glm::ortho(xFov, (float)dimY - xFov, yFov, (float)dimZ - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+        for (size_t i = 0; i < visible.size() && i < isolatedStreamlines.size(); i++) visible[i] &= isolatedStreamlines[i];
     }
-    else if (selectedAxis == AXIS_Y)
+    streamlineRenderer->setVisibleStreamlines(visible);
+    visibleStreamlineLength = 0.0;
+    for (size_t i = 0; i < visible.size(); i++)
     {
-        cameraPos = glm::vec3(-dimX / 2.0f, -dimY, -dimZ / 2.0f);
-        cameraFront = glm::vec3(0.0f, 1.0f, 0.0f);
-        cameraUp = glm::vec3(0.0f, 0.0f, 1.0f);
-        projection = glm::ortho(xFov, (float)dimZ - xFov, yFov, (float)dimX - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+        if (visible[i]) visibleStreamlineLength += streamlineAttributes.length[i];
     }
-    else if (selectedAxis == AXIS_Z)
+    if (hoveredStreamline >= 0 && (hoveredStreamline >= (int)visible.size() || !visible[hoveredStreamline]))
     {
-        cameraPos = glm::vec3(-dimX / 2.0f, -dimY / 2.0f, dimZ);
-        cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
-        cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
-        projection = glm::ortho(xFov, (float)dimX - xFov, yFov, (float)dimY - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+        hoveredStreamline = -1;
+        streamlineRenderer->setHighlightedStreamline(-1);
     }
-    else throw std::runtime_error("invalid axis selected");
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    //initialize view matrix
-    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    std::cout << "Filtered " << streamlineAttributes.size() << " streamlines to " << streamlineRenderer->getVisibleStreamlineCount()
+              << " in " << seconds * 1000.0 << " ms" << std::endl;
 }
 
-//process input each frame
-void processInput(GLFWwindow* window) {
-    // Exit application when Escape is pressed
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-        glfwSetWindowShouldClose(window, true);
-    }
+/**
+ * Turn a cursor position into a ray in streamline (voxel) coordinates.
+ * @param pixelSize Output size of a screen pixel in voxels
+ */
+void getCursorRay(GLFWwindow* window, double xpos, double ypos, Point3D& origin, Point3D& direction, float& pixelSize)
+{
+    int scrWidth, scrHeight;
+    glfwGetWindowSize(window, &scrWidth, &scrHeight);
+    float ndcX = (2.0f * (float)xpos) / scrWidth - 1.0f;
+    float ndcY = 1.0f - (2.0f * (float)ypos) / scrHeight;
+
+    //the streamlines are drawn with their corner at -dim / 2, see the model matrix in main()
+    glm::mat4 streamlineModel = glm::translate(glm::mat4(1.0f), glm::vec3((float)-dimX / 2.0f, (float)-dimY / 2.0f, (float)-dimZ / 2.0f));
+    glm::mat4 inverse = glm::inverse(projection * view * streamlineModel);
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    origin = Point3D(nearPoint.x, nearPoint.y, nearPoint.z);
+    direction = Point3D(farPoint.x - nearPoint.x, farPoint.y - nearPoint.y, farPoint.z - nearPoint.z);
+    pixelSize = 2.0f / (projection[0][0] * scrWidth); //orthographic: the view is 2 / projection[0][0] voxels wide
 }
 
-//handle mouse movement for the camera
-void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
-    // Standard camera control (non-orbit)
-    bool moveCamera = /*cameraMode ||*/ (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS);
-    if (!moveCamera) {
-        firstMouse = true;
-        return;
-    }
+/**
+ * Pick the drawn streamline under the cursor and highlight it.
+ */
+void updateHoveredStreamline(GLFWwindow* window, double xpos, double ypos)
+{
+    if (!streamlineBVH || !streamlineRenderer) return;
 
-    // Initialize reference position on first movement
-    if (firstMouse) {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
+    Point3D origin, direction;
+    float pixelSize;
+    getCursorRay(window, xpos, ypos, origin, direction, pixelSize);
 
-    // Calculate mouse movement since last frame
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // Reversed since y-coordinates go from bottom to top
-    lastX = xpos;
-    lastY = ypos;
+    auto start = std::chrono::steady_clock::now();
+    SegmentHit hit;
+    bool found = streamlineBVH->pickRay(origin, direction, pickRadiusPixels * pixelSize, hit,
+        visibleStreamlines.size() == streamlineBVH->getStreamlineCount() ? visibleStreamlines.data() : nullptr);
+    lastPickMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
 
-    //correct the offset
-    int scrWidth, scrHeight;
-    glfwGetWindowSize(window, &scrWidth, &scrHeight);
+    hoveredStreamline = found ? hit.streamline : -1;
+    hoveredHit = hit;
+    streamlineRenderer->setHighlightedStreamline(hoveredStreamline);
+}
 
-    //move the camera since we use an ortho perspective
-    if (selectedAxis == AXIS_X)
-    {
-        xoffset *= (((float)dimY - 2 * xFov) / scrWidth);
-        yoffset *= (((float)dimZ - 2 * yFov) / scrHeight);
-        cameraPos.y -= xoffset;
-        cameraPos.z -= yoffset;
-    }
-    else if (selectedAxis == AXIS_Y)
+/**
+ * Show only the bundle of a streamline: every drawn streamline that passes within bundleRadius
+ * of at least bundleFraction of the points sampled along it.
+ */
+void isolateBundle(int streamline)
+{
+    if (!streamlineBVH || streamline < 0 || streamline >= (int)streamlineBVH->getStreamlineCount()) return;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Point3D> points;
+    streamlineBVH->getStreamlinePoints(streamline, points);
+    if (points.empty()) return;
+
+    const unsigned char* visible = visibleStreamlines.size() == streamlineBVH->getStreamlineCount() ? visibleStreamlines.data() : nullptr;
+    size_t stride = std::max<size_t>(1, points.size() / 32);
+    std::vector<int> closeCount(streamlineBVH->getStreamlineCount(), 0);
+    std::vector<int> nearby;
+    int samples = 0;
+    for (size_t i = 0; i < points.size(); i += stride)
     {
-        xoffset *= (((float)dimX - 2 * xFov) / scrWidth);
-        yoffset *= (((float)dimZ - 2 * yFov) / scrHeight);
-        cameraPos.x -= xoffset;
-        cameraPos.z -= yoffset;
+        streamlineBVH->findStreamlinesNear(points[i], bundleRadius, nearby, visible);
+        for (int id : nearby) closeCount[id]++;
+        samples++;
     }
-    else if (selectedAxis == AXIS_Z)
+
+    int required = std::max(1, (int)std::ceil(bundleFraction * samples));
+    closeCount[streamline] = required;
+    isolatedStreamlines.assign(closeCount.size(), 0);
+    size_t bundleSize = 0;
+    for (size_t i = 0; i < closeCount.size(); i++)
     {
-        xoffset *= (((float)dimX - 2 * xFov) / scrWidth);
-        yoffset *= (((float)dimY - 2 * yFov) / scrHeight);
-        cameraPos.x -= xoffset;
-        cameraPos.y -= yoffset;
+        isolatedStreamlines[i] = closeCount[i] >= required;
+        bundleSize += isolatedStreamlines[i];
     }
 
-    //update view matrix
-    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Isolated a bundle of " << bundleSize << " streamlines around streamline " << streamline << " in "
+              << seconds * 1000.0 << " ms" << std::endl;
+    applyStreamlineFilter();
 }
 
-//Handle window resizing
-void frameBufferSizeCallback(GLFWwindow* window, int width, int height) {
-    // Unused parameter
-    (void)window;
-
-    // Update OpenGL viewport to match the new window size
-    glViewport(0, 0, width, height);
+/**
+ * Show all streamlines that pass the filter again.
+ */
+void clearIsolatedBundle()
+{
+    isolatedStreamlines.clear();
+    applyStreamlineFilter();
 }
 
 /**
- * @brief Sample scalar data at a floating-point position with trilinear interpolation
- *
- * @param x X coordinate
- * @param y Y coordinate
- * @param z Z coordinate
- * @return Interpolated scalar value
+ * Trace the current seeds once with every seed ordering and report timings and cache counters.
  */
-float sampleScalarData(float x, float y, float z) {
-    // Check if scalar data exists
-    if (!globalScalarData || scalarDimX <= 0 || scalarDimY <= 0 || scalarDimZ <= 0) {
-        return 0.0f;
-    }
+void benchmarkSeedOrderings()
+{
+    std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+    if (!dataset) return;
 
-    if (false)
-    {
-    //todo simplified way:
-    int x0 = std::roundf(x);
-    int y0 = std::roundf(y);
-    int z0 = std::roundf(z);
+    StreamlineTracer tracer(dataset);
+    std::vector<Point3D> seedStorage;
+    SeedSpan seeds = generateSeeds(tracer, seedStorage);
+    if (seeds.empty()) return;
 
-    float intensity = globalScalarData[z0 + scalarDimZ * (y0 + scalarDimY * x0)]; //wrong index
-    return intensity;
-    }
-    else
+    const char* orderings[] = { StreamlineTracer::SEED_ORDER_NONE, StreamlineTracer::SEED_ORDER_MORTON, StreamlineTracer::SEED_ORDER_HILBERT };
+    TracerParams params = session.tracerParams;
+    for (const char* ordering : orderings)
     {
-    // Ensure coordinates are within bounds
-    x = std::max(0.0f, std::min(x, static_cast<float>(scalarDimX - 1.01f)));
-    y = std::max(0.0f, std::min(y, static_cast<float>(scalarDimY - 1.01f)));
-    z = std::max(0.0f, std::min(z, static_cast<float>(scalarDimZ - 1.01f)));
-
-    // Get integer coordinates for the 8 surrounding voxels
-    int x0 = static_cast<int>(x);
-    int y0 = static_cast<int>(y);
-    int z0 = static_cast<int>(z);
-    int x1 = std::min(x0 + 1, scalarDimX - 1);
-    int y1 = std::min(y0 + 1, scalarDimY - 1);
-    int z1 = std::min(z0 + 1, scalarDimZ - 1);
-
-    // Calculate interpolation weights
-    float wx = x - x0;
-    float wy = y - y0;
-    float wz = z - z0;
-
-    // Get values at the 8 surrounding voxels
-    float v000 = globalScalarData[z0 * scalarDimY * scalarDimX + y0 * scalarDimX + x0];
-    float v001 = globalScalarData[z1 * scalarDimY * scalarDimX + y0 * scalarDimX + x0];
-    float v010 = globalScalarData[z0 * scalarDimY * scalarDimX + y1 * scalarDimX + x0];
-    float v011 = globalScalarData[z1 * scalarDimY * scalarDimX + y1 * scalarDimX + x0];
-    float v100 = globalScalarData[z0 * scalarDimY * scalarDimX + y0 * scalarDimX + x1];
-    float v101 = globalScalarData[z1 * scalarDimY * scalarDimX + y0 * scalarDimX + x1];
-    float v110 = globalScalarData[z0 * scalarDimY * scalarDimX + y1 * scalarDimX + x1];
-    float v111 = globalScalarData[z1 * scalarDimY * scalarDimX + y1 * scalarDimX + x1];
-
-    // Perform trilinear interpolation
-    float v00 = v000 * (1 - wz) + v001 * wz;
-    float v01 = v010 * (1 - wz) + v011 * wz;
-    float v10 = v100 * (1 - wz) + v101 * wz;
-    float v11 = v110 * (1 - wz) + v111 * wz;
-
-    float v0 = v00 * (1 - wy) + v01 * wy;
-    float v1 = v10 * (1 - wy) + v11 * wy;
-
-    return v0 * (1 - wx) + v1 * wx;
+        params.seedOrdering = ordering;
+
+        PerfCounterValues counters;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(seeds, params, nullptr, nullptr, &counters);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << ordering << ": traced " << seeds.size << " seeds in " << seconds * 1000.0 << " ms ("
+                  << (seconds > 0.0 ? seeds.size / seconds : 0.0) << " seeds/s)" << std::endl;
+        counters.print(ordering);
     }
-    
 }
 
 /**
- * Process mouse clicks.
+ * Distance between streamlines traced from the same seeds, e.g. at a coarser level or with a larger step.
+ * Up to 64 points along every reference streamline are compared to the closest point of the
+ * streamline traced from the same seed.
+ *
+ * @param referenceSlot Index into reference of the streamline of every seed, -1 if the seed gave none
+ * @param seedIndices Seed of every compared streamline, as returned by traceAllStreamlines
  */
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) 
+void measureStreamlineDeviation(const std::vector<std::vector<Point3D>>& reference, const std::vector<long long>& referenceSlot,
+    const std::vector<std::vector<Point3D>>& streamlines, const std::vector<size_t>& seedIndices, double& meanDistance, double& maxDistance)
 {
-    (void)mods;  // Unused parameter
-    ImGuiIO& io = ImGui::GetIO();
-    if (io.WantCaptureMouse) return;
+    double deviationSum = 0.0, deviationMax = 0.0;
+    long long compared = 0;
+#pragma omp parallel
+    {
+        double threadSum = 0.0, threadMax = 0.0;
+        long long threadCompared = 0;
 
-    // Handle left mouse button
+#pragma omp for schedule(dynamic)
+        for (long long i = 0; i < (long long)streamlines.size(); i++)
+        {
+            long long slot = referenceSlot[seedIndices[i]];
+            if (slot < 0) continue;
+            const std::vector<Point3D>& expected = reference[slot];
+            const std::vector<Point3D>& actual = streamlines[i];
+            size_t stride = std::max<size_t>(1, expected.size() / 64);
+            for (size_t j = 0; j < expected.size(); j += stride)
+            {
+                float closest = std::numeric_limits<float>::max();
+                for (const Point3D& p : actual)
+                {
+                    float dx = p.x - expected[j].x, dy = p.y - expected[j].y, dz = p.z - expected[j].z;
+                    closest = std::min(closest, dx * dx + dy * dy + dz * dz);
+                }
+                double distance = std::sqrt(closest);
+                threadSum += distance;
+                threadMax = std::max(threadMax, distance);
+                threadCompared++;
+            }
+        }
+
+#pragma omp critical
+        {
+            deviationSum += threadSum;
+            deviationMax = std::max(deviationMax, threadMax);
+            compared += threadCompared;
+        }
+    }
+    meanDistance = compared ? deviationSum / compared : 0.0;
+    maxDistance = deviationMax;
+}
+
+/**
+ * Trace the current seeds on every pyramid level and report the latency and how far the
+ * coarse streamlines lie from the full resolution ones. The deviation is the distance from
+ * points sampled along every full resolution streamline to the closest point of the coarse
+ * streamline from the same seed.
+ */
+void comparePyramidLevels()
+{
+    std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+    if (!dataset) return;
+
+    StreamlineTracer tracer(dataset);
+    std::vector<Point3D> seedStorage;
+    SeedSpan seeds = generateSeeds(tracer, seedStorage);
+    if (seeds.empty()) return;
+
+    TracerParams params = session.tracerParams;
+    std::vector<std::vector<Point3D>> reference;
+    std::vector<long long> referenceSlot(seeds.size, -1); //streamline of every seed at level 0
+    for (int level = 0; level < dataset->getVectorField()->getLevelCount(); level++)
+    {
+        params.level = level;
+        std::vector<size_t> seedIndices;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(seeds, params, nullptr, &seedIndices);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (level == 0)
+        {
+            for (size_t i = 0; i < seedIndices.size(); i++) referenceSlot[seedIndices[i]] = (long long)i;
+            reference = std::move(streamlines);
+            std::cout << "Level 0: " << reference.size() << " streamlines in " << seconds * 1000.0 << " ms" << std::endl;
+            continue;
+        }
+
+        double deviationMean, deviationMax;
+        measureStreamlineDeviation(reference, referenceSlot, streamlines, seedIndices, deviationMean, deviationMax);
+
+        std::cout << "Level " << level << ": " << streamlines.size() << " streamlines in " << seconds * 1000.0 << " ms, deviation from level 0 mean "
+                  << deviationMean << " max " << deviationMax << " voxels" << std::endl;
+    }
+}
+
+/**
+ * Read the scalar volume of the current dataset for a headless benchmark and set dimX/Y/Z.
+ * @return The volume, or nullptr if it can't be read
+ */
+std::shared_ptr<const float> readBenchmarkScalars()
+{
+    float* scalarData = nullptr;
+    if (readData(currentScalarFile, scalarData, dimX, dimY, dimZ) != EXIT_SUCCESS)
+    {
+        std::cerr << "Failed to read scalar data from " << currentScalarFile << std::endl;
+        return nullptr;
+    }
+    return shareVolume(scalarData);
+}
+
+/**
+ * Snapshot of the current dataset for a headless benchmark, with the vector field read from the vector file.
+ */
+std::shared_ptr<const DatasetSnapshot> makeBenchmarkDataset(std::shared_ptr<const float> scalars)
+{
+    return std::make_shared<const DatasetSnapshot>(currentDataset, false, std::move(scalars), dimX, dimY, dimZ,
+        std::unique_ptr<const VectorField>(new VectorField(currentVectorFile)));
+}
+
+/**
+ * Tracer settings of the headless benchmarks: the initial settings with up to 2000 steps.
+ */
+TracerParams getBenchmarkTracerParams()
+{
+    TracerParams params = session.tracerParams;
+    params.maxSteps = 2000;
+    params.flipX = currentDataset == BRAIN_DATASET;
+    return params;
+}
+
+/**
+ * Headless check that tracing gives bitwise identical output for 1..maxThreads threads.
+ * Loads the current dataset without a window, seeds the volume and compares the hashes of
+ * the streamlines and their attributes.
+ *
+ * @return EXIT_SUCCESS if all thread counts agree
+ */
+int checkDeterminism(int maxThreads)
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    TracerParams params = getBenchmarkTracerParams();
+    VolumeSeedingOptions options;
+    options.maxSeeds = 20000;
+    std::vector<Point3D> seeds = tracer.generateVolumeSeeds(options);
+
+    bool deterministic = true;
+    uint64_t reference = 0;
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+#if defined(_OPENMP)
+        omp_set_num_threads(threads);
+#endif
+        StreamlineAttributes attributes;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(seeds, params, &attributes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t hash = StreamlineTracer::hashStreamlines(streamlines, &attributes);
+        if (threads == 1) reference = hash;
+        bool match = hash == reference;
+        deterministic &= match;
+
+        std::cout << threads << " threads: " << streamlines.size() << " streamlines in " << seconds * 1000.0 << " ms, hash "
+                  << std::hex << hash << std::dec << (match ? "" : " MISMATCH") << std::endl;
+    }
+
+    std::cout << (deterministic ? "Tracing output is identical for all thread counts" : "Tracing output differs between thread counts") << std::endl;
+    return deterministic ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Headless comparison of the vector field storage modes. Builds the vector field of the current
+ * dataset (from the tensors for the brain dataset) once per mode, traces the same volume seeds
+ * and prints the memory use, the angular error of the quantization and the tracing throughput.
+ * With tensors it also compares the time to the first slice of streamlines with eager and lazy
+ * decomposition, and fails if they trace different streamlines.
+ */
+int benchmarkVectorStorage()
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    VolumeBuffer<float> tensors;
+    if (currentDataset == BRAIN_DATASET)
+    {
+        float* tensorData = nullptr;
+        int tensorDimX, tensorDimY, tensorDimZ;
+        if (readTensorData(currentTensorFile, tensorData, tensorDimX, tensorDimY, tensorDimZ) != EXIT_SUCCESS)
+        {
+            std::cerr << "Failed to read tensor data from " << currentTensorFile << std::endl;
+            return EXIT_FAILURE;
+        }
+        tensors.reset(tensorData);
+    }
+
+    const VectorFieldStorage modes[] = { VECTOR_STORAGE_FLOAT32, VECTOR_STORAGE_OCTAHEDRAL16, VECTOR_STORAGE_OCTAHEDRAL8, VECTOR_STORAGE_SPARSE_BLOCKS };
+    std::vector<Point3D> seeds;
+    double floatSeconds = 0.0;
+    TracerParams params = getBenchmarkTracerParams();
+    for (VectorFieldStorage mode : modes)
+    {
+        const VectorField* vectorField = tensors ? new VectorField(tensors.get(), dimX, dimY, dimZ, mode) : new VectorField(currentVectorFile, mode);
+        StreamlineTracer tracer(std::make_shared<const DatasetSnapshot>(currentDataset, tensors != nullptr, scalars, dimX, dimY, dimZ,
+            std::unique_ptr<const VectorField>(vectorField)));
+        if (seeds.empty())
+        {
+            VolumeSeedingOptions options;
+            options.maxSeeds = 20000;
+            seeds = tracer.generateVolumeSeeds(options);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(seeds, params);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (mode == VECTOR_STORAGE_FLOAT32) floatSeconds = seconds;
+
+        size_t numPoints = 0;
+        for (const std::vector<Point3D>& streamline : streamlines) numPoints += streamline.size();
+
+        std::cout << getVectorFieldStorageName(mode) << ": " << vectorField->getStorageBytes() / (1024.0 * 1024.0) << " MB"
+                  << ", angular error mean " << vectorField->getMeanAngularError() << " max " << vectorField->getMaxAngularError() << " degrees"
+                  << ", " << streamlines.size() << " streamlines (" << numPoints << " points) in " << seconds * 1000.0 << " ms"
+                  << ", " << seeds.size() / seconds << " seeds/s (" << floatSeconds / seconds << "x float)" << std::endl;
+    }
+
+    //time from the tensors to the streamlines of the middle slice, decomposing everything first or on first touch
+    if (tensors)
+    {
+        uint64_t hashes[2] = {};
+        for (int lazy = 0; lazy < 2; lazy++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            const VectorField* vectorField = lazy ? new VectorField(std::move(tensors), dimX, dimY, dimZ) : new VectorField(tensors.get(), dimX, dimY, dimZ);
+            StreamlineTracer tracer(std::make_shared<const DatasetSnapshot>(currentDataset, true, scalars, dimX, dimY, dimZ,
+                std::unique_ptr<const VectorField>(vectorField)));
+            StreamlineAttributes attributes;
+            std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(tracer.getSliceSeeds(dimX / 2, dimY / 2, dimZ / 2, AXIS_Z), params, &attributes);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            hashes[lazy] = StreamlineTracer::hashStreamlines(streamlines, &attributes);
+
+            std::cout << (lazy ? "Lazy" : "Eager") << " tensor decomposition: " << streamlines.size() << " slice streamlines after "
+                      << seconds * 1000.0 << " ms, " << vectorField->getDecomposedBrickCount() << " of " << vectorField->getBrickCount() << " bricks decomposed" << std::endl;
+        }
+        if (hashes[0] != hashes[1])
+        {
+            std::cerr << "Lazy tensor decomposition traced different streamlines" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Headless accuracy benchmark of the interpolation modes. For every mode the same volume seeds
+ * are traced with RK2 at a range of step sizes and compared to the same mode at a very small
+ * step, so the deviation is the integration error of the step size. Prints the time, the
+ * deviation and the mean streamline length (early angle terminations shorten the lines).
+ */
+int benchmarkInterpolation()
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    const float benchmarkLength = 100.0f;
+    const float referenceStep = 0.05f;
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    TracerParams params = getBenchmarkTracerParams();
+    params.maxLength = benchmarkLength;
+    params.integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+    VolumeSeedingOptions options;
+    options.maxSeeds = 2000;
+    std::vector<Point3D> seeds = tracer.generateVolumeSeeds(options);
+
+    const InterpolationMode modes[] = { INTERPOLATION_NEAREST, INTERPOLATION_TRILINEAR, INTERPOLATION_CUBIC_BSPLINE };
+    const float steps[] = { 0.1f, 0.25f, 0.5f, 1.0f, 2.0f };
+    for (InterpolationMode mode : modes)
+    {
+        params.interpolation = mode;
+        auto trace = [&](float step, std::vector<size_t>& seedIndices, double& ms) {
+            params.stepSize = step;
+            params.maxSteps = (int)(benchmarkLength / step) + 1;
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(seeds, params, nullptr, &seedIndices);
+            ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return streamlines;
+        };
+
+        std::vector<size_t> referenceSeeds;
+        double referenceMs;
+        std::vector<std::vector<Point3D>> reference = trace(referenceStep, referenceSeeds, referenceMs);
+        std::vector<long long> referenceSlot(seeds.size(), -1);
+        for (size_t i = 0; i < referenceSeeds.size(); i++) referenceSlot[referenceSeeds[i]] = (long long)i;
+        std::cout << getInterpolationModeName(mode) << ", reference step " << referenceStep << ": " << referenceMs << " ms" << std::endl;
+
+        for (float step : steps)
+        {
+            std::vector<size_t> seedIndices;
+            double ms;
+            std::vector<std::vector<Point3D>> streamlines = trace(step, seedIndices, ms);
+            double deviationMean, deviationMax;
+            measureStreamlineDeviation(reference, referenceSlot, streamlines, seedIndices, deviationMean, deviationMax);
+
+            double lengthSum = 0.0;
+            for (const std::vector<Point3D>& streamline : streamlines) lengthSum += (streamline.size() - 1) * step;
+            std::cout << "  step " << step << ": " << ms << " ms, " << streamlines.size() << " streamlines, mean length "
+                      << (streamlines.empty() ? 0.0 : lengthSum / streamlines.size()) << ", deviation mean " << deviationMean
+                      << " max " << deviationMax << " voxels" << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Trace a volume-seeded set of streamlines, build the picking hierarchy at once and in appended
+ * batches, and time ray and nearest-point queries against a linear scan over all segments.
+ */
+int benchmarkPicking()
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    TracerParams params = getBenchmarkTracerParams();
+    params.stepSize = 0.5f;
+    params.maxSteps = 400;
+    params.maxLength = 200.0f;
+    params.integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+    VolumeSeedingOptions options;
+    options.maxSeeds = 200000;
+    std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(tracer.generateVolumeSeeds(options), params);
+
+    StreamlineBVH bvh;
+    bvh.build(streamlines);
+    std::cout << "Built over " << streamlines.size() << " streamlines with " << bvh.getSegmentCount() << " segments in "
+              << bvh.getLastBuildMs() << " ms (" << bvh.getMemoryBytes() / (1024.0 * 1024.0) << " MB)" << std::endl;
+
+    //appending in batches only rebuilds the trees that are merged
+    const size_t numBatches = 8;
+    StreamlineBVH incremental;
+    double appendMs = 0.0;
+    for (size_t b = 0; b < numBatches; b++)
+    {
+        std::vector<std::vector<Point3D>> batch(streamlines.begin() + streamlines.size() * b / numBatches,
+            streamlines.begin() + streamlines.size() * (b + 1) / numBatches);
+        incremental.append(batch);
+        appendMs += incremental.getLastBuildMs();
+    }
+    std::cout << "Appended in " << numBatches << " batches in " << appendMs << " ms total, " << incremental.getTreeCount() << " trees" << std::endl;
+
+    //flatten the segments for the linear scan
+    std::vector<Point3D> starts, ends;
+    for (const std::vector<Point3D>& streamline : streamlines)
+    {
+        for (size_t k = 0; k + 1 < streamline.size(); k++)
+        {
+            starts.push_back(streamline[k]);
+            ends.push_back(streamline[k + 1]);
+        }
+    }
+    auto scanNearest = [&](const Point3D& p) {
+        float best = std::numeric_limits<float>::max();
+        for (size_t i = 0; i < starts.size(); i++)
+        {
+            float ex = ends[i].x - starts[i].x, ey = ends[i].y - starts[i].y, ez = ends[i].z - starts[i].z;
+            float rx = p.x - starts[i].x, ry = p.y - starts[i].y, rz = p.z - starts[i].z;
+            float ee = ex * ex + ey * ey + ez * ez;
+            float s = ee > 1e-12f ? std::min(1.0f, std::max(0.0f, (rx * ex + ry * ey + rz * ez) / ee)) : 0.0f;
+            float dx = rx - s * ex, dy = ry - s * ey, dz = rz - s * ez;
+            best = std::min(best, dx * dx + dy * dy + dz * dz);
+        }
+        return std::sqrt(best);
+    };
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> ux(0.0f, (float)dimX), uy(0.0f, (float)dimY), uz(0.0f, (float)dimZ);
+    const int numQueries = 100000;
+    const int numScanQueries = 100;
+    std::vector<Point3D> points(numQueries);
+    for (Point3D& p : points) p = Point3D(ux(rng), uy(rng), uz(rng));
+
+    int mismatches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numScanQueries; q++)
+    {
+        SegmentHit hit;
+        float expected = scanNearest(points[q]);
+        bool found = bvh.nearestPoint(points[q], std::numeric_limits<float>::max(), hit);
+        if (!found || std::fabs(hit.distance - expected) > 1e-3f) mismatches++;
+    }
+    double scanMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / numScanQueries;
+
+    size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numQueries; q++)
+    {
+        SegmentHit hit;
+        hits += bvh.nearestPoint(points[q], 5.0f, hit);
+    }
+    double nearestMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / numQueries;
+    std::cout << "Nearest point (within 5 voxels): " << nearestMicroseconds << " us per query, " << hits << " of " << numQueries
+              << " hit; linear scan " << scanMicroseconds << " us per query, " << mismatches << " mismatches" << std::endl;
+
+    //rays along the z axis, as seen from the default camera, with a pick radius of half a voxel
+    hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < numQueries; q++)
+    {
+        SegmentHit hit;
+        hits += bvh.pickRay(Point3D(points[q].x, points[q].y, (float)dimZ + 1.0f), Point3D(0.0f, 0.0f, -1.0f), 0.5f, hit);
+    }
+    double rayMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / numQueries;
+    std::cout << "Screen ray: " << rayMicroseconds << " us per query, " << hits << " of " << numQueries << " hit" << std::endl;
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Headless check that interactive traces don't queue behind background work. Traces the middle
+ * slice as an interactive job, first on an idle scheduler and then while normal and background
+ * jobs trace the volume seeds in chunks, and prints the latencies and the queue wait per class.
+ *
+ * @return EXIT_SUCCESS if the loaded interactive p50 stays within twice the idle p50 plus one chunk
+ */
+int benchmarkScheduler()
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    TracerParams params = getBenchmarkTracerParams();
+    VolumeSeedingOptions options;
+    options.maxSeeds = 20000;
+    std::vector<Point3D> volumeSeeds = tracer.generateVolumeSeeds(options);
+    SeedSpan sliceSeeds = tracer.getSliceSeeds(dimX / 2, dimY / 2, dimZ / 2, AXIS_Z);
+    if (volumeSeeds.empty() || sliceSeeds.empty()) return EXIT_FAILURE;
+
+    JobScheduler scheduler;
+    const int runs = 20;
+    auto traceInteractive = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        JobHandle job = scheduler.submit(JOB_INTERACTIVE, "slice trace", [&]() {
+            tracer.traceAllStreamlines(sliceSeeds, params);
+            return false;
+        });
+        scheduler.wait(job);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    LatencyStats idle;
+    for (int i = 0; i < runs; i++) idle.add(traceInteractive());
+    idle.print("Interactive trace, idle");
+
+    //every chunk traces 1000 volume seeds, the jobs give up their worker between chunks
+    const size_t chunkSeeds = 1000;
+    LatencyStats chunks;
+    std::mutex chunksMutex;
+    std::vector<JobHandle> loadJobs;
+    for (int j = 0; j < 8; j++)
+    {
+        JobClass jobClass = j < 2 ? JOB_NORMAL : JOB_BACKGROUND;
+        std::shared_ptr<size_t> next = std::make_shared<size_t>(0);
+        loadJobs.push_back(scheduler.submit(jobClass, "volume trace", [&, next]() {
+            size_t count = std::min(chunkSeeds, volumeSeeds.size() - *next);
+            auto start = std::chrono::steady_clock::now();
+            tracer.traceAllStreamlines(SeedSpan(volumeSeeds.data() + *next, count), params);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(chunksMutex);
+                chunks.add(ms);
+            }
+            *next += count;
+            return *next < volumeSeeds.size();
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    LatencyStats loaded;
+    for (int i = 0; i < runs; i++)
+    {
+        loaded.add(traceInteractive());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    loaded.print("Interactive trace, loaded");
+    for (const JobHandle& job : loadJobs) scheduler.cancel(job);
+    for (const JobHandle& job : loadJobs) scheduler.wait(job);
+
+    chunks.print("Background chunk");
+    scheduler.printStats();
+
+    double limit = 2.0 * idle.percentile(50.0) + chunks.percentile(50.0);
+    bool ok = loaded.percentile(50.0) <= limit;
+    std::cout << (ok ? "Interactive traces are not held up by background work" : "Interactive traces wait for background work")
+              << " (loaded p50 " << loaded.percentile(50.0) << " ms, limit " << limit << " ms)" << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Headless comparison of updating a trace to new limits with tracing it again. Traces the volume
+ * seeds, then steps through raising and lowering maxLength, maxSteps and maxAngle, timing the
+ * update and a full retrace with the same settings and comparing their hashes.
+ *
+ * @return EXIT_SUCCESS if every update matches its full retrace bit for bit
+ */
+int benchmarkIncremental()
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    VolumeSeedingOptions options;
+    options.maxSeeds = 20000;
+    std::vector<Point3D> seeds = tracer.generateVolumeSeeds(options);
+    if (seeds.empty()) return EXIT_FAILURE;
+
+    struct LimitChange {
+        const char* name;
+        int maxSteps;
+        float maxLength;
+        float maxAngleDegrees;
+    };
+    const LimitChange changes[] = {
+        { "Raise max length 50 -> 100", 2000, 100.0f, 45.0f },
+        { "Raise max length 100 -> 200", 2000, 200.0f, 45.0f },
+        { "Lower max steps 2000 -> 150", 150, 200.0f, 45.0f },
+        { "Raise max steps 150 -> 300", 300, 200.0f, 45.0f },
+        { "Lower max angle 45 -> 20 degrees", 300, 200.0f, 20.0f },
+        { "Raise max angle 20 -> 60 degrees", 300, 200.0f, 60.0f },
+        { "Lower max length 200 -> 80", 300, 80.0f, 60.0f },
+    };
+
+    TracerParams params = getBenchmarkTracerParams();
+    params.maxSteps = 2000;
+    params.maxLength = 50.0f;
+    params.maxAngle = 45.0f * (std::_Pi_val / 180);
+
+    TraceState state;
+    StreamlineAttributes attributes;
+    auto start = std::chrono::steady_clock::now();
+    tracer.traceAllStreamlines(seeds, params, &attributes, nullptr, nullptr, &state);
+    double recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Traced " << seeds.size() << " seeds with recorded end states in " << recordMs << " ms, state "
+              << state.getMemoryBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    bool allMatch = true;
+    for (const LimitChange& change : changes)
+    {
+        params.maxSteps = change.maxSteps;
+        params.maxLength = change.maxLength;
+        params.maxAngle = change.maxAngleDegrees * (std::_Pi_val / 180);
+        if (!tracer.canUpdateStreamlines(state, seeds, params))
+        {
+            std::cerr << change.name << ": the trace can't be updated" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        size_t resumed = 0;
+        start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Point3D>> updated = tracer.updateStreamlines(state, params, &attributes, nullptr, &resumed);
+        double updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        uint64_t updatedHash = StreamlineTracer::hashStreamlines(updated, &attributes);
+
+        StreamlineAttributes retracedAttributes;
+        start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Point3D>> retraced = tracer.traceAllStreamlines(seeds, params, &retracedAttributes);
+        double retraceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bool match = updatedHash == StreamlineTracer::hashStreamlines(retraced, &retracedAttributes);
+        allMatch &= match;
+
+        std::cout << change.name << ": update " << updateMs << " ms (" << resumed << " halves traced further), full retrace "
+                  << retraceMs << " ms, " << (updateMs > 0.0 ? retraceMs / updateMs : 0.0) << "x, "
+                  << (match ? "identical" : "MISMATCH") << std::endl;
+    }
+
+    std::cout << (allMatch ? "Every update matches its full retrace" : "Updates differ from full retraces") << std::endl;
+    return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Rank 0 of a headless distributed trace: traces the volume seeds of the current dataset once in
+ * this process and once on the tracing ranks of the transport, prints the statistics of both and
+ * compares the streamlines.
+ *
+ * @return EXIT_SUCCESS if the distributed trace gives the same streamlines
+ */
+int coordinateDistributedTrace(TraceTransport& transport)
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    TracerParams params = getBenchmarkTracerParams();
+    VolumeSeedingOptions options;
+    options.maxSeeds = 20000;
+    std::vector<Point3D> seeds = tracer.generateVolumeSeeds(options);
+    if (seeds.empty()) return EXIT_FAILURE;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<Point3D>> reference = tracer.traceAllStreamlines(seeds, params);
+    double singleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Single process: " << reference.size() << " streamlines from " << seeds.size() << " seeds in "
+              << singleMs << " ms" << std::endl;
+
+    DistributedTraceStats stats;
+    std::vector<std::vector<Point3D>> streamlines;
+    try
+    {
+        streamlines = runTraceCoordinator(transport, tracer, seeds, params, &stats);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Distributed trace failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << transport.getSize() - 1 << " tracing ranks: " << streamlines.size() << " streamlines" << std::endl;
+    stats.print();
+
+    bool match = StreamlineTracer::hashStreamlines(streamlines) == StreamlineTracer::hashStreamlines(reference);
+    std::cout << (match ? "The distributed trace matches the single process trace" : "The distributed trace differs from the single process trace") << std::endl;
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Tracing rank of a headless distributed trace: loads the current dataset and traces until rank 0 stops it.
+ */
+int runDistributedTraceRank(TraceTransport& transport)
+{
+    std::shared_ptr<const float> scalars = readBenchmarkScalars();
+    if (!scalars) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(makeBenchmarkDataset(scalars));
+    return runTraceRank(transport, tracer);
+}
+
+/**
+ * Resident memory of the process in bytes, 0 where it can't be read.
+ */
+size_t getResidentBytes()
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t sizePages = 0, residentPages = 0;
+    if (statm >> sizePages >> residentPages) return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}
+
+/**
+ * Pack and upload traced streamlines to the renderer, marking both stages of the pending interactions.
+ */
+void uploadStreamlines(const std::vector<std::vector<Point3D>>& streamlines)
+{
+    std::vector<float> vertices;
+    std::vector<int> firsts, counts;
+    StreamlineRenderer::packStreamlines(streamlines, vertices, firsts, counts);
+    interactions.mark(STAGE_PACKED);
+    streamlineRenderer->uploadVertices(vertices.data(), vertices.size() / 6, firsts.data(), counts.data(), firsts.size());
+    interactions.mark(STAGE_UPLOADED);
+}
+
+/**
+ * Show traced streamlines: upload them, rebuild the picking hierarchy and apply the filter
+ * @param params Settings they were traced with
+ */
+void showStreamlines(const std::vector<std::vector<Point3D>>& streamlines, const TracerParams& params)
+{
+    tracedParams = params;
+    uploadStreamlines(streamlines);
+    hoveredStreamline = -1;
+    isolatedStreamlines.clear();
+    if (streamlineBVH)
+    {
+        streamlineBVH->build(streamlines);
+        std::cout << "Built the picking hierarchy over " << streamlineBVH->getSegmentCount() << " segments in "
+                  << streamlineBVH->getLastBuildMs() << " ms" << std::endl;
+    }
+    applyStreamlineFilter();
+    if (activeDataset) datasetManager.updateMemoryUse(activeDataset);
+}
+
+/**
+ * Drop the full resolution trace of a preview, a running chunk finishes but its result is discarded
+ */
+void cancelPreviewRefinement()
+{
+    if (!previewRefinementJob) return;
+    getJobScheduler().cancel(previewRefinementJob);
+    previewRefinementJob = nullptr;
+    previewRefinement.reset();
+}
+
+/**
+ * (Possibly) update parameters and call generateStreamlines()
+ * @param level Pyramid level to trace on, above 0 for a coarse preview
+ */
+void regenerateStreamLines(int level = 0)
+{
+    cancelPreviewRefinement();
+    paramsChanged = false;
+    previewShown = level > 0;
+    TracerParams params = session.tracerParams;
+    params.level = level;
+
+    if (session.getDataset() && streamlineRenderer) {
+        std::vector<std::vector<Point3D>> streamlines = generateStreamlines(params);
+        showStreamlines(streamlines, params);
+    }
+}
+
+/**
+ * Trace the settings the preview shows at full resolution in the background. The seeds are traced
+ * in chunks by an interactive job, so a new preview cancels it at the next chunk and a session
+ * save waiting for a worker doesn't hold it up. The result replaces the preview once it is done,
+ * see finishPreviewRefinement(); it is the same as tracing all seeds at once.
+ */
+void startPreviewRefinement()
+{
+    std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+    if (!dataset || !streamlineRenderer) return;
+
+    std::shared_ptr<PreviewRefinement> refinement = std::make_shared<PreviewRefinement>(dataset);
+    refinement->params = tracedParams;
+    refinement->params.level = 0;
+    SeedSpan seeds = generateSeeds(refinement->tracer, refinement->seeds);
+    //slice seeds point into the seed index, the job keeps its own copy
+    if (seeds.data != refinement->seeds.data()) refinement->seeds.assign(seeds.begin(), seeds.end());
+    refinement->start = std::chrono::steady_clock::now();
+
+    previewRefinement = refinement;
+    previewRefinementJob = getJobScheduler().submit(JOB_INTERACTIVE, "refine preview", [refinement]() {
+        size_t first = refinement->tracedSeeds;
+        size_t end = std::min(refinement->seeds.size(), first + REFINEMENT_CHUNK_SEEDS);
+        if (end > first)
+        {
+            StreamlineAttributes attributes;
+            std::vector<std::vector<Point3D>> streamlines = refinement->tracer.traceAllStreamlines(
+                SeedSpan(refinement->seeds.data() + first, end - first), refinement->params, &attributes);
+            std::move(streamlines.begin(), streamlines.end(), std::back_inserter(refinement->streamlines));
+            refinement->attributes.append(attributes);
+        }
+        refinement->tracedSeeds = end;
+        return end < refinement->seeds.size();
+    });
+}
+
+/**
+ * Show the full resolution trace of the preview once its job is done
+ */
+void finishPreviewRefinement()
+{
+    if (!previewRefinementJob || !previewRefinementJob->isDone()) return;
+
+    std::shared_ptr<PreviewRefinement> refinement = std::move(previewRefinement);
+    bool cancelled = previewRefinementJob->wasCancelled();
+    previewRefinementJob = nullptr;
+    //a dataset switch or restore doesn't go through regenerateStreamLines(), so the result may be for another dataset
+    if (cancelled || refinement->dataset != session.getDataset() || !streamlineRenderer) return;
+
+    double traceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - refinement->start).count();
+    std::cout << "Refined the preview to " << refinement->streamlines.size() << " streamlines in " << traceSeconds * 1000.0
+              << " ms (" << refinement->seeds.size() << " seeds)" << std::endl;
+    lastTraceMs = traceSeconds * 1000.0;
+    lastTraceLevel = 0;
+    lastTraceIncremental = false;
+    previewShown = false;
+    streamlineAttributes = std::move(refinement->attributes);
+    showStreamlines(refinement->streamlines, refinement->params);
+}
+
+/**
+ * Opacity of the lines in the weighted blended mode. With density-aware opacity it is chosen so
+ * that an average pixel of the volume, covered by D line layers, reaches the target opacity:
+ * 1 - (1 - alpha)^D = targetOpacity. D follows from the total drawn length, which a random
+ * direction projects to pi / 4 of, the line width and the area the volume covers on screen.
+ */
+float getStreamlineOpacity()
+{
+    if (!densityOpacity) return streamlineOpacity;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    double pixelsPerVoxelX = projection[0][0] * viewport[2] / 2.0;
+    double pixelsPerVoxelY = projection[1][1] * viewport[3] / 2.0;
+    double volumeArea = selectedAxis == AXIS_X ? (double)dimY * dimZ : (selectedAxis == AXIS_Y ? (double)dimZ * dimX : (double)dimX * dimY);
+    volumeArea *= pixelsPerVoxelX * pixelsPerVoxelY;
+
+    double linePixels = visibleStreamlineLength * 0.785 * 0.5 * (pixelsPerVoxelX + pixelsPerVoxelY) * lineWidth;
+    double layers = linePixels / std::max(1.0, volumeArea);
+    if (layers <= 1.0) return targetOpacity;
+    return (float)std::max(0.01, 1.0 - std::pow(1.0 - targetOpacity, 1.0 / layers));
+}
+
+/**
+ * Update the perspective and view matrices.
+ */
+void updatePVMatrices()
+{
+    //can keep a similar zoom level axis view, so long as the dimensions are al fairly similar
+    xFov = 0.0f;
+    yFov = 0.0f;
+
+    // Initialize camera position based on data dimensions
+    if (selectedAxis == AXIS_X)
+    {
+        cameraPos = glm::vec3(dimX, -dimY / 2.0f, -dimZ / 2.0f);
+        cameraFront = glm::vec3(-1.0f, 0.0f, 0.0f);
+        cameraUp = glm::vec3(0.0f, 0.0f, 1.0f);
+        projection = glm::ortho(xFov, (float)dimY - xFov, yFov, (float)dimZ - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    }
+    else if (selectedAxis == AXIS_Y)
+    {
+        cameraPos = glm::vec3(-dimX / 2.0f, -dimY, -dimZ / 2.0f);
+        cameraFront = glm::vec3(0.0f, 1.0f, 0.0f);
+        cameraUp = glm::vec3(0.0f, 0.0f, 1.0f);
+        projection = glm::ortho(xFov, (float)dimZ - xFov, yFov, (float)dimX - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    }
+    else if (selectedAxis == AXIS_Z)
+    {
+        cameraPos = glm::vec3(-dimX / 2.0f, -dimY / 2.0f, dimZ);
+        cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+        cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+        projection = glm::ortho(xFov, (float)dimX - xFov, yFov, (float)dimY - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    }
+    else throw std::runtime_error("invalid axis selected");
+
+    //initialize view matrix
+    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+}
+
+//process input each frame
+void processInput(GLFWwindow* window) {
+    // Exit application when Escape is pressed
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+        glfwSetWindowShouldClose(window, true);
+    }
+}
+
+//handle mouse movement for the camera
+void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
+    // Standard camera control (non-orbit)
+    bool moveCamera = /*cameraMode ||*/ (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS);
+    if (!moveCamera) {
+        firstMouse = true;
+
+        //hover picking, not while the mouse is over the UI
+        if (!ImGui::GetIO().WantCaptureMouse) updateHoveredStreamline(window, xpos, ypos);
+        else if (hoveredStreamline >= 0)
+        {
+            hoveredStreamline = -1;
+            if (streamlineRenderer) streamlineRenderer->setHighlightedStreamline(-1);
+        }
+        return;
+    }
+
+    // Initialize reference position on first movement
+    if (firstMouse) {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    // Calculate mouse movement since last frame
+    float xoffset = xpos - lastX;
+    float yoffset = lastY - ypos; // Reversed since y-coordinates go from bottom to top
+    lastX = xpos;
+    lastY = ypos;
+
+    //correct the offset
+    int scrWidth, scrHeight;
+    glfwGetWindowSize(window, &scrWidth, &scrHeight);
+
+    //move the camera since we use an ortho perspective
+    if (selectedAxis == AXIS_X)
+    {
+        xoffset *= (((float)dimY - 2 * xFov) / scrWidth);
+        yoffset *= (((float)dimZ - 2 * yFov) / scrHeight);
+        cameraPos.y -= xoffset;
+        cameraPos.z -= yoffset;
+    }
+    else if (selectedAxis == AXIS_Y)
+    {
+        xoffset *= (((float)dimX - 2 * xFov) / scrWidth);
+        yoffset *= (((float)dimZ - 2 * yFov) / scrHeight);
+        cameraPos.x -= xoffset;
+        cameraPos.z -= yoffset;
+    }
+    else if (selectedAxis == AXIS_Z)
+    {
+        xoffset *= (((float)dimX - 2 * xFov) / scrWidth);
+        yoffset *= (((float)dimY - 2 * yFov) / scrHeight);
+        cameraPos.x -= xoffset;
+        cameraPos.y -= yoffset;
+    }
+
+    //update view matrix
+    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+}
+
+//Handle window resizing
+void frameBufferSizeCallback(GLFWwindow* window, int width, int height) {
+    // Unused parameter
+    (void)window;
+
+    // Update OpenGL viewport to match the new window size
+    glViewport(0, 0, width, height);
+}
+
+/**
+ * Process mouse clicks.
+ */
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) 
+{
+    (void)mods;  // Unused parameter
+    ImGuiIO& io = ImGui::GetIO();
+    if (io.WantCaptureMouse) return;
+
+    // Handle left mouse button
     if (button == GLFW_MOUSE_BUTTON_LEFT) 
     {
         if (action == GLFW_PRESS)
@@ -578,13 +1735,50 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
                 {
                     mouseSeedLoc = glm::vec3(ray_world.x + dimX / 2.0f, ray_world.y + dimY / 2.0f, ray_world.z);
                 }
-                
+
+                inputRecorder.record(glfwGetTime(), "mouseSeed", mouseSeedLoc.x, mouseSeedLoc.y, mouseSeedLoc.z);
+                beginInteraction("mouseSeed");
                 regenerateStreamLines();
             }
+            else if (hoveredStreamline >= 0)
+            {
+                //clicking a streamline shows only its bundle
+                inputRecorder.record(glfwGetTime(), "isolateBundle", (float)hoveredStreamline);
+                beginInteraction("isolateBundle");
+                isolateBundle(hoveredStreamline);
+            }
         }
     }
 }
 
+/**
+ * Clamp the zoom to the current view axis and update the projection matrix.
+ */
+void updateProjectionMatrix()
+{
+    if (selectedAxis == AXIS_X)
+    {
+        if (xFov > ((float)dimY / 2.0f) - 1.0f) xFov = ((float)dimY / 2.0f) - 1.0f;
+        if (yFov > ((float)dimZ / 2.0f) - 1.0f) yFov = ((float)dimZ / 2.0f) - 1.0f;
+
+        projection = glm::ortho(xFov, (float)dimY - xFov, yFov, (float)dimZ - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    }
+    else if (selectedAxis == AXIS_Y)
+    {
+        if (xFov > ((float)dimZ / 2.0f) - 1.0f) xFov = ((float)dimZ / 2.0f) - 1.0f;
+        if (yFov > ((float)dimX / 2.0f) - 1.0f) yFov = ((float)dimX / 2.0f) - 1.0f;
+
+        projection = glm::ortho(xFov, (float)dimZ - xFov, yFov, (float)dimX - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    }
+    else if (selectedAxis == AXIS_Z)
+    {
+        if (xFov > ((float) dimX / 2.0f) - 1.0f) xFov = ((float)dimX / 2.0f) - 1.0f;
+        if (yFov > ((float) dimY / 2.0f) - 1.0f) yFov = ((float)dimY / 2.0f) - 1.0f;
+
+        projection = glm::ortho(xFov, (float)dimX - xFov, yFov, (float)dimY - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    }
+}
+
 /**
  * Process mouse scrolling.
  */
@@ -600,56 +1794,725 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     xFov -= (float)yoffset * 2.0f;
     yFov -= (float)yoffset * 2.0f;
 
-    //update projection matrix
-    if (selectedAxis == AXIS_X)
+    updateProjectionMatrix();
+}
+
+/**
+ * Hand a newly prepared dataset to the dataset manager, so it stays resident when switching away.
+ */
+void registerActiveDataset(std::unique_ptr<ResidentDataset> entry)
+{
+    activeDataset = datasetManager.insert(std::move(entry));
+}
+
+/**
+ * Make a resident dataset the current one. Nothing is loaded or uploaded, so this takes a single frame.
+ */
+void activateDataset(ResidentDataset* entry)
+{
+    releaseDataset();
+
+    activeDataset = entry;
+    session.setDataset(entry->data);
+    dimX = entry->data->getDimX();
+    dimY = entry->data->getDimY();
+    dimZ = entry->data->getDimZ();
+    streamlineRenderer = entry->renderer.get();
+    streamlineBVH = entry->bvh.get();
+    texture = entry->texture.get();
+    tracedParams = entry->tracedParams;
+    streamlineAttributes = std::move(entry->attributes);
+    entry->attributes.clear();
+
+    currentSliceX = entry->currentSliceX;
+    currentSliceY = entry->currentSliceY;
+    currentSliceZ = entry->currentSliceZ;
+    initImgPlane();
+    updatePVMatrices();
+
+    streamlineRenderer->setLineWidth(lineWidth);
+    applyStreamlineFilter();
+
+    //the flips belong to the data, the resident streamlines were traced with the other settings of that time
+    session.tracerParams.flipX = tracedParams.flipX;
+    session.tracerParams.flipY = tracedParams.flipY;
+    session.tracerParams.flipZ = tracedParams.flipZ;
+    TracerParams current = session.tracerParams;
+    current.level = tracedParams.level;
+    paramsChanged = current != tracedParams;
+}
+
+/**
+ * Take all the actions for switching between datasets
+ */
+void switchDataSet()
+{
+    beginInteraction("dataset");
+    std::cout << "Updated Scalar File Path: " << currentScalarFile << std::endl;
+    std::cout << "Updated Vector File Path: " << currentVectorFile << std::endl;
+
+    //a resident dataset only needs its pointers swapped in
+    ResidentDataset* resident = datasetManager.acquire(currentDataset, useTensors);
+    if (resident)
     {
-        if (xFov > ((float)dimY / 2.0f) - 1.0f) xFov = ((float)dimY / 2.0f) - 1.0f;
-        if (yFov > ((float)dimZ / 2.0f) - 1.0f) yFov = ((float)dimZ / 2.0f) - 1.0f;
+        if (resident != activeDataset)
+        {
+            auto start = std::chrono::steady_clock::now();
+            activateDataset(resident);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Switched to resident dataset " << currentDataset << " in " << seconds * 1000.0 << " ms" << std::endl;
+        }
+        return;
+    }
 
-        projection = glm::ortho(xFov, (float)dimY - xFov, yFov, (float)dimZ - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    // Initial data loading
+    std::unique_ptr<ResidentDataset> entry = loadCurrentDataFiles();
+    if (!entry) return;
+    initImgPlane();
+
+    //Initialize a streamline renderer
+    entry->renderer.reset(new StreamlineRenderer(streamlineShader));
+    entry->bvh.reset(new StreamlineBVH());
+    streamlineRenderer = entry->renderer.get();
+    streamlineRenderer->setCompositeShader(oitCompositeShader);
+    streamlineRenderer->setDensityResolveShader(densityResolveShader);
+    streamlineBVH = entry->bvh.get();
+
+
+    //the brain dataset has flipped x values
+    session.tracerParams.flipX = currentDataset == BRAIN_DATASET;
+    session.tracerParams.flipY = false;
+    session.tracerParams.flipZ = false;
+
+    //generate the initial streamlines
+    tracedParams = session.tracerParams;
+    tracedParams.level = 0;
+    std::vector<std::vector<Point3D>> streamlines = generateStreamlines(tracedParams);
+    uploadStreamlines(streamlines);
+    streamlineBVH->build(streamlines);
+    applyStreamlineFilter();
+
+    registerActiveDataset(std::move(entry));
+}
+
+/**
+ * Collect the current settings for a session snapshot.
+ */
+SessionState captureSessionState()
+{
+    SessionState state;
+    state.dataset = currentDataset == TOY_DATASET ? SESSION_DATASET_TOY : SESSION_DATASET_BRAIN;
+    state.useTensors = useTensors;
+    state.dimX = dimX;
+    state.dimY = dimY;
+    state.dimZ = dimZ;
+
+    const TracerParams& params = session.tracerParams;
+    state.stepSize = params.stepSize;
+    state.maxLength = params.maxLength;
+    state.maxSteps = params.maxSteps;
+    state.maxAngleDegrees = maxAngleDegrees;
+    state.integrationMethod = params.integrationMethod == StreamlineTracer::EULER ? SESSION_INTEGRATION_EULER : SESSION_INTEGRATION_RK2;
+    state.seedOrdering = params.seedOrdering == StreamlineTracer::SEED_ORDER_NONE ? SESSION_SEED_ORDER_NONE
+        : (params.seedOrdering == StreamlineTracer::SEED_ORDER_MORTON ? SESSION_SEED_ORDER_MORTON : SESSION_SEED_ORDER_HILBERT);
+    state.flipX = params.flipX;
+    state.flipY = params.flipY;
+    state.flipZ = params.flipZ;
+
+    state.useMouseSeeding = useMouseSeeding;
+    state.useVolumeSeeding = useVolumeSeeding;
+    state.mouseSeedLoc[0] = mouseSeedLoc.x;
+    state.mouseSeedLoc[1] = mouseSeedLoc.y;
+    state.mouseSeedLoc[2] = mouseSeedLoc.z;
+    state.mouseSeedRadius = mouseSeedRadius;
+    state.mouseSeedDensity = mouseSeedDensity;
+    state.seedsPerVoxel = volumeSeedingOptions.seedsPerVoxel;
+    state.jitter = volumeSeedingOptions.jitter;
+    state.maxSeeds = volumeSeedingOptions.maxSeeds;
+
+    state.selectedAxis = selectedAxis;
+    state.currentSliceX = currentSliceX;
+    state.currentSliceY = currentSliceY;
+    state.currentSliceZ = currentSliceZ;
+    state.xFov = xFov;
+    state.yFov = yFov;
+    for (int i = 0; i < 3; i++)
+    {
+        state.cameraPos[i] = cameraPos[i];
+        state.cameraFront[i] = cameraFront[i];
+        state.cameraUp[i] = cameraUp[i];
     }
-    else if (selectedAxis == AXIS_Y)
+    state.lineWidth = lineWidth;
+    state.filter = streamlineFilter;
+    return state;
+}
+
+/**
+ * Save the current session to a snapshot in the background.
+ * Only the vertex read back happens here, the file is written by another thread.
+ */
+void saveSession(const char* filename)
+{
+    std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+    if (!dataset || !streamlineRenderer) return;
+    const VectorField* vectorField = dataset->getVectorField();
+    if (!vectorField->getData())
     {
-        if (xFov > ((float)dimZ / 2.0f) - 1.0f) xFov = ((float)dimZ / 2.0f) - 1.0f;
-        if (yFov > ((float)dimX / 2.0f) - 1.0f) yFov = ((float)dimX / 2.0f) - 1.0f;
+        std::cerr << "Session snapshots require the 32 bit float vector storage" << std::endl;
+        return;
+    }
 
-        projection = glm::ortho(xFov, (float)dimZ - xFov, yFov, (float)dimX - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    auto start = std::chrono::steady_clock::now();
+
+    //the save holds a reference to the dataset, so switching away or evicting it doesn't free the volumes under it
+    SessionVolumes volumes;
+    volumes.scalars = dataset->getScalars().data;
+    volumes.vectors = vectorField->getData();
+    volumes.fa = vectorField->getFAData();
+    volumes.zeroMask = vectorField->getZeroMask(dimX, dimY, dimZ);
+    volumes.owner = dataset;
+
+    SessionGeometry geometry;
+    streamlineRenderer->readVertices(geometry.vertices, geometry.streamlineFirsts, geometry.streamlineCounts);
+    geometry.attributes = streamlineAttributes;
+
+    saveSessionSnapshotAsync(filename, captureSessionState(), volumes, std::move(geometry));
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Started saving session snapshot " << filename << " (main thread blocked for " << seconds * 1000.0 << " ms)" << std::endl;
+}
+
+/**
+ * Restore a session from a snapshot: map the file, point the dataset into the mapping
+ * and upload the texture and vertices. Nothing is loaded, decomposed or traced.
+ *
+ * @return false if the snapshot could not be opened, the current session is left untouched then
+ */
+bool restoreSession(const char* filename)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::shared_ptr<SessionSnapshot> snapshot(SessionSnapshot::open(filename));
+    if (!snapshot) return false;
+
+    releaseDataset();
+    const SessionState& state = snapshot->getState();
+
+    //dataset
+    useTensors = state.useTensors != 0;
+    if (state.dataset == SESSION_DATASET_TOY)
+    {
+        currentDataset = TOY_DATASET;
+        currentScalarFile = TOY_SCALAR_PATH;
+        currentVectorFile = TOY_VECTOR_PATH;
     }
-    else if (selectedAxis == AXIS_Z)
+    else
+    {
+        currentDataset = BRAIN_DATASET;
+        currentScalarFile = BRAIN_SCALAR_PATH;
+        currentVectorFile = BRAIN_VECTOR_PATH;
+    }
+    dimX = state.dimX;
+    dimY = state.dimY;
+    dimZ = state.dimZ;
+    vectorStorage = VECTOR_STORAGE_FLOAT32; //snapshots always hold float vectors
+
+    //the volumes point into the mapping, which the dataset keeps open
+    std::shared_ptr<const float> scalars(snapshot, snapshot->getScalars());
+    std::unique_ptr<const VectorField> vectorField(new VectorField(snapshot->getVectors(), snapshot->getFA(), snapshot->getZeroMask(), dimX, dimY, dimZ, false));
+    std::unique_ptr<ResidentDataset> entry(new ResidentDataset());
+    entry->data = std::make_shared<const DatasetSnapshot>(currentDataset, useTensors, scalars, dimX, dimY, dimZ,
+        std::move(vectorField), snapshot);
+    session.setDataset(entry->data);
+
+    entry->texture = createSliceTexture(snapshot->getTexels());
+    texture = entry->texture.get();
+    initImgPlane();
+
+    //tracer settings
+    TracerParams& params = session.tracerParams;
+    params.stepSize = state.stepSize;
+    params.maxLength = state.maxLength;
+    params.maxSteps = state.maxSteps;
+    maxAngleDegrees = state.maxAngleDegrees;
+    params.maxAngle = maxAngleDegrees * (std::_Pi_val / 180);
+    params.integrationMethod = state.integrationMethod == SESSION_INTEGRATION_EULER ? StreamlineTracer::EULER : StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+    const char* orderings[] = { StreamlineTracer::SEED_ORDER_NONE, StreamlineTracer::SEED_ORDER_MORTON, StreamlineTracer::SEED_ORDER_HILBERT };
+    params.seedOrdering = orderings[std::max(0, std::min(2, (int)state.seedOrdering))];
+    params.flipX = state.flipX != 0;
+    params.flipY = state.flipY != 0;
+    params.flipZ = state.flipZ != 0;
+    tracedParams = params;
+    tracedParams.level = 0;
+
+    //seeding
+    useMouseSeeding = state.useMouseSeeding != 0;
+    useVolumeSeeding = state.useVolumeSeeding != 0;
+    mouseSeedLoc = glm::vec3(state.mouseSeedLoc[0], state.mouseSeedLoc[1], state.mouseSeedLoc[2]);
+    mouseSeedRadius = state.mouseSeedRadius;
+    mouseSeedDensity = state.mouseSeedDensity;
+    volumeSeedingOptions.seedsPerVoxel = state.seedsPerVoxel;
+    volumeSeedingOptions.jitter = state.jitter != 0;
+    volumeSeedingOptions.maxSeeds = state.maxSeeds;
+
+    //view
+    selectedAxis = state.selectedAxis;
+    currentSliceX = state.currentSliceX;
+    currentSliceY = state.currentSliceY;
+    currentSliceZ = state.currentSliceZ;
+    xFov = state.xFov;
+    yFov = state.yFov;
+    cameraPos = glm::vec3(state.cameraPos[0], state.cameraPos[1], state.cameraPos[2]);
+    cameraFront = glm::vec3(state.cameraFront[0], state.cameraFront[1], state.cameraFront[2]);
+    cameraUp = glm::vec3(state.cameraUp[0], state.cameraUp[1], state.cameraUp[2]);
+    updateProjectionMatrix();
+    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    lineWidth = state.lineWidth;
+
+    entry->renderer.reset(new StreamlineRenderer(streamlineShader, lineWidth));
+    streamlineRenderer = entry->renderer.get();
+    streamlineRenderer->setCompositeShader(oitCompositeShader);
+    streamlineRenderer->setDensityResolveShader(densityResolveShader);
+
+    //the streamlines go straight from the mapping to the vertex buffer
+    streamlineRenderer->uploadVertices(snapshot->getVertices(), snapshot->getVertexCount(),
+        snapshot->getStreamlineFirsts(), snapshot->getStreamlineCounts(), snapshot->getStreamlineCount());
+    entry->bvh.reset(new StreamlineBVH());
+    streamlineBVH = entry->bvh.get();
+    streamlineBVH->build(snapshot->getVertices(), 6, snapshot->getStreamlineFirsts(), snapshot->getStreamlineCounts(),
+        snapshot->getStreamlineCount());
+    snapshot->copyAttributes(streamlineAttributes);
+    streamlineFilter = state.filter;
+    applyStreamlineFilter();
+    paramsChanged = false;
+
+    registerActiveDataset(std::move(entry));
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Restored session snapshot " << filename << " with " << snapshot->getStreamlineCount() << " streamlines in "
+              << seconds * 1000.0 << " ms" << std::endl;
+    return true;
+}
+
+/**
+ * Capture the state user actions are recorded from.
+ */
+RecordedState captureRecordedState()
+{
+    const TracerParams& params = session.tracerParams;
+    RecordedState state;
+    state.stepSize = params.stepSize;
+    state.maxLength = params.maxLength;
+    state.maxAngleDegrees = maxAngleDegrees;
+    state.lineWidth = lineWidth;
+    state.maxSteps = params.maxSteps;
+    state.sliceX = currentSliceX;
+    state.sliceY = currentSliceY;
+    state.sliceZ = currentSliceZ;
+    state.axis = selectedAxis;
+    state.dataset = currentDataset == TOY_DATASET ? SESSION_DATASET_TOY : SESSION_DATASET_BRAIN;
+    state.useTensors = useTensors;
+    state.integrationMethod = params.integrationMethod == StreamlineTracer::EULER ? SESSION_INTEGRATION_EULER : SESSION_INTEGRATION_RK2;
+    state.flipX = params.flipX;
+    state.flipY = params.flipY;
+    state.flipZ = params.flipZ;
+    state.useMouseSeeding = useMouseSeeding;
+    state.useVolumeSeeding = useVolumeSeeding;
+    return state;
+}
+
+/**
+ * Start recording user actions.
+ */
+void startInputRecording()
+{
+    lastRecordedState = captureRecordedState();
+    inputRecorder.start(glfwGetTime());
+
+    //the recording starts from the current dataset and view, whatever the replay starts from
+    RecordedState& s = lastRecordedState;
+    inputRecorder.record(glfwGetTime(), "dataset", (float)s.dataset);
+    inputRecorder.record(glfwGetTime(), "useTensors", (float)s.useTensors);
+    inputRecorder.record(glfwGetTime(), "axis", (float)s.axis);
+}
+
+/**
+ * Record the actions that changed the state since the previous frame.
+ * Dataset changes come first, since they reset the slices.
+ */
+void recordStateChanges()
+{
+    if (!inputRecorder.isRecording()) return;
+
+    RecordedState now = captureRecordedState();
+    RecordedState& last = lastRecordedState;
+    double t = glfwGetTime();
+
+    if (now.dataset != last.dataset) inputRecorder.record(t, "dataset", (float)now.dataset);
+    if (now.useTensors != last.useTensors) inputRecorder.record(t, "useTensors", (float)now.useTensors);
+    if (now.axis != last.axis) inputRecorder.record(t, "axis", (float)now.axis);
+    if (now.sliceX != last.sliceX) inputRecorder.record(t, "sliceX", (float)now.sliceX);
+    if (now.sliceY != last.sliceY) inputRecorder.record(t, "sliceY", (float)now.sliceY);
+    if (now.sliceZ != last.sliceZ) inputRecorder.record(t, "sliceZ", (float)now.sliceZ);
+    if (now.stepSize != last.stepSize) inputRecorder.record(t, "stepSize", now.stepSize);
+    if (now.maxLength != last.maxLength) inputRecorder.record(t, "maxLength", now.maxLength);
+    if (now.maxSteps != last.maxSteps) inputRecorder.record(t, "maxSteps", (float)now.maxSteps);
+    if (now.maxAngleDegrees != last.maxAngleDegrees) inputRecorder.record(t, "maxAngle", now.maxAngleDegrees);
+    if (now.lineWidth != last.lineWidth) inputRecorder.record(t, "lineWidth", now.lineWidth);
+    if (now.integrationMethod != last.integrationMethod) inputRecorder.record(t, "integrationMethod", (float)now.integrationMethod);
+    if (now.flipX != last.flipX || now.flipY != last.flipY || now.flipZ != last.flipZ) inputRecorder.record(t, "flip", (float)now.flipX, (float)now.flipY, (float)now.flipZ);
+    if (now.useMouseSeeding != last.useMouseSeeding) inputRecorder.record(t, "mouseSeeding", (float)now.useMouseSeeding);
+    if (now.useVolumeSeeding != last.useVolumeSeeding) inputRecorder.record(t, "volumeSeeding", (float)now.useVolumeSeeding);
+    last = now;
+}
+
+/**
+ * Apply a recorded action the same way the UI would.
+ */
+void applyInputAction(const InputAction& action)
+{
+    const std::string& name = action.name;
+    float v = action.values[0];
+
+    if (name == "dataset")
+    {
+        const char* dataset = (int)v == SESSION_DATASET_TOY ? TOY_DATASET : BRAIN_DATASET;
+        if (dataset != currentDataset)
+        {
+            currentDataset = dataset;
+            currentScalarFile = dataset == TOY_DATASET ? TOY_SCALAR_PATH : BRAIN_SCALAR_PATH;
+            currentVectorFile = dataset == TOY_DATASET ? TOY_VECTOR_PATH : BRAIN_VECTOR_PATH;
+            if (dataset == TOY_DATASET) useTensors = false;
+            switchDataSet();
+        }
+    }
+    else if (name == "useTensors")
+    {
+        if (useTensors != (v != 0.0f) && currentDataset != TOY_DATASET)
+        {
+            useTensors = v != 0.0f;
+            switchDataSet();
+        }
+    }
+    else if (name == "axis")
+    {
+        selectedAxis = (int)v;
+        updatePVMatrices();
+        paramsChanged = true;
+    }
+    else if (name == "sliceX") { currentSliceX = (int)v; paramsChanged = true; }
+    else if (name == "sliceY") { currentSliceY = (int)v; paramsChanged = true; }
+    else if (name == "sliceZ") { currentSliceZ = (int)v; paramsChanged = true; }
+    else if (name == "stepSize") { session.tracerParams.stepSize = v; paramsChanged = true; }
+    else if (name == "maxLength") { session.tracerParams.maxLength = v; paramsChanged = true; }
+    else if (name == "maxSteps") { session.tracerParams.maxSteps = (int)v; paramsChanged = true; }
+    else if (name == "maxAngle")
+    {
+        maxAngleDegrees = v;
+        session.tracerParams.maxAngle = maxAngleDegrees * (std::_Pi_val / 180);
+        paramsChanged = true;
+    }
+    else if (name == "lineWidth")
+    {
+        lineWidth = v;
+        if (streamlineRenderer) streamlineRenderer->setLineWidth(lineWidth);
+    }
+    else if (name == "integrationMethod")
+    {
+        session.tracerParams.integrationMethod = (int)v == SESSION_INTEGRATION_EULER ? StreamlineTracer::EULER : StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+        paramsChanged = true;
+    }
+    else if (name == "flip")
+    {
+        session.tracerParams.flipX = action.values[0] != 0.0f;
+        session.tracerParams.flipY = action.values[1] != 0.0f;
+        session.tracerParams.flipZ = action.values[2] != 0.0f;
+        paramsChanged = true;
+    }
+    else if (name == "mouseSeeding") { useMouseSeeding = v != 0.0f; paramsChanged = true; }
+    else if (name == "volumeSeeding") { useVolumeSeeding = v != 0.0f; paramsChanged = true; }
+    else if (name == "mouseSeed")
+    {
+        mouseSeedLoc = glm::vec3(action.values[0], action.values[1], action.values[2]);
+        regenerateStreamLines();
+    }
+    else if (name == "regenerate")
+    {
+        regenerateStreamLines();
+    }
+    else if (name == "isolateBundle")
+    {
+        isolateBundle((int)v);
+    }
+    else if (name == "clearIsolation")
+    {
+        clearIsolatedBundle();
+    }
+    else
+    {
+        std::cerr << "Unknown recorded action " << name << std::endl;
+    }
+}
+
+/**
+ * Apply the replay actions that are due. Called at the start of a frame.
+ */
+void applyDueReplayActions()
+{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+    while (replayNext < replayActions.size() && replayActions[replayNext].time <= elapsed)
+    {
+        const InputAction& action = replayActions[replayNext++];
+        interactions.begin(action.name, replayStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(action.time)));
+        applyInputAction(action);
+    }
+}
+
+/**
+ * Close the interactions of the frames the GPU finished, oldest first.
+ * @param wait Block until every frame finished, otherwise only look at the fences
+ */
+void pollInteractionFences(bool wait)
+{
+    while (!interactionFences.empty())
+    {
+        InteractionFence& fence = interactionFences.front();
+        GLenum status = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+        if (status == GL_TIMEOUT_EXPIRED && !wait) return;
+
+        //translate the GPU time the frame finished at to the CPU clock
+        auto now = std::chrono::steady_clock::now();
+        GLint64 gpuNow = 0;
+        GLuint64 gpuFinished = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        if (status != GL_WAIT_FAILED) glGetQueryObjectui64v(fence.timestamp, GL_QUERY_RESULT, &gpuFinished);
+        GLint64 behind = gpuFinished ? std::max<GLint64>(0, gpuNow - (GLint64)gpuFinished) : 0;
+        interactions.finishFrame(now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(behind)));
+
+        glDeleteSync(fence.sync);
+        glDeleteQueries(1, &fence.timestamp);
+        interactionFences.pop_front();
+    }
+}
+
+/**
+ * Called after a frame was presented: the latency of every input it shows is the time from when
+ * it was received (or due, when replaying) until the frame finished on the GPU. Instead of waiting
+ * for the GPU, the frame is fenced and closed by a later frame once the fence signaled.
+ */
+void finishInteractionFrame()
+{
+    if (frameShowsInteractions)
+    {
+        InteractionFence fence;
+        glGenQueries(1, &fence.timestamp);
+        glQueryCounter(fence.timestamp, GL_TIMESTAMP);
+        fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        interactionFences.push_back(fence);
+        frameShowsInteractions = false;
+    }
+    pollInteractionFences(false);
+}
+
+/**
+ * Called after a replay frame was presented and its interactions were closed.
+ *
+ * @return true when the whole recording was replayed
+ */
+bool finishReplayFrame()
+{
+    if (replayNext < replayActions.size()) return false;
+
+    pollInteractionFences(true);
+    std::cout << "Replayed " << replayActions.size() << " actions, latency from input to the frame showing the result:" << std::endl;
+    interactions.print();
+    interactions.dump(latencyDumpPath);
+    return true;
+}
+
+/**
+ * Called after a frame was presented while benchmarking the render modes: times the frame
+ * and switches to the next mode when enough frames were measured.
+ *
+ * @return true when every mode was measured
+ */
+bool finishRenderBenchmarkFrame()
+{
+    glFinish();
+    auto now = std::chrono::steady_clock::now();
+    if (renderBenchmarkFrame > RENDER_BENCHMARK_WARMUP)
+    {
+        renderBenchmarkTimes[renderBenchmarkMode].add(std::chrono::duration<double, std::milli>(now - renderBenchmarkLast).count());
+    }
+    renderBenchmarkLast = now;
+
+    if (++renderBenchmarkFrame <= RENDER_BENCHMARK_WARMUP + renderBenchmarkFrames) return false;
+    renderBenchmarkFrame = 0;
+    if (++renderBenchmarkMode < NUM_RENDER_MODES)
     {
-        if (xFov > ((float) dimX / 2.0f) - 1.0f) xFov = ((float)dimX / 2.0f) - 1.0f;
-        if (yFov > ((float) dimY / 2.0f) - 1.0f) yFov = ((float)dimY / 2.0f) - 1.0f;
+        streamlineRenderMode = (StreamlineRenderMode)renderBenchmarkMode;
+        return false;
+    }
 
-        projection = glm::ortho(xFov, (float)dimX - xFov, yFov, (float)dimY - yFov, NEAR_CAM_PLANE, FAR_CAM_PLANE);
+    const GLubyte* glRenderer = glGetString(GL_RENDERER);
+    std::cout << "Frame times of " << (streamlineRenderer ? streamlineRenderer->getVisibleStreamlineCount() : 0) << " streamlines ("
+              << (streamlineRenderer ? streamlineRenderer->getVertexCount() : 0) << " vertices) on " << (glRenderer ? (const char*)glRenderer : "unknown")
+              << ", line opacity " << getStreamlineOpacity() << ":" << std::endl;
+    for (int mode = 0; mode < NUM_RENDER_MODES; mode++)
+    {
+        renderBenchmarkTimes[mode].print(getStreamlineRenderModeName((StreamlineRenderMode)mode));
     }
+    return true;
 }
 
 /**
- * Take all the actions for switching between datasets
+ * Soak test of the dataset lifecycle in the hidden window. Every iteration switches to the next of
+ * the brain (vectors), brain (tensors) and toy datasets through switchDataSet(), exactly like the
+ * UI, and retraces the volume seeds. The even rounds start by releasing the resident datasets, so
+ * the datasets are loaded, uploaded to the GL and released again before they are switched to once
+ * more from the dataset manager; the odd rounds only switch between the resident copies. Every
+ * round ends with all datasets resident, so the number of live GL objects has to be the same after
+ * every round and back to where it started once everything is released.
+ *
+ * @return EXIT_SUCCESS if neither GL objects nor resident memory leak after the warmup and the late
+ *         iterations are not much slower than the early ones
  */
-void switchDataSet()
+int runSoakTest(int iterations)
 {
-    std::cout << "Updated Scalar File Path: " << currentScalarFile << std::endl;
-    std::cout << "Updated Vector File Path: " << currentVectorFile << std::endl;
-
-    // Initial data loading
-    loadCurrentDataFiles();
-    initImgPlane();
+    struct SoakDataset {
+        const char* dataset;
+        const char* scalarFile;
+        const char* vectorFile;
+        bool tensors;
+    };
+    const SoakDataset soakDatasets[] = {
+        { BRAIN_DATASET, BRAIN_SCALAR_PATH, BRAIN_VECTOR_PATH, false },
+        { BRAIN_DATASET, BRAIN_SCALAR_PATH, BRAIN_VECTOR_PATH, true },
+        { TOY_DATASET, TOY_SCALAR_PATH, TOY_VECTOR_PATH, false }
+    };
+    const int numDatasets = 3;
+    //a round switches to every dataset twice, loading it the first time in the rounds that release them
+    const int roundLength = 2 * numDatasets;
+    const int rounds = std::max(4, (iterations + roundLength - 1) / roundLength);
+    const int warmupRounds = std::max(1, rounds / 10);
+
+    useVolumeSeeding = true;
+    volumeSeedingOptions.maxSeeds = 5000;
+    const int initialObjects = GLObject::getLiveCount();
+    int baselineObjects = -1;
+    bool objectsLeaked = false;
+    size_t baselineBytes = 0, peakBytes = 0;
+    LatencyStats loadTimes, residentTimes, early, late;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        bool releasing = round % 2 == 0;
+        if (releasing)
+        {
+            releaseDataset();
+            datasetManager.clear();
+        }
+        //every other pair of rounds is traced with the cubic coefficients, which are built on demand
+        session.tracerParams.interpolation = (round / 2) % 2 == 0 ? INTERPOLATION_TRILINEAR : INTERPOLATION_CUBIC_BSPLINE;
 
-    //Initialize a streamline tracer and renderer
-    streamlineTracer = new StreamlineTracer(vectorField, stepSize, maxSteps, maxLength, maxAngle, integrationMethod); //TODO should this be a pointer?
-    streamlineRenderer = new StreamlineRenderer(streamlineShader);
+        for (int step = 0; step < roundLength; step++)
+        {
+            const SoakDataset& next = soakDatasets[step % numDatasets];
+            currentDataset = next.dataset;
+            currentScalarFile = next.scalarFile;
+            currentVectorFile = next.vectorFile;
+            useTensors = next.tensors;
+
+            auto start = std::chrono::steady_clock::now();
+            switchDataSet();
+            if (!activeDataset)
+            {
+                std::cerr << "Failed to switch to " << currentDataset << std::endl;
+                return EXIT_FAILURE;
+            }
+            double switchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            //a loaded dataset was traced while switching, a resident one is retraced like after a settings change
+            bool resident = !releasing || step >= numDatasets;
+            if (resident) regenerateStreamLines();
+            glFinish();
+            double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            //no frames are drawn, so close the interactions the switches opened here
+            if (interactions.frameDrawn()) interactions.finishFrame(std::chrono::steady_clock::now());
+            interactions.clear();
+
+            if (round < warmupRounds) continue;
+            (resident ? residentTimes : loadTimes).add(switchMs);
+            (round < warmupRounds + (rounds - warmupRounds) / 2 ? early : late).add(totalMs);
+        }
 
+        int liveObjects = GLObject::getLiveCount();
+        size_t residentBytes = getResidentBytes();
+        if (round == warmupRounds - 1)
+        {
+            baselineObjects = liveObjects;
+            baselineBytes = residentBytes;
+        }
+        else if (round >= warmupRounds)
+        {
+            peakBytes = std::max(peakBytes, residentBytes);
+            if (liveObjects != baselineObjects && !objectsLeaked)
+            {
+                std::cerr << "Round " << round + 1 << " ends with " << liveObjects << " GL objects, " << baselineObjects << " after the warmup" << std::endl;
+                objectsLeaked = true;
+            }
+        }
+        if ((round + 1) % 10 == 0)
+        {
+            std::cout << "Round " << round + 1 << " of " << rounds << ": " << liveObjects << " GL objects, resident "
+                      << residentBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+        }
+    }
 
-    //the brain dataset has flipped x values
-    if (currentDataset == BRAIN_DATASET)
+    releaseDataset();
+    datasetManager.clear();
+    glFinish();
+    int finalObjects = GLObject::getLiveCount();
+
+    std::cout << "Soak test: " << rounds * roundLength << " dataset switches over " << numDatasets << " datasets, "
+              << volumeSeedingOptions.maxSeeds << " volume seeds per trace" << std::endl;
+    loadTimes.print("Switch with loading");
+    residentTimes.print("Switch to resident");
+    early.print("Switch and retrace, first half");
+    late.print("Switch and retrace, second half");
+
+    bool passed = !objectsLeaked;
+    std::cout << "GL objects: " << initialObjects << " before, " << baselineObjects << " after every round, " << finalObjects
+              << " after releasing all datasets" << std::endl;
+    if (finalObjects != initialObjects)
     {
-        vectorField->flipX = true;
+        std::cerr << "Releasing the datasets leaves " << finalObjects - initialObjects << " GL objects behind" << std::endl;
+        passed = false;
     }
-
-    //generate the initial streamlines
-    std::vector<std::vector<Point3D>> streamlines = generateStreamlines();
-    streamlineRenderer->prepareStreamlines(streamlines);
+    if (baselineBytes)
+    {
+        //allow for allocator and driver slack, a leaked dataset is several times larger than this
+        double growthMB = peakBytes > baselineBytes ? (peakBytes - baselineBytes) / (1024.0 * 1024.0) : 0.0;
+        double allowedMB = std::max(32.0, 0.05 * baselineBytes / (1024.0 * 1024.0));
+        std::cout << "Resident memory after warmup " << baselineBytes / (1024.0 * 1024.0) << " MB, peak " << peakBytes / (1024.0 * 1024.0)
+                  << " MB (+" << growthMB << " MB, " << allowedMB << " MB allowed)" << std::endl;
+        if (growthMB > allowedMB)
+        {
+            std::cerr << "Resident memory keeps growing" << std::endl;
+            passed = false;
+        }
+    }
+    else
+    {
+        std::cout << "Resident memory can't be measured on this platform" << std::endl;
+    }
+    if (early.count() && late.count() && late.percentile(50) > 1.5 * early.percentile(50))
+    {
+        std::cerr << "Latency degrades over time: median " << early.percentile(50) << " ms, then " << late.percentile(50) << " ms" << std::endl;
+        passed = false;
+    }
+    std::cout << (passed ? "Soak test passed" : "Soak test failed") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /**
@@ -660,6 +2523,105 @@ void switchDataSet()
 int main(int argc, char* argv[]) {
     GLFWwindow* window;
 
+    //headless benchmark of every kernel variant this machine supports
+    const char* restorePath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--benchmark-kernels")
+        {
+            runKernelBenchmarks();
+            return 0;
+        }
+        //compare the tracing output for every thread count up to the given one (default: all cores)
+        if (std::string(argv[i]) == "--check-determinism")
+        {
+            int maxThreads = 1;
+#if defined(_OPENMP)
+            maxThreads = omp_get_max_threads();
+#endif
+            if (i + 1 < argc) maxThreads = std::max(1, std::atoi(argv[i + 1]));
+            return checkDeterminism(maxThreads);
+        }
+        //compare step size, accuracy and speed of the interpolation modes
+        if (std::string(argv[i]) == "--benchmark-interpolation")
+        {
+            return benchmarkInterpolation();
+        }
+        //time building the picking hierarchy and its queries
+        if (std::string(argv[i]) == "--benchmark-picking")
+        {
+            return benchmarkPicking();
+        }
+        //trace interactively while background jobs occupy the scheduler
+        if (std::string(argv[i]) == "--benchmark-scheduler")
+        {
+            return benchmarkScheduler();
+        }
+        //time updating a trace to new limits against tracing it again
+        if (std::string(argv[i]) == "--benchmark-incremental")
+        {
+            return benchmarkIncremental();
+        }
+        //trace on several processes of this machine, each owning a slab of the volume (default: 4)
+        if (std::string(argv[i]) == "--distributed")
+        {
+            int numRanks = 4;
+            if (i + 1 < argc && std::atoi(argv[i + 1]) > 0) numRanks = std::atoi(argv[i + 1]);
+#if defined(__linux__)
+            const char* executable = "/proc/self/exe";
+#else
+            const char* executable = argv[0];
+#endif
+            std::unique_ptr<TraceTransport> transport = spawnSocketRanks(executable, numRanks, {});
+            if (!transport) return EXIT_FAILURE;
+            return coordinateDistributedTrace(*transport);
+        }
+        //one of the processes started by --distributed
+        if (std::string(argv[i]) == "--trace-rank" && i + 3 < argc)
+        {
+            std::unique_ptr<TraceTransport> transport = connectSocketRank(std::atoi(argv[i + 1]), std::atoi(argv[i + 2]), argv[i + 3]);
+            if (!transport) return EXIT_FAILURE;
+            return runDistributedTraceRank(*transport);
+        }
+#if defined(VCP_WITH_MPI)
+        //the same over MPI, started with mpirun on at least two processes
+        if (std::string(argv[i]) == "--distributed-mpi")
+        {
+            std::unique_ptr<TraceTransport> transport = createMpiTransport(&argc, &argv);
+            if (!transport) return EXIT_FAILURE;
+            return transport->getRank() == 0 ? coordinateDistributedTrace(*transport) : runDistributedTraceRank(*transport);
+        }
+#endif
+        //switch datasets and retrace many times in a hidden window, checking that GL objects, memory and latency stay flat
+        if (std::string(argv[i]) == "--soak")
+        {
+            soakIterations = 1000;
+            if (i + 1 < argc && std::atoi(argv[i + 1]) > 0) soakIterations = std::atoi(argv[++i]);
+        }
+        //compare memory, accuracy and tracing speed of the vector field storage modes
+        if (std::string(argv[i]) == "--benchmark-storage")
+        {
+            return benchmarkVectorStorage();
+        }
+        //replay a recording of user actions in a hidden window and report the latencies
+        if (std::string(argv[i]) == "--replay" && i + 1 < argc)
+        {
+            if (InputRecorder::load(argv[++i], replayActions) != EXIT_SUCCESS) return EXIT_FAILURE;
+            replaying = true;
+        }
+        //compare the frame times of the render modes on a volume-seeded set in a hidden window
+        if (std::string(argv[i]) == "--benchmark-rendering")
+        {
+            renderBenchmarkFrames = 100;
+            if (i + 1 < argc && std::atoi(argv[i + 1]) > 0) renderBenchmarkFrames = std::atoi(argv[++i]);
+        }
+        //start from a session snapshot instead of the data files
+        if (std::string(argv[i]) == "--restore" && i + 1 < argc)
+        {
+            restorePath = argv[++i];
+        }
+    }
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -673,6 +2635,11 @@ int main(int argc, char* argv[]) {
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+    //a replay renders offscreen into the default framebuffer of an invisible window
+    if (replaying || renderBenchmarkFrames > 0 || soakIterations > 0)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     // Create window
     window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Streamline Visualization", NULL, NULL);
@@ -713,6 +2680,8 @@ int main(int argc, char* argv[]) {
     // Create shaders
     sliceShader = new Shader("shaders/vertexShader1.vs", "shaders/FragShader1.fs");
     streamlineShader = new Shader("shaders/streamlineVertex.vs", "shaders/streamlineFragment.fs");
+    oitCompositeShader = new Shader("shaders/fullscreen.vs", "shaders/oitComposite.fs");
+    densityResolveShader = new Shader("shaders/fullscreen.vs", "shaders/densityResolve.fs");
     std::cout << "Shaders loaded with ID's: " << sliceShader->ID  << ", " << streamlineShader->ID << std::endl;
 
     // Setup ImGui
@@ -722,7 +2691,34 @@ int main(int argc, char* argv[]) {
     ImGui_ImplOpenGL3_Init("#version 330 core");
     ImGui::StyleColorsDark();
 
-    switchDataSet();
+    //the soak test does its own switching and skips the render loop
+    int exitCode = 0;
+    bool restored = false;
+    if (soakIterations > 0)
+    {
+        exitCode = runSoakTest(soakIterations);
+        glfwSetWindowShouldClose(window, true);
+    }
+    else
+    {
+        restored = restorePath && restoreSession(restorePath);
+        if (!restored)
+        {
+            switchDataSet();
+        }
+    }
+
+    if (renderBenchmarkFrames > 0)
+    {
+        //a dense set, where the front layer hides most lines when drawn opaque
+        useVolumeSeeding = true;
+        volumeSeedingOptions.maxSeeds = 100000;
+        regenerateStreamLines();
+        streamlineRenderMode = (StreamlineRenderMode)renderBenchmarkMode;
+        renderBenchmarkLast = std::chrono::steady_clock::now();
+    }
+
+    replayStart = std::chrono::steady_clock::now();
 
     // Main render loop
     while (!glfwWindowShouldClose(window)) {
@@ -733,6 +2729,10 @@ int main(int argc, char* argv[]) {
 
         // Process input
         processInput(window);
+        if (replaying)
+        {
+            applyDueReplayActions();
+        }
 
         // Clear the screen
         glClearColor(25.0f / 255.0f, 25.0f / 255.0f, 30.0f / 255.0f, 1.0f);
@@ -764,7 +2764,7 @@ int main(int argc, char* argv[]) {
         glDepthFunc(GL_LEQUAL);  // Allow drawing on top of equal depth values
 
         // Render slice and streamlines
-        if (streamlineRenderer != nullptr && vectorField != nullptr) {
+        if (streamlineRenderer != nullptr && session.getDataset()) {
             glEnable(GL_DEPTH_TEST);
             glDepthFunc(GL_LESS);  // Standard depth test
 
@@ -800,13 +2800,16 @@ int main(int argc, char* argv[]) {
             glDepthFunc(GL_LEQUAL);
 
             // Render streamlines
-            streamlineShader->use();
-            streamlineShader->setMat4("projection", projection);
-            streamlineShader->setMat4("view", view);
-            streamlineShader->setMat4("model", streamlineModel);
-
+            streamlineRenderer->setCamera(projection, view, streamlineModel);
+            streamlineRenderer->setRenderMode(streamlineRenderMode);
+            streamlineRenderer->setOpacity(getStreamlineOpacity());
+            streamlineRenderer->setDensitySettings(densityResolutions[densityResolutionIndex], densitySaturation, densityFrames);
+            //the benchmark measures the full accumulation in every frame
+            if (renderBenchmarkFrames > 0) streamlineRenderer->resetDensity();
             streamlineRenderer->render();
         }
+        //inputs handled from here on are drawn by the next frame, as are inputs waiting for the live preview below
+        if (!(livePreview && paramsChanged)) frameShowsInteractions = interactions.frameDrawn();
 
         // ImGui rendering
         ImGui_ImplOpenGL3_NewFrame();
@@ -845,6 +2848,11 @@ int main(int argc, char* argv[]) {
         // Streamline settings control panel
         ImGui::Begin("Streamline Controls");
 
+        //held for the whole panel, so a dataset switch from one of the controls doesn't free it under the others
+        std::shared_ptr<const DatasetSnapshot> dataset = session.getDataset();
+        const VectorField* vectorField = dataset ? dataset->getVectorField() : nullptr;
+        TracerParams& tracerParams = session.tracerParams;
+
         // Data selection section
         ImGui::TextWrapped("Dataset Selection");
 
@@ -876,6 +2884,58 @@ int main(int argc, char* argv[]) {
             ImGui::EndCombo();
         }
 
+        //datasets stay resident until they no longer fit the budget
+        ImGui::TextWrapped("Resident datasets: %.0f of %d MB", datasetManager.getTotalBytes() / (1024.0 * 1024.0), datasetBudgetMB);
+        for (const auto& entry : datasetManager.getDatasets())
+        {
+            ImGui::BulletText("%s%s: %.0f MB%s", entry->data->getName().c_str(), entry->data->usesTensors() ? " (tensors)" : "",
+                (entry->cpuBytes + entry->gpuBytes) / (1024.0 * 1024.0), entry.get() == activeDataset ? " (active)" : "");
+        }
+        if (ImGui::SliderInt("Budget (MB)", &datasetBudgetMB, 256, 16384))
+        {
+            datasetManager.setBudget((size_t)datasetBudgetMB * 1024 * 1024, activeDataset);
+        }
+
+        //changing the placement only affects new buffers, so the dataset is reloaded
+        ImGui::TextWrapped("Volume memory placement");
+        if (ImGui::BeginCombo("##VolumeAllocation", getVolumeAllocationPolicyName(getVolumeAllocationPolicy())))
+        {
+            const VolumeAllocationPolicy policies[] = { ALLOCATE_DEFAULT, ALLOCATE_HUGE_PAGES, ALLOCATE_NUMA_INTERLEAVE, ALLOCATE_NUMA_INTERLEAVE_HUGE_PAGES };
+            for (VolumeAllocationPolicy policy : policies)
+            {
+                if (ImGui::Selectable(getVolumeAllocationPolicyName(policy)) && policy != getVolumeAllocationPolicy())
+                {
+                    setVolumeAllocationPolicy(policy);
+                    releaseDataset();
+                    datasetManager.clear();
+                    switchDataSet();
+                }
+            }
+            ImGui::EndCombo();
+        }
+
+        //quantized storage trades accuracy for memory, sparse storage drops the empty blocks; the dataset is rebuilt in the new format
+        ImGui::TextWrapped("Vector field storage");
+        if (ImGui::BeginCombo("##VectorStorage", getVectorFieldStorageName(vectorStorage)))
+        {
+            const VectorFieldStorage modes[] = { VECTOR_STORAGE_FLOAT32, VECTOR_STORAGE_OCTAHEDRAL16, VECTOR_STORAGE_OCTAHEDRAL8, VECTOR_STORAGE_SPARSE_BLOCKS };
+            for (VectorFieldStorage mode : modes)
+            {
+                if (ImGui::Selectable(getVectorFieldStorageName(mode)) && mode != vectorStorage)
+                {
+                    vectorStorage = mode;
+                    releaseDataset();
+                    datasetManager.clear();
+                    switchDataSet();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (vectorField && (vectorField->getStorage() == VECTOR_STORAGE_OCTAHEDRAL16 || vectorField->getStorage() == VECTOR_STORAGE_OCTAHEDRAL8))
+        {
+            ImGui::Text("Angular error: mean %.3f, max %.3f degrees", vectorField->getMeanAngularError(), vectorField->getMaxAngularError());
+        }
+
         ImGui::TextWrapped("Use tensor field for seeding");
         ImGui::BeginDisabled(currentDataset == TOY_DATASET);
         if (ImGui::Checkbox("##useTensors", &useTensors))
@@ -883,6 +2943,18 @@ int main(int argc, char* argv[]) {
             //a little ugly to do it this way, but no time to make it prettier so we don't reload the unneeded stuff
             switchDataSet(); 
         }
+        ImGui::BeginDisabled(!useTensors || vectorStorage != VECTOR_STORAGE_FLOAT32);
+        if (ImGui::Checkbox("Decompose tensors on first touch", &lazyTensorDecomposition))
+        {
+            releaseDataset();
+            datasetManager.clear();
+            switchDataSet();
+        }
+        ImGui::EndDisabled();
+        if (vectorField && vectorField->isLazy())
+        {
+            ImGui::Text("Decomposed bricks: %zu of %zu", vectorField->getDecomposedBrickCount(), vectorField->getBrickCount());
+        }
         ImGui::EndDisabled();
 
         // Streamline parameters section
@@ -890,19 +2962,19 @@ int main(int argc, char* argv[]) {
         ImGui::Text("Streamline Parameters");
 
         ImGui::TextWrapped("Step size");
-        paramsChanged |= ImGui::SliderFloat("##stepSize", &stepSize, 0.1f, 2.0f, "%.3f");
+        paramsChanged |= ImGui::SliderFloat("##stepSize", &tracerParams.stepSize, 0.1f, 2.0f, "%.3f");
         
         ImGui::TextWrapped("Max streamline length");
-        paramsChanged |= ImGui::SliderFloat("##maxLength", &maxLength, 1.0f, 1000.0f, "%.1f");
+        paramsChanged |= ImGui::SliderFloat("##maxLength", &tracerParams.maxLength, 1.0f, 1000.0f, "%.1f");
         
         // Max steps slider
         ImGui::TextWrapped("Max integration steps");
-        paramsChanged |= ImGui::SliderInt("##maxSteps", &maxSteps, 1, 2000);
+        paramsChanged |= ImGui::SliderInt("##maxSteps", &tracerParams.maxSteps, 1, 2000);
 
         ImGui::TextWrapped("Max angle between steps (degrees)");
         if (ImGui::SliderFloat("##maxAngle", &maxAngleDegrees, 1.0f, 90.0f, "%.1f"))
         {
-            maxAngle = maxAngleDegrees * (std::_Pi_val / 180);
+            tracerParams.maxAngle = maxAngleDegrees * (std::_Pi_val / 180);
             paramsChanged = true;
         }
 
@@ -910,41 +2982,138 @@ int main(int argc, char* argv[]) {
         if (ImGui::SliderFloat("##lineWidth", &lineWidth, 1.0f, 5.0f, "%.2f"))
         {
             //TODO: make linewidth relative to zoom level.
-            streamlineRenderer->setLineWidth(lineWidth);
+            if (streamlineRenderer) streamlineRenderer->setLineWidth(lineWidth);
+        }
+
+        //transparency shows the lines behind the front layer, without sorting them
+        ImGui::TextWrapped("Rendering");
+        if (ImGui::BeginCombo("##RenderMode", getStreamlineRenderModeName(streamlineRenderMode)))
+        {
+            for (int mode = 0; mode < NUM_RENDER_MODES; mode++)
+            {
+                if (ImGui::Selectable(getStreamlineRenderModeName((StreamlineRenderMode)mode)))
+                {
+                    streamlineRenderMode = (StreamlineRenderMode)mode;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (streamlineRenderMode == RENDER_MODE_WEIGHTED_BLENDED)
+        {
+            ImGui::Checkbox("Density-aware opacity", &densityOpacity);
+            if (densityOpacity)
+            {
+                ImGui::SliderFloat("Target opacity", &targetOpacity, 0.05f, 1.0f, "%.2f");
+                ImGui::Text("Line opacity: %.3f", getStreamlineOpacity());
+            }
+            else
+            {
+                ImGui::SliderFloat("Line opacity", &streamlineOpacity, 0.01f, 1.0f, "%.3f");
+            }
+        }
+        if (streamlineRenderMode == RENDER_MODE_DENSITY)
+        {
+            //a lower resolution and spreading the lines over frames keep huge sets interactive
+            ImGui::Combo("Resolution", &densityResolutionIndex, densityResolutionNames, IM_ARRAYSIZE(densityResolutionNames));
+            ImGui::SliderFloat("Saturation", &densitySaturation, 2.0f, 1024.0f, "%.0f lines", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderInt("Progressive frames", &densityFrames, 1, 32);
+            ImGui::Text("Accumulated: %.0f%%", (streamlineRenderer ? streamlineRenderer->getDensityProgress() : 0.0f) * 100.0f);
         }
 
         ImGui::Separator();
 
         //integration method
         ImGui::TextWrapped("Integration method");
-        if (ImGui::BeginCombo("##Integration method", integrationMethod))
+        if (ImGui::BeginCombo("##Integration method", tracerParams.integrationMethod))
         {
             if (ImGui::Selectable(StreamlineTracer::EULER))
             {
-                if (integrationMethod != StreamlineTracer::EULER)
+                if (tracerParams.integrationMethod != StreamlineTracer::EULER)
                 {
-                    integrationMethod = StreamlineTracer::EULER;
+                    tracerParams.integrationMethod = StreamlineTracer::EULER;
                     paramsChanged = true;
                 }
             }
 
             if (ImGui::Selectable(StreamlineTracer::RUNGE_KUTTA_2ND_ORDER))
             {
-                if (integrationMethod != StreamlineTracer::RUNGE_KUTTA_2ND_ORDER)
+                if (tracerParams.integrationMethod != StreamlineTracer::RUNGE_KUTTA_2ND_ORDER)
+                {
+                    tracerParams.integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+                    paramsChanged = true;
+                }
+            }
+            ImGui::EndCombo();
+        }
+
+        //order in which the seeds are handed to the tracing threads
+        ImGui::TextWrapped("Seed ordering");
+        if (ImGui::BeginCombo("##Seed ordering", tracerParams.seedOrdering))
+        {
+            const char* orderings[] = { StreamlineTracer::SEED_ORDER_NONE, StreamlineTracer::SEED_ORDER_MORTON, StreamlineTracer::SEED_ORDER_HILBERT };
+            for (const char* ordering : orderings)
+            {
+                if (ImGui::Selectable(ordering) && tracerParams.seedOrdering != ordering)
+                {
+                    tracerParams.seedOrdering = ordering;
+                    paramsChanged = true;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::Button("Benchmark seed orderings"))
+        {
+            benchmarkSeedOrderings();
+        }
+
+        //the cubic mode is smooth, so the angle check allows larger steps
+        ImGui::TextWrapped("Interpolation");
+        if (ImGui::BeginCombo("##Interpolation", getInterpolationModeName(tracerParams.interpolation)))
+        {
+            const InterpolationMode modes[] = { INTERPOLATION_NEAREST, INTERPOLATION_TRILINEAR, INTERPOLATION_CUBIC_BSPLINE };
+            for (InterpolationMode mode : modes)
+            {
+                if (ImGui::Selectable(getInterpolationModeName(mode)) && mode != tracerParams.interpolation)
                 {
-                    integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+                    tracerParams.interpolation = mode;
                     paramsChanged = true;
                 }
             }
             ImGui::EndCombo();
         }
 
+        //coarse previews trace on a lower resolution level with proportionally larger steps
+        ImGui::Checkbox("Live coarse preview", &livePreview);
+        if (vectorField && vectorField->getLevelCount() > 1)
+        {
+            ImGui::SliderInt("Preview level", &previewLevel, 1, vectorField->getLevelCount() - 1);
+        }
+        ImGui::Text("Last trace: %.1f ms (level %d%s)", lastTraceMs, lastTraceLevel, lastTraceIncremental ? ", updated" : "");
+        if (previewRefinement)
+        {
+            ImGui::Text("Refining: %zu of %zu seeds", previewRefinement->tracedSeeds.load(), previewRefinement->seeds.size());
+        }
+
+        //changing only the limits resumes or cuts the last trace instead of tracing from the seeds again
+        if (ImGui::Checkbox("Update traces when only the limits change", &incrementalUpdates) && !incrementalUpdates)
+        {
+            traceState.clear();
+        }
+        if (incrementalUpdates && !traceState.empty())
+        {
+            ImGui::Text("Trace state: %.1f MB", traceState.getMemoryBytes() / (1024.0 * 1024.0));
+        }
+        if (ImGui::Button("Compare pyramid levels"))
+        {
+            comparePyramidLevels();
+        }
+
         ImGui::Separator();
 
         ImGui::TextWrapped("Flip vector field components.");
-        paramsChanged |= ImGui::Checkbox("FlipX", &(vectorField->flipX));
-        paramsChanged |= ImGui::Checkbox("FlipY", &(vectorField->flipY));
-        paramsChanged |= ImGui::Checkbox("FlipZ", &(vectorField->flipZ));
+        paramsChanged |= ImGui::Checkbox("FlipX", &tracerParams.flipX);
+        paramsChanged |= ImGui::Checkbox("FlipY", &tracerParams.flipY);
+        paramsChanged |= ImGui::Checkbox("FlipZ", &tracerParams.flipZ);
 
         //Mouse seeding
         ImGui::Separator();
@@ -958,24 +3127,243 @@ int main(int argc, char* argv[]) {
         ImGui::TextWrapped("Seed radius");
         paramsChanged |= ImGui::SliderFloat("##SeedRadius", &mouseSeedRadius, 0.01f, 20.0f);
 
+        //Volume seeding
+        ImGui::Separator();
+        ImGui::TextWrapped("Volume seeding settings");
+
+        paramsChanged |= ImGui::Checkbox("Volume seeding", &useVolumeSeeding);
+
+        ImGui::BeginDisabled(!useVolumeSeeding);
+        ImGui::TextWrapped("Seeds per voxel");
+        paramsChanged |= ImGui::SliderInt("##SeedsPerVoxel", &volumeSeedingOptions.seedsPerVoxel, 1, 8);
+        paramsChanged |= ImGui::Checkbox("Jitter seeds", &volumeSeedingOptions.jitter);
+
+        ImGui::TextWrapped("Seed budget (0 = unlimited)");
+        paramsChanged |= ImGui::SliderInt("##SeedBudget", &volumeSeedingOptions.maxSeeds, 0, 1000000);
+
+        paramsChanged |= ImGui::Checkbox("Scalar threshold", &volumeSeedingOptions.useScalarThreshold);
+        paramsChanged |= ImGui::SliderFloat("##ScalarThreshold", &volumeSeedingOptions.scalarThreshold, 0.0f, 1.0f, "%.3f");
+
+        ImGui::BeginDisabled(!vectorField || !vectorField->hasFA());
+        paramsChanged |= ImGui::Checkbox("FA threshold", &volumeSeedingOptions.useFAThreshold);
+        paramsChanged |= ImGui::SliderFloat("##FAThreshold", &volumeSeedingOptions.faThreshold, 0.0f, 1.0f, "%.2f");
+        ImGui::EndDisabled();
+
+        ImGui::TextWrapped("ROI mask (NIfTI, nonzero voxels are seeded)");
+        ImGui::InputText("##RoiMaskPath", roiMaskPath, sizeof(roiMaskPath));
+        if (ImGui::Button("Load ROI"))
+        {
+            loadRoiMask(roiMaskPath);
+            paramsChanged = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear ROI"))
+        {
+            roiMask.reset();
+            volumeSeedingOptions.roiMask = nullptr;
+            paramsChanged = true;
+        }
+        ImGui::EndDisabled();
+
+        if (useMouseSeeding) ImGui::TextWrapped("Seeds: depends on the clicked position");
+        else ImGui::TextWrapped(useVolumeSeeding ? "Seeds: up to %zu" : "Seeds: %zu in the current slice", estimateSeedCount());
+
 
+        //Filtering, applied to the traced streamlines directly
         ImGui::Separator();
-        ImGui::BeginDisabled(!paramsChanged);
+        ImGui::TextWrapped("Streamline filter (%zu of %zu shown)", streamlineRenderer ? streamlineRenderer->getVisibleStreamlineCount() : 0, streamlineAttributes.size());
+
+        bool filterChanged = false;
+        filterChanged |= ImGui::Checkbox("Length", &streamlineFilter.length.enabled);
+        filterChanged |= ImGui::DragFloatRange2("##LengthRange", &streamlineFilter.length.min, &streamlineFilter.length.max, 1.0f, 0.0f, 2.0f * tracerParams.maxLength, "%.1f");
+        filterChanged |= ImGui::Checkbox("Step count", &streamlineFilter.stepCount.enabled);
+        filterChanged |= ImGui::DragFloatRange2("##StepRange", &streamlineFilter.stepCount.min, &streamlineFilter.stepCount.max, 1.0f, 0.0f, 2.0f * tracerParams.maxSteps, "%.0f");
+        filterChanged |= ImGui::Checkbox("Mean scalar", &streamlineFilter.meanScalar.enabled);
+        filterChanged |= ImGui::DragFloatRange2("##MeanScalarRange", &streamlineFilter.meanScalar.min, &streamlineFilter.meanScalar.max, 0.005f, 0.0f, 1.0f, "%.3f");
+        filterChanged |= ImGui::Checkbox("Curvature (rad/voxel)", &streamlineFilter.curvature.enabled);
+        filterChanged |= ImGui::DragFloatRange2("##CurvatureRange", &streamlineFilter.curvature.min, &streamlineFilter.curvature.max, 0.005f, 0.0f, 2.0f, "%.3f");
+
+        ImGui::BeginDisabled(!vectorField || !vectorField->hasFA());
+        filterChanged |= ImGui::Checkbox("Mean FA", &streamlineFilter.meanFA.enabled);
+        filterChanged |= ImGui::DragFloatRange2("##MeanFARange", &streamlineFilter.meanFA.min, &streamlineFilter.meanFA.max, 0.005f, 0.0f, 1.0f, "%.2f");
+        filterChanged |= ImGui::Checkbox("Min FA", &streamlineFilter.minFA.enabled);
+        filterChanged |= ImGui::DragFloatRange2("##MinFARange", &streamlineFilter.minFA.min, &streamlineFilter.minFA.max, 0.005f, 0.0f, 1.0f, "%.2f");
+        ImGui::EndDisabled();
+
+        ImGui::TextWrapped("Show streamlines terminated by");
+        for (int r = 0; r < NUM_TERMINATION_REASONS; r++)
+        {
+            filterChanged |= ImGui::Checkbox(getTerminationReasonName((TerminationReason)r), &streamlineFilter.allowedTermination[r]);
+        }
+
+        if (filterChanged)
+        {
+            applyStreamlineFilter();
+        }
+
+        //Picking: hover a streamline to see its attributes, click it to isolate its bundle
+        ImGui::TextWrapped("Hover pick: %.1f us over %zu segments", lastPickMicroseconds, streamlineBVH ? streamlineBVH->getSegmentCount() : (size_t)0);
+        ImGui::SliderFloat("Pick radius (px)", &pickRadiusPixels, 1.0f, 16.0f);
+        ImGui::SliderFloat("Bundle radius", &bundleRadius, 0.5f, 10.0f);
+        ImGui::SliderFloat("Bundle fraction", &bundleFraction, 0.1f, 1.0f);
+        ImGui::BeginDisabled(isolatedStreamlines.empty());
+        if (ImGui::Button("Clear isolation"))
+        {
+            inputRecorder.record(glfwGetTime(), "clearIsolation");
+            clearIsolatedBundle();
+        }
+        ImGui::EndDisabled();
+
+        //Session snapshots
+        ImGui::Separator();
+        ImGui::TextWrapped("Session snapshot");
+        ImGui::InputText("##SnapshotPath", sessionSnapshotPath, sizeof(sessionSnapshotPath));
+        ImGui::BeginDisabled(isSessionSnapshotSaving());
+        if (ImGui::Button("Save session"))
+        {
+            saveSession(sessionSnapshotPath);
+        }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        if (ImGui::Button("Restore session"))
+        {
+            restoreSession(sessionSnapshotPath);
+        }
+        if (isSessionSnapshotSaving())
+        {
+            ImGui::SameLine();
+            ImGui::Text("Saving...");
+        }
+        ImGui::Text("Time to first frame: %.1f ms", timeToFirstFrameMs);
+
+        //time from an input until the frame showing its result finished, and where it went
+        ImGui::Separator();
+        const LatencyStats& latency = interactions.getTotal();
+        ImGui::TextWrapped("Input to display: p50 %.1f ms, p99 %.1f ms (%zu inputs)", latency.percentile(50.0), latency.percentile(99.0), latency.getTotalCount());
+        for (int stage = STAGE_SEEDED; stage < NUM_INTERACTION_STAGES; stage++)
+        {
+            const LatencyStats& stats = interactions.getStage((InteractionStage)stage);
+            if (stats.count() == 0) continue;
+            ImGui::BulletText("%s: p50 %.1f ms, p99 %.1f ms", getInteractionStageName((InteractionStage)stage), stats.percentile(50.0), stats.percentile(99.0));
+        }
+        for (int jobClass = 0; jobClass < NUM_JOB_CLASSES; jobClass++)
+        {
+            JobClassStats& stats = jobStats[jobClass];
+            stats.queueWait.add(getJobScheduler().takeStats((JobClass)jobClass).queueWait);
+            if (stats.queueWait.count() == 0) continue;
+            ImGui::BulletText("%s job queue wait: p50 %.1f ms, p99 %.1f ms", getJobClassName((JobClass)jobClass),
+                stats.queueWait.percentile(50.0), stats.queueWait.percentile(99.0));
+        }
+        ImGui::InputText("##LatencyPath", latencyDumpPath, sizeof(latencyDumpPath));
+        if (ImGui::Button("Save latencies"))
+        {
+            interactions.dump(latencyDumpPath);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reset latencies"))
+        {
+            interactions.clear();
+            getJobScheduler().clearStats();
+            for (JobClassStats& stats : jobStats) stats.queueWait.clear();
+        }
+
+        ImGui::Separator();
+        if (livePreview && paramsChanged)
+        {
+            beginInteraction("preview");
+            regenerateStreamLines(previewLevel);
+        }
+        else if (livePreview && previewShown)
+        {
+            //the settings stopped changing, trace them at full resolution without blocking the UI
+            if (!previewRefinementJob) startPreviewRefinement();
+            else finishPreviewRefinement();
+        }
+        ImGui::BeginDisabled(!paramsChanged && !previewShown);
         if (ImGui::Button("Regenerate Streamlines")) {
+            inputRecorder.record(glfwGetTime(), "regenerate");
+            beginInteraction("regenerate");
             regenerateStreamLines();
         }
         ImGui::EndDisabled();
 
+        //Input recording for replay benchmarks (--replay <file>)
+        ImGui::Separator();
+        ImGui::TextWrapped("Input recording");
+        ImGui::InputText("##RecordingPath", inputRecordingPath, sizeof(inputRecordingPath));
+        if (!inputRecorder.isRecording())
+        {
+            if (ImGui::Button("Start recording"))
+            {
+                startInputRecording();
+            }
+        }
+        else
+        {
+            if (ImGui::Button("Stop and save recording"))
+            {
+                recordStateChanges();
+                inputRecorder.stop();
+                inputRecorder.save(inputRecordingPath);
+            }
+            ImGui::SameLine();
+            ImGui::Text("%zu actions", inputRecorder.getActions().size());
+        }
+
         ImGui::End();
 
+        //attributes of the streamline under the mouse
+        if (hoveredStreamline >= 0 && hoveredStreamline < (int)streamlineAttributes.size() && !ImGui::GetIO().WantCaptureMouse)
+        {
+            const StreamlineAttributes& a = streamlineAttributes;
+            size_t i = (size_t)hoveredStreamline;
+            ImGui::BeginTooltip();
+            ImGui::Text("Streamline %d, segment %d", hoveredStreamline, hoveredHit.segment);
+            ImGui::Text("Position: %.1f, %.1f, %.1f", hoveredHit.point.x, hoveredHit.point.y, hoveredHit.point.z);
+            ImGui::Text("Length: %.1f voxels, %.0f steps", a.length[i], a.stepCount[i]);
+            if (vectorField && vectorField->hasFA()) ImGui::Text("FA: mean %.3f, min %.3f", a.meanFA[i], a.minFA[i]);
+            ImGui::Text("Mean scalar: %.3f", a.meanScalar[i]);
+            ImGui::Text("Curvature: %.3f rad/voxel", a.curvature[i]);
+            ImGui::Text("Stopped by: %s / %s", getTerminationReasonName((TerminationReason)a.backwardTermination[i]),
+                getTerminationReasonName((TerminationReason)a.forwardTermination[i]));
+            ImGui::TextDisabled("%s", useMouseSeeding ? "Disable mouse seeding to isolate the bundle" : "Click to isolate the bundle");
+            ImGui::EndTooltip();
+        }
+
+        recordStateChanges();
+
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         // Swap buffers and poll events
         glfwSwapBuffers(window);
+        finishInteractionFrame();
+        inputTime = std::chrono::steady_clock::now();
         glfwPollEvents();
+
+        if (timeToFirstFrameMs < 0.0)
+        {
+            //include the time the first frame takes on the GPU
+            glFinish();
+            timeToFirstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - programStart).count();
+            std::cout << "Time to first frame: " << timeToFirstFrameMs << " ms (" << (restored ? "restored from snapshot" : "cold start") << ")" << std::endl;
+        }
+
+        if (replaying && finishReplayFrame())
+        {
+            glfwSetWindowShouldClose(window, true);
+        }
+        if (renderBenchmarkFrames > 0 && finishRenderBenchmarkFrame())
+        {
+            glfwSetWindowShouldClose(window, true);
+        }
     }
 
+    //don't exit in the middle of writing a snapshot
+    cancelPreviewRefinement();
+    waitForSessionSnapshotSave();
+    pollInteractionFences(true);
+
     // Clean up
     if (sliceVAO) {
         glDeleteVertexArrays(1, &sliceVAO);
@@ -983,14 +3371,14 @@ int main(int argc, char* argv[]) {
         glDeleteBuffers(1, &sliceEBO);
     }
 
-    if (texture) {
-        glDeleteTextures(1, &texture);
-    }
+    //the resident datasets own GL objects, so release them while the context exists
+    releaseDataset();
+    datasetManager.clear();
 
-    delete vectorField;
-    delete streamlineRenderer;
     delete sliceShader;
     delete streamlineShader;
+    delete oitCompositeShader;
+    delete densityResolveShader;
     delete glyphShader;
 
     // ImGui cleanup
@@ -998,11 +3386,6 @@ int main(int argc, char* argv[]) {
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    if (globalScalarData) {
-        delete[] globalScalarData;
-        globalScalarData = nullptr;
-    }
-
     glfwTerminate();
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,354 @@
+/**
+ * @file TraceDaemon.cpp
+ * @brief Main file of vcp-traced, the tracing daemon
+ *
+ * The daemon loads datasets once and keeps them resident, so tools that need streamlines of a
+ * few thousand seeds don't each read and decompose the volumes again. It traces the requests of
+ * its clients in batches (see TraceService.h) and speaks the protocol in TraceProtocol.h on a
+ * Unix domain socket; TraceClient is the C++ client.
+ *
+ *   vcp-traced [--socket <path>] [--dataset <name> <scalar file> <vector file>]...
+ *              [--tensor-dataset <name> <scalar file> <tensor file>]...
+ *              [--batch-window <ms>] [--max-batch-seeds <count>] [--stats-interval <seconds>]
+ *   vcp-traced --benchmark [clients] [requests per client] [seeds per request]
+ *
+ * Without a dataset argument the brain dataset in the data directory is loaded as "brain".
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "include/Constants.h"
+#include "include/DataReader.h"
+#include "include/VectorField.h"
+#include "include/VolumeAllocator.h"
+#include "include/DatasetSnapshot.h"
+#include "include/StreamlineTracer.h"
+#include "include/LatencyStats.h"
+#include "include/TraceService.h"
+#include "include/TraceServer.h"
+#include "include/TraceClient.h"
+
+/**
+ * @struct DatasetFiles
+ * @brief Where a dataset of the daemon is read from
+ */
+struct DatasetFiles {
+    std::string name;
+    std::string scalarFile;
+    std::string vectorFile; ///< Eigenvectors, or the tensors if useTensors is set
+    bool useTensors = false;
+};
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+/**
+ * Read and prepare a dataset: the scalar volume, the vector field (decomposed up front when it
+ * comes from tensors, so the first requests don't pay for it) and its pyramid.
+ *
+ * @param files Files of the dataset
+ * @return The snapshot, or nullptr if it couldn't be loaded
+ */
+std::shared_ptr<const DatasetSnapshot> loadDataset(const DatasetFiles& files)
+{
+    auto start = std::chrono::steady_clock::now();
+    float* scalarData = nullptr;
+    int dimX = 0, dimY = 0, dimZ = 0;
+    if (readData(files.scalarFile.c_str(), scalarData, dimX, dimY, dimZ) != EXIT_SUCCESS)
+    {
+        std::cerr << "Failed to read scalar data from " << files.scalarFile << std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<const float> scalars = shareVolume(scalarData);
+
+    std::unique_ptr<VectorField> vectorField;
+    try
+    {
+        if (files.useTensors)
+        {
+            float* tensorData = nullptr;
+            int tensorDimX, tensorDimY, tensorDimZ;
+            if (readTensorData(files.vectorFile.c_str(), tensorData, tensorDimX, tensorDimY, tensorDimZ) != EXIT_SUCCESS)
+            {
+                std::cerr << "Failed to read tensor data from " << files.vectorFile << std::endl;
+                return nullptr;
+            }
+            VolumeBuffer<float> tensors(tensorData);
+            if (tensorDimX != dimX || tensorDimY != dimY || tensorDimZ != dimZ)
+            {
+                std::cerr << "Tensor dimensions do not match the scalar data of " << files.name << std::endl;
+                return nullptr;
+            }
+            vectorField.reset(new VectorField(tensors.get(), dimX, dimY, dimZ));
+            vectorField->buildPyramid(VECTOR_PYRAMID_LEVELS, tensors.get());
+        }
+        else
+        {
+            vectorField.reset(new VectorField(files.vectorFile.c_str()));
+            vectorField->buildPyramid(VECTOR_PYRAMID_LEVELS);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error loading the vector field of " << files.name << ": " << e.what() << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<const DatasetSnapshot> dataset = std::make_shared<const DatasetSnapshot>(files.name, files.useTensors,
+        std::move(scalars), dimX, dimY, dimZ, std::unique_ptr<const VectorField>(vectorField.release()));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded " << files.name << ": " << dimX << "x" << dimY << "x" << dimZ << ", "
+              << dataset->getMemoryBytes() / (1024.0 * 1024.0) << " MB in " << seconds << " s" << std::endl;
+    return dataset;
+}
+
+/**
+ * The brain dataset of the viewer, with its eigenvectors.
+ */
+DatasetFiles getDefaultDataset()
+{
+    DatasetFiles files;
+    files.name = "brain";
+    files.scalarFile = BRAIN_SCALAR_PATH;
+    files.vectorFile = BRAIN_VECTOR_PATH;
+    return files;
+}
+
+/**
+ * Run one benchmark configuration: start a service and a server with it on a temporary socket,
+ * let every client send its requests one after the other over the socket and time them.
+ *
+ * @param results Output, the first result of every client
+ * @return EXIT_SUCCESS if all requests succeeded
+ */
+int runBenchmarkClients(std::shared_ptr<const DatasetSnapshot> dataset, const TraceServiceOptions& options, const char* label,
+    const std::vector<Point3D>& seedPool, const TracerParams& params, int numClients, int requestsPerClient, int seedsPerRequest,
+    std::vector<TraceResult>& results)
+{
+#if !defined(_WIN32)
+    std::string socketPath = "/tmp/vcp-traced-benchmark-" + std::to_string(getpid()) + ".sock";
+#else
+    std::string socketPath = "vcp-traced-benchmark.sock";
+#endif
+    TraceService service(options);
+    service.addDataset("brain", dataset);
+    TraceServer server(service);
+    if (server.start(socketPath) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    LatencyStats latencies;
+    std::mutex latencyMutex;
+    std::atomic<int> failures{ 0 };
+    results.assign(numClients, TraceResult());
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < numClients; c++)
+    {
+        clients.emplace_back([&, c] {
+            TraceClient client;
+            if (client.connect(socketPath) != EXIT_SUCCESS)
+            {
+                std::cerr << client.getError() << std::endl;
+                failures++;
+                return;
+            }
+            for (int r = 0; r < requestsPerClient; r++)
+            {
+                //every request takes a different range of the seed pool
+                size_t offset = ((size_t)c * requestsPerClient + r) * seedsPerRequest % (seedPool.size() - seedsPerRequest + 1);
+                std::vector<Point3D> seeds(seedPool.begin() + offset, seedPool.begin() + offset + seedsPerRequest);
+
+                TraceResult result;
+                auto requestStart = std::chrono::steady_clock::now();
+                if (client.trace("brain", params, seeds, result) != EXIT_SUCCESS)
+                {
+                    std::cerr << "Request failed: " << client.getError() << std::endl;
+                    failures++;
+                    return;
+                }
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requestStart).count();
+                {
+                    std::lock_guard<std::mutex> lock(latencyMutex);
+                    latencies.add(ms);
+                }
+                if (r == 0) results[c] = std::move(result);
+            }
+        });
+    }
+    for (std::thread& client : clients) client.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    server.stop();
+
+    size_t requests = latencies.count();
+    std::cout << label << ": " << requests << " requests in " << seconds << " s, " << requests / seconds << " requests/s, "
+              << requests * seedsPerRequest / seconds << " seeds/s" << std::endl;
+    latencies.print("  Request latency");
+    std::cout << "  ";
+    service.takeStats().print();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Headless benchmark of the daemon: concurrent clients tracing small seed sets on the brain
+ * dataset over the socket, with every request traced alone, with the queued requests batched and
+ * with a batch window on top. Checks the first result of every client against a direct trace of
+ * the same seeds.
+ *
+ * @return EXIT_SUCCESS if every request succeeded and the results match
+ */
+int runBenchmark(int numClients, int requestsPerClient, int seedsPerRequest)
+{
+    DatasetFiles files = getDefaultDataset();
+    std::shared_ptr<const DatasetSnapshot> dataset = loadDataset(files);
+    if (!dataset) return EXIT_FAILURE;
+
+    StreamlineTracer tracer(dataset);
+    VolumeSeedingOptions seeding;
+    seeding.maxSeeds = 100000;
+    std::vector<Point3D> seedPool = tracer.generateVolumeSeeds(seeding);
+    if ((int)seedPool.size() < seedsPerRequest) return EXIT_FAILURE;
+
+    //the settings the viewer starts with for the brain dataset
+    TracerParams params;
+    params.maxSteps = 2000;
+    params.maxAngle = 45.0f * 3.14159265f / 180.0f;
+    params.flipX = true;
+
+    std::cout << numClients << " clients, " << requestsPerClient << " requests each, " << seedsPerRequest << " seeds per request" << std::endl;
+    const int numConfigs = 3;
+    TraceServiceOptions configs[numConfigs];
+    configs[0].maxBatchSeeds = 0;
+    configs[2].batchWindowMs = 2.0;
+    const char* labels[numConfigs] = { "Every request alone", "Queued requests batched", "Batched with a 2 ms window" };
+    std::vector<TraceResult> results[numConfigs];
+    for (int i = 0; i < numConfigs; i++)
+    {
+        if (runBenchmarkClients(dataset, configs[i], labels[i], seedPool, params, numClients, requestsPerClient, seedsPerRequest, results[i]) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool match = true;
+    for (int c = 0; c < numClients; c++)
+    {
+        size_t offset = (size_t)c * requestsPerClient * seedsPerRequest % (seedPool.size() - seedsPerRequest + 1);
+        std::vector<Point3D> seeds(seedPool.begin() + offset, seedPool.begin() + offset + seedsPerRequest);
+        std::vector<size_t> seedIndices;
+        std::vector<std::vector<Point3D>> streamlines = tracer.traceAllStreamlines(seeds, params, nullptr, &seedIndices);
+        uint64_t hash = StreamlineTracer::hashStreamlines(streamlines);
+        std::vector<uint32_t> indices(seedIndices.begin(), seedIndices.end());
+        for (int i = 0; i < numConfigs; i++)
+        {
+            match &= StreamlineTracer::hashStreamlines(results[i][c].streamlines) == hash && results[i][c].seedIndices == indices;
+        }
+    }
+    std::cout << (match ? "Daemon results match direct traces" : "Daemon results differ from direct traces") << std::endl;
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Main entry point of the daemon
+ */
+int main(int argc, char* argv[])
+{
+#if !defined(_WIN32)
+    //a client that disconnects shows up as a failed write, not as a signal
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    std::string socketPath = DEFAULT_TRACE_SOCKET;
+    std::vector<DatasetFiles> datasetFiles;
+    TraceServiceOptions options;
+    int statsInterval = 60;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        //concurrent clients against the daemon, every request alone and batched
+        if (arg == "--benchmark")
+        {
+            int numClients = i + 1 < argc && std::atoi(argv[i + 1]) > 0 ? std::atoi(argv[i + 1]) : 8;
+            int requestsPerClient = i + 2 < argc && std::atoi(argv[i + 2]) > 0 ? std::atoi(argv[i + 2]) : 50;
+            int seedsPerRequest = i + 3 < argc && std::atoi(argv[i + 3]) > 0 ? std::atoi(argv[i + 3]) : 500;
+            return runBenchmark(numClients, requestsPerClient, seedsPerRequest);
+        }
+        else if (arg == "--socket" && i + 1 < argc)
+        {
+            socketPath = argv[++i];
+        }
+        else if ((arg == "--dataset" || arg == "--tensor-dataset") && i + 3 < argc)
+        {
+            DatasetFiles files;
+            files.name = argv[i + 1];
+            files.scalarFile = argv[i + 2];
+            files.vectorFile = argv[i + 3];
+            files.useTensors = arg == "--tensor-dataset";
+            datasetFiles.push_back(files);
+            i += 3;
+        }
+        else if (arg == "--batch-window" && i + 1 < argc)
+        {
+            options.batchWindowMs = std::max(0.0, std::atof(argv[++i]));
+        }
+        else if (arg == "--max-batch-seeds" && i + 1 < argc)
+        {
+            options.maxBatchSeeds = (size_t)std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--stats-interval" && i + 1 < argc)
+        {
+            statsInterval = std::max(1, std::atoi(argv[++i]));
+        }
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (datasetFiles.empty()) datasetFiles.push_back(getDefaultDataset());
+
+    //the names in datasetFiles stay where they are from here on, the snapshots point to them
+    TraceService service(options);
+    for (const DatasetFiles& files : datasetFiles)
+    {
+        std::shared_ptr<const DatasetSnapshot> dataset = loadDataset(files);
+        if (!dataset) return EXIT_FAILURE;
+        service.addDataset(files.name, dataset);
+    }
+
+    TraceServer server(service);
+    if (server.start(socketPath) != EXIT_SUCCESS) return EXIT_FAILURE;
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::cout << "Listening on " << socketPath << std::endl;
+
+    auto lastStats = std::chrono::steady_clock::now();
+    while (!stopRequested)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (std::chrono::steady_clock::now() - lastStats < std::chrono::seconds(statsInterval)) continue;
+        lastStats = std::chrono::steady_clock::now();
+        TraceServiceStats stats = service.takeStats();
+        if (stats.requests == 0) continue;
+        std::cout << server.getClientCount() << " clients, last " << statsInterval << " s: ";
+        stats.print();
+    }
+
+    std::cout << "Shutting down" << std::endl;
+    server.stop();
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,11 @@
 #include "../include/DataReader.h"
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <cstring>
 #include "../extra/nifti1.h"
+#include "../include/Kernels.h"
+#include "../include/VolumeAllocator.h"
 
 int readData(const char* filename, float*& data, int& dimX, int& dimY, int& dimZ) {
     // Open NIFTI file
@@ -38,7 +41,7 @@ int readData(const char* filename, float*& data, int& dimX, int& dimY, int& dimZ
     int numVoxels = dimX * dimY * dimZ;
 
     // Allocate memory for data
-    data = new float[numVoxels];
+    data = allocateVolumeArray<float>(numVoxels);
 
     // Skip to the data section if there's an extended header
     if (header.vox_offset > sizeof(nifti_1_header)) {
@@ -50,7 +53,7 @@ int readData(const char* filename, float*& data, int& dimX, int& dimY, int& dimZ
 
     if (!file.good()) {
         std::cerr << "Error: Failed to read scalar data" << std::endl;
-        delete[] data;
+        freeVolume(data);
         data = nullptr;
         file.close();
         return EXIT_FAILURE;
@@ -106,34 +109,27 @@ int readTensorData(const char* filename, float*& data, int& dimX, int& dimY, int
     }
 
     // Allocate memory for data (6 components per voxel)
-    data = new float[numVoxels * numComponents];
+    data = allocateVolumeArray<float>(numVoxels * numComponents);
 
+    // The file stores every component as a separate x-fastest volume, read it at once and reorder it
+    std::vector<float> planar((size_t)numVoxels * numComponents);
+    file.read(reinterpret_cast<char*>(planar.data()), planar.size() * sizeof(float));
+    getKernels().transposeComponents(planar.data(), data, dimX, dimY, dimZ, numComponents);
 
-    for (int v = 0; v < numComponents; v++)
+    for (size_t i = 0; i < planar.size(); i++)
     {
-        for (int k = 0; k < dimZ; k++)
-        {
-            for (int j = 0; j < dimY; j++)
-            {
-                for (int i = 0; i < dimX; i++)
-                {
-                    int index = i * (dimZ * dimY * numComponents) + j * (dimZ * numComponents) + k * numComponents + v;
-                    float value;
-                    file.read((char*)&value, sizeof(value));
-
-                    //error compensation for near zero values
-                    if (value != 0.0f && (value <= 0.00001f && value >= -0.00001f)) value = 0.0f;
-                    if (isnan(value)) value = 0.0f; //default to zero to make sure we keep proper vectors
-
-                    data[index] = value;
-                }
-            }
-        }
+        float value = data[i];
+
+        //error compensation for near zero values
+        if (value != 0.0f && (value <= 0.00001f && value >= -0.00001f)) value = 0.0f;
+        if (std::isnan(value)) value = 0.0f; //default to zero to make sure we keep proper vectors
+
+        data[i] = value;
     }
 
     if (!file.good()) {
         std::cerr << "Error: Failed to read tensor data" << std::endl;
-        delete[] data;
+        freeVolume(data);
         data = nullptr;
         file.close();
         return EXIT_FAILURE;
@@ -180,28 +176,16 @@ int readVectorData(const char* filename, float*& data, int& dimX, int& dimY, int
     int numComponents = 3; // Vector field (x, y, z components)
 
     // Allocate memory for data (3 components per voxel)
-    data = new float[numVoxels * numComponents];
-   
-    for (int v = 0; v < numComponents; v++)
-    {
-        for (int k = 0; k < dimZ; k++) 
-        {
-            for (int j = 0; j < dimY; j++) 
-            {
-                for (int i = 0; i < dimX; i++) 
-                {
-                    int index = i * (dimZ * dimY * numComponents) + j * (dimZ * numComponents) + k * numComponents + v;
-                    float value;
-                    file.read((char*)&value, sizeof(value));
-                    data[index] = value;
-                }
-            }
-        }
-    }
+    data = allocateVolumeArray<float>(numVoxels * numComponents);
+
+    // The file stores every component as a separate x-fastest volume, read it at once and reorder it
+    std::vector<float> planar((size_t)numVoxels * numComponents);
+    file.read(reinterpret_cast<char*>(planar.data()), planar.size() * sizeof(float));
+    getKernels().transposeComponents(planar.data(), data, dimX, dimY, dimZ, numComponents);
 
     if (!file.good()) {
         std::cerr << "Error: Failed to read vector data" << std::endl;
-        delete[] data;
+        freeVolume(data);
         data = nullptr;
         file.close();
         return EXIT_FAILURE;
@@ -0,0 +1,117 @@
+#include "../include/DatasetManager.h"
+#include "../include/VectorField.h"
+#include "../include/StreamlineRenderer.h"
+#include "../include/StreamlineBVH.h"
+#include <iostream>
+
+ResidentDataset::ResidentDataset() = default;
+
+//defined here, where the renderer and the hierarchy are complete types
+ResidentDataset::~ResidentDataset() = default;
+
+DatasetManager::DatasetManager(size_t budgetBytes)
+    : budgetBytes(budgetBytes)
+{
+}
+
+DatasetManager::~DatasetManager()
+{
+    clear();
+}
+
+ResidentDataset* DatasetManager::acquire(const char* dataset, bool useTensors)
+{
+    for (const auto& entry : datasets)
+    {
+        if (entry->data->getName() == dataset && entry->data->usesTensors() == useTensors)
+        {
+            entry->lastUsed = ++useCounter;
+            return entry.get();
+        }
+    }
+    return nullptr;
+}
+
+ResidentDataset* DatasetManager::insert(std::unique_ptr<ResidentDataset> entry)
+{
+    for (size_t i = 0; i < datasets.size(); i++)
+    {
+        if (datasets[i]->data->getName() == entry->data->getName()
+            && datasets[i]->data->usesTensors() == entry->data->usesTensors())
+        {
+            release(i);
+            break;
+        }
+    }
+
+    ResidentDataset* inserted = entry.get();
+    inserted->lastUsed = ++useCounter;
+    computeMemoryUse(inserted);
+    datasets.push_back(std::move(entry));
+    evict(inserted);
+    return inserted;
+}
+
+void DatasetManager::updateMemoryUse(ResidentDataset* entry)
+{
+    computeMemoryUse(entry);
+    evict(entry);
+}
+
+void DatasetManager::computeMemoryUse(ResidentDataset* entry)
+{
+    size_t numVoxels = (size_t)entry->data->getDimX() * entry->data->getDimY() * entry->data->getDimZ();
+
+    //scalars, vectors, FA, the zero mask and the picking hierarchy on the CPU; the texture (2 floats per voxel) and the vertices on the GPU
+    entry->cpuBytes = entry->data->getMemoryBytes();
+    if (entry->bvh) entry->cpuBytes += entry->bvh->getMemoryBytes();
+    entry->gpuBytes = numVoxels * 2 * sizeof(float);
+    if (entry->renderer) entry->gpuBytes += entry->renderer->getVertexCount() * 6 * sizeof(float) + entry->renderer->getRenderTargetBytes();
+}
+
+size_t DatasetManager::getTotalBytes() const
+{
+    size_t total = 0;
+    for (const auto& entry : datasets) total += entry->cpuBytes + entry->gpuBytes;
+    return total;
+}
+
+void DatasetManager::clear(ResidentDataset* keep)
+{
+    for (size_t i = datasets.size(); i-- > 0;)
+    {
+        if (datasets[i].get() != keep) release(i);
+    }
+}
+
+void DatasetManager::setBudget(size_t budgetBytes, ResidentDataset* keep)
+{
+    this->budgetBytes = budgetBytes;
+    evict(keep);
+}
+
+void DatasetManager::evict(ResidentDataset* keep)
+{
+    while (getTotalBytes() > budgetBytes)
+    {
+        //least recently used dataset that may be evicted
+        size_t victim = datasets.size();
+        for (size_t i = 0; i < datasets.size(); i++)
+        {
+            if (datasets[i].get() == keep) continue;
+            if (victim == datasets.size() || datasets[i]->lastUsed < datasets[victim]->lastUsed) victim = i;
+        }
+        if (victim == datasets.size()) break; //only the kept dataset is left
+        release(victim);
+    }
+}
+
+void DatasetManager::release(size_t index)
+{
+    const ResidentDataset* entry = datasets[index].get();
+    std::cout << "Evicting dataset " << entry->data->getName() << (entry->data->usesTensors() ? " (tensors)" : "")
+              << " (" << (entry->cpuBytes + entry->gpuBytes) / (1024 * 1024) << " MB)" << std::endl;
+
+    //the volumes are freed once a background snapshot save that still reads them is done
+    datasets.erase(datasets.begin() + index);
+}
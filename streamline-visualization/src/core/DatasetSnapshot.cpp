@@ -0,0 +1,84 @@
+#include "../include/DatasetSnapshot.h"
+#include "../include/VectorField.h"
+#include "../include/VolumeAllocator.h"
+#include "../include/SliceSeedIndex.h"
+#include <algorithm>
+
+float ScalarVolume::sample(float x, float y, float z) const
+{
+    if (!data || dimX <= 0 || dimY <= 0 || dimZ <= 0) return 0.0f;
+
+    // Ensure coordinates are within bounds
+    x = std::max(0.0f, std::min(x, static_cast<float>(dimX - 1.01f)));
+    y = std::max(0.0f, std::min(y, static_cast<float>(dimY - 1.01f)));
+    z = std::max(0.0f, std::min(z, static_cast<float>(dimZ - 1.01f)));
+
+    // Get integer coordinates for the 8 surrounding voxels
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int z0 = static_cast<int>(z);
+    int x1 = std::min(x0 + 1, dimX - 1);
+    int y1 = std::min(y0 + 1, dimY - 1);
+    int z1 = std::min(z0 + 1, dimZ - 1);
+
+    // Calculate interpolation weights
+    float wx = x - x0;
+    float wy = y - y0;
+    float wz = z - z0;
+
+    // Get values at the 8 surrounding voxels
+    float v000 = data[z0 * dimY * dimX + y0 * dimX + x0];
+    float v001 = data[z1 * dimY * dimX + y0 * dimX + x0];
+    float v010 = data[z0 * dimY * dimX + y1 * dimX + x0];
+    float v011 = data[z1 * dimY * dimX + y1 * dimX + x0];
+    float v100 = data[z0 * dimY * dimX + y0 * dimX + x1];
+    float v101 = data[z1 * dimY * dimX + y0 * dimX + x1];
+    float v110 = data[z0 * dimY * dimX + y1 * dimX + x1];
+    float v111 = data[z1 * dimY * dimX + y1 * dimX + x1];
+
+    // Perform trilinear interpolation
+    float v00 = v000 * (1 - wz) + v001 * wz;
+    float v01 = v010 * (1 - wz) + v011 * wz;
+    float v10 = v100 * (1 - wz) + v101 * wz;
+    float v11 = v110 * (1 - wz) + v111 * wz;
+
+    float v0 = v00 * (1 - wy) + v01 * wy;
+    float v1 = v10 * (1 - wy) + v11 * wy;
+
+    return v0 * (1 - wx) + v1 * wx;
+}
+
+DatasetSnapshot::DatasetSnapshot(const std::string& name, bool useTensors, std::shared_ptr<const float> scalarData, int dimX, int dimY, int dimZ,
+    std::unique_ptr<const VectorField> field, std::shared_ptr<const void> backing)
+    : name(name), useTensors(useTensors), backing(std::move(backing)), scalarOwner(std::move(scalarData)), vectorField(std::move(field))
+{
+    scalars.data = scalarOwner.get();
+    scalars.dimX = dimX;
+    scalars.dimY = dimY;
+    scalars.dimZ = dimZ;
+
+    //the snapshot never changes, so the slices are indexed once instead of on every regeneration
+    if (vectorField)
+    {
+        const VectorField& f = *vectorField;
+        seedIndex.reset(new SliceSeedIndex(f.getZeroMask(f.dimX, f.dimY, f.dimZ), f.dimX, f.dimY, f.dimZ));
+    }
+}
+
+DatasetSnapshot::~DatasetSnapshot()
+{
+    //members go in reverse order: the seed index, the field, the scalars and then the memory they may point into
+}
+
+size_t DatasetSnapshot::getMemoryBytes() const
+{
+    size_t bytes = (size_t)scalars.dimX * scalars.dimY * scalars.dimZ * sizeof(float);
+    if (vectorField) bytes += vectorField->getStorageBytes();
+    if (seedIndex) bytes += seedIndex->getMemoryBytes();
+    return bytes;
+}
+
+std::shared_ptr<const float> shareVolume(float* data)
+{
+    return std::shared_ptr<const float>(data, [](const float* p) { freeVolume(const_cast<float*>(p)); });
+}
@@ -0,0 +1,381 @@
+#include "../include/DistributedTracer.h"
+#include "../include/MessageBuffer.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+enum MessageTag {
+    TAG_START = 1, ///< Coordinator to rank: settings, slab bounds and seeds
+    TAG_HAND_OFF,  ///< Rank to rank: halves that entered the slab of the receiver
+    TAG_PIECES,    ///< Rank to coordinator: points traced in a slab
+    TAG_STOP,      ///< Coordinator to rank: every half is complete
+    TAG_STATS      ///< Rank to coordinator: what the rank did, its last message
+};
+
+/**
+ * Slab that contains x, the bounds as computeSlabBounds returns them.
+ */
+int getSlabOf(const std::vector<float>& bounds, float x)
+{
+    int numSlabs = (int)bounds.size() - 1;
+    return (int)(std::upper_bound(bounds.begin() + 1, bounds.begin() + numSlabs, x) - (bounds.begin() + 1));
+}
+
+/**
+ * Settings as they go over the wire, the method and interpolation by value instead of by pointer.
+ */
+void putParams(MessageWriter& writer, const TracerParams& params)
+{
+    writer.put(params.stepSize);
+    writer.put((int32_t)params.maxSteps);
+    writer.put(params.maxLength);
+    writer.put(params.maxAngle);
+    writer.put((uint8_t)(strcmp(params.integrationMethod, StreamlineTracer::EULER) == 0 ? 1 : 0));
+    writer.put((int32_t)params.interpolation);
+    writer.put((uint8_t)params.flipX);
+    writer.put((uint8_t)params.flipY);
+    writer.put((uint8_t)params.flipZ);
+}
+
+TracerParams getParams(MessageReader& reader)
+{
+    TracerParams params;
+    params.stepSize = reader.get<float>();
+    params.maxSteps = reader.get<int32_t>();
+    params.maxLength = reader.get<float>();
+    params.maxAngle = reader.get<float>();
+    params.integrationMethod = reader.get<uint8_t>() ? StreamlineTracer::EULER : StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+    params.interpolation = (InterpolationMode)reader.get<int32_t>();
+    params.flipX = reader.get<uint8_t>() != 0;
+    params.flipY = reader.get<uint8_t>() != 0;
+    params.flipZ = reader.get<uint8_t>() != 0;
+    params.level = 0;
+    return params;
+}
+
+/**
+ * The part of a half that is handed to the next rank.
+ */
+void putHandOff(MessageWriter& writer, const SlabHalf& half)
+{
+    writer.put(half.seedIndex);
+    writer.put(half.direction);
+    writer.put(half.step);
+    writer.put(half.prevPos);
+    writer.put(half.currentPos);
+}
+
+SlabHalf getHandOff(MessageReader& reader)
+{
+    SlabHalf half;
+    half.seedIndex = reader.get<uint32_t>();
+    half.direction = reader.get<int32_t>();
+    half.step = reader.get<int32_t>();
+    half.prevPos = reader.get<Point3D>();
+    half.currentPos = reader.get<Point3D>();
+    return half;
+}
+
+} // namespace
+
+void DistributedTraceStats::print() const
+{
+    std::cout << "Distributed trace: " << wallMs << " ms, halo " << halo << " voxels, " << messages << " messages, "
+              << bytes / (1024.0 * 1024.0) << " MB sent" << std::endl;
+    for (size_t r = 0; r < rankPoints.size(); r++)
+    {
+        std::cout << "  rank " << r + 1 << ": slab x [" << slabBounds[r] << ", " << slabBounds[r + 1] << "), "
+                  << rankSeeds[r] << " seeds, " << rankPoints[r] << " points, " << rankHandOffs[r] << " hand-offs, "
+                  << rankBusyMs[r] << " ms tracing" << std::endl;
+    }
+}
+
+std::vector<float> computeSlabBounds(const SliceSeedIndex& index, int dimX, int numSlabs)
+{
+    numSlabs = std::max(1, numSlabs);
+    size_t total = index.getVoxelCount();
+    std::vector<float> bounds;
+    bounds.push_back(-FLT_MAX);
+
+    //cut where the running count of masked voxels passes the next share
+    size_t count = 0;
+    int x = 0;
+    for (int slab = 1; slab < numSlabs; slab++)
+    {
+        size_t share = total * slab / numSlabs;
+        while (x < dimX - 1 && count + index.getSliceCount(AXIS_X, x) <= share) count += index.getSliceCount(AXIS_X, x++);
+        //the boundary lies between two voxel centers, and every slab keeps at least one slice
+        float bound = std::max(bounds.size() > 1 ? bounds.back() + 1.0f : 0.5f, x - 0.5f);
+        bounds.push_back(std::min(bound, dimX - 0.5f));
+    }
+    bounds.push_back(FLT_MAX);
+    return bounds;
+}
+
+int getSlabHalo(const TracerParams& params)
+{
+    //samples are taken within one step of the current point, the mask is read at the rounded point
+    int footprint = params.interpolation == INTERPOLATION_CUBIC_BSPLINE ? 2 : 1;
+    return (int)std::ceil(params.stepSize) + footprint;
+}
+
+std::vector<std::vector<Point3D>> runTraceCoordinator(TraceTransport& transport, const StreamlineTracer& tracer,
+    const std::vector<Point3D>& seeds, const TracerParams& params, DistributedTraceStats* stats)
+{
+    int numSlabs = transport.getSize() - 1;
+    if (numSlabs < 1) throw std::runtime_error("A distributed trace needs at least one tracing rank");
+    const VectorField* field = tracer.getDataset()->getVectorField();
+    std::vector<float> bounds = computeSlabBounds(*tracer.getDataset()->getSeedIndex(), field->dimX, numSlabs);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<char> startMessage;
+    MessageWriter writer(startMessage);
+    putParams(writer, params);
+    writer.putArray(bounds.data(), bounds.size());
+    writer.put((uint64_t)seeds.size());
+    writer.putArray(seeds.data(), seeds.size());
+    for (int rank = 1; rank <= numSlabs; rank++)
+    {
+        std::vector<char> copy = startMessage;
+        transport.send(rank, TAG_START, copy);
+    }
+
+    //a half is complete once it terminated and every piece of it arrived, pieces of one half can
+    //come from different ranks in any order
+    size_t numHalves = seeds.size() * 2;
+    std::vector<std::vector<Point3D>> halves(numHalves);
+    std::vector<int32_t> receivedPoints(numHalves, 0);
+    std::vector<int32_t> finalSteps(numHalves, -1);
+    size_t completeHalves = 0;
+
+    int source, tag;
+    std::vector<char> payload;
+    while (completeHalves < numHalves)
+    {
+        transport.receive(source, tag, payload, true);
+        if (tag == TRACE_RANK_CLOSED) throw std::runtime_error("Tracing rank " + std::to_string(source) + " exited before the trace was complete");
+        if (tag != TAG_PIECES) throw std::runtime_error("Unexpected message from a tracing rank");
+        MessageReader reader(payload);
+        uint64_t count = reader.get<uint64_t>();
+        for (uint64_t p = 0; p < count; p++)
+        {
+            uint32_t seedIndex = reader.get<uint32_t>();
+            int32_t direction = reader.get<int32_t>();
+            int32_t firstStep = reader.get<int32_t>();
+            int32_t numPoints = reader.get<int32_t>();
+            uint8_t stopped = reader.get<uint8_t>();
+            if (seedIndex >= seeds.size() || firstStep < 0 || numPoints < 0) throw std::runtime_error("Invalid piece");
+
+            size_t half = seedIndex * 2 + (direction > 0 ? 1 : 0);
+            std::vector<Point3D>& points = halves[half];
+            if (points.size() < (size_t)(firstStep + numPoints)) points.resize(firstStep + numPoints);
+            reader.getArray(points.data() + firstStep, numPoints);
+            receivedPoints[half] += numPoints;
+            if (stopped) finalSteps[half] = firstStep + numPoints;
+            if (finalSteps[half] >= 0 && receivedPoints[half] == finalSteps[half]) completeHalves++;
+        }
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    //every half is complete, so no rank has work left
+    for (int rank = 1; rank <= numSlabs; rank++)
+    {
+        std::vector<char> empty;
+        transport.send(rank, TAG_STOP, empty);
+    }
+    if (stats)
+    {
+        *stats = DistributedTraceStats();
+        stats->wallMs = wallMs;
+        stats->halo = getSlabHalo(params);
+        stats->slabBounds = bounds;
+        stats->rankSeeds.assign(numSlabs, 0);
+        stats->rankPoints.assign(numSlabs, 0);
+        stats->rankHandOffs.assign(numSlabs, 0);
+        stats->rankBusyMs.assign(numSlabs, 0.0);
+        stats->messages = transport.getMessagesSent();
+        stats->bytes = transport.getBytesSent();
+    }
+    std::vector<bool> finished(numSlabs + 1, false);
+    for (int received = 0; received < numSlabs;)
+    {
+        transport.receive(source, tag, payload, true);
+        if ((tag != TAG_STATS && tag != TRACE_RANK_CLOSED) || finished[source]) continue;
+        finished[source] = true;
+        received++;
+        if (!stats || tag != TAG_STATS) continue;
+        MessageReader reader(payload);
+        int slab = source - 1;
+        stats->rankSeeds[slab] = reader.get<uint64_t>();
+        stats->rankPoints[slab] = reader.get<uint64_t>();
+        stats->rankHandOffs[slab] = reader.get<uint64_t>();
+        stats->rankBusyMs[slab] = reader.get<double>();
+        stats->messages += reader.get<uint64_t>();
+        stats->bytes += reader.get<uint64_t>();
+    }
+
+    // Join the halves like traceStreamline and keep the streamlines with sufficient points, in seed order
+    std::vector<std::vector<Point3D>> streamlines;
+    for (size_t i = 0; i < seeds.size(); i++)
+    {
+        const std::vector<Point3D>& backward = halves[i * 2];
+        const std::vector<Point3D>& forward = halves[i * 2 + 1];
+        if (backward.size() + forward.size() + 1 <= 2) continue;
+
+        std::vector<Point3D> streamline;
+        streamline.reserve(backward.size() + forward.size() + 1);
+        streamline.insert(streamline.end(), backward.rbegin(), backward.rend());
+        streamline.push_back(seeds[i]);
+        streamline.insert(streamline.end(), forward.begin(), forward.end());
+        streamlines.push_back(std::move(streamline));
+    }
+    return streamlines;
+}
+
+int runTraceRank(TraceTransport& transport, const StreamlineTracer& tracer)
+{
+    const size_t batchSize = 4096; //halves traced between two looks at the incoming messages
+    int slab = transport.getRank() - 1;
+    int numSlabs = transport.getSize() - 1;
+
+    try
+    {
+        //hand-offs of ranks that started earlier may arrive before the seeds
+        int source, tag;
+        std::vector<char> payload;
+        std::vector<std::vector<char>> earlyHandOffs;
+        while (transport.receive(source, tag, payload, true) && tag != TAG_START)
+        {
+            if (tag == TRACE_RANK_CLOSED && source == 0) throw std::runtime_error("The coordinator exited");
+            if (tag == TAG_HAND_OFF) earlyHandOffs.push_back(payload);
+        }
+
+        MessageReader reader(payload);
+        TracerParams params = getParams(reader);
+        std::vector<float> bounds(numSlabs + 1);
+        reader.getArray(bounds.data(), bounds.size());
+        std::vector<Point3D> seeds(reader.get<uint64_t>());
+        reader.getArray(seeds.data(), seeds.size());
+        float xBegin = bounds[slab];
+        float xEnd = bounds[slab + 1];
+
+        //both halves of the seeds in this slab start here
+        std::vector<SlabHalf> pending;
+        uint64_t ownSeeds = 0;
+        for (size_t i = 0; i < seeds.size(); i++)
+        {
+            if (getSlabOf(bounds, seeds[i].x) != slab) continue;
+            ownSeeds++;
+            for (int direction = 1; direction >= -1; direction -= 2)
+            {
+                SlabHalf half;
+                half.seedIndex = (uint32_t)i;
+                half.direction = direction;
+                half.prevPos = half.currentPos = seeds[i];
+                pending.push_back(half);
+            }
+        }
+
+        for (const std::vector<char>& message : earlyHandOffs)
+        {
+            MessageReader handOffReader(message);
+            uint64_t count = handOffReader.get<uint64_t>();
+            for (uint64_t h = 0; h < count; h++) pending.push_back(getHandOff(handOffReader));
+        }
+
+        uint64_t points = 0, handOffs = 0;
+        double busyMs = 0.0;
+        std::vector<SlabHalf> batch;
+        std::vector<std::vector<char>> handOffMessages(numSlabs + 1);
+        std::vector<uint64_t> handOffCounts(numSlabs + 1);
+        bool stopping = false;
+        while (!stopping)
+        {
+            if (!pending.empty())
+            {
+                size_t count = std::min(batchSize, pending.size());
+                batch.assign(std::make_move_iterator(pending.end() - count), std::make_move_iterator(pending.end()));
+                pending.resize(pending.size() - count);
+
+                auto start = std::chrono::steady_clock::now();
+                tracer.traceHalvesInSlab(params, batch, xBegin, xEnd);
+                busyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                std::vector<char> pieces;
+                MessageWriter pieceWriter(pieces);
+                pieceWriter.put((uint64_t)batch.size());
+                for (SlabHalf& half : batch)
+                {
+                    //a NaN point is in no slab, it would have failed the mask check in a single process trace
+                    int owner = half.stopped ? slab : getSlabOf(bounds, half.currentPos.x);
+                    if (owner == slab) half.stopped = true;
+
+                    pieceWriter.put(half.seedIndex);
+                    pieceWriter.put(half.direction);
+                    pieceWriter.put((int32_t)(half.step - half.points.size()));
+                    pieceWriter.put((int32_t)half.points.size());
+                    pieceWriter.put((uint8_t)half.stopped);
+                    pieceWriter.putArray(half.points.data(), half.points.size());
+                    points += half.points.size();
+
+                    if (half.stopped) continue;
+                    MessageWriter handOffWriter(handOffMessages[owner + 1]);
+                    if (handOffCounts[owner + 1]++ == 0) handOffWriter.put((uint64_t)0); //count, filled in below
+                    putHandOff(handOffWriter, half);
+                    handOffs++;
+                }
+                transport.send(0, TAG_PIECES, pieces);
+                for (int rank = 1; rank <= numSlabs; rank++)
+                {
+                    if (handOffCounts[rank] == 0) continue;
+                    memcpy(handOffMessages[rank].data(), &handOffCounts[rank], sizeof(uint64_t));
+                    transport.send(rank, TAG_HAND_OFF, handOffMessages[rank]);
+                    handOffCounts[rank] = 0;
+                }
+            }
+
+            //take what arrived, waiting only when there is nothing left to trace
+            while (!stopping && transport.receive(source, tag, payload, pending.empty()))
+            {
+                if (tag == TAG_STOP)
+                {
+                    stopping = true;
+                }
+                else if (tag == TRACE_RANK_CLOSED && source == 0)
+                {
+                    throw std::runtime_error("The coordinator exited");
+                }
+                else if (tag == TAG_HAND_OFF)
+                {
+                    MessageReader handOffReader(payload);
+                    uint64_t count = handOffReader.get<uint64_t>();
+                    for (uint64_t h = 0; h < count; h++) pending.push_back(getHandOff(handOffReader));
+                }
+            }
+        }
+
+        std::vector<char> statsMessage;
+        MessageWriter statsWriter(statsMessage);
+        statsWriter.put(ownSeeds);
+        statsWriter.put(points);
+        statsWriter.put(handOffs);
+        statsWriter.put(busyMs);
+        statsWriter.put(transport.getMessagesSent());
+        statsWriter.put(transport.getBytesSent());
+        transport.send(0, TAG_STATS, statsMessage);
+        transport.flush();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Tracing rank " << transport.getRank() << " failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
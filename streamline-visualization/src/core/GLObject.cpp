@@ -0,0 +1,58 @@
+#include "../include/GLObject.h"
+#include "../extra/glad.h"
+
+//handles are only used on the thread that owns the GL context
+static int liveCount = 0;
+
+GLObject::GLObject(GLObjectType type)
+    : type(type)
+{
+    switch (type)
+    {
+    case GL_OBJECT_BUFFER: glGenBuffers(1, &id); break;
+    case GL_OBJECT_VERTEX_ARRAY: glGenVertexArrays(1, &id); break;
+    default: glGenTextures(1, &id); break;
+    }
+    if (id) liveCount++;
+}
+
+GLObject::~GLObject()
+{
+    reset();
+}
+
+GLObject::GLObject(GLObject&& other)
+    : type(other.type), id(other.id)
+{
+    other.id = 0;
+}
+
+GLObject& GLObject::operator=(GLObject&& other)
+{
+    if (this != &other)
+    {
+        reset();
+        type = other.type;
+        id = other.id;
+        other.id = 0;
+    }
+    return *this;
+}
+
+void GLObject::reset()
+{
+    if (!id) return;
+    switch (type)
+    {
+    case GL_OBJECT_BUFFER: glDeleteBuffers(1, &id); break;
+    case GL_OBJECT_VERTEX_ARRAY: glDeleteVertexArrays(1, &id); break;
+    default: glDeleteTextures(1, &id); break;
+    }
+    id = 0;
+    liveCount--;
+}
+
+int GLObject::getLiveCount()
+{
+    return liveCount;
+}
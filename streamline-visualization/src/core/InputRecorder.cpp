@@ -0,0 +1,80 @@
+#include "../include/InputRecorder.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+void InputRecorder::start(double now)
+{
+    actions.clear();
+    startTime = now;
+    recording = true;
+}
+
+void InputRecorder::stop()
+{
+    recording = false;
+}
+
+void InputRecorder::record(double now, const char* name, float v0, float v1, float v2)
+{
+    if (!recording) return;
+
+    InputAction action;
+    action.time = now - startTime;
+    action.name = name;
+    action.values[0] = v0;
+    action.values[1] = v1;
+    action.values[2] = v2;
+    actions.push_back(action);
+}
+
+int InputRecorder::save(const char* filename) const
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not create input recording " << filename << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    file.precision(9);
+    for (const InputAction& action : actions)
+    {
+        file << action.time << " " << action.name << " " << action.values[0] << " " << action.values[1] << " " << action.values[2] << "\n";
+    }
+    std::cout << "Saved " << actions.size() << " recorded actions to " << filename << std::endl;
+    return file ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int InputRecorder::load(const char* filename, std::vector<InputAction>& actions)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not open input recording " << filename << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    actions.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream stream(line);
+        InputAction action;
+        if (!(stream >> action.time >> action.name >> action.values[0] >> action.values[1] >> action.values[2]))
+        {
+            std::cerr << "Invalid action on line " << lineNumber << " of " << filename << std::endl;
+            return EXIT_FAILURE;
+        }
+        actions.push_back(action);
+    }
+
+    std::stable_sort(actions.begin(), actions.end(), [](const InputAction& a, const InputAction& b) { return a.time < b.time; });
+    return EXIT_SUCCESS;
+}
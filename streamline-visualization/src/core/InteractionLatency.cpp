@@ -0,0 +1,156 @@
+#include "../include/InteractionLatency.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+const char* getInteractionStageName(InteractionStage stage)
+{
+    switch (stage)
+    {
+    case STAGE_INPUT: return "Input";
+    case STAGE_SEEDED: return "Seeding";
+    case STAGE_TRACED: return "Tracing";
+    case STAGE_PACKED: return "Packing";
+    case STAGE_UPLOADED: return "Upload";
+    case STAGE_DISPLAYED: return "Display";
+    default: return "Unknown";
+    }
+}
+
+double Interaction::getStageMs(InteractionStage stage) const
+{
+    if (stage == STAGE_INPUT || !reached[stage]) return 0.0;
+
+    //the previous stage that was passed, the input is always passed
+    int previous = stage - 1;
+    while (previous > STAGE_INPUT && !reached[previous]) previous--;
+    return std::chrono::duration<double, std::milli>(times[stage] - times[previous]).count();
+}
+
+double Interaction::getTotalMs() const
+{
+    return std::chrono::duration<double, std::milli>(times[STAGE_DISPLAYED] - times[STAGE_INPUT]).count();
+}
+
+InteractionTracker::InteractionTracker()
+    : total(INTERACTION_HISTORY)
+{
+    for (LatencyStats& stats : stages) stats = LatencyStats(INTERACTION_HISTORY);
+}
+
+uint64_t InteractionTracker::begin(const std::string& name, Clock::time_point inputTime)
+{
+    Interaction interaction;
+    interaction.id = nextId++;
+    interaction.name = name;
+    interaction.times[STAGE_INPUT] = inputTime;
+    interaction.reached[STAGE_INPUT] = true;
+    pending.push_back(interaction);
+    return interaction.id;
+}
+
+void InteractionTracker::mark(InteractionStage stage)
+{
+    Clock::time_point now = Clock::now();
+    for (Interaction& interaction : pending)
+    {
+        interaction.times[stage] = now;
+        interaction.reached[stage] = true;
+    }
+}
+
+bool InteractionTracker::frameDrawn()
+{
+    if (pending.empty()) return false;
+    drawn.push_back(std::move(pending));
+    pending.clear();
+    return true;
+}
+
+void InteractionTracker::finishFrame(Clock::time_point displayed)
+{
+    if (drawn.empty()) return;
+    for (Interaction& interaction : drawn.front())
+    {
+        interaction.times[STAGE_DISPLAYED] = displayed;
+        interaction.reached[STAGE_DISPLAYED] = true;
+
+        double ms = interaction.getTotalMs();
+        total.add(ms);
+        auto named = perName.find(interaction.name);
+        if (named == perName.end()) named = perName.emplace(interaction.name, LatencyStats(INTERACTION_HISTORY)).first;
+        named->second.add(ms);
+        for (int stage = STAGE_SEEDED; stage < NUM_INTERACTION_STAGES; stage++)
+        {
+            if (interaction.reached[stage]) stages[stage].add(interaction.getStageMs((InteractionStage)stage));
+        }
+        finished.push_back(interaction);
+        if (finished.size() > INTERACTION_HISTORY) finished.pop_front();
+    }
+    drawn.pop_front();
+}
+
+int InteractionTracker::dump(const char* filename) const
+{
+    std::ofstream file(filename);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << filename << " for writing" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    //summary as comment lines, so the rest reads as a plain CSV table
+    file << "# Input to display: " << total.count() << " samples, p50 " << total.percentile(50.0) << " ms, p99 "
+         << total.percentile(99.0) << " ms, max " << total.maximum() << " ms\n";
+    for (int stage = STAGE_SEEDED; stage < NUM_INTERACTION_STAGES; stage++)
+    {
+        const LatencyStats& stats = stages[stage];
+        file << "# " << getInteractionStageName((InteractionStage)stage) << ": " << stats.count() << " samples, p50 "
+             << stats.percentile(50.0) << " ms, p99 " << stats.percentile(99.0) << " ms\n";
+    }
+
+    file << "id,name";
+    for (int stage = STAGE_SEEDED; stage < NUM_INTERACTION_STAGES; stage++) file << "," << getInteractionStageName((InteractionStage)stage) << " ms";
+    file << ",Total ms\n";
+
+    //skipped stages are left empty
+    for (const Interaction& interaction : finished)
+    {
+        file << interaction.id << "," << interaction.name;
+        for (int stage = STAGE_SEEDED; stage < NUM_INTERACTION_STAGES; stage++)
+        {
+            file << ",";
+            if (interaction.reached[stage]) file << interaction.getStageMs((InteractionStage)stage);
+        }
+        file << "," << interaction.getTotalMs() << "\n";
+    }
+
+    if (!file)
+    {
+        std::cerr << "Failed to write " << filename << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << finished.size() << " interaction latencies to " << filename << std::endl;
+    return EXIT_SUCCESS;
+}
+
+void InteractionTracker::print() const
+{
+    for (const auto& entry : perName)
+    {
+        entry.second.print(entry.first.c_str());
+    }
+    total.print("All inputs");
+    for (int stage = STAGE_SEEDED; stage < NUM_INTERACTION_STAGES; stage++)
+    {
+        if (stages[stage].count()) stages[stage].print(getInteractionStageName((InteractionStage)stage));
+    }
+}
+
+void InteractionTracker::clear()
+{
+    finished.clear();
+    total.clear();
+    for (LatencyStats& stats : stages) stats.clear();
+    perName.clear();
+}
@@ -0,0 +1,229 @@
+#include "../include/JobScheduler.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+const char* getJobClassName(JobClass jobClass)
+{
+    switch (jobClass)
+    {
+    case JOB_INTERACTIVE: return "Interactive";
+    case JOB_NORMAL: return "Normal";
+    case JOB_BACKGROUND: return "Background";
+    default: return "Unknown";
+    }
+}
+
+JobScheduler::JobScheduler(int numWorkers)
+{
+    numWorkers = std::max(1, numWorkers);
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+
+    //interactive work may use every worker and core, background work one worker and a quarter of the cores
+    maxRunning[JOB_INTERACTIVE] = numWorkers;
+    maxRunning[JOB_NORMAL] = std::max(1, numWorkers - 1);
+    maxRunning[JOB_BACKGROUND] = 1;
+    chunkThreads[JOB_INTERACTIVE] = 0;
+    chunkThreads[JOB_NORMAL] = std::max(1, cores / 2);
+    chunkThreads[JOB_BACKGROUND] = std::max(1, cores / 4);
+
+    workers.reserve(numWorkers);
+    for (int i = 0; i < numWorkers; i++) workers.push_back(std::thread(&JobScheduler::workerLoop, this));
+}
+
+JobScheduler::~JobScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (int c = 0; c < NUM_JOB_CLASSES; c++)
+        {
+            for (const JobHandle& job : queues[c]) finishJob(job, true);
+            queues[c].clear();
+        }
+    }
+    workAvailable.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+JobHandle JobScheduler::submit(JobClass jobClass, const char* name, std::function<bool()> step)
+{
+    JobHandle job = std::make_shared<ScheduledJob>();
+    job->jobClass = jobClass;
+    job->name = name;
+    job->step = std::move(step);
+    job->submitTime = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+        {
+            finishJob(job, true);
+            return job;
+        }
+        queues[jobClass].push_back(job);
+    }
+    workAvailable.notify_one();
+    return job;
+}
+
+void JobScheduler::wait(const JobHandle& job)
+{
+    if (!job) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    jobDone.wait(lock, [&job] { return job->isDone(); });
+}
+
+void JobScheduler::cancel(const JobHandle& job)
+{
+    if (!job) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (job->isDone()) return;
+    job->cancelled = true;
+
+    //a queued job is closed right away, a running one by its worker after the current chunk
+    std::deque<JobHandle>& queue = queues[job->jobClass];
+    auto it = std::find(queue.begin(), queue.end(), job);
+    if (it != queue.end())
+    {
+        queue.erase(it);
+        finishJob(job, true);
+    }
+}
+
+void JobScheduler::setConcurrencyLimit(JobClass jobClass, int limit)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxRunning[jobClass] = std::max(1, limit);
+    }
+    workAvailable.notify_all();
+}
+
+void JobScheduler::setChunkThreads(JobClass jobClass, int threads)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    chunkThreads[jobClass] = std::max(0, threads);
+}
+
+JobClassStats JobScheduler::takeStats(JobClass jobClass)
+{
+    JobClassStats taken;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::swap(taken, stats[jobClass]);
+    taken.queued = queues[jobClass].size();
+    taken.running = running[jobClass];
+    return taken;
+}
+
+void JobScheduler::clearStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int c = 0; c < NUM_JOB_CLASSES; c++) stats[c] = JobClassStats();
+}
+
+void JobScheduler::printStats()
+{
+    for (int c = 0; c < NUM_JOB_CLASSES; c++)
+    {
+        JobClassStats classStats = takeStats((JobClass)c);
+        std::string label = std::string(getJobClassName((JobClass)c)) + " queue wait";
+        classStats.queueWait.print(label.c_str());
+        std::cout << "  " << classStats.completed << " completed, " << classStats.cancelled << " cancelled, "
+                  << classStats.preempted << " preempted" << std::endl;
+    }
+}
+
+JobHandle JobScheduler::takeNextJob()
+{
+    for (int c = 0; c < NUM_JOB_CLASSES; c++)
+    {
+        if (queues[c].empty() || running[c] >= maxRunning[c]) continue;
+        JobHandle job = queues[c].front();
+        queues[c].pop_front();
+        running[c]++;
+        return job;
+    }
+    return nullptr;
+}
+
+void JobScheduler::finishJob(const JobHandle& job, bool wasCancelled)
+{
+    if (wasCancelled) stats[job->jobClass].cancelled++;
+    else stats[job->jobClass].completed++;
+    job->cancelled = wasCancelled;
+    job->step = nullptr; //release whatever the step captured
+    job->done = true;
+    jobDone.notify_all();
+}
+
+void JobScheduler::workerLoop()
+{
+#if defined(_OPENMP)
+    const int defaultThreads = omp_get_max_threads();
+#endif
+    std::unique_lock<std::mutex> lock(mutex);
+    JobHandle job;
+    while (true)
+    {
+        if (!job) workAvailable.wait(lock, [this, &job] { return stopping || (job = takeNextJob()) != nullptr; });
+        if (!job) return;
+
+        JobClass jobClass = job->jobClass;
+        if (!job->started)
+        {
+            job->started = true;
+            stats[jobClass].queueWait.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->submitTime).count());
+        }
+        int threads = chunkThreads[jobClass];
+
+        bool more = false;
+        if (!job->cancelled)
+        {
+            lock.unlock();
+#if defined(_OPENMP)
+            omp_set_num_threads(threads > 0 ? threads : defaultThreads);
+#endif
+            try
+            {
+                more = job->step();
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Job " << job->name << " failed: " << e.what() << std::endl;
+                job->cancelled = true;
+            }
+            lock.lock();
+        }
+        running[jobClass]--;
+
+        if (!more || job->cancelled || stopping)
+        {
+            finishJob(job, more || job->cancelled);
+        }
+        else
+        {
+            //back to the front of its queue: it continues right away unless a more urgent job waits
+            queues[jobClass].push_front(job);
+            JobHandle next = takeNextJob();
+            if (next != job)
+            {
+                stats[jobClass].preempted++;
+                if (next) workAvailable.notify_one(); //the preempted job may fit on another worker
+            }
+            job = next;
+            if (job) continue;
+        }
+        job = nullptr;
+        workAvailable.notify_one(); //a slot of the class is free again
+    }
+}
+
+JobScheduler& getJobScheduler()
+{
+    static JobScheduler scheduler;
+    return scheduler;
+}
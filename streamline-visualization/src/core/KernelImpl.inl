@@ -0,0 +1,411 @@
+// Kernel implementations shared by all instruction set variants.
+//
+// This file is included inside a different namespace by every Kernels*.cpp translation unit,
+// which are compiled with different instruction set flags. It must therefore only use plain
+// C functions and its own helpers: inline functions from other headers (std::min, glm, Eigen)
+// would be emitted with the instruction set of whichever translation unit the linker keeps.
+
+static inline float kMin(float a, float b) { return a < b ? a : b; }
+static inline float kMax(float a, float b) { return a > b ? a : b; }
+static inline int kMinI(int a, int b) { return a < b ? a : b; }
+static inline int kMaxI(int a, int b) { return a > b ? a : b; }
+static inline float kAbs(float a) { return a < 0.0f ? -a : a; }
+
+static void interpolateTrilinear(const float* data, int dimX, int dimY, int dimZ, float x, float y, float z, float* out)
+{
+    // Indices of the surrounding voxels, clamped so the cell stays inside the volume
+    int x0 = kMaxI(0, kMinI((int)x, dimX - 2));
+    int y0 = kMaxI(0, kMinI((int)y, dimY - 2));
+    int z0 = kMaxI(0, kMinI((int)z, dimZ - 2));
+    int x1 = kMinI(x0 + 1, dimX - 1);
+    int y1 = kMinI(y0 + 1, dimY - 1);
+    int z1 = kMinI(z0 + 1, dimZ - 1);
+
+    float wx = kMax(0.0f, kMin(1.0f, x - x0));
+    float wy = kMax(0.0f, kMin(1.0f, y - y0));
+    float wz = kMax(0.0f, kMin(1.0f, z - z0));
+
+    const float* c000 = data + 3 * (z0 + dimZ * (y0 + dimY * x0));
+    const float* c001 = data + 3 * (z1 + dimZ * (y0 + dimY * x0));
+    const float* c010 = data + 3 * (z0 + dimZ * (y1 + dimY * x0));
+    const float* c011 = data + 3 * (z1 + dimZ * (y1 + dimY * x0));
+    const float* c100 = data + 3 * (z0 + dimZ * (y0 + dimY * x1));
+    const float* c101 = data + 3 * (z1 + dimZ * (y0 + dimY * x1));
+    const float* c110 = data + 3 * (z0 + dimZ * (y1 + dimY * x1));
+    const float* c111 = data + 3 * (z1 + dimZ * (y1 + dimY * x1));
+
+    for (int c = 0; c < 3; c++)
+    {
+        float v00 = c000[c] + wz * (c001[c] - c000[c]);
+        float v01 = c010[c] + wz * (c011[c] - c010[c]);
+        float v10 = c100[c] + wz * (c101[c] - c100[c]);
+        float v11 = c110[c] + wz * (c111[c] - c110[c]);
+        float v0 = v00 + wy * (v01 - v00);
+        float v1 = v10 + wy * (v11 - v10);
+        out[c] = v0 + wx * (v1 - v0);
+    }
+}
+
+// Number of cyclic Jacobi sweeps, 3x3 float tensors converge in 4-5 sweeps
+static const int JACOBI_SWEEPS = 6;
+
+/**
+ * Apply one Jacobi rotation that zeroes A[p][q], accumulating the rotation in V.
+ */
+static inline void jacobiRotate(float A[3][3], float V[3][3], int p, int q)
+{
+    float apq = A[p][q];
+    if (apq == 0.0f) return;
+
+    float theta = (A[q][q] - A[p][p]) / (2.0f * apq);
+    float t = 1.0f / (kAbs(theta) + sqrtf(theta * theta + 1.0f));
+    if (theta < 0.0f) t = -t;
+    float c = 1.0f / sqrtf(t * t + 1.0f);
+    float s = t * c;
+
+    for (int k = 0; k < 3; k++)
+    {
+        float akp = A[k][p];
+        float akq = A[k][q];
+        A[k][p] = c * akp - s * akq;
+        A[k][q] = s * akp + c * akq;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        float apk = A[p][k];
+        float aqk = A[q][k];
+        A[p][k] = c * apk - s * aqk;
+        A[q][k] = s * apk + c * aqk;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        float vkp = V[k][p];
+        float vkq = V[k][q];
+        V[k][p] = c * vkp - s * vkq;
+        V[k][q] = s * vkp + c * vkq;
+    }
+}
+
+static void decomposeTensors(const float* tensors, size_t count, float* vectors, float* fa)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* t = tensors + 6 * i;
+        float* v = vectors + 3 * i;
+
+        if (t[0] == 0.0f && t[1] == 0.0f && t[2] == 0.0f && t[3] == 0.0f && t[4] == 0.0f && t[5] == 0.0f)
+        {
+            v[0] = v[1] = v[2] = 0.0f;
+            if (fa) fa[i] = 0.0f;
+            continue;
+        }
+
+        float A[3][3] = {
+            { t[0], t[3], t[4] },
+            { t[3], t[1], t[5] },
+            { t[4], t[5], t[2] }
+        };
+        float V[3][3] = {
+            { 1.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f }
+        };
+
+        for (int sweep = 0; sweep < JACOBI_SWEEPS; sweep++)
+        {
+            jacobiRotate(A, V, 0, 1);
+            jacobiRotate(A, V, 0, 2);
+            jacobiRotate(A, V, 1, 2);
+        }
+
+        // The major eigenvector belongs to the largest eigenvalue
+        float l0 = A[0][0], l1 = A[1][1], l2 = A[2][2];
+        int major = (l0 >= l1 && l0 >= l2) ? 0 : (l1 >= l2 ? 1 : 2);
+        v[0] = V[0][major];
+        v[1] = V[1][major];
+        v[2] = V[2][major];
+
+        if (fa)
+        {
+            // fractional anisotropy: sqrt(1/2) * |l - mean| / |l|
+            float norm = l0 * l0 + l1 * l1 + l2 * l2;
+            float d = (l0 - l1) * (l0 - l1) + (l1 - l2) * (l1 - l2) + (l2 - l0) * (l2 - l0);
+            fa[i] = norm > 0.0f ? kMin(1.0f, sqrtf(0.5f * d / norm)) : 0.0f;
+        }
+    }
+}
+
+static void transposeComponents(const float* planar, float* interleaved, int dimX, int dimY, int dimZ, int numComponents)
+{
+    // Walk the output contiguously so the writes stream, the reads stride by dimX * dimY * dimZ per component
+    size_t componentStride = (size_t)dimX * dimY * dimZ;
+    for (int x = 0; x < dimX; x++)
+    {
+        for (int y = 0; y < dimY; y++)
+        {
+            const float* column = planar + (size_t)y * dimX + x;
+            float* out = interleaved + (size_t)numComponents * dimZ * (y + (size_t)dimY * x);
+            for (int z = 0; z < dimZ; z++)
+            {
+                const float* src = column + (size_t)z * dimY * dimX;
+                for (int v = 0; v < numComponents; v++)
+                {
+                    out[z * numComponents + v] = src[v * componentStride];
+                }
+            }
+        }
+    }
+}
+
+static void packVertices(const float* points, size_t count, float* vertices)
+{
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    for (size_t j = 0; j < count; j++)
+    {
+        const float* p = points + 3 * j;
+
+        // color based on the direction to the next point, the last point keeps the previous color
+        if (j + 1 < count)
+        {
+            r = kAbs(p[3] - p[0]);
+            g = kAbs(p[4] - p[1]);
+            b = kAbs(p[5] - p[2]);
+            float l = sqrtf(r * r + g * g + b * b);
+            if (l > 0.0f)
+            {
+                r /= l;
+                g /= l;
+                b /= l;
+            }
+        }
+
+        float* vert = vertices + 6 * j;
+        vert[0] = p[0];
+        vert[1] = p[1];
+        vert[2] = p[2];
+        vert[3] = r;
+        vert[4] = g;
+        vert[5] = b;
+    }
+}
+
+static void packScalarMaskTexture(const float* scalars, const bool* mask, float* texels, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        texels[2 * i] = scalars[i];
+        texels[2 * i + 1] = mask[i] ? 1.0f : 0.0f;
+    }
+}
+
+static void filterRange(const float* values, size_t count, float minValue, float maxValue, unsigned char* mask)
+{
+    // Branch free so the compiler can vectorize the compare and the and
+    for (size_t i = 0; i < count; i++)
+    {
+        float v = values[i];
+        mask[i] &= (unsigned char)((v >= minValue) & (v <= maxValue));
+    }
+}
+
+// Octahedral quantized vector storage: two signed normalized direction coordinates and an
+// unsigned normalized magnitude per voxel. The octahedral helpers come from OctahedralEncoding.h,
+// which every Kernels*.cpp includes before this file; they are static, so they are compiled
+// with the instruction set of the including translation unit as well.
+
+template <typename Direction, typename Magnitude>
+static void encodeOctahedral(const float* vectors, size_t count, float maxMagnitude, int directionMax, int magnitudeMax,
+    Direction* directions, Magnitude* magnitudes)
+{
+    float magnitudeScale = maxMagnitude > 0.0f ? magnitudeMax / maxMagnitude : 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* v = vectors + 3 * i;
+        float u, w;
+        octEncode(v[0], v[1], v[2], u, w);
+        directions[2 * i] = (Direction)octQuantize(u, directionMax);
+        directions[2 * i + 1] = (Direction)octQuantize(w, directionMax);
+
+        //nonzero vectors never round to a zero magnitude, so the zero mask is unchanged by the quantization
+        float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        int m = (int)(length * magnitudeScale + 0.5f);
+        if (length > 0.0f && m == 0) m = 1;
+        magnitudes[i] = (Magnitude)kMinI(m, magnitudeMax);
+    }
+}
+
+static void encodeOctahedral16(const float* vectors, size_t count, float maxMagnitude, short* directions, unsigned short* magnitudes)
+{
+    encodeOctahedral(vectors, count, maxMagnitude, 32767, 65535, directions, magnitudes);
+}
+
+static void encodeOctahedral8(const float* vectors, size_t count, float maxMagnitude, signed char* directions, unsigned char* magnitudes)
+{
+    encodeOctahedral(vectors, count, maxMagnitude, 127, 255, directions, magnitudes);
+}
+
+template <typename Direction, typename Magnitude>
+static inline void decodeOctahedralVoxel(const Direction* directions, const Magnitude* magnitudes, int index,
+    float directionScale, float magnitudeScale, float* out)
+{
+    float m = magnitudes[index] * magnitudeScale;
+    octDecode(directions[2 * index] * directionScale, directions[2 * index + 1] * directionScale, out);
+    out[0] *= m;
+    out[1] *= m;
+    out[2] *= m;
+}
+
+template <typename Direction, typename Magnitude>
+static void interpolateTrilinearOctahedral(const Direction* directions, const Magnitude* magnitudes, float directionScale, float magnitudeScale,
+    int dimX, int dimY, int dimZ, float x, float y, float z, float* out)
+{
+    int x0 = kMaxI(0, kMinI((int)x, dimX - 2));
+    int y0 = kMaxI(0, kMinI((int)y, dimY - 2));
+    int z0 = kMaxI(0, kMinI((int)z, dimZ - 2));
+    int x1 = kMinI(x0 + 1, dimX - 1);
+    int y1 = kMinI(y0 + 1, dimY - 1);
+    int z1 = kMinI(z0 + 1, dimZ - 1);
+
+    float wx = kMax(0.0f, kMin(1.0f, x - x0));
+    float wy = kMax(0.0f, kMin(1.0f, y - y0));
+    float wz = kMax(0.0f, kMin(1.0f, z - z0));
+
+    //decode the 8 corners, then interpolate like the float field
+    float c[8][3];
+    decodeOctahedralVoxel(directions, magnitudes, z0 + dimZ * (y0 + dimY * x0), directionScale, magnitudeScale, c[0]);
+    decodeOctahedralVoxel(directions, magnitudes, z1 + dimZ * (y0 + dimY * x0), directionScale, magnitudeScale, c[1]);
+    decodeOctahedralVoxel(directions, magnitudes, z0 + dimZ * (y1 + dimY * x0), directionScale, magnitudeScale, c[2]);
+    decodeOctahedralVoxel(directions, magnitudes, z1 + dimZ * (y1 + dimY * x0), directionScale, magnitudeScale, c[3]);
+    decodeOctahedralVoxel(directions, magnitudes, z0 + dimZ * (y0 + dimY * x1), directionScale, magnitudeScale, c[4]);
+    decodeOctahedralVoxel(directions, magnitudes, z1 + dimZ * (y0 + dimY * x1), directionScale, magnitudeScale, c[5]);
+    decodeOctahedralVoxel(directions, magnitudes, z0 + dimZ * (y1 + dimY * x1), directionScale, magnitudeScale, c[6]);
+    decodeOctahedralVoxel(directions, magnitudes, z1 + dimZ * (y1 + dimY * x1), directionScale, magnitudeScale, c[7]);
+
+    for (int k = 0; k < 3; k++)
+    {
+        float v00 = c[0][k] + wz * (c[1][k] - c[0][k]);
+        float v01 = c[2][k] + wz * (c[3][k] - c[2][k]);
+        float v10 = c[4][k] + wz * (c[5][k] - c[4][k]);
+        float v11 = c[6][k] + wz * (c[7][k] - c[6][k]);
+        float v0 = v00 + wy * (v01 - v00);
+        float v1 = v10 + wy * (v11 - v10);
+        out[k] = v0 + wx * (v1 - v0);
+    }
+}
+
+static void interpolateTrilinearOctahedral16(const short* directions, const unsigned short* magnitudes, float maxMagnitude,
+    int dimX, int dimY, int dimZ, float x, float y, float z, float* out)
+{
+    interpolateTrilinearOctahedral(directions, magnitudes, 1.0f / 32767.0f, maxMagnitude / 65535.0f, dimX, dimY, dimZ, x, y, z, out);
+}
+
+static void interpolateTrilinearOctahedral8(const signed char* directions, const unsigned char* magnitudes, float maxMagnitude,
+    int dimX, int dimY, int dimZ, float x, float y, float z, float* out)
+{
+    interpolateTrilinearOctahedral(directions, magnitudes, 1.0f / 127.0f, maxMagnitude / 255.0f, dimX, dimY, dimZ, x, y, z, out);
+}
+
+// Cubic B-spline interpolation on prefiltered coefficients (Unser et al., "B-spline signal processing")
+
+// Pole of the cubic B-spline prefilter, sqrt(3) - 2
+static const float BSPLINE_POLE = -0.26794919243f;
+
+static void prefilterBSpline(float* data, int count, size_t stride, int width)
+{
+    if (count < 2) return;
+    const float z = BSPLINE_POLE;
+    const float gain = (1.0f - z) * (1.0f - 1.0f / z); //6 for the cubic B-spline
+
+    //the inner loops run over width contiguous, independent signals, so they vectorize
+    for (int k = 0; k < count; k++)
+    {
+        float* s = data + k * stride;
+        for (int w = 0; w < width; w++) s[w] *= gain;
+    }
+
+    //causal initialization with mirror boundaries, truncated where z^k drops below float precision
+    int horizon = kMinI(count, 12);
+    float zk = z;
+    for (int k = 1; k < horizon; k++)
+    {
+        const float* s = data + k * stride;
+        for (int w = 0; w < width; w++) data[w] += zk * s[w];
+        zk *= z;
+    }
+
+    //causal filter
+    for (int k = 1; k < count; k++)
+    {
+        float* s = data + k * stride;
+        const float* prev = s - stride;
+        for (int w = 0; w < width; w++) s[w] += z * prev[w];
+    }
+
+    //anticausal initialization and filter
+    float* last = data + (count - 1) * stride;
+    const float* beforeLast = last - stride;
+    for (int w = 0; w < width; w++) last[w] = (z / (z * z - 1.0f)) * (last[w] + z * beforeLast[w]);
+    for (int k = count - 2; k >= 0; k--)
+    {
+        float* s = data + k * stride;
+        const float* next = s + stride;
+        for (int w = 0; w < width; w++) s[w] = z * (next[w] - s[w]);
+    }
+}
+
+static inline int mirrorIndex(int i, int dim)
+{
+    if (i < 0) i = -i;
+    if (i >= dim) i = 2 * (dim - 1) - i;
+    return kMaxI(0, kMinI(i, dim - 1));
+}
+
+static inline void bsplineWeights(float t, float* w)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    float u = 1.0f - t;
+    w[0] = u * u * u * (1.0f / 6.0f);
+    w[1] = (3.0f * t3 - 6.0f * t2 + 4.0f) * (1.0f / 6.0f);
+    w[2] = (-3.0f * t3 + 3.0f * t2 + 3.0f * t + 1.0f) * (1.0f / 6.0f);
+    w[3] = t3 * (1.0f / 6.0f);
+}
+
+static void interpolateCubicBSpline(const float* coefficients, int dimX, int dimY, int dimZ, float x, float y, float z, float* out)
+{
+    int ix = (int)x; if (x < ix) ix--;
+    int iy = (int)y; if (y < iy) iy--;
+    int iz = (int)z; if (z < iz) iz--;
+
+    float wx[4], wy[4], wz[4];
+    bsplineWeights(x - ix, wx);
+    bsplineWeights(y - iy, wy);
+    bsplineWeights(z - iz, wz);
+
+    int zi[4];
+    for (int k = 0; k < 4; k++) zi[k] = mirrorIndex(iz - 1 + k, dimZ);
+
+    //64 taps, 4x4 z columns weighted by the x and y weights
+    float sum[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 4; i++)
+    {
+        int xi = mirrorIndex(ix - 1 + i, dimX);
+        for (int j = 0; j < 4; j++)
+        {
+            int yi = mirrorIndex(iy - 1 + j, dimY);
+            const float* column = coefficients + 3 * (size_t)dimZ * (yi + (size_t)dimY * xi);
+            float wxy = wx[i] * wy[j];
+            for (int k = 0; k < 4; k++)
+            {
+                const float* c = column + 3 * zi[k];
+                float w = wxy * wz[k];
+                sum[0] += w * c[0];
+                sum[1] += w * c[1];
+                sum[2] += w * c[2];
+            }
+        }
+    }
+    out[0] = sum[0];
+    out[1] = sum[1];
+    out[2] = sum[2];
+}
@@ -0,0 +1,356 @@
+#include "../include/Kernels.h"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <math.h>
+#include "../include/OctahedralEncoding.h"
+#include <Eigen/Dense>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VCP_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Scalar variant, compiled with the baseline instruction set of the build
+namespace scalar_kernels {
+#include "KernelImpl.inl"
+}
+
+static bool scalarSupported(const CpuFeatures& features)
+{
+    (void)features;
+    return true;
+}
+
+const KernelSet& getScalarKernels()
+{
+    static const KernelSet kernels = {
+        "Scalar",
+        scalarSupported,
+        scalar_kernels::interpolateTrilinear,
+        scalar_kernels::decomposeTensors,
+        scalar_kernels::transposeComponents,
+        scalar_kernels::packVertices,
+        scalar_kernels::packScalarMaskTexture,
+        scalar_kernels::filterRange,
+        scalar_kernels::encodeOctahedral16,
+        scalar_kernels::encodeOctahedral8,
+        scalar_kernels::interpolateTrilinearOctahedral16,
+        scalar_kernels::interpolateTrilinearOctahedral8,
+        scalar_kernels::prefilterBSpline,
+        scalar_kernels::interpolateCubicBSpline
+    };
+    return kernels;
+}
+
+#if defined(VCP_X86)
+/**
+ * Execute the cpuid instruction for a leaf and subleaf.
+ */
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned int)info[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/**
+ * Read the XCR0 register, which tells which register states the operating system saves.
+ */
+static unsigned long long readXcr0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+const CpuFeatures& getCpuFeatures()
+{
+    static const CpuFeatures features = []() {
+        CpuFeatures f;
+#if defined(VCP_X86)
+        unsigned int regs[4];
+        cpuid(0, 0, regs);
+        unsigned int maxLeaf = regs[0];
+
+        cpuid(1, 0, regs);
+        bool osxsave = (regs[2] & (1u << 27)) != 0;
+        bool avx = (regs[2] & (1u << 28)) != 0;
+        f.fma = (regs[2] & (1u << 12)) != 0;
+
+        //the OS has to save the YMM (and for AVX-512 the ZMM and mask) registers on context switches
+        unsigned long long xcr0 = osxsave ? readXcr0() : 0;
+        bool osAvx = avx && (xcr0 & 0x6) == 0x6;
+        bool osAvx512 = osAvx && (xcr0 & 0xE0) == 0xE0;
+
+        if (maxLeaf >= 7)
+        {
+            cpuid(7, 0, regs);
+            f.avx2 = osAvx && (regs[1] & (1u << 5)) != 0;
+            f.avx512f = osAvx512 && (regs[1] & (1u << 16)) != 0;
+            f.avx512dq = osAvx512 && (regs[1] & (1u << 17)) != 0;
+            f.avx512bw = osAvx512 && (regs[1] & (1u << 30)) != 0;
+            f.avx512vl = osAvx512 && (regs[1] & (1u << 31)) != 0;
+        }
+        f.fma = f.fma && osAvx;
+#elif defined(__aarch64__) || defined(_M_ARM64)
+        f.neon = true;
+#endif
+        return f;
+    }();
+    return features;
+}
+
+/**
+ * All kernel sets compiled into this binary, from most to least preferred.
+ */
+static std::vector<const KernelSet*> getCompiledKernelSets()
+{
+    std::vector<const KernelSet*> sets;
+#if defined(VCP_HAVE_AVX512_KERNELS)
+    sets.push_back(&getAVX512Kernels());
+#endif
+#if defined(VCP_HAVE_AVX2_KERNELS)
+    sets.push_back(&getAVX2Kernels());
+#endif
+    sets.push_back(&getScalarKernels());
+    return sets;
+}
+
+std::vector<const KernelSet*> getAvailableKernelSets()
+{
+    std::vector<const KernelSet*> available;
+    for (const KernelSet* set : getCompiledKernelSets())
+    {
+        if (set->isSupported(getCpuFeatures())) available.push_back(set);
+    }
+    return available;
+}
+
+const KernelSet& getKernels()
+{
+    static const KernelSet* selected = []() {
+        std::vector<const KernelSet*> available = getAvailableKernelSets();
+        const KernelSet* choice = available.front();
+
+        //allow forcing a specific variant, e.g. to compare results between machines
+        const char* forced = std::getenv("VCP_KERNELS");
+        if (forced)
+        {
+            bool found = false;
+            for (const KernelSet* set : available)
+            {
+#if defined(_MSC_VER)
+                if (_stricmp(set->name, forced) == 0)
+#else
+                if (strcasecmp(set->name, forced) == 0)
+#endif
+                {
+                    choice = set;
+                    found = true;
+                }
+            }
+            if (!found) std::cerr << "Kernel set " << forced << " is not available on this machine, ignoring VCP_KERNELS" << std::endl;
+        }
+
+        std::cout << "Using " << choice->name << " kernels" << std::endl;
+        return choice;
+    }();
+    return *selected;
+}
+
+/**
+ * Time a callable and return the elapsed time in milliseconds.
+ */
+template <typename F>
+static double timeMs(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Largest absolute difference between two arrays, used to compare variants to the scalar kernels.
+ */
+static float maxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) diff = std::max(diff, std::abs(a[i] - b[i]));
+    return diff;
+}
+
+void runKernelBenchmarks()
+{
+    const int dim = 128;
+    const size_t numVoxels = (size_t)dim * dim * dim;
+    const size_t numSamples = 1 << 20;
+
+    //synthetic inputs with a fixed seed so every variant sees the same data
+    std::srand(42);
+    auto random = []() { return (float)std::rand() / RAND_MAX; };
+
+    std::vector<float> field(numVoxels * 3);
+    for (float& v : field) v = random() * 2.0f - 1.0f;
+    std::vector<float> samples(numSamples * 3);
+    for (float& v : samples) v = random() * (dim - 1);
+    std::vector<float> tensors(numVoxels * 6);
+    for (size_t i = 0; i < numVoxels; i++)
+    {
+        //diagonally dominant so the tensors are positive definite like diffusion tensors
+        for (int c = 0; c < 3; c++) tensors[6 * i + c] = 1.0f + random();
+        for (int c = 3; c < 6; c++) tensors[6 * i + c] = random() * 0.5f - 0.25f;
+    }
+    std::vector<float> scalars(numVoxels);
+    for (float& v : scalars) v = random();
+    std::vector<char> maskStorage(numVoxels);
+    for (char& m : maskStorage) m = random() > 0.5f;
+    const bool* mask = reinterpret_cast<const bool*>(maskStorage.data());
+
+    const CpuFeatures& f = getCpuFeatures();
+    std::cout << "CPU features: AVX2 " << f.avx2 << ", FMA " << f.fma << ", AVX-512F " << f.avx512f << ", AVX-512VL " << f.avx512vl
+              << ", AVX-512BW " << f.avx512bw << ", AVX-512DQ " << f.avx512dq << ", NEON " << f.neon << std::endl;
+
+    std::vector<float> reference[6];
+    bool haveReference = false;
+
+    //the scalar kernels are last in the list, so run in reverse to get the reference first
+    std::vector<const KernelSet*> sets = getAvailableKernelSets();
+    for (auto it = sets.rbegin(); it != sets.rend(); ++it)
+    {
+        const KernelSet& k = **it;
+        std::vector<float> results[6];
+
+        results[0].resize(numSamples * 3);
+        double interpolateMs = timeMs([&]() {
+            for (size_t i = 0; i < numSamples; i++)
+            {
+                k.interpolateTrilinear(field.data(), dim, dim, dim, samples[3 * i], samples[3 * i + 1], samples[3 * i + 2], &results[0][3 * i]);
+            }
+        });
+
+        results[1].resize(numVoxels * 4);
+        double decomposeMs = timeMs([&]() { k.decomposeTensors(tensors.data(), numVoxels, results[1].data(), results[1].data() + numVoxels * 3); });
+
+        results[2].resize(numVoxels * 3);
+        double transposeMs = timeMs([&]() { k.transposeComponents(field.data(), results[2].data(), dim, dim, dim, 3); });
+
+        results[3].resize(numSamples * 6);
+        double packMs = timeMs([&]() { k.packVertices(samples.data(), numSamples, results[3].data()); });
+
+        results[4].resize(numVoxels * 2);
+        double textureMs = timeMs([&]() { k.packScalarMaskTexture(scalars.data(), mask, results[4].data(), numVoxels); });
+
+        std::vector<unsigned char> visible(numVoxels, 1);
+        double filterMs = timeMs([&]() { k.filterRange(scalars.data(), numVoxels, 0.25f, 0.75f, visible.data()); });
+        results[5].assign(visible.begin(), visible.end());
+
+        //quantized storage, timed against the float interpolation above
+        std::vector<short> directions16(numVoxels * 2);
+        std::vector<unsigned short> magnitudes16(numVoxels);
+        std::vector<signed char> directions8(numVoxels * 2);
+        std::vector<unsigned char> magnitudes8(numVoxels);
+        const float maxMagnitude = std::sqrt(3.0f);
+        double encodeMs = timeMs([&]() {
+            k.encodeOctahedral16(field.data(), numVoxels, maxMagnitude, directions16.data(), magnitudes16.data());
+            k.encodeOctahedral8(field.data(), numVoxels, maxMagnitude, directions8.data(), magnitudes8.data());
+        });
+        std::vector<float> quantized(numSamples * 3);
+        double interpolate16Ms = timeMs([&]() {
+            for (size_t i = 0; i < numSamples; i++)
+            {
+                k.interpolateTrilinearOctahedral16(directions16.data(), magnitudes16.data(), maxMagnitude, dim, dim, dim,
+                    samples[3 * i], samples[3 * i + 1], samples[3 * i + 2], &quantized[3 * i]);
+            }
+        });
+        float error16 = maxDifference(quantized, results[0]);
+        double interpolate8Ms = timeMs([&]() {
+            for (size_t i = 0; i < numSamples; i++)
+            {
+                k.interpolateTrilinearOctahedral8(directions8.data(), magnitudes8.data(), maxMagnitude, dim, dim, dim,
+                    samples[3 * i], samples[3 * i + 1], samples[3 * i + 2], &quantized[3 * i]);
+            }
+        });
+        float error8 = maxDifference(quantized, results[0]);
+
+        //cubic B-spline: prefilter a copy of the field along z, y and x, then evaluate with 64 taps
+        std::vector<float> coefficients = field;
+        const size_t zColumn = (size_t)3 * dim;
+        double prefilterMs = timeMs([&]() {
+            for (int row = 0; row < dim * dim; row++) k.prefilterBSpline(coefficients.data() + zColumn * row, dim, 3, 3);
+            for (int x = 0; x < dim; x++) k.prefilterBSpline(coefficients.data() + zColumn * dim * x, dim, zColumn, (int)zColumn);
+            for (int y = 0; y < dim; y++) k.prefilterBSpline(coefficients.data() + zColumn * y, dim, zColumn * dim, (int)zColumn);
+        });
+        double cubicMs = timeMs([&]() {
+            for (size_t i = 0; i < numSamples; i++)
+            {
+                k.interpolateCubicBSpline(coefficients.data(), dim, dim, dim, samples[3 * i], samples[3 * i + 1], samples[3 * i + 2], &quantized[3 * i]);
+            }
+        });
+
+        std::cout << k.name << " kernels:" << std::endl
+                  << "  interpolateTrilinear:  " << interpolateMs << " ms (" << numSamples / interpolateMs / 1000.0 << " M samples/s)" << std::endl
+                  << "  decomposeTensors:      " << decomposeMs << " ms (" << numVoxels / decomposeMs / 1000.0 << " M tensors/s)" << std::endl
+                  << "  transposeComponents:   " << transposeMs << " ms" << std::endl
+                  << "  packVertices:          " << packMs << " ms" << std::endl
+                  << "  packScalarMaskTexture: " << textureMs << " ms" << std::endl
+                  << "  filterRange:           " << filterMs << " ms (" << numVoxels / filterMs / 1000.0 << " M values/s)" << std::endl
+                  << "  encodeOctahedral16+8:  " << encodeMs << " ms" << std::endl
+                  << "  interpolateOctahedral16: " << interpolate16Ms << " ms (" << numSamples / interpolate16Ms / 1000.0 << " M samples/s, "
+                  << interpolateMs / interpolate16Ms << "x float, max component error " << error16 << ")" << std::endl
+                  << "  interpolateOctahedral8:  " << interpolate8Ms << " ms (" << numSamples / interpolate8Ms / 1000.0 << " M samples/s, "
+                  << interpolateMs / interpolate8Ms << "x float, max component error " << error8 << ")" << std::endl
+                  << "  prefilterBSpline:      " << prefilterMs << " ms" << std::endl
+                  << "  interpolateCubicBSpline: " << cubicMs << " ms (" << numSamples / cubicMs / 1000.0 << " M samples/s, "
+                  << interpolateMs / cubicMs << "x trilinear)" << std::endl;
+
+        if (haveReference)
+        {
+            const char* names[6] = { "interpolateTrilinear", "decomposeTensors", "transposeComponents", "packVertices", "packScalarMaskTexture", "filterRange" };
+            for (int i = 0; i < 6; i++)
+            {
+                std::cout << "  max difference to scalar in " << names[i] << ": " << maxDifference(results[i], reference[i]) << std::endl;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < 6; i++) reference[i] = results[i];
+            haveReference = true;
+        }
+    }
+
+    //check the eigensolver against Eigen on a subset of the tensors
+    const size_t numChecked = 10000;
+    std::vector<float> vectors(numChecked * 3);
+    getKernels().decomposeTensors(tensors.data(), numChecked, vectors.data(), nullptr);
+    double maxAngle = 0.0;
+    for (size_t i = 0; i < numChecked; i++)
+    {
+        const float* t = &tensors[6 * i];
+        Eigen::Matrix3f tensor;
+        tensor << t[0], t[3], t[4],
+                  t[3], t[1], t[5],
+                  t[4], t[5], t[2];
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eigensolver(tensor);
+        Eigen::Vector3f expected = eigensolver.eigenvectors().col(2);
+        Eigen::Vector3f actual(vectors[3 * i], vectors[3 * i + 1], vectors[3 * i + 2]);
+        double cosAngle = std::min(1.0f, std::abs(expected.dot(actual)));  //eigenvectors have no sign
+        maxAngle = std::max(maxAngle, std::acos(cosAngle) * 180.0 / 3.14159265358979323846);
+    }
+    std::cout << "Max major eigenvector deviation from Eigen: " << maxAngle << " degrees" << std::endl;
+}
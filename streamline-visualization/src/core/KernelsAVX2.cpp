@@ -0,0 +1,34 @@
+// AVX2 variant of the kernels, this file is compiled with AVX2 code generation enabled (see CMakeLists.txt)
+#include "../include/Kernels.h"
+#include <math.h>
+#include "../include/OctahedralEncoding.h"
+
+namespace avx2_kernels {
+#include "KernelImpl.inl"
+}
+
+static bool isSupported(const CpuFeatures& features)
+{
+    return features.avx2 && features.fma;
+}
+
+const KernelSet& getAVX2Kernels()
+{
+    static const KernelSet kernels = {
+        "AVX2",
+        isSupported,
+        avx2_kernels::interpolateTrilinear,
+        avx2_kernels::decomposeTensors,
+        avx2_kernels::transposeComponents,
+        avx2_kernels::packVertices,
+        avx2_kernels::packScalarMaskTexture,
+        avx2_kernels::filterRange,
+        avx2_kernels::encodeOctahedral16,
+        avx2_kernels::encodeOctahedral8,
+        avx2_kernels::interpolateTrilinearOctahedral16,
+        avx2_kernels::interpolateTrilinearOctahedral8,
+        avx2_kernels::prefilterBSpline,
+        avx2_kernels::interpolateCubicBSpline
+    };
+    return kernels;
+}
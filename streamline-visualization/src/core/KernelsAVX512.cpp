@@ -0,0 +1,36 @@
+// AVX512 variant of the kernels, this file is compiled with AVX512 code generation enabled (see CMakeLists.txt)
+#include "../include/Kernels.h"
+#include <math.h>
+#include "../include/OctahedralEncoding.h"
+
+namespace avx512_kernels {
+#include "KernelImpl.inl"
+}
+
+//the compiler may use every extension this file is built with (-mavx512vl, and /arch:AVX512 also enables BW and DQ),
+//so CPUs with only the foundation (Xeon Phi) fall back to the AVX2 kernels
+static bool isSupported(const CpuFeatures& features)
+{
+    return features.avx512f && features.avx512vl && features.avx512bw && features.avx512dq && features.avx2 && features.fma;
+}
+
+const KernelSet& getAVX512Kernels()
+{
+    static const KernelSet kernels = {
+        "AVX-512",
+        isSupported,
+        avx512_kernels::interpolateTrilinear,
+        avx512_kernels::decomposeTensors,
+        avx512_kernels::transposeComponents,
+        avx512_kernels::packVertices,
+        avx512_kernels::packScalarMaskTexture,
+        avx512_kernels::filterRange,
+        avx512_kernels::encodeOctahedral16,
+        avx512_kernels::encodeOctahedral8,
+        avx512_kernels::interpolateTrilinearOctahedral16,
+        avx512_kernels::interpolateTrilinearOctahedral8,
+        avx512_kernels::prefilterBSpline,
+        avx512_kernels::interpolateCubicBSpline
+    };
+    return kernels;
+}
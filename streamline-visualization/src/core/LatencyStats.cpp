@@ -0,0 +1,73 @@
+#include "../include/LatencyStats.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+void LatencyStats::add(double ms)
+{
+    totalCount++;
+    sortedValid = false;
+    if (maxSamples == 0 || samples.size() < maxSamples)
+    {
+        samples.push_back(ms);
+        return;
+    }
+    samples[oldest] = ms;
+    oldest = (oldest + 1) % maxSamples;
+}
+
+void LatencyStats::add(const LatencyStats& other)
+{
+    size_t n = other.samples.size();
+    for (size_t i = 0; i < n; i++) add(other.samples[(other.oldest + i) % n]);
+    //count the samples the other collection already replaced as well
+    totalCount += other.totalCount - n;
+}
+
+void LatencyStats::clear()
+{
+    samples.clear();
+    sorted.clear();
+    sortedValid = false;
+    oldest = 0;
+    totalCount = 0;
+}
+
+double LatencyStats::percentile(double p) const
+{
+    if (samples.empty()) return 0.0;
+
+    if (!sortedValid)
+    {
+        sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        sortedValid = true;
+    }
+
+    //nearest rank: the smallest sample that at least p percent of the samples are less than or equal to
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    rank = std::min(sorted.size(), std::max<size_t>(1, rank));
+    return sorted[rank - 1];
+}
+
+double LatencyStats::mean() const
+{
+    if (samples.empty()) return 0.0;
+
+    double sum = 0.0;
+    for (double s : samples) sum += s;
+    return sum / samples.size();
+}
+
+double LatencyStats::maximum() const
+{
+    return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+}
+
+void LatencyStats::print(const char* label) const
+{
+    std::cout << label << ": " << samples.size() << " samples";
+    if (totalCount > samples.size()) std::cout << " (the last of " << totalCount << ")";
+    std::cout << ", p50 " << percentile(50.0) << " ms, p95 " << percentile(95.0)
+              << " ms, p99 " << percentile(99.0) << " ms, max " << maximum() << " ms" << std::endl;
+}
@@ -0,0 +1,114 @@
+#include "../include/PerfCounters.h"
+#include <iostream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+/**
+ * Open a counter for the calling thread on any CPU.
+ */
+static int openCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void PerfCounterValues::add(const PerfCounterValues& other)
+{
+    if (!other.valid) return;
+    cycles += other.cycles;
+    instructions += other.instructions;
+    l1dReadMisses += other.l1dReadMisses;
+    cacheReferences += other.cacheReferences;
+    cacheMisses += other.cacheMisses;
+    valid = true;
+}
+
+void PerfCounterValues::print(const char* label) const
+{
+    if (!valid)
+    {
+        std::cout << label << ": performance counters unavailable" << std::endl;
+        return;
+    }
+
+    double ipc = cycles > 0 ? (double)instructions / cycles : 0.0;
+    double llcMissRate = cacheReferences > 0 ? 100.0 * cacheMisses / cacheReferences : 0.0;
+    double l1dMissesPerKI = instructions > 0 ? 1000.0 * l1dReadMisses / instructions : 0.0;
+    std::cout << label << ": " << cycles << " cycles, IPC " << ipc
+              << ", L1D read misses/1k instr " << l1dMissesPerKI
+              << ", LLC misses " << cacheMisses << "/" << cacheReferences << " (" << llcMissRate << "%)" << std::endl;
+}
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < NUM_COUNTERS; i++) fds[i] = -1;
+
+#if defined(__linux__)
+    fds[0] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[1] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[2] = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fds[3] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+    fds[4] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+#endif
+}
+
+void PerfCounters::start()
+{
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+PerfCounterValues PerfCounters::stop()
+{
+    PerfCounterValues values;
+
+#if defined(__linux__)
+    uint64_t counts[NUM_COUNTERS] = { 0 };
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[i], &counts[i], sizeof(uint64_t)) == sizeof(uint64_t))
+        {
+            values.valid = true;
+        }
+    }
+
+    values.cycles = counts[0];
+    values.instructions = counts[1];
+    values.l1dReadMisses = counts[2];
+    values.cacheReferences = counts[3];
+    values.cacheMisses = counts[4];
+#endif
+
+    return values;
+}
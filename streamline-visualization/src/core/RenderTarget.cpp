@@ -0,0 +1,138 @@
+#include "../include/RenderTarget.h"
+#include "../extra/glad.h"
+#include <iostream>
+
+namespace {
+
+/**
+ * Bytes per texel of the internal formats used by the render targets.
+ */
+size_t getTexelBytes(unsigned int format)
+{
+    switch (format)
+    {
+    case GL_R8: return 1;
+    case GL_R16F: return 2;
+    case GL_R32F: return 4;
+    case GL_RG16F: return 4;
+    case GL_RGBA8: return 4;
+    case GL_RGBA16F: return 8;
+    case GL_RGBA32F: return 16;
+    default: return 4;
+    }
+}
+
+/**
+ * Pixel transfer format matching an internal format, only used for allocating the texture.
+ */
+unsigned int getPixelFormat(unsigned int format)
+{
+    switch (format)
+    {
+    case GL_R8: case GL_R16F: case GL_R32F: return GL_RED;
+    case GL_RG16F: return GL_RG;
+    default: return GL_RGBA;
+    }
+}
+
+} // namespace
+
+RenderTarget::RenderTarget(const std::vector<unsigned int>& colorFormats, bool depth)
+    : colorFormats(colorFormats), hasDepth(depth)
+{
+}
+
+RenderTarget::~RenderTarget()
+{
+    release();
+}
+
+void RenderTarget::release()
+{
+    if (!textures.empty()) glDeleteTextures((GLsizei)textures.size(), textures.data());
+    textures.clear();
+    if (depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+    depthBuffer = 0;
+    if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+    framebuffer = 0;
+    width = height = 0;
+}
+
+bool RenderTarget::resize(int newWidth, int newHeight)
+{
+    if (newWidth == width && newHeight == height && framebuffer) return true;
+    release();
+    if (newWidth <= 0 || newHeight <= 0) return false;
+
+    width = newWidth;
+    height = newHeight;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    textures.resize(colorFormats.size());
+    glGenTextures((GLsizei)textures.size(), textures.data());
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, colorFormats[i], width, height, 0, getPixelFormat(colorFormats[i]), GL_FLOAT, nullptr);
+        //linear so a reduced resolution target is upsampled smoothly when resolved
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, GL_TEXTURE_2D, textures[i], 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (hasDepth)
+    {
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cerr << "Render target of " << width << "x" << height << " is incomplete" << std::endl;
+        release();
+    }
+    return complete;
+}
+
+void RenderTarget::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    std::vector<GLenum> drawBuffers(textures.size());
+    for (size_t i = 0; i < drawBuffers.size(); i++) drawBuffers[i] = GL_COLOR_ATTACHMENT0 + (GLenum)i;
+    glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+    glViewport(0, 0, width, height);
+}
+
+void RenderTarget::copyDepthFrom(unsigned int source) const
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void RenderTarget::bindTextures(int firstUnit) const
+{
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + (GLenum)i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+size_t RenderTarget::getMemoryBytes() const
+{
+    size_t bytes = hasDepth && depthBuffer ? (size_t)width * height * 4 : 0;
+    for (size_t i = 0; i < textures.size(); i++) bytes += (size_t)width * height * getTexelBytes(colorFormats[i]);
+    return bytes;
+}
@@ -0,0 +1,371 @@
+#include "../include/SessionSnapshot.h"
+#include "../include/JobScheduler.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(bool) == 1, "the zero mask is stored as one byte per voxel");
+
+static const char SNAPSHOT_MAGIC[8] = { 'V', 'C', 'P', 'S', 'N', 'A', 'P', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+// Sections start on page boundaries so the mapped pointers are aligned for the kernels
+static const uint64_t SECTION_ALIGNMENT = 4096;
+
+enum SnapshotSectionIndex {
+    SECTION_SCALARS = 0,
+    SECTION_VECTORS,
+    SECTION_FA,
+    SECTION_ZERO_MASK,
+    SECTION_TEXELS,
+    SECTION_VERTICES,
+    SECTION_STREAMLINE_FIRSTS,
+    SECTION_STREAMLINE_COUNTS,
+    SECTION_ATTR_LENGTH,
+    SECTION_ATTR_STEP_COUNT,
+    SECTION_ATTR_MEAN_FA,
+    SECTION_ATTR_MIN_FA,
+    SECTION_ATTR_MEAN_SCALAR,
+    SECTION_ATTR_CURVATURE,
+    SECTION_ATTR_BACKWARD_TERMINATION,
+    SECTION_ATTR_FORWARD_TERMINATION,
+    NUM_SNAPSHOT_SECTIONS
+};
+
+struct SnapshotSection {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+/**
+ * Fixed size header at the start of the file. The header size is stored as well, so a
+ * snapshot written by a build with a different SessionState layout is rejected.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t vertexCount;
+    uint64_t streamlineCount;
+    SnapshotSection sections[NUM_SNAPSHOT_SECTIONS];
+    SessionState state;
+};
+
+static_assert(std::is_trivially_copyable<SessionState>::value, "the session state is written to the snapshot as is");
+static_assert(std::is_trivially_copyable<SnapshotHeader>::value, "the header is written to the snapshot as is");
+
+//------------------------------------------------------------------------------
+// Reading
+//------------------------------------------------------------------------------
+
+SessionSnapshot* SessionSnapshot::open(const char* filename)
+{
+    SessionSnapshot* snapshot = new SessionSnapshot();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Could not open session snapshot " << filename << std::endl;
+        delete snapshot;
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mappingHandle = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    void* view = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0) : NULL;
+    snapshot->fileHandle = file;
+    snapshot->mappingHandle = mappingHandle;
+    if (!view)
+    {
+        std::cerr << "Could not map session snapshot " << filename << std::endl;
+        delete snapshot;
+        return nullptr;
+    }
+    snapshot->mapping = static_cast<unsigned char*>(view);
+    snapshot->mappingBytes = (size_t)size.QuadPart;
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Could not open session snapshot " << filename << std::endl;
+        delete snapshot;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader))
+    {
+        std::cerr << "Session snapshot " << filename << " is too small" << std::endl;
+        close(fd);
+        delete snapshot;
+        return nullptr;
+    }
+    //private writable mapping: pages are shared with the page cache until something writes to them
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        std::cerr << "Could not map session snapshot " << filename << std::endl;
+        delete snapshot;
+        return nullptr;
+    }
+    snapshot->mapping = static_cast<unsigned char*>(view);
+    snapshot->mappingBytes = (size_t)st.st_size;
+#endif
+
+    //validate the header and the section table before handing out any pointers
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(snapshot->mapping);
+    bool valid = snapshot->mappingBytes >= sizeof(SnapshotHeader)
+        && std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+        && header->version == SNAPSHOT_VERSION
+        && header->headerSize == sizeof(SnapshotHeader);
+    for (int i = 0; valid && i < NUM_SNAPSHOT_SECTIONS; i++)
+    {
+        const SnapshotSection& s = header->sections[i];
+        valid = s.offset % SECTION_ALIGNMENT == 0 && s.offset <= snapshot->mappingBytes && s.bytes <= snapshot->mappingBytes - s.offset;
+    }
+    //the counts are bounded by the file size first, so the section sizes computed from them can't overflow
+    const SessionState& state = header->state;
+    uint64_t maxElements = snapshot->mappingBytes / sizeof(float);
+    valid = valid && state.dimX > 0 && state.dimY > 0 && state.dimZ > 0
+        && (uint64_t)state.dimX * (uint64_t)state.dimY <= maxElements / (uint64_t)state.dimZ
+        && header->vertexCount <= maxElements / 6
+        && header->streamlineCount <= snapshot->mappingBytes / sizeof(int);
+    if (valid)
+    {
+        uint64_t numVoxels = (uint64_t)state.dimX * (uint64_t)state.dimY * (uint64_t)state.dimZ;
+        valid = header->sections[SECTION_SCALARS].bytes == numVoxels * sizeof(float)
+            && header->sections[SECTION_VECTORS].bytes == numVoxels * 3 * sizeof(float)
+            && (header->sections[SECTION_FA].bytes == 0 || header->sections[SECTION_FA].bytes == numVoxels * sizeof(float))
+            && header->sections[SECTION_ZERO_MASK].bytes == numVoxels * sizeof(bool)
+            && header->sections[SECTION_TEXELS].bytes == numVoxels * 2 * sizeof(float)
+            && header->sections[SECTION_VERTICES].bytes == header->vertexCount * 6 * sizeof(float)
+            && header->sections[SECTION_STREAMLINE_FIRSTS].bytes == header->streamlineCount * sizeof(int)
+            && header->sections[SECTION_STREAMLINE_COUNTS].bytes == header->streamlineCount * sizeof(int);
+    }
+    //the streamlines are uploaded and indexed straight from the mapping, so each has to lie within the vertices
+    if (valid)
+    {
+        const int* firsts = snapshot->getStreamlineFirsts();
+        const int* counts = snapshot->getStreamlineCounts();
+        for (uint64_t i = 0; valid && i < header->streamlineCount; i++)
+        {
+            valid = firsts[i] >= 0 && counts[i] >= 0 && (uint64_t)firsts[i] + (uint64_t)counts[i] <= header->vertexCount;
+        }
+    }
+    if (!valid)
+    {
+        std::cerr << "File " << filename << " is not a valid session snapshot for this version" << std::endl;
+        delete snapshot;
+        return nullptr;
+    }
+
+    snapshot->state = header->state;
+    return snapshot;
+}
+
+SessionSnapshot::~SessionSnapshot()
+{
+#if defined(_WIN32)
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mappingHandle) CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle && fileHandle != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)fileHandle);
+#else
+    if (mapping) munmap(mapping, mappingBytes);
+#endif
+}
+
+unsigned char* SessionSnapshot::section(int index) const
+{
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(mapping);
+    return header->sections[index].bytes > 0 ? mapping + header->sections[index].offset : nullptr;
+}
+
+size_t SessionSnapshot::sectionBytes(int index) const
+{
+    return (size_t)reinterpret_cast<const SnapshotHeader*>(mapping)->sections[index].bytes;
+}
+
+float* SessionSnapshot::getScalars() const { return reinterpret_cast<float*>(section(SECTION_SCALARS)); }
+float* SessionSnapshot::getVectors() const { return reinterpret_cast<float*>(section(SECTION_VECTORS)); }
+float* SessionSnapshot::getFA() const { return reinterpret_cast<float*>(section(SECTION_FA)); }
+bool* SessionSnapshot::getZeroMask() const { return reinterpret_cast<bool*>(section(SECTION_ZERO_MASK)); }
+const float* SessionSnapshot::getTexels() const { return reinterpret_cast<const float*>(section(SECTION_TEXELS)); }
+const float* SessionSnapshot::getVertices() const { return reinterpret_cast<const float*>(section(SECTION_VERTICES)); }
+size_t SessionSnapshot::getVertexCount() const { return (size_t)reinterpret_cast<const SnapshotHeader*>(mapping)->vertexCount; }
+const int* SessionSnapshot::getStreamlineFirsts() const { return reinterpret_cast<const int*>(section(SECTION_STREAMLINE_FIRSTS)); }
+const int* SessionSnapshot::getStreamlineCounts() const { return reinterpret_cast<const int*>(section(SECTION_STREAMLINE_COUNTS)); }
+size_t SessionSnapshot::getStreamlineCount() const { return (size_t)reinterpret_cast<const SnapshotHeader*>(mapping)->streamlineCount; }
+
+/**
+ * Copy one attribute column, an empty or mismatching section gives an empty column.
+ */
+template <typename T>
+static void copyColumn(const unsigned char* data, size_t bytes, size_t count, std::vector<T>& column)
+{
+    column.clear();
+    if (!data || bytes != count * sizeof(T)) return;
+    column.resize(count);
+    std::memcpy(column.data(), data, bytes);
+}
+
+void SessionSnapshot::copyAttributes(StreamlineAttributes& attributes) const
+{
+    size_t n = getStreamlineCount();
+    copyColumn(section(SECTION_ATTR_LENGTH), sectionBytes(SECTION_ATTR_LENGTH), n, attributes.length);
+    copyColumn(section(SECTION_ATTR_STEP_COUNT), sectionBytes(SECTION_ATTR_STEP_COUNT), n, attributes.stepCount);
+    copyColumn(section(SECTION_ATTR_MEAN_FA), sectionBytes(SECTION_ATTR_MEAN_FA), n, attributes.meanFA);
+    copyColumn(section(SECTION_ATTR_MIN_FA), sectionBytes(SECTION_ATTR_MIN_FA), n, attributes.minFA);
+    copyColumn(section(SECTION_ATTR_MEAN_SCALAR), sectionBytes(SECTION_ATTR_MEAN_SCALAR), n, attributes.meanScalar);
+    copyColumn(section(SECTION_ATTR_CURVATURE), sectionBytes(SECTION_ATTR_CURVATURE), n, attributes.curvature);
+    copyColumn(section(SECTION_ATTR_BACKWARD_TERMINATION), sectionBytes(SECTION_ATTR_BACKWARD_TERMINATION), n, attributes.backwardTermination);
+    copyColumn(section(SECTION_ATTR_FORWARD_TERMINATION), sectionBytes(SECTION_ATTR_FORWARD_TERMINATION), n, attributes.forwardTermination);
+
+    //a snapshot without (complete) attributes restores without them rather than with misaligned columns
+    if (attributes.stepCount.size() != attributes.length.size() || attributes.forwardTermination.size() != attributes.length.size())
+    {
+        attributes.clear();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Writing
+//------------------------------------------------------------------------------
+
+int writeSessionSnapshot(const char* filename, const SessionState& state, const SessionVolumes& volumes, const SessionGeometry& geometry)
+{
+    size_t numVoxels = (size_t)state.dimX * state.dimY * state.dimZ;
+    if (numVoxels == 0 || !volumes.scalars || !volumes.vectors || !volumes.zeroMask)
+    {
+        std::cerr << "No dataset loaded, not writing a session snapshot" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    //the background texture is rebuilt here so restoring can upload it straight from the mapping
+    std::vector<float> texels(numVoxels * 2);
+    for (size_t i = 0; i < numVoxels; i++)
+    {
+        texels[2 * i] = volumes.scalars[i];
+        texels[2 * i + 1] = volumes.zeroMask[i] ? 1.0f : 0.0f;
+    }
+
+    const StreamlineAttributes& a = geometry.attributes;
+    bool hasAttributes = a.size() == geometry.streamlineFirsts.size();
+    const void* data[NUM_SNAPSHOT_SECTIONS] = {
+        volumes.scalars, volumes.vectors, volumes.fa, volumes.zeroMask, texels.data(),
+        geometry.vertices.data(), geometry.streamlineFirsts.data(), geometry.streamlineCounts.data(),
+        a.length.data(), a.stepCount.data(), a.meanFA.data(), a.minFA.data(),
+        a.meanScalar.data(), a.curvature.data(), a.backwardTermination.data(), a.forwardTermination.data()
+    };
+    size_t n = hasAttributes ? a.size() : 0;
+    size_t bytes[NUM_SNAPSHOT_SECTIONS] = {
+        numVoxels * sizeof(float), numVoxels * 3 * sizeof(float), volumes.fa ? numVoxels * sizeof(float) : 0, numVoxels * sizeof(bool), texels.size() * sizeof(float),
+        geometry.vertices.size() * sizeof(float), geometry.streamlineFirsts.size() * sizeof(int), geometry.streamlineCounts.size() * sizeof(int),
+        n * sizeof(float), n * sizeof(float), n * sizeof(float), n * sizeof(float),
+        n * sizeof(float), n * sizeof(float), n * sizeof(unsigned char), n * sizeof(unsigned char)
+    };
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.vertexCount = geometry.vertices.size() / 6;
+    header.streamlineCount = geometry.streamlineFirsts.size();
+    header.state = state;
+
+    uint64_t offset = SECTION_ALIGNMENT;
+    for (int i = 0; i < NUM_SNAPSHOT_SECTIONS; i++)
+    {
+        header.sections[i].offset = offset;
+        header.sections[i].bytes = bytes[i];
+        offset += (bytes[i] + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    }
+
+    //write to a temporary file and rename it, so a crash never leaves a truncated snapshot behind
+    std::string tempName = std::string(filename) + ".tmp";
+    std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not create session snapshot " << tempName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    static const char padding[SECTION_ALIGNMENT] = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padding, SECTION_ALIGNMENT - sizeof(header) % SECTION_ALIGNMENT);
+    for (int i = 0; i < NUM_SNAPSHOT_SECTIONS; i++)
+    {
+        if (bytes[i] == 0) continue;
+        file.write(static_cast<const char*>(data[i]), bytes[i]);
+        size_t remainder = bytes[i] % SECTION_ALIGNMENT;
+        if (remainder) file.write(padding, SECTION_ALIGNMENT - remainder);
+    }
+    file.close();
+    if (!file)
+    {
+        std::cerr << "Failed writing session snapshot " << tempName << std::endl;
+        std::remove(tempName.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::remove(filename); //rename does not replace existing files on Windows
+    if (std::rename(tempName.c_str(), filename) != 0)
+    {
+        std::cerr << "Could not move session snapshot to " << filename << std::endl;
+        std::remove(tempName.c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static std::mutex saveMutex; //serializes starting and waiting for the save job
+static JobHandle saveJob;
+static std::atomic<bool> saving(false);
+
+void saveSessionSnapshotAsync(const char* filename, const SessionState& state, const SessionVolumes& volumes, SessionGeometry geometry)
+{
+    std::lock_guard<std::mutex> lock(saveMutex);
+    getJobScheduler().wait(saveJob);
+
+    saving = true;
+    std::string name = filename;
+    //the geometry is moved into the job, the volumes stay owned by the application (and volumes.owner)
+    std::shared_ptr<SessionGeometry> ownedGeometry = std::make_shared<SessionGeometry>(std::move(geometry));
+    saveJob = getJobScheduler().submit(JOB_NORMAL, "save session", [name, state, volumes, ownedGeometry]() {
+        auto start = std::chrono::steady_clock::now();
+        if (writeSessionSnapshot(name.c_str(), state, volumes, *ownedGeometry) == EXIT_SUCCESS)
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Saved session snapshot " << name << " in " << seconds * 1000.0 << " ms" << std::endl;
+        }
+        saving = false;
+        return false;
+    });
+}
+
+void waitForSessionSnapshotSave()
+{
+    std::lock_guard<std::mutex> lock(saveMutex);
+    getJobScheduler().wait(saveJob);
+    saveJob = nullptr;
+}
+
+bool isSessionSnapshotSaving()
+{
+    return saving;
+}
@@ -0,0 +1,97 @@
+#include "../include/SliceSeedIndex.h"
+#include "../include/Constants.h"
+#include <chrono>
+
+SliceSeedIndex::SliceSeedIndex(const bool* mask, int dimX, int dimY, int dimZ)
+{
+    dims[AXIS_X] = dimX;
+    dims[AXIS_Y] = dimY;
+    dims[AXIS_Z] = dimZ;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int axis = 0; axis < 3; axis++) buildAxis(axis, mask);
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SliceSeedIndex::buildAxis(int axis, const bool* mask)
+{
+    int dimX = dims[AXIS_X];
+    int dimY = dims[AXIS_Y];
+    int dimZ = dims[AXIS_Z];
+    int sliceCount = dims[axis];
+    size_t planeXY = (size_t)dimX * dimY;
+
+    //the two remaining axes of a slice, the lower one outermost, and their strides in the mask
+    int outerAxis = axis == AXIS_X ? AXIS_Y : AXIS_X;
+    int innerAxis = axis == AXIS_Z ? AXIS_Y : AXIS_Z;
+    size_t strides[3] = { 1, (size_t)dimX, planeXY };
+    int outerDim = dims[outerAxis];
+    int innerDim = dims[innerAxis];
+
+    offsets[axis].assign(sliceCount + 1, 0);
+    if (!mask || dimX <= 0 || dimY <= 0 || dimZ <= 0)
+    {
+        points[axis].clear();
+        return;
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < sliceCount; s++)
+    {
+        size_t count = 0;
+        for (int o = 0; o < outerDim; o++)
+        {
+            const bool* row = mask + s * strides[axis] + o * strides[outerAxis];
+            for (int i = 0; i < innerDim; i++) count += row[i * strides[innerAxis]] ? 1 : 0;
+        }
+        offsets[axis][s + 1] = count;
+    }
+
+    for (int s = 0; s < sliceCount; s++) offsets[axis][s + 1] += offsets[axis][s];
+    points[axis].resize(offsets[axis][sliceCount]);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < sliceCount; s++)
+    {
+        Point3D* out = points[axis].data() + offsets[axis][s];
+        int coord[3];
+        coord[axis] = s;
+        for (int o = 0; o < outerDim; o++)
+        {
+            coord[outerAxis] = o;
+            const bool* row = mask + s * strides[axis] + o * strides[outerAxis];
+            for (int i = 0; i < innerDim; i++)
+            {
+                if (!row[i * strides[innerAxis]]) continue;
+                coord[innerAxis] = i;
+                *out++ = Point3D((float)coord[AXIS_X], (float)coord[AXIS_Y], (float)coord[AXIS_Z]);
+            }
+        }
+    }
+}
+
+SeedSpan SliceSeedIndex::getSlice(int axis, int slice) const
+{
+    if (axis < 0 || axis > 2 || slice < 0 || slice >= dims[axis] || offsets[axis].empty()) return SeedSpan();
+    size_t first = offsets[axis][slice];
+    return SeedSpan(points[axis].data() + first, offsets[axis][slice + 1] - first);
+}
+
+bool SliceSeedIndex::isRangeEmpty(int axis, int first, int last) const
+{
+    if (axis < 0 || axis > 2 || offsets[axis].empty()) return true;
+    first = first < 0 ? 0 : first;
+    last = last >= dims[axis] ? dims[axis] - 1 : last;
+    if (first > last) return true;
+    return offsets[axis][last + 1] == offsets[axis][first];
+}
+
+size_t SliceSeedIndex::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bytes += offsets[axis].size() * sizeof(size_t) + points[axis].size() * sizeof(Point3D);
+    }
+    return bytes;
+}
@@ -0,0 +1,144 @@
+#include "../include/SparseBlockVolume.h"
+#include <algorithm>
+#include <cstring>
+
+SparseBlockVolume::SparseBlockVolume(const float* dense, int dimX, int dimY, int dimZ, int numComponents)
+    : dimX(dimX), dimY(dimY), dimZ(dimZ), numComponents(numComponents), zeroVoxel(numComponents, 0.0f)
+{
+    blocksX = (dimX + BLOCK_SIZE - 1) >> BLOCK_BITS;
+    blocksY = (dimY + BLOCK_SIZE - 1) >> BLOCK_BITS;
+    blocksZ = (dimZ + BLOCK_SIZE - 1) >> BLOCK_BITS;
+    tilesX = (blocksX + TILE_SIZE - 1) >> TILE_BITS;
+    tilesY = (blocksY + TILE_SIZE - 1) >> TILE_BITS;
+    tilesZ = (blocksZ + TILE_SIZE - 1) >> TILE_BITS;
+
+    //find the blocks that contain a nonzero value
+    const int numBlockRows = blocksX * blocksY;
+    std::vector<unsigned char> occupied((size_t)numBlockRows * blocksZ, 0);
+#pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < numBlockRows; row++)
+    {
+        int bx = row / blocksY;
+        int by = row % blocksY;
+        int xEnd = std::min(dimX, (bx + 1) * BLOCK_SIZE);
+        int yEnd = std::min(dimY, (by + 1) * BLOCK_SIZE);
+        for (int x = bx * BLOCK_SIZE; x < xEnd; x++)
+        {
+            for (int y = by * BLOCK_SIZE; y < yEnd; y++)
+            {
+                //a z column of the volume is contiguous, so scan it once for all blocks of the row
+                const float* column = dense + (size_t)numComponents * dimZ * (y + (size_t)dimY * x);
+                for (int z = 0; z < dimZ; z++)
+                {
+                    for (int c = 0; c < numComponents; c++)
+                    {
+                        if (column[numComponents * z + c] != 0.0f)
+                        {
+                            occupied[(size_t)row * blocksZ + (z >> BLOCK_BITS)] = 1;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //number the occupied tiles and blocks in block order, so the layout doesn't depend on the thread count
+    tiles.assign((size_t)tilesX * tilesY * tilesZ, -1);
+    for (int bx = 0; bx < blocksX; bx++)
+    {
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bz = 0; bz < blocksZ; bz++)
+            {
+                if (!occupied[bz + (size_t)blocksZ * (by + (size_t)blocksY * bx)]) continue;
+
+                int& tile = tiles[(bz >> TILE_BITS) + tilesZ * ((by >> TILE_BITS) + tilesY * (bx >> TILE_BITS))];
+                if (tile < 0)
+                {
+                    tile = (int)(tileBlocks.size() / TILE_BLOCKS);
+                    tileBlocks.resize(tileBlocks.size() + TILE_BLOCKS, -1);
+                }
+                int local = (bz & (TILE_SIZE - 1)) + TILE_SIZE * ((by & (TILE_SIZE - 1)) + TILE_SIZE * (bx & (TILE_SIZE - 1)));
+                tileBlocks[(size_t)tile * TILE_BLOCKS + local] = (int)numBlocks++;
+            }
+        }
+    }
+
+    //copy the occupied blocks, voxels outside the volume stay zero
+    const size_t blockFloats = (size_t)BLOCK_VOXELS * numComponents;
+    blocks = allocateVolumeBuffer<float>(std::max<size_t>(1, numBlocks * blockFloats));
+    const int numBlocksTotal = blocksX * blocksY * blocksZ;
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < numBlocksTotal; b++)
+    {
+        int bz = b % blocksZ;
+        int by = (b / blocksZ) % blocksY;
+        int bx = b / (blocksZ * blocksY);
+        int block = findBlock(bx, by, bz);
+        if (block < 0) continue;
+
+        float* target = blocks.get() + (size_t)block * blockFloats;
+        std::memset(target, 0, blockFloats * sizeof(float));
+        int zBegin = bz * BLOCK_SIZE;
+        int zCount = std::min(dimZ, zBegin + BLOCK_SIZE) - zBegin;
+        for (int lx = 0; lx < BLOCK_SIZE && bx * BLOCK_SIZE + lx < dimX; lx++)
+        {
+            for (int ly = 0; ly < BLOCK_SIZE && by * BLOCK_SIZE + ly < dimY; ly++)
+            {
+                int x = bx * BLOCK_SIZE + lx;
+                int y = by * BLOCK_SIZE + ly;
+                const float* source = dense + (size_t)numComponents * (zBegin + (size_t)dimZ * (y + (size_t)dimY * x));
+                std::memcpy(target + (size_t)numComponents * BLOCK_SIZE * (ly + BLOCK_SIZE * lx), source, (size_t)zCount * numComponents * sizeof(float));
+            }
+        }
+    }
+}
+
+void SparseBlockVolume::interpolateTrilinear(float x, float y, float z, float* out) const
+{
+    // Same cell selection as the dense kernel (see KernelImpl.inl)
+    int x0 = std::max(0, std::min((int)x, dimX - 2));
+    int y0 = std::max(0, std::min((int)y, dimY - 2));
+    int z0 = std::max(0, std::min((int)z, dimZ - 2));
+    int x1 = std::min(x0 + 1, dimX - 1);
+    int y1 = std::min(y0 + 1, dimY - 1);
+    int z1 = std::min(z0 + 1, dimZ - 1);
+
+    //most cells lie inside a single block, which answers empty regions with one index lookup
+    if ((x0 >> BLOCK_BITS) == (x1 >> BLOCK_BITS) && (y0 >> BLOCK_BITS) == (y1 >> BLOCK_BITS) && (z0 >> BLOCK_BITS) == (z1 >> BLOCK_BITS)
+        && findBlock(x0 >> BLOCK_BITS, y0 >> BLOCK_BITS, z0 >> BLOCK_BITS) < 0)
+    {
+        std::fill(out, out + numComponents, 0.0f);
+        return;
+    }
+
+    float wx = std::max(0.0f, std::min(1.0f, x - x0));
+    float wy = std::max(0.0f, std::min(1.0f, y - y0));
+    float wz = std::max(0.0f, std::min(1.0f, z - z0));
+
+    const float* corners[8] = {
+        getVoxel(x0, y0, z0), getVoxel(x0, y0, z1), getVoxel(x0, y1, z0), getVoxel(x0, y1, z1),
+        getVoxel(x1, y0, z0), getVoxel(x1, y0, z1), getVoxel(x1, y1, z0), getVoxel(x1, y1, z1)
+    };
+    for (const float*& corner : corners)
+    {
+        if (!corner) corner = zeroVoxel.data();
+    }
+
+    for (int c = 0; c < numComponents; c++)
+    {
+        float v00 = corners[0][c] + wz * (corners[1][c] - corners[0][c]);
+        float v01 = corners[2][c] + wz * (corners[3][c] - corners[2][c]);
+        float v10 = corners[4][c] + wz * (corners[5][c] - corners[4][c]);
+        float v11 = corners[6][c] + wz * (corners[7][c] - corners[6][c]);
+        float v0 = v00 + wy * (v01 - v00);
+        float v1 = v10 + wy * (v11 - v10);
+        out[c] = v0 + wx * (v1 - v0);
+    }
+}
+
+size_t SparseBlockVolume::getMemoryBytes() const
+{
+    return tiles.size() * sizeof(int) + tileBlocks.size() * sizeof(int) + numBlocks * BLOCK_VOXELS * numComponents * sizeof(float);
+}
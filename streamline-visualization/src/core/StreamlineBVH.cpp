@@ -0,0 +1,613 @@
+#include "../include/StreamlineBVH.h"
+#include "../include/SpaceFillingCurve.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <utility>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+//deep enough for any tree: the split keys have 63 Morton bits and 32 index bits
+const int TRAVERSAL_STACK_SIZE = 128;
+
+int countLeadingZeros32(uint32_t v)
+{
+    if (v == 0) return 32;
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, v);
+    return 31 - (int)index;
+#else
+    return __builtin_clz(v);
+#endif
+}
+
+int countLeadingZeros64(uint64_t v)
+{
+    uint32_t high = (uint32_t)(v >> 32);
+    return high ? countLeadingZeros32(high) : 32 + countLeadingZeros32((uint32_t)v);
+}
+
+/**
+ * Sort the chunks of every thread and merge them pairwise, every round in parallel.
+ */
+void parallelSort(std::vector<std::pair<uint64_t, int>>& items)
+{
+    int numChunks = 1;
+#if defined(_OPENMP)
+    numChunks = std::max(1, std::min(omp_get_max_threads(), (int)(items.size() / 4096)));
+#endif
+    std::vector<size_t> bounds(numChunks + 1);
+    for (int c = 0; c <= numChunks; c++) bounds[c] = items.size() * c / numChunks;
+
+#pragma omp parallel for
+    for (int c = 0; c < numChunks; c++)
+    {
+        std::sort(items.begin() + bounds[c], items.begin() + bounds[c + 1]);
+    }
+
+    for (int width = 1; width < numChunks; width *= 2)
+    {
+#pragma omp parallel for
+        for (int c = 0; c < numChunks; c += 2 * width)
+        {
+            if (c + width >= numChunks) continue;
+            std::inplace_merge(items.begin() + bounds[c], items.begin() + bounds[c + width],
+                items.begin() + bounds[std::min(c + 2 * width, numChunks)]);
+        }
+    }
+}
+
+float clampUnit(float a)
+{
+    return a < 0.0f ? 0.0f : (a > 1.0f ? 1.0f : a);
+}
+
+/**
+ * Squared distance from a point to a box, zero inside.
+ */
+float boxDistanceSquared(const float* min, const float* max, const float* p)
+{
+    float distance = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float d = std::max(std::max(min[axis] - p[axis], p[axis] - max[axis]), 0.0f);
+        distance += d * d;
+    }
+    return distance;
+}
+
+/**
+ * Entry parameter of a ray into a box grown by radius, false if the ray misses it.
+ */
+bool intersectBox(const float* min, const float* max, float radius, const float* origin, const float* direction, float& tEnter)
+{
+    float tNear = 0.0f;
+    float tFar = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float lo = min[axis] - radius, hi = max[axis] + radius;
+        if (std::fabs(direction[axis]) < 1e-12f)
+        {
+            if (origin[axis] < lo || origin[axis] > hi) return false;
+            continue;
+        }
+        float inverse = 1.0f / direction[axis];
+        float t0 = (lo - origin[axis]) * inverse;
+        float t1 = (hi - origin[axis]) * inverse;
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar) return false;
+    }
+    tEnter = tNear;
+    return true;
+}
+
+float dot3(const float* a, const float* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/**
+ * Closest points of a ray (unit direction, t >= 0) and a segment, returns the squared distance.
+ */
+float raySegmentDistanceSquared(const float* origin, const float* direction, const float* a, const float* b, float& t, float& s)
+{
+    float e[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float r[3] = { a[0] - origin[0], a[1] - origin[1], a[2] - origin[2] };
+    float ee = dot3(e, e), de = dot3(direction, e), dr = dot3(direction, r), er = dot3(e, r);
+
+    float denominator = ee - de * de;
+    s = (ee > 1e-12f && denominator > 1e-12f * ee) ? clampUnit((de * dr - er) / denominator) : 0.0f;
+    t = dr + s * de;
+    if (t < 0.0f)
+    {
+        //the closest approach lies behind the origin, use the point of the segment closest to the origin
+        t = 0.0f;
+        s = ee > 1e-12f ? clampUnit(-er / ee) : 0.0f;
+    }
+
+    float d[3];
+    for (int axis = 0; axis < 3; axis++) d[axis] = origin[axis] + t * direction[axis] - (a[axis] + s * e[axis]);
+    return dot3(d, d);
+}
+
+/**
+ * Closest point of a segment to a point, returns the squared distance.
+ */
+float pointSegmentDistanceSquared(const float* p, const float* a, const float* b, float& s)
+{
+    float e[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float r[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    float ee = dot3(e, e);
+    s = ee > 1e-12f ? clampUnit(dot3(r, e) / ee) : 0.0f;
+
+    float d[3];
+    for (int axis = 0; axis < 3; axis++) d[axis] = r[axis] - s * e[axis];
+    return dot3(d, d);
+}
+
+} // namespace
+
+void StreamlineBVH::build(const std::vector<std::vector<Point3D>>& streamlines)
+{
+    clear();
+    append(streamlines);
+}
+
+void StreamlineBVH::build(const float* vertices, size_t stride, const int* firsts, const int* counts, size_t numStreamlines)
+{
+    clear();
+    append(vertices, stride, firsts, counts, numStreamlines);
+}
+
+void StreamlineBVH::append(const std::vector<std::vector<Point3D>>& streamlines)
+{
+    auto start = std::chrono::steady_clock::now();
+    Tree tree;
+    tree.firstStreamline = (int)numStreamlines;
+    tree.numStreamlines = (int)streamlines.size();
+
+    std::vector<size_t> segmentFirst(streamlines.size() + 1, 0);
+    for (size_t i = 0; i < streamlines.size(); i++)
+    {
+        segmentFirst[i + 1] = segmentFirst[i] + (streamlines[i].size() > 1 ? streamlines[i].size() - 1 : 0);
+    }
+    tree.segments.resize(segmentFirst.back());
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (long long i = 0; i < (long long)streamlines.size(); i++)
+    {
+        const std::vector<Point3D>& points = streamlines[i];
+        for (size_t k = 0; k + 1 < points.size(); k++)
+        {
+            Segment& segment = tree.segments[segmentFirst[i] + k];
+            segment.a[0] = points[k].x; segment.a[1] = points[k].y; segment.a[2] = points[k].z;
+            segment.b[0] = points[k + 1].x; segment.b[1] = points[k + 1].y; segment.b[2] = points[k + 1].z;
+            segment.streamline = tree.firstStreamline + (int)i;
+            segment.index = (int)k;
+        }
+    }
+
+    addTree(std::move(tree));
+    lastBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void StreamlineBVH::append(const float* vertices, size_t stride, const int* firsts, const int* counts, size_t numStreamlines)
+{
+    auto start = std::chrono::steady_clock::now();
+    Tree tree;
+    tree.firstStreamline = (int)this->numStreamlines;
+    tree.numStreamlines = (int)numStreamlines;
+
+    std::vector<size_t> segmentFirst(numStreamlines + 1, 0);
+    for (size_t i = 0; i < numStreamlines; i++)
+    {
+        segmentFirst[i + 1] = segmentFirst[i] + (counts[i] > 1 ? counts[i] - 1 : 0);
+    }
+    tree.segments.resize(segmentFirst.back());
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (long long i = 0; i < (long long)numStreamlines; i++)
+    {
+        for (int k = 0; k + 1 < counts[i]; k++)
+        {
+            const float* a = vertices + ((size_t)firsts[i] + k) * stride;
+            const float* b = a + stride;
+            Segment& segment = tree.segments[segmentFirst[i] + k];
+            segment.a[0] = a[0]; segment.a[1] = a[1]; segment.a[2] = a[2];
+            segment.b[0] = b[0]; segment.b[1] = b[1]; segment.b[2] = b[2];
+            segment.streamline = tree.firstStreamline + (int)i;
+            segment.index = k;
+        }
+    }
+
+    addTree(std::move(tree));
+    lastBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void StreamlineBVH::clear()
+{
+    trees.clear();
+    numStreamlines = 0;
+}
+
+void StreamlineBVH::addTree(Tree&& tree)
+{
+    numStreamlines += tree.numStreamlines;
+    trees.push_back(std::move(tree));
+
+    //merge like the carries of a binary counter, the merged segments are sorted again by buildTree
+    while (trees.size() > 1 && trees.back().segments.size() >= trees[trees.size() - 2].segments.size())
+    {
+        Tree& newest = trees.back();
+        Tree& previous = trees[trees.size() - 2];
+        previous.segments.insert(previous.segments.end(), newest.segments.begin(), newest.segments.end());
+        previous.numStreamlines += newest.numStreamlines;
+        trees.pop_back();
+    }
+    buildTree(trees.back());
+}
+
+void StreamlineBVH::buildTree(Tree& tree)
+{
+    const int n = (int)tree.segments.size();
+    tree.nodes.clear();
+
+    //bounds of the segment centers for quantizing them to the Morton grid
+    float centerMin[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float centerMax[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+#pragma omp parallel
+    {
+        float threadMin[3] = { centerMin[0], centerMin[1], centerMin[2] };
+        float threadMax[3] = { centerMax[0], centerMax[1], centerMax[2] };
+#pragma omp for
+        for (int i = 0; i < n; i++)
+        {
+            const Segment& segment = tree.segments[i];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float center = 0.5f * (segment.a[axis] + segment.b[axis]);
+                threadMin[axis] = std::min(threadMin[axis], center);
+                threadMax[axis] = std::max(threadMax[axis], center);
+            }
+        }
+#pragma omp critical
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                centerMin[axis] = std::min(centerMin[axis], threadMin[axis]);
+                centerMax[axis] = std::max(centerMax[axis], threadMax[axis]);
+            }
+        }
+    }
+
+    //sort the segments along the Morton curve
+    const float gridSize = (float)((1 << 21) - 1);
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centerMax[axis] - centerMin[axis];
+        scale[axis] = extent > 0.0f ? gridSize / extent : 0.0f;
+    }
+
+    std::vector<std::pair<uint64_t, int>> keys(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++)
+    {
+        const Segment& segment = tree.segments[i];
+        uint32_t cell[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float center = 0.5f * (segment.a[axis] + segment.b[axis]);
+            cell[axis] = (uint32_t)std::min(gridSize, std::max(0.0f, (center - centerMin[axis]) * scale[axis]));
+        }
+        keys[i] = std::make_pair(mortonEncode3D(cell[0], cell[1], cell[2]), i);
+    }
+    parallelSort(keys);
+
+    std::vector<Segment> sorted(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) sorted[i] = tree.segments[keys[i].second];
+    tree.segments.swap(sorted);
+    sorted = std::vector<Segment>();
+
+    //lookup tables from (streamline, index) to the sorted position
+    tree.streamlineFirst.assign(tree.numStreamlines + 1, 0);
+    for (int i = 0; i < n; i++) tree.streamlineFirst[tree.segments[i].streamline - tree.firstStreamline + 1]++;
+    for (int s = 0; s < tree.numStreamlines; s++) tree.streamlineFirst[s + 1] += tree.streamlineFirst[s];
+    tree.sortedPosition.resize(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++)
+    {
+        const Segment& segment = tree.segments[i];
+        tree.sortedPosition[tree.streamlineFirst[segment.streamline - tree.firstStreamline] + segment.index] = i;
+    }
+
+    if (n < 2) return;
+
+    //length of the common prefix of the keys at i and j, equal codes are told apart by their position
+    auto delta = [&keys, n](int i, int j) -> int {
+        if (j < 0 || j >= n) return -1;
+        uint64_t difference = keys[i].first ^ keys[j].first;
+        if (difference == 0) return 64 + countLeadingZeros32((uint32_t)(i ^ j));
+        return countLeadingZeros64(difference);
+    };
+
+    //every internal node finds its key range and split independently (Karras 2012)
+    tree.nodes.resize(n - 1);
+    std::vector<int> leafParent(n), nodeParent(n - 1, -1);
+#pragma omp parallel for
+    for (int i = 0; i < n - 1; i++)
+    {
+        int d = delta(i, i + 1) - delta(i, i - 1) > 0 ? 1 : -1;
+        int minPrefix = delta(i, i - d);
+
+        //upper bound of the range length, then binary search for the other end
+        int maxLength = 2;
+        while (delta(i, i + maxLength * d) > minPrefix) maxLength *= 2;
+        int length = 0;
+        for (int t = maxLength / 2; t >= 1; t /= 2)
+        {
+            if (delta(i, i + (length + t) * d) > minPrefix) length += t;
+        }
+        int j = i + length * d;
+
+        //binary search for the split within the range
+        int nodePrefix = delta(i, j);
+        int split = 0;
+        int t = length;
+        do
+        {
+            t = (t + 1) / 2;
+            if (delta(i, i + (split + t) * d) > nodePrefix) split += t;
+        } while (t > 1);
+        int gamma = i + split * d + std::min(d, 0);
+
+        Node& node = tree.nodes[i];
+        node.left = std::min(i, j) == gamma ? ~gamma : gamma;
+        node.right = std::max(i, j) == gamma + 1 ? ~(gamma + 1) : gamma + 1;
+        if (node.left < 0) leafParent[~node.left] = i; else nodeParent[node.left] = i;
+        if (node.right < 0) leafParent[~node.right] = i; else nodeParent[node.right] = i;
+    }
+
+    //fit the boxes bottom-up, the second child to arrive computes the box of its parent
+    std::vector<std::atomic<int>> arrivals(n - 1);
+#pragma omp parallel for
+    for (int i = 0; i < n - 1; i++) arrivals[i].store(0);
+
+    const Tree& constTree = tree;
+#pragma omp parallel for
+    for (int leaf = 0; leaf < n; leaf++)
+    {
+        int node = leafParent[leaf];
+        while (node >= 0 && arrivals[node].fetch_add(1) == 1)
+        {
+            Node& parent = tree.nodes[node];
+            float leftMin[3], leftMax[3], rightMin[3], rightMax[3];
+            getBounds(constTree, parent.left, leftMin, leftMax);
+            getBounds(constTree, parent.right, rightMin, rightMax);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                parent.min[axis] = std::min(leftMin[axis], rightMin[axis]);
+                parent.max[axis] = std::max(leftMax[axis], rightMax[axis]);
+            }
+            node = nodeParent[node];
+        }
+    }
+}
+
+void StreamlineBVH::getBounds(const Tree& tree, int child, float* min, float* max)
+{
+    if (child < 0)
+    {
+        const Segment& segment = tree.segments[~child];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            min[axis] = std::min(segment.a[axis], segment.b[axis]);
+            max[axis] = std::max(segment.a[axis], segment.b[axis]);
+        }
+        return;
+    }
+    const Node& node = tree.nodes[child];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        min[axis] = node.min[axis];
+        max[axis] = node.max[axis];
+    }
+}
+
+bool StreamlineBVH::pickRay(const Point3D& origin, const Point3D& direction, float radius, SegmentHit& hit,
+    const unsigned char* visible) const
+{
+    float length = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+    if (length == 0.0f) return false;
+    const float o[3] = { origin.x, origin.y, origin.z };
+    const float d[3] = { direction.x / length, direction.y / length, direction.z / length };
+    const float radiusSquared = radius * radius;
+
+    float bestT = std::numeric_limits<float>::max();
+    bool found = false;
+    int stack[TRAVERSAL_STACK_SIZE];
+    for (const Tree& tree : trees)
+    {
+        if (tree.segments.empty()) continue;
+
+        int size = 0;
+        stack[size++] = tree.nodes.empty() ? ~0 : 0;
+        while (size > 0)
+        {
+            int child = stack[--size];
+            if (child < 0)
+            {
+                const Segment& segment = tree.segments[~child];
+                if (visible && !visible[segment.streamline]) continue;
+                float t, s;
+                float distanceSquared = raySegmentDistanceSquared(o, d, segment.a, segment.b, t, s);
+                if (distanceSquared > radiusSquared || t >= bestT) continue;
+
+                bestT = t;
+                found = true;
+                hit.streamline = segment.streamline;
+                hit.segment = segment.index;
+                hit.distance = std::sqrt(distanceSquared);
+                hit.rayT = t / length;
+                hit.point = Point3D(segment.a[0] + s * (segment.b[0] - segment.a[0]), segment.a[1] + s * (segment.b[1] - segment.a[1]),
+                    segment.a[2] + s * (segment.b[2] - segment.a[2]));
+                continue;
+            }
+
+            //visit the child the ray enters first last, so it is popped first
+            const Node& node = tree.nodes[child];
+            float tEnter;
+            if (!intersectBox(node.min, node.max, radius, o, d, tEnter) || tEnter > bestT) continue;
+
+            float min[3], max[3];
+            float tLeft = 0.0f, tRight = 0.0f;
+            getBounds(tree, node.left, min, max);
+            bool hitLeft = intersectBox(min, max, radius, o, d, tLeft) && tLeft <= bestT;
+            getBounds(tree, node.right, min, max);
+            bool hitRight = intersectBox(min, max, radius, o, d, tRight) && tRight <= bestT;
+            if (hitLeft && hitRight)
+            {
+                bool leftFirst = tLeft <= tRight;
+                stack[size++] = leftFirst ? node.right : node.left;
+                stack[size++] = leftFirst ? node.left : node.right;
+            }
+            else if (hitLeft) stack[size++] = node.left;
+            else if (hitRight) stack[size++] = node.right;
+        }
+    }
+    return found;
+}
+
+bool StreamlineBVH::nearestPoint(const Point3D& point, float maxDistance, SegmentHit& hit, const unsigned char* visible) const
+{
+    const float p[3] = { point.x, point.y, point.z };
+    float bestSquared = maxDistance * maxDistance;
+    bool found = false;
+    int stack[TRAVERSAL_STACK_SIZE];
+    for (const Tree& tree : trees)
+    {
+        if (tree.segments.empty()) continue;
+
+        int size = 0;
+        stack[size++] = tree.nodes.empty() ? ~0 : 0;
+        while (size > 0)
+        {
+            int child = stack[--size];
+            if (child < 0)
+            {
+                const Segment& segment = tree.segments[~child];
+                if (visible && !visible[segment.streamline]) continue;
+                float s;
+                float distanceSquared = pointSegmentDistanceSquared(p, segment.a, segment.b, s);
+                if (distanceSquared > bestSquared) continue;
+
+                bestSquared = distanceSquared;
+                found = true;
+                hit.streamline = segment.streamline;
+                hit.segment = segment.index;
+                hit.distance = std::sqrt(distanceSquared);
+                hit.rayT = 0.0f;
+                hit.point = Point3D(segment.a[0] + s * (segment.b[0] - segment.a[0]), segment.a[1] + s * (segment.b[1] - segment.a[1]),
+                    segment.a[2] + s * (segment.b[2] - segment.a[2]));
+                continue;
+            }
+
+            const Node& node = tree.nodes[child];
+            if (boxDistanceSquared(node.min, node.max, p) > bestSquared) continue;
+
+            float min[3], max[3];
+            getBounds(tree, node.left, min, max);
+            float leftSquared = boxDistanceSquared(min, max, p);
+            getBounds(tree, node.right, min, max);
+            float rightSquared = boxDistanceSquared(min, max, p);
+            bool leftFirst = leftSquared <= rightSquared;
+            if (std::max(leftSquared, rightSquared) <= bestSquared) stack[size++] = leftFirst ? node.right : node.left;
+            if (std::min(leftSquared, rightSquared) <= bestSquared) stack[size++] = leftFirst ? node.left : node.right;
+        }
+    }
+    return found;
+}
+
+void StreamlineBVH::findStreamlinesNear(const Point3D& point, float radius, std::vector<int>& streamlines,
+    const unsigned char* visible) const
+{
+    streamlines.clear();
+    const float p[3] = { point.x, point.y, point.z };
+    const float radiusSquared = radius * radius;
+    int stack[TRAVERSAL_STACK_SIZE];
+    for (const Tree& tree : trees)
+    {
+        if (tree.segments.empty()) continue;
+
+        int size = 0;
+        stack[size++] = tree.nodes.empty() ? ~0 : 0;
+        while (size > 0)
+        {
+            int child = stack[--size];
+            if (child < 0)
+            {
+                const Segment& segment = tree.segments[~child];
+                if (visible && !visible[segment.streamline]) continue;
+                float s;
+                if (pointSegmentDistanceSquared(p, segment.a, segment.b, s) <= radiusSquared) streamlines.push_back(segment.streamline);
+                continue;
+            }
+
+            const Node& node = tree.nodes[child];
+            if (boxDistanceSquared(node.min, node.max, p) > radiusSquared) continue;
+            stack[size++] = node.left;
+            stack[size++] = node.right;
+        }
+    }
+
+    std::sort(streamlines.begin(), streamlines.end());
+    streamlines.erase(std::unique(streamlines.begin(), streamlines.end()), streamlines.end());
+}
+
+void StreamlineBVH::getStreamlinePoints(int streamline, std::vector<Point3D>& points) const
+{
+    points.clear();
+    for (const Tree& tree : trees)
+    {
+        int local = streamline - tree.firstStreamline;
+        if (local < 0 || local >= tree.numStreamlines) continue;
+
+        for (int k = tree.streamlineFirst[local]; k < tree.streamlineFirst[local + 1]; k++)
+        {
+            const Segment& segment = tree.segments[tree.sortedPosition[k]];
+            points.push_back(Point3D(segment.a[0], segment.a[1], segment.a[2]));
+            if (k + 1 == tree.streamlineFirst[local + 1]) points.push_back(Point3D(segment.b[0], segment.b[1], segment.b[2]));
+        }
+        return;
+    }
+}
+
+size_t StreamlineBVH::getSegmentCount() const
+{
+    size_t count = 0;
+    for (const Tree& tree : trees) count += tree.segments.size();
+    return count;
+}
+
+size_t StreamlineBVH::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (const Tree& tree : trees)
+    {
+        bytes += tree.segments.capacity() * sizeof(Segment) + tree.nodes.capacity() * sizeof(Node)
+            + (tree.streamlineFirst.capacity() + tree.sortedPosition.capacity()) * sizeof(int);
+    }
+    return bytes;
+}
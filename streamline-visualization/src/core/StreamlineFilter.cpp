@@ -0,0 +1,48 @@
+#include "../include/StreamlineFilter.h"
+#include "../include/Kernels.h"
+
+const char* getTerminationReasonName(TerminationReason reason)
+{
+    switch (reason)
+    {
+    case TERMINATED_MAX_STEPS:   return "Max steps";
+    case TERMINATED_MAX_LENGTH:  return "Max length";
+    case TERMINATED_ANGLE:       return "Max angle";
+    case TERMINATED_MASK:        return "Left volume";
+    case TERMINATED_ZERO_VECTOR: return "Zero vector";
+    case TERMINATED_INVALID:     return "Invalid";
+    default:                     return "Unknown";
+    }
+}
+
+void computeVisibleStreamlines(const StreamlineAttributes& attributes, const StreamlineFilter& filter, std::vector<unsigned char>& visible)
+{
+    size_t count = attributes.size();
+    visible.assign(count, 1);
+    if (count == 0) return;
+
+    //every range narrows the mask down with one pass over its column
+    const KernelSet& kernels = getKernels();
+    const AttributeRange* ranges[] = { &filter.length, &filter.stepCount, &filter.meanFA, &filter.minFA, &filter.meanScalar, &filter.curvature };
+    const std::vector<float>* columns[] = { &attributes.length, &attributes.stepCount, &attributes.meanFA, &attributes.minFA, &attributes.meanScalar, &attributes.curvature };
+    for (int i = 0; i < 6; i++)
+    {
+        if (!ranges[i]->enabled) continue;
+        kernels.filterRange(columns[i]->data(), count, ranges[i]->min, ranges[i]->max, visible.data());
+    }
+
+    //termination reasons through a lookup table, skipped when everything is accepted
+    bool allAllowed = true;
+    unsigned char allowed[NUM_TERMINATION_REASONS];
+    for (int r = 0; r < NUM_TERMINATION_REASONS; r++)
+    {
+        allowed[r] = filter.allowedTermination[r] ? 1 : 0;
+        allAllowed &= filter.allowedTermination[r];
+    }
+    if (allAllowed) return;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        visible[i] &= allowed[attributes.backwardTermination[i]] & allowed[attributes.forwardTermination[i]];
+    }
+}
@@ -1,18 +1,51 @@
 #include "../include/StreamlineRenderer.h"
 #include "../extra/glad.h"
+#include "../include/Kernels.h"
+#include "../include/RenderTarget.h"
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 
+/**
+ * Blend state of the caller, the transparency and density passes restore it so it doesn't leak
+ * into the drawing that follows (the UI, the slice)
+ */
+struct BlendState {
+    GLboolean enabled;
+    GLint srcRGB, dstRGB, srcAlpha, dstAlpha;
+};
+
+static BlendState saveBlendState() {
+    BlendState state;
+    state.enabled = glIsEnabled(GL_BLEND);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &state.srcRGB);
+    glGetIntegerv(GL_BLEND_DST_RGB, &state.dstRGB);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &state.srcAlpha);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &state.dstAlpha);
+    return state;
+}
+
+static void restoreBlendState(const BlendState& state) {
+    glBlendFuncSeparate(state.srcRGB, state.dstRGB, state.srcAlpha, state.dstAlpha);
+    if (state.enabled) glEnable(GL_BLEND);
+    else glDisable(GL_BLEND);
+}
+
+const char* getStreamlineRenderModeName(StreamlineRenderMode mode) {
+    switch (mode)
+    {
+    case RENDER_MODE_OPAQUE: return "Opaque";
+    case RENDER_MODE_WEIGHTED_BLENDED: return "Weighted blended transparency";
+    case RENDER_MODE_DENSITY: return "Line density";
+    default: return "Unknown";
+    }
+}
+
 StreamlineRenderer::StreamlineRenderer(Shader* shaderProgram, float width)
-    : shader(shaderProgram), vertexCount(0), bufferIndexCount(0), lineWidth(width) {
-    // Initialize OpenGL buffers
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    : VAO(GL_OBJECT_VERTEX_ARRAY), VBO(GL_OBJECT_BUFFER), shader(shaderProgram), vertexCount(0), lineWidth(width) {
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindVertexArray(VAO.get());
+    glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
 
     // Set vertex attribute pointers
     // Position attribute
@@ -27,101 +60,306 @@ StreamlineRenderer::StreamlineRenderer(Shader* shaderProgram, float width)
 }
 
 StreamlineRenderer::~StreamlineRenderer() {
-    // Clean up OpenGL resources
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    //the buffers and render targets delete their GL objects themselves
 }
 
 void StreamlineRenderer::prepareStreamlines(const std::vector<std::vector<Point3D>>& streamlines, bool isToyDataset) {
-    // Format for each vertex: [x,y,z,r,g,b]
     std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-    unsigned int currentIndex = 0;
+    std::vector<int> firsts, counts;
+    packStreamlines(streamlines, vertices, firsts, counts);
+    streamlineFirsts.swap(firsts);
+    streamlineCounts.swap(counts);
+
+    uploadVertices(vertices.data(), vertices.size() / 6, streamlineFirsts.data(), streamlineCounts.data(), streamlines.size());
+
+    std::cout << "Prepared " << streamlines.size() << " streamlines with "
+              << vertexCount << " vertices" << std::endl;
+}
+
+void StreamlineRenderer::packStreamlines(const std::vector<std::vector<Point3D>>& streamlines, std::vector<float>& vertices,
+    std::vector<int>& firsts, std::vector<int>& counts) {
+    // Format for each vertex: [x,y,z,r,g,b]
+    int currentIndex = 0;
 
     //precalculate the needed space for the vectors so we don't have to reallocate memory every step
-    int totalVertsSize = 0;
-    int totalIndicesSize = 0;
-    for each(std::vector<Point3D> streamline in streamlines)
+    size_t totalVertsSize = 0;
+    for (const std::vector<Point3D>& streamline : streamlines)
     {
-        totalIndicesSize += streamline.size() + 1; //+1 for the primitive restart
         totalVertsSize += streamline.size() * 6; //6 vertex attributes
     }
     vertices.resize(totalVertsSize);
-    indices.reserve(totalIndicesSize);
+
+    //one vertex range per streamline, also for empty ones so the ranges line up with the streamline indices
+    firsts.resize(streamlines.size());
+    counts.resize(streamlines.size());
+
+    static_assert(sizeof(Point3D) == 3 * sizeof(float), "Point3D is packed as 3 consecutive floats");
+    const KernelSet& kernels = getKernels();
 
     for (int i = 0; i < streamlines.size(); i++)
     {
+        firsts[i] = currentIndex;
+        counts[i] = (int)streamlines[i].size();
         if (streamlines[i].empty()) continue;
-        float r, g, b;
-        for (int j = 0; j < streamlines[i].size()-1; j++)
-        {
-            //get color based on direction
-            r = std::abs(streamlines[i][j + 1].x - streamlines[i][j].x);
-            g = std::abs(streamlines[i][j + 1].y - streamlines[i][j].y);
-            b = std::abs(streamlines[i][j + 1].z - streamlines[i][j].z);
-            //normalize
-            float l = std::sqrtf(r * r + g * g + b * b);
-            r /= l;
-            g /= l;
-            b /= l;
-            
-            //Add point to segment
-            vertices[currentIndex * 6 + 0] = streamlines[i][j].x;
-            vertices[currentIndex * 6 + 1] = streamlines[i][j].y;
-            vertices[currentIndex * 6 + 2] = streamlines[i][j].z;
-            vertices[currentIndex * 6 + 3] = r;
-            vertices[currentIndex * 6 + 4] = g;
-            vertices[currentIndex * 6 + 5] = b;
-            
-            indices.push_back(currentIndex);
-            currentIndex++;
-        }
 
-        //manually add last vertex since we can't calculate the angle
-        vertices[currentIndex * 6 + 0] = streamlines[i][streamlines[i].size() - 1].x;
-        vertices[currentIndex * 6 + 1] = streamlines[i][streamlines[i].size() - 1].y;
-        vertices[currentIndex * 6 + 2] = streamlines[i][streamlines[i].size() - 1].z;
-        vertices[currentIndex * 6 + 3] = r; //definitely ignore this compiler warning
-        vertices[currentIndex * 6 + 4] = g;
-        vertices[currentIndex * 6 + 5] = b;
-
-        indices.push_back(currentIndex);
-        currentIndex++;
-        indices.push_back(0xFFFF);//primitive restart fixed index
+        //positions and direction colors in one pass
+        kernels.packVertices(reinterpret_cast<const float*>(streamlines[i].data()), streamlines[i].size(), &vertices[currentIndex * 6]);
+        currentIndex += (int)streamlines[i].size();
     }
+}
+
+void StreamlineRenderer::uploadVertices(const float* vertices, size_t numVertices, const int* firsts, const int* counts, size_t numStreamlines) {
+    vertexCount = (int)numVertices;
+    if (firsts != streamlineFirsts.data()) streamlineFirsts.assign(firsts, firsts + numStreamlines);
+    if (counts != streamlineCounts.data()) streamlineCounts.assign(counts, counts + numStreamlines);
 
-    vertexCount = vertices.size() / 6; // 6 values per vertex (3 position, 3 color)
-    bufferIndexCount = indices.size();
+    // Everything is visible until a filter is applied
+    highlightedStreamline = -1;
+    densityRestart = true;
+    drawFirsts = streamlineFirsts;
+    drawCounts = streamlineCounts;
 
     // Bind the vertex array and buffer
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindVertexArray(VAO.get());
+    glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
 
     // Upload vertex data
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, numVertices * 6 * sizeof(float), vertices, GL_STATIC_DRAW);
 
     // Unbind
     glBindVertexArray(0);
-
-    std::cout << "Prepared " << streamlines.size() << " streamlines with "
-              << vertexCount << " vertices" << std::endl;
 }
 
-void StreamlineRenderer::render() const {
+void StreamlineRenderer::readVertices(std::vector<float>& vertices, std::vector<int>& firsts, std::vector<int>& counts) const {
+    vertices.resize((size_t)vertexCount * 6);
+    firsts = streamlineFirsts;
+    counts = streamlineCounts;
     if (vertexCount == 0) return;
 
+    glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamlineRenderer::setVisibleStreamlines(const std::vector<unsigned char>& visible) {
+    densityRestart = true;
+    drawFirsts.clear();
+    drawCounts.clear();
+    for (size_t i = 0; i < streamlineFirsts.size(); i++)
+    {
+        if (i < visible.size() && !visible[i]) continue;
+        if (streamlineCounts[i] == 0) continue;
+        drawFirsts.push_back(streamlineFirsts[i]);
+        drawCounts.push_back(streamlineCounts[i]);
+    }
+}
+
+void StreamlineRenderer::setCamera(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model) {
+    shader->use();
+    shader->setMat4("projection", projection);
+    shader->setMat4("view", view);
+    shader->setMat4("model", model);
+    camera = projection * view * model;
+}
+
+void StreamlineRenderer::setDensitySettings(float resolution, float saturation, int frames) {
+    if (resolution != densityResolution || frames != densityFrames) densityRestart = true;
+    densityResolution = resolution;
+    densitySaturation = saturation;
+    densityFrames = frames < 1 ? 1 : frames;
+}
+
+float StreamlineRenderer::getDensityProgress() const {
+    return drawFirsts.empty() ? 1.0f : (float)accumulatedStreamlines / (float)drawFirsts.size();
+}
+
+void StreamlineRenderer::render() {
+    if (vertexCount == 0 || drawFirsts.empty()) return;
+
     shader->use();
+    shader->setBool("highlight", false);
 
     // Set line width
     glLineWidth(lineWidth);
 
-    // Draw lines
-    glBindVertexArray(VAO);
+    if (renderMode == RENDER_MODE_WEIGHTED_BLENDED && compositeShader && renderWeightedBlended())
+    {
+        renderHighlight();
+        return;
+    }
+    if (renderMode == RENDER_MODE_DENSITY && densityResolveShader && renderDensity())
+    {
+        renderHighlight();
+        return;
+    }
+
+    // Draw one line strip per visible streamline in a single call
+    shader->setBool("weightedBlended", false);
+    glBindVertexArray(VAO.get());
+    glMultiDrawArrays(GL_LINE_STRIP, drawFirsts.data(), drawCounts.data(), (GLsizei)drawFirsts.size());
+    glBindVertexArray(0);
+
+    renderHighlight();
+}
+
+bool StreamlineRenderer::renderWeightedBlended() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint screenFramebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &screenFramebuffer);
+
+    if (!transparencyTarget) transparencyTarget.reset(new RenderTarget({ GL_RGBA16F, GL_R16F }, true));
+    if (!transparencyTarget->resize(viewport[2], viewport[3])) return false;
+
+    // The lines are depth tested against the opaque geometry already drawn, but don't occlude each other
+    transparencyTarget->copyDepthFrom((unsigned int)screenFramebuffer);
+    transparencyTarget->bind();
+    const float clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; // alpha holds the revealage, the product of (1 - alpha)
+    const float clearWeight[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+    glClearBufferfv(GL_COLOR, 1, clearWeight);
+
+    // Weighted sums in the color channels, revealage in the alpha of the first target
+    BlendState blendState = saveBlendState();
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+    shader->setBool("weightedBlended", true);
+    shader->setFloat("opacity", opacity);
+    glBindVertexArray(VAO.get());
+    glMultiDrawArrays(GL_LINE_STRIP, drawFirsts.data(), drawCounts.data(), (GLsizei)drawFirsts.size());
+    shader->setBool("weightedBlended", false);
+
+    // Composite the average color with the total coverage onto the screen
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)screenFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glDepthMask(GL_TRUE);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    compositeShader->use();
+    compositeShader->setInt("accumulationTexture", 0);
+    compositeShader->setInt("weightTexture", 1);
+    transparencyTarget->bindTextures(0);
+    drawFullscreenTriangle();
+
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    restoreBlendState(blendState);
+    shader->use();
+    return true;
+}
+
+void StreamlineRenderer::buildDensityBatches() {
+    //batch k holds every densityFrames-th visible streamline starting at k, so every batch is spread over the whole set
+    batchFirsts.resize(drawFirsts.size());
+    batchCounts.resize(drawCounts.size());
+    batchOffsets.assign(densityFrames + 1, 0);
+    size_t next = 0;
+    for (int batch = 0; batch < densityFrames; batch++)
+    {
+        batchOffsets[batch] = next;
+        for (size_t i = batch; i < drawFirsts.size(); i += densityFrames)
+        {
+            batchFirsts[next] = drawFirsts[i];
+            batchCounts[next] = drawCounts[i];
+            next++;
+        }
+    }
+    batchOffsets[densityFrames] = next;
+}
+
+bool StreamlineRenderer::renderDensity() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint screenFramebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &screenFramebuffer);
+
+    if (!densityTarget) densityTarget.reset(new RenderTarget({ GL_R32F }, false));
+    int width = (int)(viewport[2] * densityResolution + 0.5f);
+    int height = (int)(viewport[3] * densityResolution + 0.5f);
+    if (width != densityTarget->getWidth() || height != densityTarget->getHeight()) densityRestart = true;
+    if (!densityTarget->resize(width < 1 ? 1 : width, height < 1 ? 1 : height)) return false;
+
+    //any change of the picture starts the accumulation over
+    if (camera != accumulatedCamera || lineWidth != accumulatedLineWidth) densityRestart = true;
+    densityTarget->bind();
+    if (densityRestart)
+    {
+        buildDensityBatches();
+        const float clearCount[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, clearCount);
+        accumulatedBatches = 0;
+        accumulatedStreamlines = 0;
+        accumulatedCamera = camera;
+        accumulatedLineWidth = lineWidth;
+        densityRestart = false;
+    }
+
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    BlendState blendState = saveBlendState();
+    if (accumulatedBatches < densityFrames)
+    {
+        //every line fragment adds one, all layers count so there is no depth test
+        size_t first = batchOffsets[accumulatedBatches];
+        size_t count = batchOffsets[accumulatedBatches + 1] - first;
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glLineWidth(std::max(1.0f, lineWidth * densityResolution));
+        shader->setBool("density", true);
+        glBindVertexArray(VAO.get());
+        if (count > 0) glMultiDrawArrays(GL_LINE_STRIP, &batchFirsts[first], &batchCounts[first], (GLsizei)count);
+        glBindVertexArray(0);
+        shader->setBool("density", false);
+        glLineWidth(lineWidth);
+        accumulatedBatches++;
+        accumulatedStreamlines += count;
+    }
+
+    //draw the counts, scaled up to the whole set while accumulating, with the colormap
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)screenFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    densityResolveShader->use();
+    densityResolveShader->setInt("densityTexture", 0);
+    densityResolveShader->setFloat("countScale", accumulatedStreamlines > 0 ? (float)drawFirsts.size() / accumulatedStreamlines : 0.0f);
+    densityResolveShader->setFloat("saturation", densitySaturation);
+    densityTarget->bindTextures(0);
+    drawFullscreenTriangle();
 
-    glDrawElements(GL_LINE_STRIP, bufferIndexCount, GL_UNSIGNED_INT, 0);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    restoreBlendState(blendState);
+    shader->use();
+    return true;
+}
+
+void StreamlineRenderer::drawFullscreenTriangle() {
+    if (!emptyVAO) emptyVAO = GLObject(GL_OBJECT_VERTEX_ARRAY);
+    glBindVertexArray(emptyVAO.get());
+    glDrawArrays(GL_TRIANGLES, 0, 3);
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
+
+void StreamlineRenderer::renderHighlight() {
+    // Draw the highlighted streamline again on top of the others
+    if (highlightedStreamline >= 0 && highlightedStreamline < (int)streamlineCounts.size() && streamlineCounts[highlightedStreamline] > 1)
+    {
+        shader->setBool("highlight", true);
+        glLineWidth(lineWidth + 2.0f);
+        glDepthFunc(GL_ALWAYS);
+        glBindVertexArray(VAO.get());
+        glDrawArrays(GL_LINE_STRIP, streamlineFirsts[highlightedStreamline], streamlineCounts[highlightedStreamline]);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LEQUAL);
+        glLineWidth(lineWidth);
+        shader->setBool("highlight", false);
+    }
+}
+
+size_t StreamlineRenderer::getRenderTargetBytes() const {
+    return (transparencyTarget ? transparencyTarget->getMemoryBytes() : 0) + (densityTarget ? densityTarget->getMemoryBytes() : 0);
+}
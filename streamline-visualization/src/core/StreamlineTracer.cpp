@@ -1,37 +1,66 @@
 #include "../include/StreamlineTracer.h"
+#include "../include/SpaceFillingCurve.h"
 #include <cmath>
 #include <iostream>
 #include <random>
-
-// External function declaration for scalar data sampling (implemented in Source.cpp)
-extern float sampleScalarData(float x, float y, float z);
-
-StreamlineTracer::StreamlineTracer(VectorField* field, float step, int steps, float maxLen, float maxAngle, const char* integrationMethod)
-    : vectorField(field), stepSize(step), maxSteps(steps),
-      maxLength(maxLen), maxAngle(maxAngle), integrationMethod(integrationMethod) {
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <glm/gtc/constants.hpp>
+
+StreamlineTracer::StreamlineTracer(std::shared_ptr<const DatasetSnapshot> dataset)
+    : dataset(std::move(dataset)) {
     // Validate input parameters
-    if (!field) {
+    vectorField = this->dataset ? this->dataset->getVectorField() : nullptr;
+    if (!vectorField) {
         std::cerr << "Error: Null vector field provided to StreamlineTracer" << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    this->zeroMask = field->getZeroMask(field->dimX, field->dimY, field->dimZ); //for quicker access
+    this->zeroMask = vectorField->getZeroMask(vectorField->dimX, vectorField->dimY, vectorField->dimZ); //for quicker access
+    this->sliceSeeds = this->dataset->getSeedIndex();
 }
 
-std::vector<Point3D> StreamlineTracer::generateSliceGridSeeds(int currentSliceX, int currentSliceY, int currentSliceZ, int axis)
+StreamlineTracer::TracedField StreamlineTracer::getTracedField(int level, const TracerParams& params) const
 {
-    std::vector<Point3D> seeds;
+    TracedField traced;
+    traced.field = level > 0 ? vectorField->getLevel(level) : vectorField;
+    traced.zeroMask = traced.field->getZeroMask(traced.field->dimX, traced.field->dimY, traced.field->dimZ);
+    traced.interpolation = params.interpolation;
+    traced.flipSign = glm::vec3(params.flipX ? -1.0f : 1.0f, params.flipY ? -1.0f : 1.0f, params.flipZ ? -1.0f : 1.0f);
+    traced.field->prepareInterpolation(params.interpolation);
+    return traced;
+}
 
-    if (!vectorField) 
+StreamlineTracer::TracedField StreamlineTracer::getLevelField(const TracerParams& params, TracerParams& levelParams, float& levelScale) const
+{
+    //a coarse level is traced with the same step size in its own voxels, so the length limit shrinks with it
+    levelParams = params;
+    levelScale = 1.0f;
+    int level = 0;
+    if (params.level > 0 && vectorField->getLevelCount() > 1)
     {
-        std::cerr << "Error: Vector field is nullptr in generateUnifiedBrainSeeds" << std::endl;
-        return seeds;
+        level = std::min(params.level, vectorField->getLevelCount() - 1);
+        levelScale = (float)(1 << level);
+        levelParams.maxLength = params.maxLength / levelScale;
+    }
+    return getTracedField(level, levelParams);
+}
+
+SeedSpan StreamlineTracer::getSliceSeeds(int currentSliceX, int currentSliceY, int currentSliceZ, int axis) const
+{
+    if (!vectorField || !sliceSeeds)
+    {
+        std::cerr << "Error: Vector field is nullptr in getSliceSeeds" << std::endl;
+        return SeedSpan();
     }
 
     if (!(axis == AXIS_X || axis == AXIS_Y || axis == AXIS_Z))
     {
         std::cerr << "Error: undefined axis" << std::endl;
-        return seeds;
+        return SeedSpan();
     }
 
     int dimX = vectorField->dimX;
@@ -41,62 +70,22 @@ std::vector<Point3D> StreamlineTracer::generateSliceGridSeeds(int currentSliceX,
     if (currentSliceX < 0 || currentSliceX >= dimX || currentSliceY < 0 || currentSliceY >= dimY || currentSliceZ < 0 || currentSliceZ >= dimZ)
     {
         std::cerr << "Error: slice out of bounds" << std::endl;
-        return seeds;
-    }
-
-    std::cout << "Generating simple grid slice seeds" << std::endl;
-
-    //preallocate max memory needed for seeds
-    if      (axis == AXIS_X) seeds.reserve(dimY * dimZ);
-    else if (axis == AXIS_Y) seeds.reserve(dimX * dimZ);
-    else if (axis == AXIS_Z) seeds.reserve(dimX * dimY);
-    std::cout << axis << std::endl;
-    if (axis == AXIS_X)
-    {
-        for (int y = 0; y < dimY; y++)
-        {
-            for (int z = 0; z < dimZ; z++)
-            {
-                if (this->zeroMask[currentSliceX + y * dimX + z * dimX * dimY])
-                {
-                    seeds.push_back(Point3D(currentSliceX, y, z));
-                }
-            }
-        }
-    }
-    else if (axis == AXIS_Y)
-    {
-        for (int x = 0; x < dimX; x++)
-        {
-            for (int z = 0; z < dimZ; z++)
-            {
-                if (this->zeroMask[x + currentSliceY * dimX + z * dimX * dimY])
-                {
-                    seeds.push_back(Point3D(x, currentSliceY, z));
-                }
-            }
-        }
-    }
-    else if (axis == AXIS_Z)
-    {
-        for (int x = 0; x < dimX; x++)
-        {
-            for (int y = 0; y < dimY; y++)
-            {
-                if (this->zeroMask[x + y * dimX + currentSliceZ * dimX * dimY])
-                {
-                    seeds.push_back(Point3D(x, y, currentSliceZ));
-                }
-            }
-        }
+        return SeedSpan();
     }
-    seeds.shrink_to_fit();//free the unused memory
 
-    std::cout << "Sampled " << seeds.size() << " seed points" << std::endl;
+    int slice = axis == AXIS_X ? currentSliceX : (axis == AXIS_Y ? currentSliceY : currentSliceZ);
+    SeedSpan seeds = sliceSeeds->getSlice(axis, slice);
+    std::cout << "Sampled " << seeds.size << " seed points" << std::endl;
     return seeds;
 }
 
-std::vector<Point3D> StreamlineTracer::generateMouseSeeds(int sliceX, int sliceY, int sliceZ, int axis, glm::vec3 seedLoc, float seedRadius, float density)
+std::vector<Point3D> StreamlineTracer::generateSliceGridSeeds(int currentSliceX, int currentSliceY, int currentSliceZ, int axis) const
+{
+    SeedSpan seeds = getSliceSeeds(currentSliceX, currentSliceY, currentSliceZ, axis);
+    return std::vector<Point3D>(seeds.begin(), seeds.end());
+}
+
+std::vector<Point3D> StreamlineTracer::generateMouseSeeds(int sliceX, int sliceY, int sliceZ, int axis, glm::vec3 seedLoc, float seedRadius, float density) const
 {
     std::vector<Point3D> seeds;
     
@@ -122,21 +111,22 @@ std::vector<Point3D> StreamlineTracer::generateMouseSeeds(int sliceX, int sliceY
     }
 
     std::cout << "Generating mouse seeds" << std::endl;
+    TracedField traced = getTracedField(0, TracerParams());
 
     if (axis == AXIS_X)
     {
         if (!vectorField->isInBounds(sliceX, seedLoc.y, seedLoc.z)) return seeds;
-        if (!inZeroMask(glm::vec3(sliceX, seedLoc.y, seedLoc.z))) return seeds;
+        if (!inZeroMask(traced, glm::vec3(sliceX, seedLoc.y, seedLoc.z))) return seeds;
     }
     else if (axis == AXIS_Y)
     {
         if (!vectorField->isInBounds(seedLoc.x, sliceY, seedLoc.z)) return seeds;
-        if (!inZeroMask(glm::vec3(seedLoc.x, sliceY, seedLoc.z))) return seeds;
+        if (!inZeroMask(traced, glm::vec3(seedLoc.x, sliceY, seedLoc.z))) return seeds;
     }
     else if (axis == AXIS_Z)
     {
         if (!vectorField->isInBounds(seedLoc.x, seedLoc.y, sliceZ)) return seeds;
-        if (!inZeroMask(glm::vec3(seedLoc.x, seedLoc.y, sliceZ))) return seeds;
+        if (!inZeroMask(traced, glm::vec3(seedLoc.x, seedLoc.y, sliceZ))) return seeds;
     }
     //calculate the volume of the seeding area
     float seedAttenuation = 0.5f;
@@ -148,11 +138,11 @@ std::vector<Point3D> StreamlineTracer::generateMouseSeeds(int sliceX, int sliceY
     for (size_t i = 0; i < maxSeeds; i++)
     {
         //spherical random sampling
-        float r = seedRadius * std::sqrtf((float) std::rand() / RAND_MAX);
-        float theta = (float) std::rand() / RAND_MAX * 2 * std::_Pi_val;
-        float phi = (float)std::rand() / RAND_MAX * std::_Pi_val;
+        float r = seedRadius * std::sqrt((float) std::rand() / RAND_MAX);
+        float theta = (float) std::rand() / RAND_MAX * 2 * glm::pi<double>();
+        float phi = (float)std::rand() / RAND_MAX * glm::pi<double>();
 
-        glm::vec3 seedPoint = glm::vec3(r * std::cosf(theta) * std::sinf(phi), r * std::sinf(theta) * std::sinf(phi), r * std::cosf(phi));
+        glm::vec3 seedPoint = glm::vec3(r * std::cos(theta) * std::sin(phi), r * std::sin(theta) * std::sin(phi), r * std::cos(phi));
         
         if (axis == AXIS_X)
         {
@@ -170,7 +160,7 @@ std::vector<Point3D> StreamlineTracer::generateMouseSeeds(int sliceX, int sliceY
         //check if the seed is valid
         if (vectorField->isInBounds(seedPoint.x, seedPoint.y, seedPoint.z))
         {
-            if (inZeroMask(seedPoint))
+            if (inZeroMask(traced, seedPoint))
             {
                 seeds.push_back(Point3D(seedPoint.x, seedPoint.y, seedPoint.z));
             }
@@ -182,12 +172,158 @@ std::vector<Point3D> StreamlineTracer::generateMouseSeeds(int sliceX, int sliceY
 
 }
 
+/**
+ * Cheap deterministic hash (splitmix64) used to jitter seeds independently of the thread layout.
+ */
+static uint64_t hashSeed(uint64_t v)
+{
+    v += 0x9E3779B97F4A7C15ull;
+    v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+    v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+    return v ^ (v >> 31);
+}
+
+/**
+ * Map a hash to a uniform float in [-0.5, 0.5).
+ */
+static float hashToOffset(uint64_t h)
+{
+    return (float)(h >> 40) / (float)(1ull << 24) - 0.5f;
+}
+
+std::vector<Point3D> StreamlineTracer::generateVolumeSeeds(const VolumeSeedingOptions& options) const
+{
+    std::vector<Point3D> seeds;
+
+    if (!vectorField)
+    {
+        std::cerr << "Error: Vector field is nullptr in generateVolumeSeeds" << std::endl;
+        return seeds;
+    }
+
+    if (options.useFAThreshold && !vectorField->hasFA())
+    {
+        std::cerr << "Warning: FA threshold requested but the vector field has no FA, ignoring it" << std::endl;
+    }
+
+    std::cout << "Generating volume seeds" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+
+    int dimX = vectorField->dimX;
+    int dimY = vectorField->dimY;
+    int dimZ = vectorField->dimZ;
+    int seedsPerVoxel = std::max(1, options.seedsPerVoxel);
+    bool useFA = options.useFAThreshold && vectorField->hasFA();
+    const ScalarVolume& scalars = dataset->getScalars();
+
+    //the bricks are visited in Morton order
+    int bricksX = (dimX + SEED_BRICK_SIZE - 1) / SEED_BRICK_SIZE;
+    int bricksY = (dimY + SEED_BRICK_SIZE - 1) / SEED_BRICK_SIZE;
+    int bricksZ = (dimZ + SEED_BRICK_SIZE - 1) / SEED_BRICK_SIZE;
+    std::vector<std::pair<uint64_t, glm::ivec3>> bricks;
+    bricks.reserve(bricksX * bricksY * bricksZ);
+    for (int bx = 0; bx < bricksX; bx++)
+    {
+        for (int by = 0; by < bricksY; by++)
+        {
+            for (int bz = 0; bz < bricksZ; bz++)
+            {
+                bricks.push_back(std::make_pair(mortonEncode3D(bx, by, bz), glm::ivec3(bx, by, bz)));
+            }
+        }
+    }
+    std::sort(bricks.begin(), bricks.end(),
+        [](const std::pair<uint64_t, glm::ivec3>& a, const std::pair<uint64_t, glm::ivec3>& b) { return a.first < b.first; });
+
+    //voxels inside a brick are visited in Morton order as well, so the concatenation is in global Morton order
+    std::vector<std::pair<uint64_t, glm::ivec3>> brickVoxels;
+    brickVoxels.reserve(SEED_BRICK_SIZE * SEED_BRICK_SIZE * SEED_BRICK_SIZE);
+    for (int x = 0; x < SEED_BRICK_SIZE; x++)
+    {
+        for (int y = 0; y < SEED_BRICK_SIZE; y++)
+        {
+            for (int z = 0; z < SEED_BRICK_SIZE; z++)
+            {
+                brickVoxels.push_back(std::make_pair(mortonEncode3D(x, y, z), glm::ivec3(x, y, z)));
+            }
+        }
+    }
+    std::sort(brickVoxels.begin(), brickVoxels.end(),
+        [](const std::pair<uint64_t, glm::ivec3>& a, const std::pair<uint64_t, glm::ivec3>& b) { return a.first < b.first; });
+
+    std::vector<std::vector<Point3D>> brickSeeds(bricks.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < (int)bricks.size(); b++)
+    {
+        glm::ivec3 origin = glm::ivec3(bricks[b].second.x * SEED_BRICK_SIZE, bricks[b].second.y * SEED_BRICK_SIZE, bricks[b].second.z * SEED_BRICK_SIZE);
+        std::vector<Point3D>& local = brickSeeds[b];
+
+        //a brick is empty if all its slices along any axis are, e.g. the background around the brain
+        if (sliceSeeds && (sliceSeeds->isRangeEmpty(AXIS_X, origin.x, origin.x + SEED_BRICK_SIZE - 1)
+            || sliceSeeds->isRangeEmpty(AXIS_Y, origin.y, origin.y + SEED_BRICK_SIZE - 1)
+            || sliceSeeds->isRangeEmpty(AXIS_Z, origin.z, origin.z + SEED_BRICK_SIZE - 1))) continue;
+
+        for (size_t v = 0; v < brickVoxels.size(); v++)
+        {
+            int x = origin.x + brickVoxels[v].second.x;
+            int y = origin.y + brickVoxels[v].second.y;
+            int z = origin.z + brickVoxels[v].second.z;
+            if (x >= dimX || y >= dimY || z >= dimZ) continue;
+
+            int index = x + y * dimX + z * dimX * dimY;
+            if (!this->zeroMask[index]) continue;
+            if (options.roiMask && !options.roiMask[index]) continue;
+            if (options.useScalarThreshold && !(scalars.sample(x, y, z) > options.scalarThreshold)) continue;
+            if (useFA && !(vectorField->getFA(x, y, z) > options.faThreshold)) continue;
+
+            for (int k = 0; k < seedsPerVoxel; k++)
+            {
+                if (!options.jitter)
+                {
+                    local.push_back(Point3D(x, y, z));
+                    continue;
+                }
+
+                uint64_t h = hashSeed(((uint64_t)index * seedsPerVoxel + k) ^ ((uint64_t)options.randomSeed << 40));
+                float jx = std::max(0.0f, std::min(dimX - 1.0f, x + hashToOffset(h)));
+                float jy = std::max(0.0f, std::min(dimY - 1.0f, y + hashToOffset(hashSeed(h))));
+                float jz = std::max(0.0f, std::min(dimZ - 1.0f, z + hashToOffset(hashSeed(h + 1))));
+                local.push_back(Point3D(jx, jy, jz));
+            }
+        }
+    }
+
+    size_t total = 0;
+    for (size_t b = 0; b < brickSeeds.size(); b++) total += brickSeeds[b].size();
+
+    //respect the global budget by keeping an evenly spread subset, which keeps the Morton order intact
+    size_t budget = options.maxSeeds > 0 ? std::min(total, (size_t)options.maxSeeds) : total;
+    seeds.reserve(budget);
+    size_t i = 0;
+    for (size_t b = 0; b < brickSeeds.size(); b++)
+    {
+        for (size_t s = 0; s < brickSeeds[b].size(); s++, i++)
+        {
+            if (budget == total || (i + 1) * budget / total > i * budget / total)
+            {
+                seeds.push_back(brickSeeds[b][s]);
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Sampled " << seeds.size() << " volume seeds (" << total << " candidates) in " << seconds * 1000.0 << " ms, "
+              << (seconds > 0.0 ? seeds.size() / seconds : 0.0) << " seeds/s" << std::endl;
+    return seeds;
+}
+
 std::vector<std::vector<Point3D>> StreamlineTracer::traceVectors(std::vector<Point3D> seeds)
 {
     std::vector<std::vector<Point3D>> streamlines;
     streamlines.reserve(seeds.size());  // Pre-allocate memory
 
-    for each(Point3D seed in seeds)
+    for (Point3D seed : seeds)
     {
         float vx, vy, vz;
         vectorField->getVector(seed.x, seed.y, seed.z, vx, vy, vz);
@@ -210,17 +346,31 @@ std::vector<std::vector<Point3D>> StreamlineTracer::traceVectors(std::vector<Poi
     return streamlines;
 }
 
-std::vector<Point3D> StreamlineTracer::traceStreamline(const Point3D& seed) {
+std::vector<Point3D> StreamlineTracer::traceStreamline(const Point3D& seed, const TracerParams& params) const {
+    TerminationReason backwardReason, forwardReason;
+    return traceStreamline(getTracedField(0, params), params, seed, backwardReason, forwardReason);
+}
+
+std::vector<Point3D> StreamlineTracer::traceStreamline(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+    TerminationReason& backwardReason, TerminationReason& forwardReason) {
     std::vector<Point3D> streamline;
+    backwardReason = forwardReason = TERMINATED_INVALID;
 
     // Validate seed point
-    if (!vectorField->isInBounds(seed.x, seed.y, seed.z)) {
+    if (!traced.field->isInBounds(seed.x, seed.y, seed.z)) {
         return streamline;
     }
 
     // Trace in both directions from the seed point
-    std::vector<Point3D> forwardPath = traceStreamlineDirection(seed, 1);
-    std::vector<Point3D> backwardPath = traceStreamlineDirection(seed, -1);
+    std::vector<Point3D> forwardPath = traceStreamlineDirection(traced, params, seed, 1, forwardReason);
+    std::vector<Point3D> backwardPath = traceStreamlineDirection(traced, params, seed, -1, backwardReason);
+
+    return joinStreamline(seed, backwardPath, forwardPath);
+}
+
+std::vector<Point3D> StreamlineTracer::joinStreamline(const Point3D& seed, const std::vector<Point3D>& backwardPath, const std::vector<Point3D>& forwardPath)
+{
+    std::vector<Point3D> streamline;
 
     // Combine paths
     if (forwardPath.size() + backwardPath.size() > 0) //we skip empty paths
@@ -232,32 +382,38 @@ std::vector<Point3D> StreamlineTracer::traceStreamline(const Point3D& seed) {
         streamline.insert(streamline.end(), forwardPath.begin(), forwardPath.end());
     }
 
-    streamline.shrink_to_fit();
-
     return streamline;
 }
 
-bool StreamlineTracer::inZeroMask(glm::vec3 v)
+bool StreamlineTracer::inZeroMask(const TracedField& traced, glm::vec3 v)
 {
     int x = std::roundf(v.x);
     int y = std::roundf(v.y);
     int z = std::roundf(v.z);
+    const VectorField* field = traced.field;
     
     //first sanity check if the coordinates are even in the domain of the mask
-    if (x < 0 || x >= this->vectorField->dimX || y < 0 || y >= this->vectorField->dimY || z < 0 || z >= this->vectorField->dimZ)
+    if (x < 0 || x >= field->dimX || y < 0 || y >= field->dimY || z < 0 || z >= field->dimZ)
     {
         return false;
     }
 
     //check the value of the zero mask at the point
-    return this->zeroMask[x + y * this->vectorField->dimX + z * this->vectorField->dimX * this->vectorField->dimY];
+    return traced.zeroMask[x + y * field->dimX + z * field->dimX * field->dimY];
+}
+
+glm::vec3 StreamlineTracer::sampleVector(const TracedField& traced, glm::vec3 pos)
+{
+    //the flips are linear so they can be applied after interpolating
+    glm::vec3 v;
+    traced.field->interpolateVector(pos.x, pos.y, pos.z, traced.interpolation, v.x, v.y, v.z);
+    return v * traced.flipSign;
 }
 
-glm::vec3 StreamlineTracer::rk2Integrate(glm::vec3 pos, float step)
+glm::vec3 StreamlineTracer::rk2Integrate(const TracedField& traced, glm::vec3 pos, float step)
 {
     //x0 = pos
-    glm::vec3 vx0; //v(x0)
-    vectorField->interpolateVector(pos.x, pos.y, pos.z, vx0.x, vx0.y, vx0.z);
+    glm::vec3 vx0 = sampleVector(traced, pos); //v(x0)
 
     //check for zero vector
     if (vx0 == glm::vec3(0.0f))
@@ -267,8 +423,7 @@ glm::vec3 StreamlineTracer::rk2Integrate(glm::vec3 pos, float step)
 
     glm::vec3 x1 = pos + 0.5f * step * glm::normalize(vx0);//midpoint
 
-    glm::vec3 vx1;
-    vectorField->interpolateVector(x1.x, x1.y, x1.z, vx1.x, vx1.y, vx1.z); //get the vector at the midpoint
+    glm::vec3 vx1 = sampleVector(traced, x1); //get the vector at the midpoint
 
     if (vx1 == glm::vec3(0.0f))
     {
@@ -279,11 +434,10 @@ glm::vec3 StreamlineTracer::rk2Integrate(glm::vec3 pos, float step)
     return next;
 }
 
-glm::vec3 StreamlineTracer::eulerIntegrate(glm::vec3 pos, float step)
+glm::vec3 StreamlineTracer::eulerIntegrate(const TracedField& traced, glm::vec3 pos, float step)
 {
     //do first step manually so the loop can check angles more easily
-    glm::vec3 vectorAtPos;
-    vectorField->interpolateVector(pos.x, pos.y, pos.z, vectorAtPos.x, vectorAtPos.y, vectorAtPos.z);
+    glm::vec3 vectorAtPos = sampleVector(traced, pos);
 
     if (vectorAtPos == glm::vec3(0.0f))
     {
@@ -295,76 +449,121 @@ glm::vec3 StreamlineTracer::eulerIntegrate(glm::vec3 pos, float step)
     return next;
 }
 
-std::vector<Point3D> StreamlineTracer::traceStreamlineDirection(const Point3D& seed, int direction)
+std::vector<Point3D> StreamlineTracer::traceStreamlineDirection(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+    int direction, TerminationReason& reason, std::vector<float>* angles)
 {
     std::vector<Point3D> path;
-    path.reserve(this->maxSteps); //preallocate max memory for the path
+    path.reserve(params.maxSteps); //preallocate max memory for the path
+    if (angles)
+    {
+        angles->clear();
+        angles->reserve(params.maxSteps);
+    }
 
-    float totalLength = 0.0f;
+    glm::vec3 nextPos;
+    if (firstStreamlineStep(traced, params, seed, direction, nextPos, reason))
+    {
+        path.push_back(Point3D(nextPos.x, nextPos.y, nextPos.z));
+        if (angles) angles->push_back(0.0f); //the first step has no previous direction to turn from
+    }
+    else
+    {
+        path.shrink_to_fit(); //release unused memory
+        return path;
+    }
 
+    //calculate the rest of the path
+    continueStreamlineDirection(traced, params, seed, direction, path, angles, reason);
+    return path;
+}
+
+bool StreamlineTracer::firstStreamlineStep(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+    int direction, glm::vec3& nextPos, TerminationReason& reason)
+{
     glm::vec3 currentPos = glm::vec3(seed.x, seed.y, seed.z); //convert to glm vector for easier algebra
 
-    glm::vec3 nextPos;
-    if (strcmp(this->integrationMethod, StreamlineTracer::EULER) == 0) //c string comparison
+    if (strcmp(params.integrationMethod, StreamlineTracer::EULER) == 0) //c string comparison
     {
-        nextPos = eulerIntegrate(currentPos, this->stepSize * direction);
+        nextPos = eulerIntegrate(traced, currentPos, params.stepSize * direction);
     }
-    else if (strcmp(this->integrationMethod, StreamlineTracer::RUNGE_KUTTA_2ND_ORDER) == 0)
+    else if (strcmp(params.integrationMethod, StreamlineTracer::RUNGE_KUTTA_2ND_ORDER) == 0)
     {
-        nextPos = rk2Integrate(currentPos, this->stepSize * direction);
+        nextPos = rk2Integrate(traced, currentPos, params.stepSize * direction);
     }
     else
     {
         std::cerr << "ERROR: invalid integration method given." << std::endl;
-        path.shrink_to_fit();
-        return path;
+        reason = TERMINATED_INVALID;
+        return false;
     }
 
     //check if the seed and next position are valid
-    if (inZeroMask(nextPos) && inZeroMask(currentPos))
+    if (!(inZeroMask(traced, nextPos) && inZeroMask(traced, currentPos)))
     {
-        path.push_back(Point3D(nextPos.x, nextPos.y, nextPos.z));
-    }
-    else
-    {
-        path.shrink_to_fit(); //release unused memory
-        return path;
+        reason = TERMINATED_MASK;
+        return false;
     }
+    return true;
+}
 
-    glm::vec3 prevPos = currentPos;
-    currentPos = nextPos;
+void StreamlineTracer::continueStreamlineDirection(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+    int direction, std::vector<Point3D>& path, std::vector<float>* angles, TerminationReason& reason)
+{
+    size_t last = path.size() - 1;
+    glm::vec3 prevPos = last > 0 ? glm::vec3(path[last - 1].x, path[last - 1].y, path[last - 1].z) : glm::vec3(seed.x, seed.y, seed.z);
+    glm::vec3 currentPos = glm::vec3(path[last].x, path[last].y, path[last].z);
+    int step = (int)path.size();
+    integrateStreamlineDirection(traced, params, direction, prevPos, currentPos, step, path, angles, reason, -FLT_MAX, FLT_MAX);
+}
 
-    //calculate the rest of the path
-    for (int step = 1; step < maxSteps && totalLength < maxLength; step++)
+bool StreamlineTracer::integrateStreamlineDirection(const TracedField& traced, const TracerParams& params, int direction,
+    glm::vec3& prevPos, glm::vec3& currentPos, int& step, std::vector<Point3D>& path, std::vector<float>* angles,
+    TerminationReason& reason, float xBegin, float xEnd)
+{
+    //summed step by step like below, so a resumed path sees the same length as an uninterrupted one
+    float totalLength = 0.0f;
+    for (int i = 1; i < step; i++) totalLength += params.stepSize;
+    bool bounded = xBegin > -FLT_MAX || xEnd < FLT_MAX;
+
+    for (; step < params.maxSteps && totalLength < params.maxLength; step++)
     {
+        //a half that left the slab is continued by the owner of its current point
+        if (bounded && !(currentPos.x >= xBegin && currentPos.x < xEnd)) return false;
+
         glm::vec3 nextPos;
-        if (strcmp(this->integrationMethod, StreamlineTracer::EULER) == 0)
+        if (strcmp(params.integrationMethod, StreamlineTracer::EULER) == 0)
         {
-            nextPos = eulerIntegrate(currentPos, this->stepSize * direction);
+            nextPos = eulerIntegrate(traced, currentPos, params.stepSize * direction);
         }
-        else if (strcmp(this->integrationMethod, StreamlineTracer::RUNGE_KUTTA_2ND_ORDER) == 0)
+        else if (strcmp(params.integrationMethod, StreamlineTracer::RUNGE_KUTTA_2ND_ORDER) == 0)
         {
-            nextPos = rk2Integrate(currentPos, this->stepSize * direction);
+            nextPos = rk2Integrate(traced, currentPos, params.stepSize * direction);
         }
         else
         {
             std::cerr << "ERROR: invalid integration method given." << std::endl;
+            reason = TERMINATED_INVALID;
             path.shrink_to_fit();
-            return path;
+            if (angles) angles->shrink_to_fit();
+            return true;
         }
 
         //check if the algorithm hasn't hit a zero direction vector point since then it will get stuck
         if (nextPos == currentPos)
         {
+            reason = TERMINATED_ZERO_VECTOR;
             path.shrink_to_fit(); //release unused memory
-            return path;
+            if (angles) angles->shrink_to_fit();
+            return true;
         }
 
         //check if the next point is still in bounds
-        if (!inZeroMask(nextPos))
+        if (!inZeroMask(traced, nextPos))
         {
+            reason = TERMINATED_MASK;
             path.shrink_to_fit(); //release unused memory
-            return path;
+            if (angles) angles->shrink_to_fit();
+            return true;
         }
 
         //printf("seed Vector: (%.2f, %.2f, %.2f)\n", prevPos.x, prevPos.y, prevPos.z);
@@ -382,56 +581,403 @@ std::vector<Point3D> StreamlineTracer::traceStreamlineDirection(const Point3D& s
         //check if the angle between the vectors is too big
         //TODO something might be wrong with the angle constraint
         //printf("Vector: (%.2f, %.2f, %.2f) direction: %i\n", nextPos.x, nextPos.y, nextPos.z, direction);
-        //std::cout << "Angle between vectors: " << std::acosf(cosAngle) << " max angle: " << this->maxAngle << std::endl;
-        if (!(std::acosf(cosAngle) < this->maxAngle))
+        //std::cout << "Angle between vectors: " << std::acosf(cosAngle) << " max angle: " << params.maxAngle << std::endl;
+        float angle = std::acos(cosAngle);
+        if (!(angle < params.maxAngle))
         {
+            reason = TERMINATED_ANGLE;
             path.shrink_to_fit(); //release unused memory
-            return path;
+            if (angles) angles->shrink_to_fit();
+            return true;
         }
 
         //std::cout << "direction: " << direction << std::endl;
         path.push_back(Point3D(nextPos.x, nextPos.y, nextPos.z));
+        if (angles) angles->push_back(angle);
 
         prevPos = currentPos;
         currentPos = nextPos;
 
-        totalLength += this->stepSize; //discrete stepsize is used so no need to calculate the length of the actual vector
+        totalLength += params.stepSize; //discrete stepsize is used so no need to calculate the length of the actual vector
     }
 
+    reason = step >= params.maxSteps ? TERMINATED_MAX_STEPS : TERMINATED_MAX_LENGTH;
     path.shrink_to_fit(); //release unused memory
-    return path;
+    if (angles) angles->shrink_to_fit();
+    return true;
 }
 
-std::vector<std::vector<Point3D>> StreamlineTracer::traceAllStreamlines(const std::vector<Point3D>& seeds) {
-    std::vector<std::vector<Point3D>> streamlines;
-    streamlines.reserve(seeds.size());  // Pre-allocate memory
+bool StreamlineTracer::limitStreamlineDirection(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+    int direction, float previousMaxAngle, TracedHalf& half, bool& resumed)
+{
+    resumed = false;
+
+    //a half that stopped before its first step did so regardless of the limits
+    if (half.points.empty()) return false;
+
+    //replay the checks of the loop in continueStreamlineDirection on the recorded steps
+    float totalLength = 0.0f;
+    int step = 1;
+    TerminationReason reason = TERMINATED_ANGLE;
+    for (; step < params.maxSteps && totalLength < params.maxLength; step++)
+    {
+        if ((size_t)step == half.points.size())
+        {
+            //out of recorded steps: the mask and a zero vector stop the half under any limits, the angle unless it was raised
+            if (half.reason == TERMINATED_MASK || half.reason == TERMINATED_ZERO_VECTOR || half.reason == TERMINATED_INVALID) return false;
+            if (half.reason == TERMINATED_ANGLE && !(params.maxAngle > previousMaxAngle)) return false;
+
+            //a raised limit lets the half go on from where it stopped
+            TerminationReason previousReason = half.reason;
+            continueStreamlineDirection(traced, params, seed, direction, half.points, &half.angles, half.reason);
+            resumed = true;
+            return half.reason != previousReason || half.points.size() != (size_t)step;
+        }
+        if (!(half.angles[step] < params.maxAngle)) break;
+        totalLength += params.stepSize;
+    }
+    if (!(step < params.maxSteps && totalLength < params.maxLength))
+    {
+        reason = step >= params.maxSteps ? TERMINATED_MAX_STEPS : TERMINATED_MAX_LENGTH;
+    }
+
+    //cut the half in place at the step the new limits stop it
+    if (half.points.size() == (size_t)step && half.reason == reason) return false;
+    half.points.resize(step);
+    half.angles.resize(step);
+    half.reason = reason;
+    return true;
+}
+
+std::vector<size_t> StreamlineTracer::computeSeedOrder(SeedSpan seeds, const char* seedOrdering) const
+{
+    std::vector<size_t> order(seeds.size);
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+    bool useMorton = strcmp(seedOrdering, StreamlineTracer::SEED_ORDER_MORTON) == 0;
+    bool useHilbert = strcmp(seedOrdering, StreamlineTracer::SEED_ORDER_HILBERT) == 0;
+    if (!useMorton && !useHilbert) return order;
+
+    //number of bits needed to address every voxel along the largest axis
+    int maxDim = std::max(vectorField->dimX, std::max(vectorField->dimY, vectorField->dimZ));
+    int bits = 1;
+    while ((1 << bits) < maxDim) bits++;
+
+    std::vector<uint64_t> keys(seeds.size);
+#pragma omp parallel for
+    for (long long i = 0; i < (long long)seeds.size; i++)
+    {
+        uint32_t x = (uint32_t)std::max(0.0f, seeds[i].x);
+        uint32_t y = (uint32_t)std::max(0.0f, seeds[i].y);
+        uint32_t z = (uint32_t)std::max(0.0f, seeds[i].z);
+        keys[i] = useHilbert ? hilbertEncode3D(x, y, z, bits) : mortonEncode3D(x, y, z);
+    }
+
+    //stable so seeds in the same voxel keep their generator order
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+    return order;
+}
+
+StreamlineAttributeValues StreamlineTracer::computeAttributes(const std::vector<Point3D>& streamline, TerminationReason backwardReason, TerminationReason forwardReason) const
+{
+    const VectorField* field = vectorField;
+    const ScalarVolume& scalars = dataset->getScalars();
+    float length = 0.0f;
+    float totalTurn = 0.0f;
+    float faSum = 0.0f;
+    float faMin = 1.0f;
+    float scalarSum = 0.0f;
+    bool hasFA = field->hasFA();
+
+    glm::vec3 prevDir;
+    for (size_t i = 0; i < streamline.size(); i++)
+    {
+        const Point3D& p = streamline[i];
+        float fa = hasFA ? field->getFA((int)std::roundf(p.x), (int)std::roundf(p.y), (int)std::roundf(p.z)) : 0.0f;
+        faSum += fa;
+        faMin = std::min(faMin, fa);
+        scalarSum += scalars.sample(p.x, p.y, p.z);
+
+        if (i == 0) continue;
+        glm::vec3 segment = glm::vec3(p.x - streamline[i - 1].x, p.y - streamline[i - 1].y, p.z - streamline[i - 1].z);
+        float segmentLength = glm::length(segment);
+        if (segmentLength <= 0.0f) continue;
+        glm::vec3 dir = segment / segmentLength;
+        if (length > 0.0f)
+        {
+            totalTurn += std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(prevDir, dir))));
+        }
+        length += segmentLength;
+        prevDir = dir;
+    }
+
+    float n = (float)std::max<size_t>(1, streamline.size());
+    StreamlineAttributeValues values;
+    values.length = length;
+    values.stepCount = (float)(streamline.size() > 0 ? streamline.size() - 1 : 0);
+    values.meanFA = faSum / n;
+    values.minFA = streamline.empty() ? 0.0f : faMin;
+    values.meanScalar = scalarSum / n;
+    values.curvature = length > 0.0f ? totalTurn / length : 0.0f;
+    values.backwardTermination = backwardReason;
+    values.forwardTermination = forwardReason;
+    return values;
+}
+
+std::vector<std::vector<Point3D>> StreamlineTracer::traceAllStreamlines(SeedSpan seeds, const TracerParams& tracerParams,
+    StreamlineAttributes* attributes, std::vector<size_t>* seedIndices, PerfCounterValues* counterTotals, TraceState* state) const {
+    std::vector<size_t> order = computeSeedOrder(seeds, tracerParams.seedOrdering);
+    if (counterTotals) *counterTotals = PerfCounterValues();
+
+    TracerParams params;
+    float levelScale;
+    TracedField traced = getLevelField(tracerParams, params, levelScale);
+
+    if (state)
+    {
+        state->dataset = dataset;
+        state->params = tracerParams;
+        state->seeds.assign(seeds.begin(), seeds.end());
+        state->backward.assign(seeds.size, TracedHalf());
+        state->forward.assign(seeds.size, TracedHalf());
+    }
+
+    //one slot per seed, so the result doesn't depend on which thread traced which seed or finished first
+    std::vector<std::vector<Point3D>> slots(seeds.size);
+    std::vector<StreamlineAttributeValues> attributeSlots(attributes ? seeds.size : 0);
 
     // Use OpenMP for parallel processing
 #pragma omp parallel
     {
-        std::vector<std::vector<Point3D>> localStreamlines;
+        //opening the counters costs system calls per thread, so only when they are asked for
+        std::unique_ptr<PerfCounters> counters;
+        if (counterTotals)
+        {
+            counters.reset(new PerfCounters());
+            counters->start();
+        }
 
-#pragma omp for nowait
-        for (size_t i = 0; i < seeds.size(); i++) {
-            std::vector<Point3D> streamline = traceStreamline(seeds[i]);
+        //static scheduling hands every thread one contiguous, and thus spatially compact, range of the curve
+#pragma omp for schedule(static) nowait
+        for (long long i = 0; i < (long long)seeds.size; i++) {
+            size_t seedIndex = order[i];
+            TerminationReason backwardReason, forwardReason;
+            Point3D seed = seeds[seedIndex];
+            if (levelScale != 1.0f)
+            {
+                seed = Point3D((seed.x + 0.5f) / levelScale - 0.5f, (seed.y + 0.5f) / levelScale - 0.5f, (seed.z + 0.5f) / levelScale - 0.5f);
+            }
+            std::vector<Point3D> streamline;
+            if (state)
+            {
+                //the same trace as traceStreamline, but the halves and their turning angles are kept
+                TracedHalf& backward = state->backward[seedIndex];
+                TracedHalf& forward = state->forward[seedIndex];
+                if (traced.field->isInBounds(seed.x, seed.y, seed.z))
+                {
+                    forward.points = traceStreamlineDirection(traced, params, seed, 1, forward.reason, &forward.angles);
+                    backward.points = traceStreamlineDirection(traced, params, seed, -1, backward.reason, &backward.angles);
+                }
+                backwardReason = backward.reason;
+                forwardReason = forward.reason;
+                streamline = joinStreamline(seed, backward.points, forward.points);
+            }
+            else
+            {
+                streamline = traceStreamline(traced, params, seed, backwardReason, forwardReason);
+            }
+            if (levelScale != 1.0f)
+            {
+                for (Point3D& p : streamline)
+                {
+                    p = Point3D((p.x + 0.5f) * levelScale - 0.5f, (p.y + 0.5f) * levelScale - 0.5f, (p.z + 0.5f) * levelScale - 0.5f);
+                }
+            }
 
             // Only keep streamlines with sufficient points
             if (streamline.size() > 2) {
-                localStreamlines.push_back(std::move(streamline));
+                if (attributes) attributeSlots[seedIndex] = computeAttributes(streamline, backwardReason, forwardReason);
+                slots[seedIndex] = std::move(streamline);
             }
         }
 
-        // Combine local results
-#pragma omp critical
+        if (counters)
         {
-            streamlines.insert(
-                streamlines.end(),
-                localStreamlines.begin(),
-                localStreamlines.end()
-            );
+            PerfCounterValues threadCounters = counters->stop();
+#pragma omp critical
+            {
+                counterTotals->add(threadCounters);
+            }
         }
     }
 
-    streamlines.shrink_to_fit();
+    std::vector<std::vector<Point3D>> streamlines = compactStreamlines(slots, attributeSlots, attributes, seedIndices);
+    if (state) state->attributeValues = std::move(attributeSlots);
+    return streamlines;
+}
+
+std::vector<std::vector<Point3D>> StreamlineTracer::compactStreamlines(std::vector<std::vector<Point3D>>& slots,
+    const std::vector<StreamlineAttributeValues>& attributeSlots, StreamlineAttributes* attributes, std::vector<size_t>* seedIndices)
+{
+    // Compact the kept streamlines in seed order, moving only the point vectors
+    size_t kept = 0;
+    for (const std::vector<Point3D>& slot : slots) {
+        if (!slot.empty()) kept++;
+    }
+
+    std::vector<std::vector<Point3D>> streamlines;
+    streamlines.reserve(kept);
+    if (attributes)
+    {
+        attributes->clear();
+        attributes->reserve(kept);
+    }
+    if (seedIndices)
+    {
+        seedIndices->clear();
+        seedIndices->reserve(kept);
+    }
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].empty()) continue;
+        streamlines.push_back(std::move(slots[i]));
+        if (attributes) attributes->push_back(attributeSlots[i]);
+        if (seedIndices) seedIndices->push_back(i);
+    }
+
     return streamlines;
-}
\ No newline at end of file
+}
+
+bool StreamlineTracer::canUpdateStreamlines(const TraceState& state, SeedSpan seeds, const TracerParams& params) const
+{
+    if (state.empty() || state.dataset.lock() != dataset) return false;
+    if (state.seeds.size() != seeds.size || memcmp(state.seeds.data(), seeds.data, seeds.size * sizeof(Point3D)) != 0) return false;
+
+    //everything but the limits has to match, the seed order doesn't change the result
+    TracerParams limited = params;
+    limited.maxSteps = state.params.maxSteps;
+    limited.maxLength = state.params.maxLength;
+    limited.maxAngle = state.params.maxAngle;
+    limited.seedOrdering = state.params.seedOrdering;
+    return limited == state.params;
+}
+
+std::vector<std::vector<Point3D>> StreamlineTracer::updateStreamlines(TraceState& state, const TracerParams& tracerParams,
+    StreamlineAttributes* attributes, std::vector<size_t>* seedIndices, size_t* resumed) const {
+    TracerParams params;
+    float levelScale;
+    TracedField traced = getLevelField(tracerParams, params, levelScale);
+
+    //attributes are kept per seed, so only the streamlines that changed need new ones
+    bool hadAttributes = !state.attributeValues.empty();
+    if (!attributes) state.attributeValues.clear();
+    else if (!hadAttributes) state.attributeValues.resize(state.seeds.size());
+
+    std::vector<std::vector<Point3D>> slots(state.seeds.size());
+    long long resumedHalves = 0;
+
+    //most seeds only compare a few angles while some trace on, so the seeds are handed out dynamically
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:resumedHalves)
+    for (long long i = 0; i < (long long)state.seeds.size(); i++) {
+        Point3D seed = state.seeds[i];
+        if (levelScale != 1.0f)
+        {
+            seed = Point3D((seed.x + 0.5f) / levelScale - 0.5f, (seed.y + 0.5f) / levelScale - 0.5f, (seed.z + 0.5f) / levelScale - 0.5f);
+        }
+        TracedHalf& backward = state.backward[i];
+        TracedHalf& forward = state.forward[i];
+        bool backwardResumed, forwardResumed;
+        bool changed = limitStreamlineDirection(traced, params, seed, -1, state.params.maxAngle, backward, backwardResumed);
+        changed = limitStreamlineDirection(traced, params, seed, 1, state.params.maxAngle, forward, forwardResumed) || changed;
+        resumedHalves += (backwardResumed ? 1 : 0) + (forwardResumed ? 1 : 0);
+
+        std::vector<Point3D> streamline = joinStreamline(seed, backward.points, forward.points);
+        if (levelScale != 1.0f)
+        {
+            for (Point3D& p : streamline)
+            {
+                p = Point3D((p.x + 0.5f) * levelScale - 0.5f, (p.y + 0.5f) * levelScale - 0.5f, (p.z + 0.5f) * levelScale - 0.5f);
+            }
+        }
+
+        // Only keep streamlines with sufficient points
+        if (streamline.size() > 2) {
+            if (attributes && (changed || !hadAttributes)) state.attributeValues[i] = computeAttributes(streamline, backward.reason, forward.reason);
+            slots[i] = std::move(streamline);
+        }
+    }
+
+    state.params = tracerParams;
+    if (resumed) *resumed = (size_t)resumedHalves;
+    return compactStreamlines(slots, state.attributeValues, attributes, seedIndices);
+}
+
+void StreamlineTracer::traceHalvesInSlab(const TracerParams& params, std::vector<SlabHalf>& halves, float xBegin, float xEnd) const
+{
+    TracedField traced = getTracedField(0, params);
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (long long i = 0; i < (long long)halves.size(); i++) {
+        SlabHalf& half = halves[i];
+        half.points.clear();
+        half.stopped = true;
+
+        glm::vec3 prevPos = glm::vec3(half.prevPos.x, half.prevPos.y, half.prevPos.z);
+        glm::vec3 currentPos = glm::vec3(half.currentPos.x, half.currentPos.y, half.currentPos.z);
+        int step = half.step;
+        if (step == 0)
+        {
+            //the seed checks of traceStreamline and the first step of traceStreamlineDirection
+            const Point3D& seed = half.currentPos;
+            glm::vec3 nextPos;
+            if (!traced.field->isInBounds(seed.x, seed.y, seed.z))
+            {
+                half.reason = TERMINATED_INVALID;
+                continue;
+            }
+            if (!firstStreamlineStep(traced, params, seed, half.direction, nextPos, half.reason)) continue;
+            half.points.push_back(Point3D(nextPos.x, nextPos.y, nextPos.z));
+            prevPos = currentPos;
+            currentPos = nextPos;
+            step = 1;
+        }
+
+        TerminationReason reason = half.reason;
+        half.stopped = integrateStreamlineDirection(traced, params, half.direction, prevPos, currentPos, step, half.points, nullptr, reason, xBegin, xEnd);
+        half.reason = reason;
+        half.step = step;
+        half.prevPos = Point3D(prevPos.x, prevPos.y, prevPos.z);
+        half.currentPos = Point3D(currentPos.x, currentPos.y, currentPos.z);
+    }
+}
+
+uint64_t StreamlineTracer::hashStreamlines(const std::vector<std::vector<Point3D>>& streamlines, const StreamlineAttributes* attributes)
+{
+    //FNV-1a over the raw bytes, so any difference in order or in a single bit of a float shows up
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const void* data, size_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; i++)
+        {
+            hash ^= p[i];
+            hash *= 0x100000001b3ull;
+        }
+    };
+
+    uint64_t count = streamlines.size();
+    add(&count, sizeof(count));
+    for (const std::vector<Point3D>& streamline : streamlines)
+    {
+        uint64_t n = streamline.size();
+        add(&n, sizeof(n));
+        add(streamline.data(), streamline.size() * sizeof(Point3D));
+    }
+
+    if (attributes)
+    {
+        const std::vector<float>* columns[] = { &attributes->length, &attributes->stepCount, &attributes->meanFA, &attributes->minFA, &attributes->meanScalar, &attributes->curvature };
+        for (const std::vector<float>* column : columns) add(column->data(), column->size() * sizeof(float));
+        add(attributes->backwardTermination.data(), attributes->backwardTermination.size());
+        add(attributes->forwardTermination.data(), attributes->forwardTermination.size());
+    }
+    return hash;
+}
@@ -0,0 +1,132 @@
+#include "../include/TraceClient.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+TraceClient::~TraceClient()
+{
+#if !defined(_WIN32)
+    if (socket >= 0) close(socket);
+#endif
+}
+
+int TraceClient::connect(const std::string& socketPath)
+{
+#if !defined(_WIN32)
+    if (socket >= 0) close(socket);
+    socket = -1;
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+    {
+        error = "Invalid socket path " + socketPath;
+        return EXIT_FAILURE;
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket < 0 || ::connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        error = "Failed to connect to " + socketPath + ": " + strerror(errno);
+        if (socket >= 0) close(socket);
+        socket = -1;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+#else
+    error = "The tracing daemon needs Unix domain sockets, which this build doesn't support";
+    return EXIT_FAILURE;
+#endif
+}
+
+int TraceClient::trace(const std::string& dataset, const TracerParams& params, const std::vector<Point3D>& seeds, TraceResult& result)
+{
+    std::vector<char> request;
+    encodeTraceRequest(dataset, params, seeds.data(), seeds.size(), request);
+    result = TraceResult();
+    if (exchange(TRACE_MESSAGE_TRACE, request, &result, nullptr) != EXIT_SUCCESS)
+    {
+        result.error = error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int TraceClient::listDatasets(std::vector<TraceDatasetInfo>& datasets)
+{
+    std::vector<char> answer;
+    if (exchange(TRACE_MESSAGE_LIST_DATASETS, std::vector<char>(), nullptr, &answer) != EXIT_SUCCESS) return EXIT_FAILURE;
+    try
+    {
+        datasets = decodeDatasetList(answer);
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int TraceClient::exchange(uint16_t type, const std::vector<char>& request, TraceResult* result, std::vector<char>* answer)
+{
+    if (socket < 0)
+    {
+        error = "Not connected";
+        return EXIT_FAILURE;
+    }
+
+    uint32_t requestId = nextRequestId++;
+    if (!writeTraceFrame(socket, type, requestId, request))
+    {
+        error = "Lost the connection to the daemon";
+        return EXIT_FAILURE;
+    }
+
+    TraceFrameHeader header;
+    std::vector<char> payload;
+    while (true)
+    {
+        if (!readTraceFrame(socket, header, payload))
+        {
+            error = "Lost the connection to the daemon";
+            return EXIT_FAILURE;
+        }
+        if (header.requestId != requestId) continue;
+
+        if (header.type == TRACE_MESSAGE_ERROR)
+        {
+            error.assign(payload.begin(), payload.end());
+            return EXIT_FAILURE;
+        }
+        if (header.type == TRACE_MESSAGE_RESULT && result)
+        {
+            try
+            {
+                if (decodeTraceResultChunk(payload, *result)) return EXIT_SUCCESS;
+            }
+            catch (const std::exception& e)
+            {
+                error = e.what();
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (header.type != TRACE_MESSAGE_RESULT && answer)
+        {
+            answer->swap(payload);
+            return EXIT_SUCCESS;
+        }
+        error = "Unexpected answer from the daemon";
+        return EXIT_FAILURE;
+    }
+}
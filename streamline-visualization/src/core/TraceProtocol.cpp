@@ -0,0 +1,232 @@
+#include "../include/TraceProtocol.h"
+#include "../include/MessageBuffer.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+TracerParams toTracerParams(const TraceRequestParams& request)
+{
+    if (!(request.stepSize > 0.0f) || !std::isfinite(request.stepSize)) throw std::runtime_error("Invalid step size");
+    if (request.maxSteps < 0) throw std::runtime_error("Invalid max steps");
+    if (std::isnan(request.maxLength) || std::isnan(request.maxAngle)) throw std::runtime_error("Invalid limits");
+    if (request.integrationMethod > 1) throw std::runtime_error("Unknown integration method");
+    if (request.interpolation > INTERPOLATION_CUBIC_BSPLINE) throw std::runtime_error("Unknown interpolation mode");
+
+    TracerParams params;
+    params.stepSize = request.stepSize;
+    params.maxSteps = request.maxSteps;
+    params.maxLength = request.maxLength;
+    params.maxAngle = request.maxAngle;
+    params.integrationMethod = request.integrationMethod == 1 ? StreamlineTracer::EULER : StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+    params.interpolation = (InterpolationMode)request.interpolation;
+    params.level = request.level;
+    params.flipX = (request.flips & 1) != 0;
+    params.flipY = (request.flips & 2) != 0;
+    params.flipZ = (request.flips & 4) != 0;
+    return params;
+}
+
+TraceRequestParams toRequestParams(const TracerParams& params)
+{
+    TraceRequestParams request;
+    request.stepSize = params.stepSize;
+    request.maxSteps = params.maxSteps;
+    request.maxLength = params.maxLength;
+    request.maxAngle = params.maxAngle;
+    request.integrationMethod = strcmp(params.integrationMethod, StreamlineTracer::EULER) == 0 ? 1 : 0;
+    request.interpolation = (uint8_t)params.interpolation;
+    request.flips = (params.flipX ? 1 : 0) | (params.flipY ? 2 : 0) | (params.flipZ ? 4 : 0);
+    request.level = (uint8_t)params.level;
+    return request;
+}
+
+void encodeTraceRequest(const std::string& dataset, const TracerParams& params, const Point3D* seeds, size_t numSeeds, std::vector<char>& out)
+{
+    TraceRequestParams request = toRequestParams(params);
+    request.numSeeds = (uint32_t)numSeeds;
+    request.datasetNameLength = (uint32_t)dataset.size();
+
+    out.clear();
+    out.reserve(sizeof(request) + dataset.size() + numSeeds * sizeof(Point3D));
+    MessageWriter writer(out);
+    writer.put(request);
+    writer.putArray(dataset.data(), dataset.size());
+    writer.putArray(seeds, numSeeds);
+}
+
+void decodeTraceRequest(const std::vector<char>& in, std::string& dataset, TracerParams& params, std::vector<Point3D>& seeds)
+{
+    MessageReader reader(in);
+    TraceRequestParams request = reader.get<TraceRequestParams>();
+    if (request.datasetNameLength > reader.getRemaining()) throw std::runtime_error("Truncated message");
+    dataset.resize(request.datasetNameLength);
+    reader.getArray(&dataset[0], dataset.size());
+    if (request.numSeeds != reader.getRemaining() / sizeof(Point3D) || reader.getRemaining() % sizeof(Point3D) != 0)
+    {
+        throw std::runtime_error("The seed count doesn't match the message size");
+    }
+    seeds.resize(request.numSeeds);
+    reader.getArray(seeds.data(), seeds.size());
+    params = toTracerParams(request);
+}
+
+size_t encodeTraceResultChunk(const TraceResult& result, size_t first, std::vector<char>& out)
+{
+    //whole streamlines until the chunk has enough points
+    size_t end = first;
+    size_t numPoints = 0;
+    while (end < result.streamlines.size() && (end == first || numPoints < TRACE_RESULT_CHUNK_POINTS))
+    {
+        numPoints += result.streamlines[end++].size();
+    }
+
+    TraceResultChunkHeader header;
+    header.numStreamlines = (uint32_t)(end - first);
+    header.numPoints = (uint32_t)numPoints;
+    header.flags = end == result.streamlines.size() ? TRACE_RESULT_LAST : 0;
+
+    out.clear();
+    out.reserve(sizeof(header) + header.numStreamlines * 2 * sizeof(uint32_t) + numPoints * sizeof(Point3D));
+    MessageWriter writer(out);
+    writer.put(header);
+    writer.putArray(result.seedIndices.data() + first, end - first);
+    for (size_t i = first; i < end; i++) writer.put((uint32_t)result.streamlines[i].size());
+    for (size_t i = first; i < end; i++) writer.putArray(result.streamlines[i].data(), result.streamlines[i].size());
+    return end;
+}
+
+bool decodeTraceResultChunk(const std::vector<char>& in, TraceResult& result)
+{
+    MessageReader reader(in);
+    TraceResultChunkHeader header = reader.get<TraceResultChunkHeader>();
+    if (header.numStreamlines > reader.getRemaining() / (2 * sizeof(uint32_t))) throw std::runtime_error("Truncated message");
+
+    size_t first = result.streamlines.size();
+    result.seedIndices.resize(first + header.numStreamlines);
+    reader.getArray(result.seedIndices.data() + first, header.numStreamlines);
+    std::vector<uint32_t> counts(header.numStreamlines);
+    reader.getArray(counts.data(), counts.size());
+
+    uint64_t numPoints = 0;
+    for (uint32_t count : counts) numPoints += count;
+    if (numPoints != header.numPoints || numPoints * sizeof(Point3D) != reader.getRemaining()) throw std::runtime_error("Malformed result chunk");
+
+    result.streamlines.resize(first + header.numStreamlines);
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        result.streamlines[first + i].resize(counts[i]);
+        reader.getArray(result.streamlines[first + i].data(), counts[i]);
+    }
+    return (header.flags & TRACE_RESULT_LAST) != 0;
+}
+
+void encodeDatasetList(const std::vector<TraceDatasetInfo>& datasets, std::vector<char>& out)
+{
+    out.clear();
+    MessageWriter writer(out);
+    writer.put((uint32_t)datasets.size());
+    for (const TraceDatasetInfo& info : datasets)
+    {
+        writer.put((uint32_t)info.name.size());
+        writer.putArray(info.name.data(), info.name.size());
+        writer.put((int32_t)info.dimX);
+        writer.put((int32_t)info.dimY);
+        writer.put((int32_t)info.dimZ);
+    }
+}
+
+std::vector<TraceDatasetInfo> decodeDatasetList(const std::vector<char>& in)
+{
+    MessageReader reader(in);
+    uint32_t count = reader.get<uint32_t>();
+    std::vector<TraceDatasetInfo> datasets;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        TraceDatasetInfo info;
+        uint32_t length = reader.get<uint32_t>();
+        if (length > reader.getRemaining()) throw std::runtime_error("Truncated message");
+        info.name.resize(length);
+        reader.getArray(&info.name[0], length);
+        info.dimX = reader.get<int32_t>();
+        info.dimY = reader.get<int32_t>();
+        info.dimZ = reader.get<int32_t>();
+        datasets.push_back(info);
+    }
+    return datasets;
+}
+
+#if !defined(_WIN32)
+
+namespace {
+
+bool writeAll(int socket, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::send(socket, data, size, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+bool readAll(int socket, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t count = ::recv(socket, data, size, 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        data += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+} // namespace
+
+bool writeTraceFrame(int socket, uint16_t type, uint32_t requestId, const std::vector<char>& payload)
+{
+    TraceFrameHeader header;
+    header.type = type;
+    header.requestId = requestId;
+    header.bytes = (uint32_t)payload.size();
+    return writeAll(socket, reinterpret_cast<const char*>(&header), sizeof(header)) && writeAll(socket, payload.data(), payload.size());
+}
+
+bool readTraceFrame(int socket, TraceFrameHeader& header, std::vector<char>& payload)
+{
+    if (!readAll(socket, reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != TRACE_PROTOCOL_MAGIC || header.version != TRACE_PROTOCOL_VERSION || header.bytes > TRACE_MAX_FRAME_BYTES) return false;
+    payload.resize(header.bytes);
+    return readAll(socket, payload.data(), payload.size());
+}
+
+#else
+
+bool writeTraceFrame(int, uint16_t, uint32_t, const std::vector<char>&)
+{
+    return false;
+}
+
+bool readTraceFrame(int, TraceFrameHeader&, std::vector<char>&)
+{
+    return false;
+}
+
+#endif
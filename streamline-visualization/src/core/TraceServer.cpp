@@ -0,0 +1,343 @@
+#include "../include/TraceServer.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+//Requests of one client that may be queued, traced or waiting to be sent back at once, the
+//reader stops taking requests from the client until the writer sent answers
+const int MAX_PENDING_REQUESTS = 64;
+
+} // namespace
+
+/**
+ * A connected client. The reader and the writer thread share it with the callbacks of the
+ * requests in flight, which may outlive the connection.
+ */
+struct TraceServer::Connection {
+    struct Answer {
+        uint16_t type = TRACE_MESSAGE_RESULT;
+        uint32_t requestId = 0;
+        TraceResult result;          ///< For TRACE_MESSAGE_RESULT, sent in chunks
+        std::vector<char> payload;   ///< For the other messages
+    };
+
+    int socket = -1;
+    std::thread reader;
+    std::thread writer;
+    std::atomic<int> running{ 2 };   ///< Threads that didn't finish yet
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<Answer> answers;
+    int pending = 0;                 ///< Requests read whose answer wasn't sent yet
+    bool readerDone = false;         ///< The client sent its last request
+    bool abandoned = false;          ///< The server stops or the client is gone, answers are dropped
+};
+
+TraceServer::TraceServer(TraceService& service)
+    : service(service)
+{
+}
+
+TraceServer::~TraceServer()
+{
+    stop();
+}
+
+#if !defined(_WIN32)
+
+int TraceServer::start(const std::string& path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Invalid socket path " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSocket < 0)
+    {
+        std::cerr << "Failed to create a socket: " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    //a socket file nobody accepts on is left over from a daemon that didn't shut down cleanly
+    if (connect(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+    {
+        std::cerr << "Another daemon is listening on " << path << std::endl;
+        close(listenSocket);
+        listenSocket = -1;
+        return EXIT_FAILURE;
+    }
+    close(listenSocket);
+    unlink(path.c_str());
+
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSocket < 0 || bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenSocket, SOMAXCONN) != 0)
+    {
+        std::cerr << "Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+        if (listenSocket >= 0) close(listenSocket);
+        listenSocket = -1;
+        return EXIT_FAILURE;
+    }
+
+    socketPath = path;
+    stopping = false;
+    acceptor = std::thread(&TraceServer::acceptClients, this);
+    return EXIT_SUCCESS;
+}
+
+void TraceServer::stop()
+{
+    if (listenSocket < 0) return;
+    stopping = true;
+    acceptor.join();
+    close(listenSocket);
+    unlink(socketPath.c_str());
+    listenSocket = -1;
+
+    //wake up the readers and writers of the remaining clients
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (const std::shared_ptr<Connection>& connection : connections)
+        {
+            std::lock_guard<std::mutex> connectionLock(connection->mutex);
+            connection->abandoned = true;
+            connection->wakeUp.notify_all();
+            shutdown(connection->socket, SHUT_RDWR);
+        }
+    }
+    reapConnections(true);
+}
+
+void TraceServer::acceptClients()
+{
+    while (!stopping)
+    {
+        //poll instead of blocking in accept, so stop() doesn't depend on how the system wakes up accept
+        pollfd p;
+        p.fd = listenSocket;
+        p.events = POLLIN;
+        p.revents = 0;
+        int result = poll(&p, 1, 200);
+        reapConnections(false);
+        if (result <= 0) continue;
+
+        int client = accept(listenSocket, nullptr, nullptr);
+        if (client < 0) continue;
+
+        std::shared_ptr<Connection> connection = std::make_shared<Connection>();
+        connection->socket = client;
+        clientCount++;
+        connection->reader = std::thread(&TraceServer::readRequests, this, connection);
+        connection->writer = std::thread(&TraceServer::writeResults, this, connection);
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections.push_back(connection);
+    }
+}
+
+void TraceServer::reapConnections(bool all)
+{
+    std::list<std::shared_ptr<Connection>> finished;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (auto it = connections.begin(); it != connections.end();)
+        {
+            if (all || (*it)->running == 0)
+            {
+                finished.push_back(*it);
+                it = connections.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (const std::shared_ptr<Connection>& connection : finished)
+    {
+        connection->reader.join();
+        connection->writer.join();
+        close(connection->socket);
+        clientCount--;
+    }
+}
+
+void TraceServer::readRequests(std::shared_ptr<Connection> connection)
+{
+    TraceFrameHeader header;
+    std::vector<char> payload;
+    while (true)
+    {
+        //a client that doesn't read its results doesn't get to queue more work
+        {
+            std::unique_lock<std::mutex> lock(connection->mutex);
+            connection->wakeUp.wait(lock, [&] { return connection->pending < MAX_PENDING_REQUESTS || connection->abandoned; });
+            if (connection->abandoned) break;
+        }
+        if (!readTraceFrame(connection->socket, header, payload)) break;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            connection->pending++;
+        }
+
+        Connection::Answer answer;
+        answer.requestId = header.requestId;
+        if (header.type == TRACE_MESSAGE_TRACE)
+        {
+            std::string dataset;
+            TracerParams params;
+            std::vector<Point3D> seeds;
+            try
+            {
+                decodeTraceRequest(payload, dataset, params, seeds);
+            }
+            catch (const std::exception& e)
+            {
+                answer.type = TRACE_MESSAGE_ERROR;
+                answer.payload.assign(e.what(), e.what() + strlen(e.what()));
+            }
+
+            if (answer.type != TRACE_MESSAGE_ERROR)
+            {
+                uint32_t requestId = header.requestId;
+                service.submit(dataset, params, std::move(seeds), [connection, requestId](TraceResult& result) {
+                    Connection::Answer answer;
+                    answer.requestId = requestId;
+                    if (result.error.empty())
+                    {
+                        answer.result = std::move(result);
+                    }
+                    else
+                    {
+                        answer.type = TRACE_MESSAGE_ERROR;
+                        answer.payload.assign(result.error.begin(), result.error.end());
+                    }
+                    //the request stays pending until the writer sent the answer
+                    std::lock_guard<std::mutex> lock(connection->mutex);
+                    if (connection->abandoned) connection->pending--;
+                    else connection->answers.push_back(std::move(answer));
+                    connection->wakeUp.notify_all();
+                });
+                continue;
+            }
+        }
+        else if (header.type == TRACE_MESSAGE_LIST_DATASETS)
+        {
+            answer.type = TRACE_MESSAGE_DATASETS;
+            encodeDatasetList(service.getDatasets(), answer.payload);
+        }
+        else
+        {
+            answer.type = TRACE_MESSAGE_ERROR;
+            const char* message = "Unknown message type";
+            answer.payload.assign(message, message + strlen(message));
+        }
+
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (connection->abandoned) connection->pending--;
+        else connection->answers.push_back(std::move(answer));
+        connection->wakeUp.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->readerDone = true;
+    connection->wakeUp.notify_all();
+    connection->running--;
+}
+
+void TraceServer::writeResults(std::shared_ptr<Connection> connection)
+{
+    std::vector<char> payload;
+    while (true)
+    {
+        Connection::Answer answer;
+        {
+            //the answers of requests the client sent before it closed its side are still sent
+            std::unique_lock<std::mutex> lock(connection->mutex);
+            connection->wakeUp.wait(lock, [&] {
+                return connection->abandoned || !connection->answers.empty() || (connection->readerDone && connection->pending == 0);
+            });
+            if (connection->abandoned || connection->answers.empty()) break;
+            answer = std::move(connection->answers.front());
+            connection->answers.pop_front();
+        }
+
+        bool sent = true;
+        if (answer.type == TRACE_MESSAGE_RESULT)
+        {
+            //chunks of whole streamlines, so the client can start on the first ones early
+            size_t next = 0;
+            do
+            {
+                next = encodeTraceResultChunk(answer.result, next, payload);
+                sent = writeTraceFrame(connection->socket, TRACE_MESSAGE_RESULT, answer.requestId, payload);
+            } while (sent && next < answer.result.streamlines.size());
+        }
+        else
+        {
+            sent = writeTraceFrame(connection->socket, answer.type, answer.requestId, answer.payload);
+        }
+
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (!sent)
+        {
+            //the client is gone, let the reader stop as well
+            connection->pending -= 1 + (int)connection->answers.size();
+            connection->abandoned = true;
+            connection->answers.clear();
+            connection->wakeUp.notify_all();
+            shutdown(connection->socket, SHUT_RDWR);
+            break;
+        }
+        //a client that reads its answers makes room for its next requests
+        connection->pending--;
+        connection->wakeUp.notify_all();
+    }
+    connection->running--;
+}
+
+#else
+
+int TraceServer::start(const std::string& path)
+{
+    std::cerr << "The tracing daemon needs Unix domain sockets, which this build doesn't support" << std::endl;
+    return EXIT_FAILURE;
+}
+
+void TraceServer::stop()
+{
+}
+
+void TraceServer::acceptClients()
+{
+}
+
+void TraceServer::reapConnections(bool)
+{
+}
+
+void TraceServer::readRequests(std::shared_ptr<Connection>)
+{
+}
+
+void TraceServer::writeResults(std::shared_ptr<Connection>)
+{
+}
+
+#endif
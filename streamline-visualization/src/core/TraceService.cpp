@@ -0,0 +1,181 @@
+#include "../include/TraceService.h"
+#include <iostream>
+
+void TraceServiceStats::print() const
+{
+    std::cout << requests << " requests in " << batches << " batches (" << (batches > 0 ? (double)requests / batches : 0.0)
+              << " per batch), " << seeds << " seeds, " << streamlines << " streamlines" << std::endl;
+    queueMs.print("  Queued");
+    traceMs.print("  Batch traced");
+}
+
+TraceService::TraceService(const TraceServiceOptions& options)
+    : options(options)
+{
+    dispatcher = std::thread(&TraceService::run, this);
+}
+
+TraceService::~TraceService()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    dispatcher.join();
+}
+
+void TraceService::addDataset(const std::string& name, std::shared_ptr<const DatasetSnapshot> dataset)
+{
+    std::shared_ptr<const StreamlineTracer> tracer = std::make_shared<const StreamlineTracer>(std::move(dataset));
+    std::lock_guard<std::mutex> lock(mutex);
+    tracers[name] = tracer;
+}
+
+std::vector<TraceDatasetInfo> TraceService::getDatasets() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<TraceDatasetInfo> datasets;
+    for (const auto& entry : tracers)
+    {
+        TraceDatasetInfo info;
+        info.name = entry.first;
+        info.dimX = entry.second->getDataset()->getDimX();
+        info.dimY = entry.second->getDataset()->getDimY();
+        info.dimZ = entry.second->getDataset()->getDimZ();
+        datasets.push_back(info);
+    }
+    return datasets;
+}
+
+void TraceService::submit(const std::string& dataset, const TracerParams& params, std::vector<Point3D> seeds, TraceCallback done)
+{
+    Request request;
+    request.params = params;
+    request.seeds = std::move(seeds);
+    request.done = std::move(done);
+    request.submitTime = std::chrono::steady_clock::now();
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = tracers.find(dataset);
+        if (it != tracers.end())
+        {
+            request.tracer = it->second;
+            queuedSeeds += request.seeds.size();
+            queue.push_back(std::move(request));
+            queued = true;
+        }
+    }
+
+    if (!queued)
+    {
+        TraceResult result;
+        result.error = "Unknown dataset " + dataset;
+        request.done(result);
+        return;
+    }
+    wakeUp.notify_all();
+}
+
+TraceServiceStats TraceService::takeStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    TraceServiceStats taken = std::move(stats);
+    stats = TraceServiceStats();
+    return taken;
+}
+
+void TraceService::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wakeUp.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) break;
+
+        //give concurrent requests the batch window to join the oldest one, a lone request doesn't wait
+        if (options.batchWindowMs > 0.0 && queue.size() > 1)
+        {
+            auto window = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(options.batchWindowMs));
+            wakeUp.wait_until(lock, queue.front().submitTime + window, [this] { return stopping || queuedSeeds >= options.maxBatchSeeds; });
+        }
+
+        std::vector<Request> batch;
+        batch.push_back(std::move(queue.front()));
+        queue.pop_front();
+        size_t batchSeeds = batch[0].seeds.size();
+
+        //every queued request that can be traced in the same call, in the order they came
+        for (auto it = queue.begin(); it != queue.end() && batchSeeds < options.maxBatchSeeds;)
+        {
+            if (it->tracer == batch[0].tracer && it->params == batch[0].params && batchSeeds + it->seeds.size() <= options.maxBatchSeeds)
+            {
+                batchSeeds += it->seeds.size();
+                batch.push_back(std::move(*it));
+                it = queue.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        queuedSeeds -= batchSeeds;
+
+        lock.unlock();
+        traceBatch(batch);
+        lock.lock();
+    }
+}
+
+void TraceService::traceBatch(std::vector<Request>& batch)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    //the seeds of all requests in one trace, request r owns the seeds from offsets[r]
+    std::vector<size_t> offsets;
+    std::vector<Point3D> seeds;
+    for (Request& request : batch)
+    {
+        offsets.push_back(seeds.size());
+        seeds.insert(seeds.end(), request.seeds.begin(), request.seeds.end());
+    }
+    offsets.push_back(seeds.size());
+
+    std::vector<TraceResult> results(batch.size());
+    std::vector<std::vector<Point3D>> streamlines;
+    std::vector<size_t> seedIndices;
+    try
+    {
+        streamlines = batch[0].tracer->traceAllStreamlines(seeds, batch[0].params, nullptr, &seedIndices);
+    }
+    catch (const std::exception& e)
+    {
+        for (TraceResult& result : results) result.error = e.what();
+    }
+    double traceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    //the streamlines are in seed order, so every request gets a consecutive range of them
+    size_t r = 0;
+    for (size_t i = 0; i < streamlines.size(); i++)
+    {
+        while (seedIndices[i] >= offsets[r + 1]) r++;
+        results[r].streamlines.push_back(std::move(streamlines[i]));
+        results[r].seedIndices.push_back((uint32_t)(seedIndices[i] - offsets[r]));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.requests += batch.size();
+        stats.batches++;
+        stats.seeds += seeds.size();
+        stats.streamlines += streamlines.size();
+        stats.traceMs.add(traceMs);
+        for (const Request& request : batch)
+        {
+            stats.queueMs.add(std::chrono::duration<double, std::milli>(start - request.submitTime).count());
+        }
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) batch[i].done(results[i]);
+}
@@ -0,0 +1,444 @@
+#include "../include/TraceTransport.h"
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <stdexcept>
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 //macOS has no per call flag, a closed peer is caught by poll first
+#endif
+#endif
+#if defined(VCP_WITH_MPI)
+#include <mpi.h>
+#endif
+
+namespace {
+
+/**
+ * A message that arrived completely.
+ */
+struct ReceivedMessage {
+    int source;
+    int tag;
+    std::vector<char> payload;
+};
+
+#if !defined(_WIN32)
+
+/**
+ * Frame header in front of every message on a socket.
+ */
+struct FrameHeader {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t bytes;
+};
+
+/**
+ * Non-blocking sockets to every other rank with a send and a receive buffer each. Sends are
+ * only queued and written whenever the sockets are polled, so two ranks sending each other
+ * large messages at the same time can't deadlock on full socket buffers.
+ */
+class SocketTransport : public TraceTransport {
+public:
+    SocketTransport(int rank, const std::vector<int>& peerSockets, const std::vector<pid_t>& children = std::vector<pid_t>())
+        : rank(rank), sockets(peerSockets), children(children), outgoing(peerSockets.size()), outgoingOffset(peerSockets.size(), 0),
+          incoming(peerSockets.size())
+    {
+        for (int fd : sockets)
+        {
+            if (fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+
+    ~SocketTransport() override
+    {
+        try
+        {
+            flush();
+        }
+        catch (const std::exception&)
+        {
+            //the peers are gone, nothing left to deliver
+        }
+        for (int fd : sockets)
+        {
+            if (fd >= 0) close(fd);
+        }
+        for (pid_t child : children)
+        {
+            int status = 0;
+            waitpid(child, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                std::cerr << "Tracing process " << child << " did not exit cleanly" << std::endl;
+            }
+        }
+    }
+
+    int getRank() const override { return rank; }
+    int getSize() const override { return (int)sockets.size(); }
+
+    void send(int destination, int tag, std::vector<char>& payload) override
+    {
+        if (destination < 0 || destination >= getSize() || destination == rank) throw std::runtime_error("Invalid destination rank");
+        if (sockets[destination] < 0) throw std::runtime_error("Rank " + std::to_string(destination) + " is no longer connected");
+        FrameHeader header = { (uint32_t)tag, 0, (uint64_t)payload.size() };
+        std::vector<char>& out = outgoing[destination];
+        out.insert(out.end(), reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header) + sizeof(header));
+        out.insert(out.end(), payload.begin(), payload.end());
+        bytesSent += sizeof(header) + payload.size();
+        messagesSent++;
+        payload.clear();
+        progress(0);
+    }
+
+    bool receive(int& source, int& tag, std::vector<char>& payload, bool wait) override
+    {
+        progress(0);
+        while (ready.empty() && wait) progress(-1);
+        if (ready.empty()) return false;
+
+        source = ready.front().source;
+        tag = ready.front().tag;
+        payload.swap(ready.front().payload);
+        ready.pop_front();
+        return true;
+    }
+
+    void flush() override
+    {
+        while (hasOutgoing()) progress(-1);
+    }
+
+private:
+    bool hasOutgoing() const
+    {
+        for (size_t i = 0; i < outgoing.size(); i++)
+        {
+            if (outgoingOffset[i] < outgoing[i].size()) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Write what the sockets take and read what arrived, waiting up to timeoutMs (-1 for ever) for either.
+     */
+    void progress(int timeoutMs)
+    {
+        std::vector<pollfd> fds;
+        std::vector<int> peers;
+        for (int peer = 0; peer < (int)sockets.size(); peer++)
+        {
+            if (sockets[peer] < 0) continue;
+            pollfd p;
+            p.fd = sockets[peer];
+            p.events = POLLIN;
+            if (outgoingOffset[peer] < outgoing[peer].size()) p.events |= POLLOUT;
+            p.revents = 0;
+            fds.push_back(p);
+            peers.push_back(peer);
+        }
+        if (fds.empty())
+        {
+            if (timeoutMs != 0) throw std::runtime_error("All other ranks closed their connections");
+            return;
+        }
+
+        int result = poll(fds.data(), (nfds_t)fds.size(), timeoutMs);
+        if (result < 0)
+        {
+            if (errno == EINTR) return;
+            throw std::runtime_error(std::string("poll failed: ") + strerror(errno));
+        }
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            int peer = peers[i];
+            if (fds[i].revents & POLLOUT) writeTo(peer);
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) readFrom(peer);
+        }
+    }
+
+    void writeTo(int peer)
+    {
+        std::vector<char>& out = outgoing[peer];
+        while (outgoingOffset[peer] < out.size())
+        {
+            ssize_t written = ::send(sockets[peer], out.data() + outgoingOffset[peer], out.size() - outgoingOffset[peer], MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+                if (errno != EPIPE && errno != ECONNRESET) throw std::runtime_error(std::string("Sending to a rank failed: ") + strerror(errno));
+                //the peer is gone, readFrom reports it
+                break;
+            }
+            outgoingOffset[peer] += (size_t)written;
+        }
+        out.clear();
+        outgoingOffset[peer] = 0;
+    }
+
+    void readFrom(int peer)
+    {
+        std::vector<char>& in = incoming[peer];
+        char buffer[1 << 16];
+        bool closed = false;
+        while (true)
+        {
+            ssize_t count = recv(sockets[peer], buffer, sizeof(buffer), 0);
+            if (count < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+                if (errno != ECONNRESET) throw std::runtime_error(std::string("Receiving from a rank failed: ") + strerror(errno));
+            }
+            if (count <= 0)
+            {
+                //the peer is gone, whatever this rank still had queued for it is lost
+                close(sockets[peer]);
+                sockets[peer] = -1;
+                outgoing[peer].clear();
+                outgoingOffset[peer] = 0;
+                closed = true;
+                break;
+            }
+            in.insert(in.end(), buffer, buffer + count);
+        }
+
+        //cut the complete frames off the front of the buffer
+        size_t offset = 0;
+        while (in.size() - offset >= sizeof(FrameHeader))
+        {
+            FrameHeader header;
+            memcpy(&header, in.data() + offset, sizeof(header));
+            if (in.size() - offset - sizeof(header) < header.bytes) break;
+            ReceivedMessage message;
+            message.source = peer;
+            message.tag = (int)header.tag;
+            message.payload.assign(in.begin() + offset + sizeof(header), in.begin() + offset + sizeof(header) + header.bytes);
+            ready.push_back(std::move(message));
+            offset += sizeof(header) + header.bytes;
+        }
+        if (offset > 0) in.erase(in.begin(), in.begin() + offset);
+
+        //reported after the last complete message of the peer
+        if (closed)
+        {
+            ReceivedMessage message;
+            message.source = peer;
+            message.tag = TRACE_RANK_CLOSED;
+            ready.push_back(std::move(message));
+        }
+    }
+
+    int rank;
+    std::vector<int> sockets;         ///< Socket to every rank, -1 for this rank and closed ones
+    std::vector<pid_t> children;      ///< Processes started by spawnSocketRanks, rank 0 only
+    std::vector<std::vector<char>> outgoing;
+    std::vector<size_t> outgoingOffset;
+    std::vector<std::vector<char>> incoming;
+    std::deque<ReceivedMessage> ready;
+};
+
+#endif
+
+#if defined(VCP_WITH_MPI)
+
+/**
+ * Nonblocking MPI sends, the buffers are kept until MPI is done with them.
+ */
+class MpiTransport : public TraceTransport {
+public:
+    MpiTransport(int* argc, char*** argv)
+    {
+        MPI_Init(argc, argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+    }
+
+    ~MpiTransport() override
+    {
+        flush();
+        MPI_Finalize();
+    }
+
+    int getRank() const override { return rank; }
+    int getSize() const override { return size; }
+
+    void send(int destination, int tag, std::vector<char>& payload) override
+    {
+        if (payload.size() > (size_t)INT32_MAX) throw std::runtime_error("Message too large for MPI");
+        pending.push_back(PendingSend());
+        PendingSend& message = pending.back();
+        message.data.swap(payload);
+        MPI_Isend(message.data.data(), (int)message.data.size(), MPI_BYTE, destination, tag, MPI_COMM_WORLD, &message.request);
+        bytesSent += message.data.size();
+        messagesSent++;
+        completeSends();
+    }
+
+    bool receive(int& source, int& tag, std::vector<char>& payload, bool wait) override
+    {
+        completeSends();
+        MPI_Status status;
+        if (wait)
+        {
+            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        }
+        else
+        {
+            int arrived = 0;
+            MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &arrived, &status);
+            if (!arrived) return false;
+        }
+        int count = 0;
+        MPI_Get_count(&status, MPI_BYTE, &count);
+        source = status.MPI_SOURCE;
+        tag = status.MPI_TAG;
+        payload.resize(count);
+        MPI_Recv(payload.data(), count, MPI_BYTE, source, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        return true;
+    }
+
+    void flush() override
+    {
+        for (PendingSend& message : pending) MPI_Wait(&message.request, MPI_STATUS_IGNORE);
+        pending.clear();
+    }
+
+private:
+    struct PendingSend {
+        std::vector<char> data;
+        MPI_Request request;
+    };
+
+    void completeSends()
+    {
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            int done = 0;
+            MPI_Test(&it->request, &done, MPI_STATUS_IGNORE);
+            it = done ? pending.erase(it) : std::next(it);
+        }
+    }
+
+    int rank = 0;
+    int size = 1;
+    std::list<PendingSend> pending; ///< A list so the buffers never move while MPI reads them
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<TraceTransport> spawnSocketRanks(const char* executable, int numRanks, const std::vector<std::string>& extraArgs)
+{
+#if defined(_WIN32)
+    std::cerr << "Local tracing processes need Unix domain sockets, build with VCP_WITH_MPI instead" << std::endl;
+    return nullptr;
+#else
+    int size = numRanks + 1;
+    if (numRanks < 1) return nullptr;
+
+    //ends[a][b] is the socket of rank a to rank b
+    std::vector<std::vector<int>> ends(size, std::vector<int>(size, -1));
+    for (int a = 0; a < size; a++)
+    {
+        for (int b = a + 1; b < size; b++)
+        {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+            {
+                std::cerr << "Could not create a socket pair: " << strerror(errno) << std::endl;
+                for (std::vector<int>& row : ends)
+                {
+                    for (int fd : row) if (fd >= 0) close(fd);
+                }
+                return nullptr;
+            }
+            ends[a][b] = pair[0];
+            ends[b][a] = pair[1];
+        }
+    }
+
+    std::vector<pid_t> children;
+    for (int rank = 1; rank < size; rank++)
+    {
+        std::ostringstream sockets;
+        for (int peer = 0; peer < size; peer++) sockets << (peer ? "," : "") << ends[rank][peer];
+        std::string rankArg = std::to_string(rank), sizeArg = std::to_string(size), socketsArg = sockets.str();
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            //keep only the sockets of this rank
+            for (int a = 0; a < size; a++)
+            {
+                if (a == rank) continue;
+                for (int fd : ends[a]) if (fd >= 0) close(fd);
+            }
+            std::vector<char*> args;
+            args.push_back(const_cast<char*>(executable));
+            args.push_back(const_cast<char*>("--trace-rank"));
+            args.push_back(const_cast<char*>(rankArg.c_str()));
+            args.push_back(const_cast<char*>(sizeArg.c_str()));
+            args.push_back(const_cast<char*>(socketsArg.c_str()));
+            for (const std::string& arg : extraArgs) args.push_back(const_cast<char*>(arg.c_str()));
+            args.push_back(nullptr);
+            execv(executable, args.data());
+            std::cerr << "Could not start tracing process " << executable << ": " << strerror(errno) << std::endl;
+            _exit(127);
+        }
+        if (pid < 0)
+        {
+            std::cerr << "Could not fork tracing process: " << strerror(errno) << std::endl;
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    for (int a = 1; a < size; a++)
+    {
+        for (int fd : ends[a]) if (fd >= 0) close(fd);
+    }
+    if ((int)children.size() != numRanks)
+    {
+        //closing the sockets makes the started processes give up
+        for (int fd : ends[0]) if (fd >= 0) close(fd);
+        for (pid_t child : children) waitpid(child, nullptr, 0);
+        return nullptr;
+    }
+    return std::unique_ptr<TraceTransport>(new SocketTransport(0, ends[0], children));
+#endif
+}
+
+std::unique_ptr<TraceTransport> connectSocketRank(int rank, int size, const char* sockets)
+{
+#if defined(_WIN32)
+    return nullptr;
+#else
+    std::vector<int> peers;
+    std::istringstream in(sockets ? sockets : "");
+    std::string item;
+    while (std::getline(in, item, ',')) peers.push_back(std::atoi(item.c_str()));
+    if (size < 2 || rank < 1 || rank >= size || (int)peers.size() != size) return nullptr;
+    peers[rank] = -1;
+    return std::unique_ptr<TraceTransport>(new SocketTransport(rank, peers));
+#endif
+}
+
+#if defined(VCP_WITH_MPI)
+std::unique_ptr<TraceTransport> createMpiTransport(int* argc, char*** argv)
+{
+    return std::unique_ptr<TraceTransport>(new MpiTransport(argc, argv));
+}
+#endif
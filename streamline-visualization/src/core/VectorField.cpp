@@ -3,10 +3,38 @@
 #include <fstream>
 #include <algorithm>
 #include <cmath>
+#include <vector>
+#include <chrono>
+#include <thread>
 #include "../extra/nifti1.h"
 #include "../include/DataReader.h"
+#include "../include/Kernels.h"
+#include "../include/VolumeAllocator.h"
+#include "../include/OctahedralEncoding.h"
+#include "../include/SparseBlockVolume.h"
 
-VectorField::VectorField(const char* filename) {
+const char* getVectorFieldStorageName(VectorFieldStorage storage)
+{
+    switch (storage)
+    {
+    case VECTOR_STORAGE_OCTAHEDRAL16: return "Octahedral 16 bit";
+    case VECTOR_STORAGE_OCTAHEDRAL8: return "Octahedral 8 bit";
+    case VECTOR_STORAGE_SPARSE_BLOCKS: return "Sparse 8^3 blocks";
+    default: return "32 bit float";
+    }
+}
+
+const char* getInterpolationModeName(InterpolationMode mode)
+{
+    switch (mode)
+    {
+    case INTERPOLATION_TRILINEAR: return "Trilinear";
+    case INTERPOLATION_CUBIC_BSPLINE: return "Cubic B-spline";
+    default: return "Nearest voxel";
+    }
+}
+
+VectorField::VectorField(const char* filename, VectorFieldStorage storage) {
     float* vectorData;
     int dimX, dimY, dimZ;
 
@@ -17,89 +45,140 @@ VectorField::VectorField(const char* filename) {
     }
 
     // Store field properties
+    this->ownedData.reset(vectorData);
     this->data = vectorData;
     this->dimX = dimX;
     this->dimY = dimY;
     this->dimZ = dimZ;
 
-    this->zeroMask = calculateZeroMask();
+    this->storage = storage;
+    if (storage == VECTOR_STORAGE_SPARSE_BLOCKS) buildSparse();
+    else if (storage != VECTOR_STORAGE_FLOAT32) quantizeAll();
+
+    calculateZeroMask();
 
     std::cout << "Loaded vector field: " << dimX << "x" << dimY << "x" << dimZ << std::endl;
 }
 
-VectorField::VectorField(float* tensorField, int dimX, int dimY, int dimZ)
+VectorField::VectorField(float* tensorField, int dimX, int dimY, int dimZ, VectorFieldStorage storage)
 {
     this->dimX = dimX;
     this->dimY = dimY;
     this->dimZ = dimZ;
 
-    //initialize the vector field
-    this->data = new float[dimX * dimY * dimZ * 3];
+    //initialize the vector field, quantized fields only need a float buffer per chunk
+    bool quantized = storage == VECTOR_STORAGE_OCTAHEDRAL16 || storage == VECTOR_STORAGE_OCTAHEDRAL8;
+    if (!quantized) this->ownedData = allocateVolumeBuffer<float>((size_t)dimX * dimY * dimZ * 3);
+    this->ownedFA = allocateVolumeBuffer<float>((size_t)dimX * dimY * dimZ);
+    this->data = ownedData.get();
+    this->faData = ownedFA.get();
+    if (quantized) allocateQuantized(storage, 1.0f); //eigenvectors have unit length
 
     std::cout << "Start processing tensors" << std::endl;
 
-    //fill the vectorfield with the tensor eigenvectors
-    for (int x = 0; x < this->dimX; x++)
+    //the tensor and vector data share the voxel order, so the voxels can be decomposed in independent chunks
+    const KernelSet& kernels = getKernels();
+    const long long numVoxels = (long long)dimX * dimY * dimZ;
+    const long long chunkSize = 4096;
+    double errorSum = 0.0, errorMax = 0.0;
+    size_t numNonzero = 0;
+#pragma omp parallel
     {
-        for (int y = 0; y < this->dimY; y++)
+        std::vector<float> chunk(quantized ? chunkSize * 3 : 0);
+        double threadErrorSum = 0.0, threadErrorMax = 0.0;
+        size_t threadNonzero = 0;
+
+#pragma omp for schedule(dynamic)
+        for (long long start = 0; start < numVoxels; start += chunkSize)
         {
-            for (int z = 0; z < this->dimZ; z++)
-            {
-                Eigen::Vector3f eigenVector = getMajorEigenVector(tensorField, x, y, z);
+            size_t count = (size_t)std::min(chunkSize, numVoxels - start);
+            float* vectors = quantized ? chunk.data() : ownedData.get() + 3 * start;
+            kernels.decomposeTensors(tensorField + 6 * start, count, vectors, ownedFA.get() + start);
+            if (quantized) quantize(vectors, start, count, threadErrorSum, threadErrorMax, threadNonzero);
+        }
 
-                // Calculate index into data array (3 components per voxel)
-                int index = 3 * (z + dimZ * (y + dimY * x));
-                this->data[index + 0] = eigenVector(0);
-                this->data[index + 1] = eigenVector(1);
-                this->data[index + 2] = eigenVector(2);
-            }
+#pragma omp critical
+        {
+            errorSum += threadErrorSum;
+            errorMax = std::max(errorMax, threadErrorMax);
+            numNonzero += threadNonzero;
         }
     }
+    if (quantized) reportQuantization(errorSum, errorMax, numNonzero);
+    if (storage == VECTOR_STORAGE_SPARSE_BLOCKS)
+    {
+        this->storage = storage;
+        buildSparse();
+    }
 
-    this->zeroMask = calculateZeroMask();
+    calculateZeroMask();
 
     std::cout << "Initialized vector field from tensor field" << std::endl;
 }
 
-Eigen::Vector3f VectorField::getMajorEigenVector(float* tensorField, int x, int y, int z)
+VectorField::VectorField(VolumeBuffer<float> tensorField, int dimX, int dimY, int dimZ)
 {
-    int index = 6 * (z + this->dimZ * (y + this->dimY * x));
-
-    //load the tensor data
-    float t11 = tensorField[index + 0];
-    float t22 = tensorField[index + 1];
-    float t33 = tensorField[index + 2];
-    float t12 = tensorField[index + 3];
-    float t13 = tensorField[index + 4];
-    float t23 = tensorField[index + 5];
-
-    if (t11 == 0.0f && t22 == 0.0f && t33 == 0.0f && t12 == 0.0f && t13 == 0.0f && t23 == 0.0f)
+    auto start = std::chrono::steady_clock::now();
+    this->dimX = dimX;
+    this->dimY = dimY;
+    this->dimZ = dimZ;
+    this->lazyTensors = std::move(tensorField);
+
+    //the vectors and FA are only written brick by brick, so their pages are committed as the bricks are touched
+    size_t numVoxels = (size_t)dimX * dimY * dimZ;
+    this->ownedData = allocateVolumeBuffer<float>(numVoxels * 3);
+    this->ownedFA = allocateVolumeBuffer<float>(numVoxels);
+    this->data = ownedData.get();
+    this->faData = ownedFA.get();
+
+    bricksX = (dimX + TENSOR_BRICK_SIZE - 1) / TENSOR_BRICK_SIZE;
+    bricksY = (dimY + TENSOR_BRICK_SIZE - 1) / TENSOR_BRICK_SIZE;
+    bricksZ = (dimZ + TENSOR_BRICK_SIZE - 1) / TENSOR_BRICK_SIZE;
+    brickStates.reset(new std::atomic<unsigned char>[getBrickCount()]);
+    for (size_t b = 0; b < getBrickCount(); b++) brickStates[b].store(BRICK_PENDING, std::memory_order_relaxed);
+
+    //a tensor decomposes to a zero vector exactly when it is zero, so the mask doesn't need the vectors
+    ownedZeroMask = allocateVolumeBuffer<bool>(numVoxels);
+    bool* mask = ownedZeroMask.get();
+    const float* tensors = lazyTensors.get();
+#pragma omp parallel for
+    for (int x = 0; x < dimX; x++)
     {
-        Eigen::Vector3f v = { 0.0f,0.0f,0.0f };
-        return v;
+        for (int y = 0; y < dimY; y++)
+        {
+            for (int z = 0; z < dimZ; z++)
+            {
+                const float* t = tensors + 6 * ((size_t)z + dimZ * ((size_t)y + (size_t)dimY * x));
+                mask[x + y * (size_t)dimX + z * (size_t)dimX * dimY] = t[0] != 0.0f || t[1] != 0.0f || t[2] != 0.0f
+                    || t[3] != 0.0f || t[4] != 0.0f || t[5] != 0.0f;
+            }
+        }
     }
+    this->zeroMask = mask;
 
-    Eigen::Matrix3f tensor;
-    tensor << 
-        t11, t12, t13,
-        t12, t22, t23,
-        t13, t23, t33;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Initialized lazy vector field from tensor field (" << getBrickCount() << " bricks) in " << seconds * 1000.0 << " ms" << std::endl;
+}
 
-    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eigensolver(tensor);
-    if (eigensolver.info() != Eigen::Success) 
+VectorField::VectorField(float* vectorData, float* faData, bool* zeroMask, int dimX, int dimY, int dimZ, bool ownsData)
+{
+    this->dimX = dimX;
+    this->dimY = dimY;
+    this->dimZ = dimZ;
+    this->data = vectorData;
+    this->faData = faData;
+    if (ownsData)
     {
-        //make sure the solver converges
-        std::cout << "Error while calculating eigenvalues" << std::endl;
-        std::cout << tensor << "\n\n";
-        std::cout << t11 << ", " << t22 << ", " << t33 << ", " << t12 << ", " << t13 << ", " << t23 << std::endl;
+        this->ownedData.reset(vectorData);
+        this->ownedFA.reset(faData);
+        this->ownedZeroMask.reset(zeroMask);
     }
-
-    return eigensolver.eigenvectors().col(2); //the third eigenvector corresponds to the largest eigenvalue
+    if (zeroMask) this->zeroMask = zeroMask;
+    else calculateZeroMask();
 }
 
 VectorField::~VectorField() {
-    // Free allocated memory
-    delete[] data;
+    //every buffer is held by a VolumeBuffer or unique_ptr member
 }
 
 void VectorField::getVector(int x, int y, int z, float& vx, float& vy, float& vz) const {
@@ -110,16 +189,42 @@ void VectorField::getVector(int x, int y, int z, float& vx, float& vy, float& vz
         return;
     }
 
+    if (storage == VECTOR_STORAGE_SPARSE_BLOCKS)
+    {
+        //empty blocks hold zero vectors
+        const float* v = sparseData->getVoxel(x, y, z);
+        if (!v)
+        {
+            vx = vy = vz = 0.0f;
+            return;
+        }
+        vx = v[0];
+        vy = v[1];
+        vz = v[2];
+        return;
+    }
+    if (storage != VECTOR_STORAGE_FLOAT32)
+    {
+        float v[3];
+        decodeVector((size_t)z + dimZ * ((size_t)y + dimY * (size_t)x), v);
+        vx = v[0];
+        vy = v[1];
+        vz = v[2];
+        return;
+    }
+
+    touch(x, y, z);
+
     // Calculate index into data array (3 components per voxel)
     int index = 3 * (z + dimZ * (y + dimY * x));
 
     // Extract vector components
-    vx = flipX ? -1.0f * data[index] : data[index];
-    vy = flipY ? -1.0f * data[index + 1] : data[index + 1];
-    vz = flipZ ? -1.0f * data[index + 2] : data[index + 2];
+    vx = data[index];
+    vy = data[index + 1];
+    vz = data[index + 2];
 }
 
-void VectorField::interpolateVector(float x, float y, float z, float& vx, float& vy, float& vz) const {
+void VectorField::interpolateVector(float x, float y, float z, InterpolationMode mode, float& vx, float& vy, float& vz) const {
     // If outside bounds, return zero vector
     if (!isInBounds(x, y, z)) {
         std::cout << "interpolated vector out of bounds" << std::endl;
@@ -127,7 +232,7 @@ void VectorField::interpolateVector(float x, float y, float z, float& vx, float&
         return;
     }
 
-    if (SIMPLE_INTERPOLATION)
+    if (mode == INTERPOLATION_NEAREST)
     {
         int x0 = std::roundf(x);
         int y0 = std::roundf(y);
@@ -137,64 +242,419 @@ void VectorField::interpolateVector(float x, float y, float z, float& vx, float&
         return;
     }
 
-    // Calculate indices of surrounding voxels
-    int x0 = static_cast<int>(x);
-    int y0 = static_cast<int>(y);
-    int z0 = static_cast<int>(z);
-
-    // Ensure indices are within bounds for interpolation
-    x0 = std::max(0, std::min(x0, dimX-2));
-    y0 = std::max(0, std::min(y0, dimY-2));
-    z0 = std::max(0, std::min(z0, dimZ-2));
-
-    int x1 = std::min(x0 + 1, dimX-1);
-    int y1 = std::min(y0 + 1, dimY-1);
-    int z1 = std::min(z0 + 1, dimZ-1);
-
-    // Calculate interpolation weights
-    float wx = x - x0;
-    float wy = y - y0;
-    float wz = z - z0;
-
-    // Clamp weights to [0,1] range
-    wx = std::max(0.0f, std::min(1.0f, wx));
-    wy = std::max(0.0f, std::min(1.0f, wy));
-    wz = std::max(0.0f, std::min(1.0f, wz));
-
-    // Get vectors at the 8 surrounding voxels
-    float v000x, v000y, v000z;
-    float v001x, v001y, v001z;
-    float v010x, v010y, v010z;
-    float v011x, v011y, v011z;
-    float v100x, v100y, v100z;
-    float v101x, v101y, v101z;
-    float v110x, v110y, v110z;
-    float v111x, v111y, v111z;
-
-    getVector(x0, y0, z0, v000x, v000y, v000z);
-    getVector(x0, y0, z1, v001x, v001y, v001z);
-    getVector(x0, y1, z0, v010x, v010y, v010z);
-    getVector(x0, y1, z1, v011x, v011y, v011z);
-    getVector(x1, y0, z0, v100x, v100y, v100z);
-    getVector(x1, y0, z1, v101x, v101y, v101z);
-    getVector(x1, y1, z0, v110x, v110y, v110z);
-    getVector(x1, y1, z1, v111x, v111y, v111z);
-
-    // Trilinear interpolation for each vector component
-    vx = (1-wx)*(1-wy)*(1-wz)*v000x + (1-wx)*(1-wy)*wz*v001x +
-         (1-wx)*wy*(1-wz)*v010x + (1-wx)*wy*wz*v011x +
-         wx*(1-wy)*(1-wz)*v100x + wx*(1-wy)*wz*v101x +
-         wx*wy*(1-wz)*v110x + wx*wy*wz*v111x;
-
-    vy = (1-wx)*(1-wy)*(1-wz)*v000y + (1-wx)*(1-wy)*wz*v001y +
-         (1-wx)*wy*(1-wz)*v010y + (1-wx)*wy*wz*v011y +
-         wx*(1-wy)*(1-wz)*v100y + wx*(1-wy)*wz*v101y +
-         wx*wy*(1-wz)*v110y + wx*wy*wz*v111y;
-
-    vz = (1-wx)*(1-wy)*(1-wz)*v000z + (1-wx)*(1-wy)*wz*v001z +
-         (1-wx)*wy*(1-wz)*v010z + (1-wx)*wy*wz*v011z +
-         wx*(1-wy)*(1-wz)*v100z + wx*(1-wy)*wz*v101z +
-         wx*wy*(1-wz)*v110z + wx*wy*wz*v111z;
+    // Trilinear or cubic interpolation
+    float interpolated[3];
+    const KernelSet& kernels = getKernels();
+    if (mode == INTERPOLATION_CUBIC_BSPLINE)
+        kernels.interpolateCubicBSpline(cubicCoefficients.get(), dimX, dimY, dimZ, x, y, z, interpolated);
+    else if (storage == VECTOR_STORAGE_OCTAHEDRAL16)
+        kernels.interpolateTrilinearOctahedral16(directions16.get(), magnitudes16.get(), maxMagnitude, dimX, dimY, dimZ, x, y, z, interpolated);
+    else if (storage == VECTOR_STORAGE_OCTAHEDRAL8)
+        kernels.interpolateTrilinearOctahedral8(directions8.get(), magnitudes8.get(), maxMagnitude, dimX, dimY, dimZ, x, y, z, interpolated);
+    else if (storage == VECTOR_STORAGE_SPARSE_BLOCKS)
+        sparseData->interpolateTrilinear(x, y, z, interpolated);
+    else
+    {
+        touchAround(x, y, z);
+        kernels.interpolateTrilinear(data, dimX, dimY, dimZ, x, y, z, interpolated);
+    }
+    vx = interpolated[0];
+    vy = interpolated[1];
+    vz = interpolated[2];
+}
+
+float VectorField::getFA(int x, int y, int z) const
+{
+    if (!faData || x < 0 || x >= dimX || y < 0 || y >= dimY || z < 0 || z >= dimZ)
+    {
+        return 0.0f;
+    }
+
+    touch(x, y, z);
+    return faData[z + dimZ * (y + dimY * x)];
+}
+
+size_t VectorField::getStorageBytes() const
+{
+    size_t numVoxels = (size_t)dimX * dimY * dimZ;
+    size_t vectorBytes = 3 * sizeof(float);
+    if (storage == VECTOR_STORAGE_OCTAHEDRAL16) vectorBytes = 2 * sizeof(short) + sizeof(unsigned short);
+    if (storage == VECTOR_STORAGE_OCTAHEDRAL8) vectorBytes = 2 * sizeof(signed char) + sizeof(unsigned char);
+    if (storage == VECTOR_STORAGE_SPARSE_BLOCKS) vectorBytes = 0;
+    size_t bytes = numVoxels * (vectorBytes + (faData ? sizeof(float) : 0) + sizeof(bool));
+    if (sparseData) bytes += sparseData->getMemoryBytes();
+    for (const auto& level : coarseLevels) bytes += level->getStorageBytes();
+    if (cubicCoefficients) bytes += numVoxels * 3 * sizeof(float);
+    if (lazyTensors) bytes += numVoxels * 6 * sizeof(float);
+    return bytes;
+}
+
+void VectorField::touchAround(float x, float y, float z) const
+{
+    if (!brickStates) return;
+
+    //the same cell as the trilinear kernel, it spans two bricks along an axis only at a brick boundary
+    int x0 = std::max(0, std::min((int)x, dimX - 2));
+    int y0 = std::max(0, std::min((int)y, dimY - 2));
+    int z0 = std::max(0, std::min((int)z, dimZ - 2));
+    int x1 = std::min(x0 + 1, dimX - 1), y1 = std::min(y0 + 1, dimY - 1), z1 = std::min(z0 + 1, dimZ - 1);
+    touch(x0, y0, z0);
+    if (x1 / TENSOR_BRICK_SIZE == x0 / TENSOR_BRICK_SIZE && y1 / TENSOR_BRICK_SIZE == y0 / TENSOR_BRICK_SIZE && z1 / TENSOR_BRICK_SIZE == z0 / TENSOR_BRICK_SIZE) return;
+    touch(x1, y0, z0);
+    touch(x0, y1, z0);
+    touch(x1, y1, z0);
+    touch(x0, y0, z1);
+    touch(x1, y0, z1);
+    touch(x0, y1, z1);
+    touch(x1, y1, z1);
+}
+
+void VectorField::decomposeBrick(size_t brick) const
+{
+    unsigned char expected = BRICK_PENDING;
+    if (!brickStates[brick].compare_exchange_strong(expected, BRICK_DECOMPOSING, std::memory_order_acquire))
+    {
+        //another thread claimed it, it takes a few microseconds
+        while (brickStates[brick].load(std::memory_order_acquire) != BRICK_READY) std::this_thread::yield();
+        return;
+    }
+
+    int bx = (int)(brick % bricksX);
+    int by = (int)(brick / bricksX % bricksY);
+    int bz = (int)(brick / ((size_t)bricksX * bricksY));
+    int x0 = bx * TENSOR_BRICK_SIZE, y0 = by * TENSOR_BRICK_SIZE, z0 = bz * TENSOR_BRICK_SIZE;
+    int x1 = std::min(x0 + TENSOR_BRICK_SIZE, (int)dimX);
+    int y1 = std::min(y0 + TENSOR_BRICK_SIZE, (int)dimY);
+    int z1 = std::min(z0 + TENSOR_BRICK_SIZE, (int)dimZ);
+
+    //z runs are contiguous in the tensor, vector and FA volumes
+    const KernelSet& kernels = getKernels();
+    float* vectors = ownedData.get();
+    float* fa = ownedFA.get();
+    for (int x = x0; x < x1; x++)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            size_t first = (size_t)z0 + dimZ * ((size_t)y + (size_t)dimY * x);
+            kernels.decomposeTensors(lazyTensors.get() + 6 * first, z1 - z0, vectors + 3 * first, fa + first);
+        }
+    }
+
+    decomposedBricks++;
+    brickStates[brick].store(BRICK_READY, std::memory_order_release);
+}
+
+void VectorField::decomposeAll() const
+{
+    if (!brickStates || decomposedBricks.load() == getBrickCount()) return;
+
+#pragma omp parallel for schedule(dynamic)
+    for (long long b = 0; b < (long long)getBrickCount(); b++)
+    {
+        if (brickStates[b].load(std::memory_order_acquire) != BRICK_READY) decomposeBrick((size_t)b);
+    }
+}
+
+void VectorField::allocateQuantized(VectorFieldStorage storage, float maxMagnitude)
+{
+    size_t numVoxels = (size_t)dimX * dimY * dimZ;
+    this->storage = storage;
+    this->maxMagnitude = maxMagnitude;
+    if (storage == VECTOR_STORAGE_OCTAHEDRAL16)
+    {
+        directions16 = allocateVolumeBuffer<short>(numVoxels * 2);
+        magnitudes16 = allocateVolumeBuffer<unsigned short>(numVoxels);
+    }
+    else
+    {
+        directions8 = allocateVolumeBuffer<signed char>(numVoxels * 2);
+        magnitudes8 = allocateVolumeBuffer<unsigned char>(numVoxels);
+    }
+}
+
+void VectorField::quantize(const float* vectors, size_t start, size_t count, double& errorSum, double& errorMax, size_t& numNonzero)
+{
+    const KernelSet& kernels = getKernels();
+    if (storage == VECTOR_STORAGE_OCTAHEDRAL16)
+        kernels.encodeOctahedral16(vectors, count, maxMagnitude, directions16.get() + 2 * start, magnitudes16.get() + start);
+    else
+        kernels.encodeOctahedral8(vectors, count, maxMagnitude, directions8.get() + 2 * start, magnitudes8.get() + start);
+
+    //measure the angle between every nonzero vector and its decoded version
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* v = vectors + 3 * i;
+        double length = std::sqrt((double)v[0] * v[0] + (double)v[1] * v[1] + (double)v[2] * v[2]);
+        if (length == 0.0) continue;
+
+        float decoded[3];
+        decodeVector(start + i, decoded);
+        double decodedLength = std::sqrt((double)decoded[0] * decoded[0] + (double)decoded[1] * decoded[1] + (double)decoded[2] * decoded[2]);
+        double cosAngle = (v[0] * decoded[0] + v[1] * decoded[1] + v[2] * decoded[2]) / (length * decodedLength);
+        double angle = std::acos(std::max(-1.0, std::min(1.0, cosAngle))) * 180.0 / 3.14159265358979323846;
+        errorSum += angle;
+        errorMax = std::max(errorMax, angle);
+        numNonzero++;
+    }
+}
+
+void VectorField::quantizeAll()
+{
+    const long long numVoxels = (long long)dimX * dimY * dimZ;
+    float largest = 0.0f;
+    for (long long i = 0; i < numVoxels; i++)
+    {
+        const float* v = data + 3 * i;
+        largest = std::max(largest, v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+    allocateQuantized(storage, std::sqrt(largest));
+
+    const long long chunkSize = 4096;
+    double errorSum = 0.0, errorMax = 0.0;
+    size_t numNonzero = 0;
+#pragma omp parallel
+    {
+        double threadErrorSum = 0.0, threadErrorMax = 0.0;
+        size_t threadNonzero = 0;
+
+#pragma omp for schedule(dynamic)
+        for (long long start = 0; start < numVoxels; start += chunkSize)
+        {
+            size_t count = (size_t)std::min(chunkSize, numVoxels - start);
+            quantize(data + 3 * start, start, count, threadErrorSum, threadErrorMax, threadNonzero);
+        }
+
+#pragma omp critical
+        {
+            errorSum += threadErrorSum;
+            errorMax = std::max(errorMax, threadErrorMax);
+            numNonzero += threadNonzero;
+        }
+    }
+
+    ownedData.reset();
+    data = nullptr;
+    reportQuantization(errorSum, errorMax, numNonzero);
+}
+
+void VectorField::reportQuantization(double errorSum, double errorMax, size_t numNonzero)
+{
+    meanAngularError = numNonzero ? errorSum / numNonzero : 0.0;
+    maxAngularError = errorMax;
+
+    size_t numVoxels = (size_t)dimX * dimY * dimZ;
+    size_t floatBytes = numVoxels * 3 * sizeof(float);
+    size_t quantizedBytes = storage == VECTOR_STORAGE_OCTAHEDRAL16 ? numVoxels * 6 : numVoxels * 3;
+    std::cout << "Quantized vector field to " << getVectorFieldStorageName(storage) << ": "
+              << quantizedBytes / (1024.0 * 1024.0) << " MB instead of " << floatBytes / (1024.0 * 1024.0) << " MB ("
+              << (double)floatBytes / quantizedBytes << "x smaller), angular error mean " << meanAngularError
+              << " max " << maxAngularError << " degrees" << std::endl;
+}
+
+void VectorField::buildSparse()
+{
+    sparseData.reset(new SparseBlockVolume(data, dimX, dimY, dimZ, 3));
+    ownedData.reset();
+    data = nullptr;
+
+    size_t denseBytes = (size_t)dimX * dimY * dimZ * 3 * sizeof(float);
+    std::cout << "Stored vector field in " << sparseData->getBlockCount() << " of " << sparseData->getTotalBlockCount()
+              << " blocks: " << sparseData->getMemoryBytes() / (1024.0 * 1024.0) << " MB instead of " << denseBytes / (1024.0 * 1024.0)
+              << " MB (" << (double)denseBytes / sparseData->getMemoryBytes() << "x smaller)" << std::endl;
+}
+
+void VectorField::decodeVector(size_t index, float* out) const
+{
+    float m;
+    if (storage == VECTOR_STORAGE_OCTAHEDRAL16)
+    {
+        m = magnitudes16[index] * (maxMagnitude / 65535.0f);
+        octDecode(directions16[2 * index] * (1.0f / 32767.0f), directions16[2 * index + 1] * (1.0f / 32767.0f), out);
+    }
+    else
+    {
+        m = magnitudes8[index] * (maxMagnitude / 255.0f);
+        octDecode(directions8[2 * index] * (1.0f / 127.0f), directions8[2 * index + 1] * (1.0f / 127.0f), out);
+    }
+    out[0] *= m;
+    out[1] *= m;
+    out[2] *= m;
+}
+
+/**
+ * Average the nonzero tensors of the 2x2x2 children of every voxel of the next level.
+ */
+static void downsampleTensors(const float* tensors, int dimX, int dimY, int dimZ, float* coarse, int coarseX, int coarseY, int coarseZ)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int x = 0; x < coarseX; x++)
+    {
+        for (int y = 0; y < coarseY; y++)
+        {
+            for (int z = 0; z < coarseZ; z++)
+            {
+                float sum[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+                int count = 0;
+                for (int cx = 2 * x; cx <= std::min(2 * x + 1, dimX - 1); cx++)
+                    for (int cy = 2 * y; cy <= std::min(2 * y + 1, dimY - 1); cy++)
+                        for (int cz = 2 * z; cz <= std::min(2 * z + 1, dimZ - 1); cz++)
+                        {
+                            const float* t = tensors + 6 * ((size_t)cz + dimZ * ((size_t)cy + (size_t)dimY * cx));
+                            if (t[0] == 0.0f && t[1] == 0.0f && t[2] == 0.0f && t[3] == 0.0f && t[4] == 0.0f && t[5] == 0.0f) continue;
+                            for (int c = 0; c < 6; c++) sum[c] += t[c];
+                            count++;
+                        }
+
+                //zero tensors lie outside the brain, averaging them in would shrink the tensors at the border
+                float* out = coarse + 6 * ((size_t)z + coarseZ * ((size_t)y + (size_t)coarseY * x));
+                for (int c = 0; c < 6; c++) out[c] = count ? sum[c] / count : 0.0f;
+            }
+        }
+    }
+}
+
+void VectorField::buildPyramid(int numLevels, const float* tensorField)
+{
+    coarseLevels.clear();
+
+    auto start = std::chrono::steady_clock::now();
+    const KernelSet& kernels = getKernels();
+    const float* fineTensors = tensorField;
+    std::vector<float> tensors; //tensors of the last built level
+
+    const VectorField* fine = this;
+    for (int level = 1; level < numLevels; level++)
+    {
+        int fineX = fine->dimX, fineY = fine->dimY, fineZ = fine->dimZ;
+        int coarseX = (fineX + 1) / 2, coarseY = (fineY + 1) / 2, coarseZ = (fineZ + 1) / 2;
+        if (fineX < 4 || fineY < 4 || fineZ < 4) break; //keep at least two voxels per axis for interpolation
+
+        size_t numCoarse = (size_t)coarseX * coarseY * coarseZ;
+        VolumeBuffer<float> vectors = allocateVolumeBuffer<float>(numCoarse * 3);
+        VolumeBuffer<float> fa;
+
+        if (tensorField)
+        {
+            //tensor space averaging, then the same decomposition as level 0
+            std::vector<float> coarseTensors(numCoarse * 6);
+            downsampleTensors(fineTensors, fineX, fineY, fineZ, coarseTensors.data(), coarseX, coarseY, coarseZ);
+            fa = allocateVolumeBuffer<float>(numCoarse);
+            const long long chunkSize = 4096;
+#pragma omp parallel for schedule(dynamic)
+            for (long long first = 0; first < (long long)numCoarse; first += chunkSize)
+            {
+                size_t count = (size_t)std::min(chunkSize, (long long)numCoarse - first);
+                kernels.decomposeTensors(coarseTensors.data() + 6 * first, count, vectors.get() + 3 * first, fa.get() + first);
+            }
+            tensors.swap(coarseTensors);
+            fineTensors = tensors.data();
+        }
+        else
+        {
+            //renormalized vector averaging
+#pragma omp parallel for schedule(dynamic)
+            for (int x = 0; x < coarseX; x++)
+            {
+                for (int y = 0; y < coarseY; y++)
+                {
+                    for (int z = 0; z < coarseZ; z++)
+                    {
+                        float reference[3] = { 0.0f, 0.0f, 0.0f };
+                        float sum[3] = { 0.0f, 0.0f, 0.0f };
+                        float magnitudeSum = 0.0f;
+                        int count = 0;
+                        for (int cx = 2 * x; cx <= std::min(2 * x + 1, fineX - 1); cx++)
+                            for (int cy = 2 * y; cy <= std::min(2 * y + 1, fineY - 1); cy++)
+                                for (int cz = 2 * z; cz <= std::min(2 * z + 1, fineZ - 1); cz++)
+                                {
+                                    float v[3];
+                                    fine->getVector(cx, cy, cz, v[0], v[1], v[2]);
+                                    float magnitude = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+                                    if (magnitude == 0.0f) continue;
+
+                                    //eigenvectors have no sign, so align every child with the first one
+                                    if (count == 0) for (int c = 0; c < 3; c++) reference[c] = v[c];
+                                    float sign = v[0] * reference[0] + v[1] * reference[1] + v[2] * reference[2] < 0.0f ? -1.0f : 1.0f;
+                                    for (int c = 0; c < 3; c++) sum[c] += sign * v[c] / magnitude;
+                                    magnitudeSum += magnitude;
+                                    count++;
+                                }
+
+                        float* out = vectors.get() + 3 * ((size_t)z + coarseZ * ((size_t)y + (size_t)coarseY * x));
+                        float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                        for (int c = 0; c < 3; c++)
+                        {
+                            out[c] = length > 0.0f ? sum[c] / length * (magnitudeSum / count) : 0.0f;
+                        }
+                    }
+                }
+            }
+        }
+
+        coarseLevels.emplace_back(new VectorField(vectors.release(), fa.release(), nullptr, coarseX, coarseY, coarseZ, true));
+        fine = coarseLevels.back().get();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Built vector field pyramid with " << getLevelCount() << " levels in " << seconds * 1000.0 << " ms" << std::endl;
+}
+
+const VectorField* VectorField::getLevel(int level) const
+{
+    if (level <= 0 || coarseLevels.empty()) return this;
+    return coarseLevels[std::min(level, (int)coarseLevels.size()) - 1].get();
+}
+
+void VectorField::prepareInterpolation(InterpolationMode mode) const
+{
+    if (mode == INTERPOLATION_CUBIC_BSPLINE) std::call_once(cubicOnce, [this]() { prefilterCubic(); });
+}
+
+void VectorField::prefilterCubic() const
+{
+    auto start = std::chrono::steady_clock::now();
+    const KernelSet& kernels = getKernels();
+    size_t numVoxels = (size_t)dimX * dimY * dimZ;
+    cubicCoefficients = allocateVolumeBuffer<float>(numVoxels * 3);
+
+    //start from the decoded vectors
+#pragma omp parallel for
+    for (int x = 0; x < dimX; x++)
+    {
+        for (int y = 0; y < dimY; y++)
+        {
+            for (int z = 0; z < dimZ; z++)
+            {
+                float* c = cubicCoefficients.get() + 3 * ((size_t)z + dimZ * ((size_t)y + (size_t)dimY * x));
+                getVector(x, y, z, c[0], c[1], c[2]);
+            }
+        }
+    }
+
+    //separable: along z every z column is filtered on its own (3 interleaved components),
+    //along y and x whole contiguous z columns are filtered at once
+    const size_t zColumn = (size_t)3 * dimZ;
+#pragma omp parallel for
+    for (int x = 0; x < dimX; x++)
+    {
+        for (int y = 0; y < dimY; y++)
+        {
+            kernels.prefilterBSpline(cubicCoefficients.get() + zColumn * (y + (size_t)dimY * x), dimZ, 3, 3);
+        }
+    }
+#pragma omp parallel for
+    for (int x = 0; x < dimX; x++)
+    {
+        kernels.prefilterBSpline(cubicCoefficients.get() + zColumn * dimY * x, dimY, zColumn, (int)zColumn);
+    }
+#pragma omp parallel for
+    for (int y = 0; y < dimY; y++)
+    {
+        kernels.prefilterBSpline(cubicCoefficients.get() + zColumn * y, dimX, zColumn * dimY, (int)zColumn);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Computed cubic B-spline coefficients in " << seconds * 1000.0 << " ms" << std::endl;
 }
 
 bool VectorField::isInBounds(float x, float y, float z) const {
@@ -204,7 +664,7 @@ bool VectorField::isInBounds(float x, float y, float z) const {
             z >= 0.0f && z <= dimZ-1.0f);
 }
 
-bool* VectorField::getZeroMask(int dimX, int dimY, int dimZ)
+const bool* VectorField::getZeroMask(int dimX, int dimY, int dimZ) const
 {
     //check if dimensions match
     if (this->dimX != dimX || this->dimY != dimY || this->dimZ != dimZ)
@@ -215,9 +675,10 @@ bool* VectorField::getZeroMask(int dimX, int dimY, int dimZ)
     return this->zeroMask;
 }
 
-bool* VectorField::calculateZeroMask()
+void VectorField::calculateZeroMask()
 {
-    bool* mask = new bool[this->dimX * this->dimY * this->dimZ];
+    ownedZeroMask = allocateVolumeBuffer<bool>((size_t)this->dimX * this->dimY * this->dimZ);
+    bool* mask = ownedZeroMask.get();
     int index;
     float vx, vy, vz;
     for (size_t x = 0; x < this->dimX; x++)
@@ -241,5 +702,5 @@ bool* VectorField::calculateZeroMask()
             }
         }
     }
-    return mask;
+    this->zeroMask = mask;
 }
\ No newline at end of file
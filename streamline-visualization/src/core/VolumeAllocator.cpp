@@ -0,0 +1,243 @@
+#include "../include/VolumeAllocator.h"
+#include "../include/Constants.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+// From linux/mempolicy.h, defined here so libnuma is not needed
+static const int MPOL_INTERLEAVE_MODE = 3;
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+#endif
+
+/**
+ * Bookkeeping of a single allocation, needed to release it the same way it was made.
+ */
+struct VolumeAllocation {
+    size_t bytes;
+    bool mapped; ///< Allocated with mmap/VirtualAlloc instead of the aligned heap
+};
+
+static std::mutex allocationsMutex;
+static std::map<void*, VolumeAllocation> allocations;
+
+static VolumeAllocationPolicy parsePolicy(const char* name)
+{
+    std::string n = name;
+    if (n == "hugepages") return ALLOCATE_HUGE_PAGES;
+    if (n == "interleave") return ALLOCATE_NUMA_INTERLEAVE;
+    if (n == "interleave-hugepages") return ALLOCATE_NUMA_INTERLEAVE_HUGE_PAGES;
+    if (n != "default") std::cerr << "Unknown volume allocation policy " << name << ", using default" << std::endl;
+    return ALLOCATE_DEFAULT;
+}
+
+static VolumeAllocationPolicy& currentPolicy()
+{
+    static VolumeAllocationPolicy policy = []() {
+        const char* env = std::getenv("VCP_VOLUME_ALLOCATION");
+        VolumeAllocationPolicy p = parsePolicy(env ? env : VOLUME_ALLOCATION_POLICY);
+        std::cout << "Volume allocation policy: " << getVolumeAllocationPolicyName(p) << " (" << getNumaNodeCount() << " NUMA nodes)" << std::endl;
+        return p;
+    }();
+    return policy;
+}
+
+const char* getVolumeAllocationPolicyName(VolumeAllocationPolicy policy)
+{
+    switch (policy)
+    {
+    case ALLOCATE_HUGE_PAGES: return "hugepages";
+    case ALLOCATE_NUMA_INTERLEAVE: return "interleave";
+    case ALLOCATE_NUMA_INTERLEAVE_HUGE_PAGES: return "interleave-hugepages";
+    default: return "default";
+    }
+}
+
+VolumeAllocationPolicy getVolumeAllocationPolicy()
+{
+    return currentPolicy();
+}
+
+void setVolumeAllocationPolicy(VolumeAllocationPolicy policy)
+{
+    currentPolicy() = policy;
+}
+
+int getNumaNodeCount()
+{
+    static int nodes = []() {
+        int count = 1;
+#if defined(__linux__)
+        //format is a list of ranges, e.g. "0-1" or "0,2-3"
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string ranges;
+        if (online >> ranges)
+        {
+            int last = 0;
+            size_t pos = 0;
+            while (pos < ranges.size())
+            {
+                size_t end = ranges.find(',', pos);
+                if (end == std::string::npos) end = ranges.size();
+                std::string range = ranges.substr(pos, end - pos);
+                size_t dash = range.find('-');
+                last = std::max(last, std::atoi(dash == std::string::npos ? range.c_str() : range.c_str() + dash + 1));
+                pos = end + 1;
+            }
+            count = last + 1;
+        }
+#elif defined(_WIN32)
+        ULONG highest = 0;
+        if (GetNumaHighestNodeNumber(&highest)) count = (int)highest + 1;
+#endif
+        return count;
+    }();
+    return nodes;
+}
+
+#if defined(__linux__)
+/**
+ * Map anonymous memory, with explicit huge pages if requested and available.
+ */
+static void* mapPages(size_t bytes, bool hugePages)
+{
+    if (hugePages)
+    {
+        void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) return ptr;
+    }
+
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return nullptr;
+
+    //no reserved huge pages, ask for transparent huge pages instead
+    if (hugePages) madvise(ptr, bytes, MADV_HUGEPAGE);
+    return ptr;
+}
+
+/**
+ * Interleave the pages of a mapping over all NUMA nodes, must happen before the pages are touched.
+ */
+static void interleavePages(void* ptr, size_t bytes)
+{
+    int nodes = getNumaNodeCount();
+    if (nodes <= 1) return;
+
+    unsigned long nodeMask[16] = { 0 };
+    for (int n = 0; n < nodes && n < (int)(sizeof(nodeMask) * 8); n++)
+    {
+        nodeMask[n / (sizeof(unsigned long) * 8)] |= 1ul << (n % (sizeof(unsigned long) * 8));
+    }
+
+    if (syscall(SYS_mbind, ptr, bytes, MPOL_INTERLEAVE_MODE, nodeMask, sizeof(nodeMask) * 8, 0) != 0)
+    {
+        std::cerr << "Warning: could not interleave volume memory over the NUMA nodes" << std::endl;
+    }
+}
+#endif
+
+void* allocateVolume(size_t bytes)
+{
+    if (bytes == 0) bytes = 1;
+
+    VolumeAllocationPolicy policy = getVolumeAllocationPolicy();
+    bool hugePages = policy == ALLOCATE_HUGE_PAGES || policy == ALLOCATE_NUMA_INTERLEAVE_HUGE_PAGES;
+    bool interleave = policy == ALLOCATE_NUMA_INTERLEAVE || policy == ALLOCATE_NUMA_INTERLEAVE_HUGE_PAGES;
+
+    void* ptr = nullptr;
+    VolumeAllocation allocation = { bytes, false };
+
+#if defined(__linux__)
+    if (policy != ALLOCATE_DEFAULT)
+    {
+        allocation.bytes = hugePages ? (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE : bytes;
+        ptr = mapPages(allocation.bytes, hugePages);
+        if (ptr)
+        {
+            allocation.mapped = true;
+            if (interleave) interleavePages(ptr, allocation.bytes);
+        }
+    }
+#elif defined(_WIN32)
+    if (hugePages)
+    {
+        //large pages need the SeLockMemoryPrivilege, fall back to regular pages without it
+        SIZE_T largePage = GetLargePageMinimum();
+        if (largePage > 0)
+        {
+            allocation.bytes = (bytes + largePage - 1) / largePage * largePage;
+            ptr = VirtualAlloc(nullptr, allocation.bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            allocation.mapped = ptr != nullptr;
+        }
+    }
+    (void)interleave; //no interleaving on Windows, pages are placed on first touch
+#else
+    (void)hugePages;
+    (void)interleave;
+#endif
+
+    if (!ptr)
+    {
+        allocation = { bytes, false };
+#if defined(_WIN32)
+        ptr = _aligned_malloc(bytes, 64);
+#else
+        if (posix_memalign(&ptr, 64, bytes) != 0) ptr = nullptr;
+#endif
+    }
+
+    if (!ptr) throw std::bad_alloc();
+
+    std::lock_guard<std::mutex> lock(allocationsMutex);
+    allocations[ptr] = allocation;
+    return ptr;
+}
+
+void freeVolume(void* ptr)
+{
+    if (!ptr) return;
+
+    VolumeAllocation allocation;
+    {
+        std::lock_guard<std::mutex> lock(allocationsMutex);
+        auto it = allocations.find(ptr);
+        if (it == allocations.end())
+        {
+            std::cerr << "Error: freeVolume called on a buffer that was not allocated with allocateVolume" << std::endl;
+            return;
+        }
+        allocation = it->second;
+        allocations.erase(it);
+    }
+
+    if (allocation.mapped)
+    {
+#if defined(__linux__)
+        munmap(ptr, allocation.bytes);
+#elif defined(_WIN32)
+        VirtualFree(ptr, 0, MEM_RELEASE);
+#endif
+        return;
+    }
+
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
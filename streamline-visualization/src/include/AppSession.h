@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include "DatasetSnapshot.h"
+#include "StreamlineTracer.h"
+
+/**
+ * @file AppSession.h
+ * @brief The state of a running application session
+ */
+
+/**
+ * @class AppSession
+ * @brief The active dataset and the tracer settings edited in the UI
+ *
+ * The UI thread swaps in a new dataset with setDataset(); any other thread takes its own
+ * reference with getDataset() and keeps reading that snapshot for as long as it holds it,
+ * even if the UI has moved on to another dataset in the meantime. The tracer parameters are
+ * only touched by the UI thread, a trace gets a copy of them.
+ */
+class AppSession {
+public:
+    /**
+     * @brief Constructor, no dataset is loaded yet
+     * @param params Initial tracer settings
+     */
+    explicit AppSession(const TracerParams& params = TracerParams()) : tracerParams(params) {}
+
+    /**
+     * @brief Get a reference to the active dataset
+     * @return The dataset, or nullptr if none is loaded
+     */
+    std::shared_ptr<const DatasetSnapshot> getDataset() const { return std::atomic_load(&dataset); }
+
+    /**
+     * @brief Replace the active dataset, readers of the previous one keep it alive until they are done
+     */
+    void setDataset(std::shared_ptr<const DatasetSnapshot> next) { std::atomic_store(&dataset, std::move(next)); }
+
+    TracerParams tracerParams; ///< Settings of the next trace, edited by the UI
+
+private:
+    std::shared_ptr<const DatasetSnapshot> dataset;
+};
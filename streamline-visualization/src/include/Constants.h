@@ -24,4 +24,17 @@ const short AXIS_X = 0;
 const short AXIS_Y = 1;
 const short AXIS_Z = 2;
 
+//Placement of the large volume buffers, overridden by the VCP_VOLUME_ALLOCATION environment variable
+//one of "default", "hugepages", "interleave" or "interleave-hugepages" (see VolumeAllocator.h)
+const char* const VOLUME_ALLOCATION_POLICY = "default";
+
+//Edge length of the bricks the volume is split in for parallel seeding, must be a power of two
+const int SEED_BRICK_SIZE = 8;
+
+//Levels of the vector field pyramid used for coarse preview tracing, including full resolution
+const int VECTOR_PYRAMID_LEVELS = 4;
+
+//Memory budget for datasets kept resident for instant switching (CPU volumes plus GPU texture and vertices)
+const int DATASET_MEMORY_BUDGET_MB = 2048;
+
 #endif
\ No newline at end of file
@@ -14,7 +14,7 @@
  * @brief Read scalar data from a NIFTI file
  *
  * @param filename Path to the NIFTI file
- * @param data Output parameter to store the loaded data (caller must delete[])
+ * @param data Output parameter to store the loaded data (caller must release it with freeVolume())
  * @param dimX Output parameter for X dimension
  * @param dimY Output parameter for Y dimension
  * @param dimZ Output parameter for Z dimension
@@ -37,7 +37,7 @@ void printSlice(float* data, int slice, int x, int y, int z);
  * @brief Read vector field data from a NIFTI file
  *
  * @param filename Path to the NIFTI file
- * @param data Output parameter to store the loaded data (3 components per voxel, caller must delete[])
+ * @param data Output parameter to store the loaded data (3 components per voxel, caller must release it with freeVolume())
  * @param dimX Output parameter for X dimension
  * @param dimY Output parameter for Y dimension
  * @param dimZ Output parameter for Z dimension
@@ -49,7 +49,7 @@ int readVectorData(const char* filename, float*& data, int& dimX, int& dimY, int
  * @brief Read diffusion tensor data from a NIFTI file
  *
  * @param filename Path to the NIFTI file
- * @param data Output parameter to store the loaded data (6 components per voxel, caller must delete[])
+ * @param data Output parameter to store the loaded data (6 components per voxel, caller must release it with freeVolume())
  * @param dimX Output parameter for X dimension
  * @param dimY Output parameter for Y dimension
  * @param dimZ Output parameter for Z dimension
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "StreamlineTracer.h"
+#include "DatasetSnapshot.h"
+#include "GLObject.h"
+
+class StreamlineRenderer;
+class StreamlineBVH;
+
+/**
+ * @file DatasetManager.h
+ * @brief Keeps several prepared datasets resident so switching between them is instant
+ *
+ * A prepared dataset is everything the application builds from the data files: the dataset
+ * snapshot with the scalar volume and the vector field, the 3D background texture and the
+ * renderer with its uploaded streamlines. Instead of tearing these down on every dataset switch, the manager
+ * keeps them until the total memory of all resident datasets exceeds a budget, and then
+ * evicts the least recently used ones.
+ */
+
+/**
+ * @struct ResidentDataset
+ * @brief A prepared dataset, owns all of its CPU and GPU resources
+ */
+struct ResidentDataset {
+    std::shared_ptr<const DatasetSnapshot> data; ///< The volumes, shared with whoever still reads them
+    std::unique_ptr<StreamlineRenderer> renderer;
+    std::unique_ptr<StreamlineBVH> bvh;    ///< Picking hierarchy over the streamlines in the renderer
+    GLObject texture;                      ///< 3D background texture
+    StreamlineAttributes attributes;       ///< Attributes of the streamlines in the renderer
+    TracerParams tracedParams;             ///< Settings the streamlines in the renderer were traced with
+
+    int currentSliceX = 0, currentSliceY = 0, currentSliceZ = 0; ///< Slices the streamlines were seeded on
+
+    size_t cpuBytes = 0;   ///< Memory of the volumes
+    size_t gpuBytes = 0;   ///< Memory of the texture and vertex buffer
+    uint64_t lastUsed = 0; ///< Activation counter value of the last activation
+
+    ResidentDataset();
+    ResidentDataset(const ResidentDataset&) = delete;
+    ResidentDataset& operator=(const ResidentDataset&) = delete;
+
+    /**
+     * @brief Destructor - the members delete the GL objects and drop the reference to the volumes
+     */
+    ~ResidentDataset();
+};
+
+/**
+ * @class DatasetManager
+ * @brief Set of resident datasets with least recently used eviction under a memory budget
+ */
+class DatasetManager {
+public:
+    /**
+     * @brief Constructor
+     * @param budgetBytes Total CPU plus GPU memory the resident datasets may use
+     */
+    DatasetManager(size_t budgetBytes);
+
+    /**
+     * @brief Destructor - releases all resident datasets
+     */
+    ~DatasetManager();
+
+    /**
+     * @brief Find a resident dataset by name and mark it as the most recently used one
+     * @return The dataset, or nullptr if it is not resident
+     */
+    ResidentDataset* acquire(const char* dataset, bool useTensors);
+
+    /**
+     * @brief Make a prepared dataset resident, replacing a resident copy of the same dataset
+     *
+     * The memory use is computed here, afterwards least recently used datasets are evicted
+     * until the budget is met. The inserted dataset itself is never evicted by this call.
+     * @return The dataset, owned by the manager until it is evicted or cleared
+     */
+    ResidentDataset* insert(std::unique_ptr<ResidentDataset> entry);
+
+    /**
+     * @brief Recompute the memory use of a dataset, e.g. after its streamlines were regenerated
+     */
+    void updateMemoryUse(ResidentDataset* entry);
+
+    /**
+     * @brief Release all resident datasets except the given one
+     */
+    void clear(ResidentDataset* keep = nullptr);
+
+    /**
+     * @brief Change the budget and evict datasets if needed, except the given one
+     */
+    void setBudget(size_t budgetBytes, ResidentDataset* keep = nullptr);
+
+    size_t getBudget() const { return budgetBytes; }
+    size_t getTotalBytes() const;
+    const std::vector<std::unique_ptr<ResidentDataset>>& getDatasets() const { return datasets; }
+
+private:
+    void computeMemoryUse(ResidentDataset* entry);
+    void evict(ResidentDataset* keep);
+    void release(size_t index);
+
+    std::vector<std::unique_ptr<ResidentDataset>> datasets; ///< Resident datasets, in no particular order
+    size_t budgetBytes;
+    uint64_t useCounter = 0;
+};
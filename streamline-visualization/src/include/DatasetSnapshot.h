@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+class VectorField;
+class SliceSeedIndex;
+
+/**
+ * @file DatasetSnapshot.h
+ * @brief Immutable, reference counted volumes of a loaded dataset
+ *
+ * A dataset snapshot owns the scalar volume and the vector field of a dataset and never changes
+ * after construction, so any number of threads can read it without locking. Whoever needs the
+ * volumes (a tracer, a background save, the UI) holds a shared pointer to the snapshot, so the
+ * volumes are freed when the last of them lets go, not when the UI switches to another dataset.
+ *
+ * Not to be confused with SessionSnapshot, the file a session is saved to; a dataset restored
+ * from such a file keeps the mapping alive through its snapshot.
+ */
+
+/**
+ * @struct ScalarVolume
+ * @brief Read-only view of a scalar volume, index x + y * dimX + z * dimX * dimY
+ */
+struct ScalarVolume {
+    const float* data = nullptr;
+    int dimX = 0, dimY = 0, dimZ = 0;
+
+    /**
+     * @brief Sample at a floating-point position with trilinear interpolation, clamped to the volume
+     * @return Interpolated value, 0 if there is no data
+     */
+    float sample(float x, float y, float z) const;
+};
+
+/**
+ * @class DatasetSnapshot
+ * @brief The volumes of a prepared dataset, shared read-only between threads
+ */
+class DatasetSnapshot {
+public:
+    /**
+     * @brief Constructor, takes ownership of the volumes
+     * @param name Dataset name (BRAIN_DATASET or TOY_DATASET), copied into the snapshot
+     * @param useTensors Whether the vector field was computed from the tensors
+     * @param scalars Scalar volume, its deleter frees it (see shareVolume())
+     * @param field Vector field, deleted with the snapshot
+     * @param backing Memory the volumes point into that has to outlive them, e.g. a mapped session snapshot, or nullptr
+     */
+    DatasetSnapshot(const std::string& name, bool useTensors, std::shared_ptr<const float> scalars, int dimX, int dimY, int dimZ,
+        std::unique_ptr<const VectorField> field, std::shared_ptr<const void> backing = nullptr);
+
+    /**
+     * @brief Destructor - frees the vector field, then the scalars and the backing memory
+     */
+    ~DatasetSnapshot();
+
+    const std::string& getName() const { return name; }
+    bool usesTensors() const { return useTensors; }
+    int getDimX() const { return scalars.dimX; }
+    int getDimY() const { return scalars.dimY; }
+    int getDimZ() const { return scalars.dimZ; }
+    const ScalarVolume& getScalars() const { return scalars; }
+    const VectorField* getVectorField() const { return vectorField.get(); }
+
+    /**
+     * @brief Get the masked voxels of every slice, built with the snapshot
+     * @return The index, or nullptr if there is no vector field
+     */
+    const SliceSeedIndex* getSeedIndex() const { return seedIndex.get(); }
+
+    /**
+     * @brief Memory of the scalar volume, the vector field and the seed index in bytes
+     */
+    size_t getMemoryBytes() const;
+
+private:
+    DatasetSnapshot(const DatasetSnapshot&) = delete;
+    DatasetSnapshot& operator=(const DatasetSnapshot&) = delete;
+
+    std::string name;
+    bool useTensors;
+    std::shared_ptr<const void> backing;       ///< Declared first, so it is released last
+    std::shared_ptr<const float> scalarOwner;
+    ScalarVolume scalars;
+    std::unique_ptr<const VectorField> vectorField;
+    std::unique_ptr<const SliceSeedIndex> seedIndex;
+};
+
+/**
+ * @brief Hand a buffer from allocateVolume() to a shared pointer that frees it with freeVolume()
+ */
+std::shared_ptr<const float> shareVolume(float* data);
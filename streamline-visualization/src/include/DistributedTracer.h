@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "StreamlineTracer.h"
+#include "TraceTransport.h"
+
+/**
+ * @file DistributedTracer.h
+ * @brief Tracing one seed set on several processes, each owning a slab of the volume
+ *
+ * The volume is cut along x into one slab per tracing rank, balanced by the number of masked
+ * voxels per x slice. A rank starts the halves of the seeds in its slab and traces them until
+ * they terminate or leave the slab. A half that leaves is handed to the owner of its current
+ * point with only what is needed to continue it (seed index, direction, step count and the last
+ * two points), see SlabHalf. The traced pieces go to the coordinator (rank 0), which detects the
+ * end of the trace when every half has terminated and all its pieces have arrived, stops the
+ * ranks and joins the pieces into streamlines.
+ *
+ * The streamlines are bitwise identical to traceAllStreamlines at full resolution. Every rank
+ * currently loads the whole dataset, but it only samples its slab plus getSlabHalo() voxels on
+ * either side, which is what a rank loading just its own bricks would need.
+ */
+
+/**
+ * @struct DistributedTraceStats
+ * @brief What a distributed trace did, gathered by the coordinator
+ */
+struct DistributedTraceStats {
+    double wallMs = 0.0;              ///< From sending the seeds until the last piece arrived
+    int halo = 0;                     ///< Voxels beyond its slab a rank samples
+    std::vector<float> slabBounds;    ///< x where every slab begins, plus the end of the last one
+    std::vector<uint64_t> rankSeeds;  ///< Seeds started per tracing rank
+    std::vector<uint64_t> rankPoints; ///< Points traced per tracing rank
+    std::vector<uint64_t> rankHandOffs; ///< Halves every tracing rank handed to a neighbour
+    std::vector<double> rankBusyMs;   ///< Time every tracing rank spent tracing
+    uint64_t messages = 0;            ///< Messages sent by all ranks, without the final statistics
+    uint64_t bytes = 0;               ///< Bytes sent by all ranks, without the final statistics
+
+    /**
+     * @brief Print the per rank numbers and the totals to stdout
+     */
+    void print() const;
+};
+
+/**
+ * @brief Cut the volume into slabs along x with about the same number of masked voxels each
+ * @param index Seed index of the dataset, for the masked voxels per x slice
+ * @param dimX Size of the volume along x
+ * @param numSlabs Number of slabs
+ * @return numSlabs + 1 bounds, slab i is [bounds[i], bounds[i + 1]); the outer bounds are -FLT_MAX and FLT_MAX
+ */
+std::vector<float> computeSlabBounds(const SliceSeedIndex& index, int dimX, int numSlabs);
+
+/**
+ * @brief Get the voxels beyond its slab a rank samples: the reach of a step plus the interpolation footprint
+ */
+int getSlabHalo(const TracerParams& params);
+
+/**
+ * @brief Run rank 0 of a distributed trace
+ *
+ * Sends the settings, slab bounds and seeds to the tracing ranks, collects the pieces until
+ * every half is complete and stops the ranks.
+ *
+ * @param transport Transport of rank 0, with at least one tracing rank
+ * @param tracer Tracer on the dataset the ranks loaded, for the slab bounds
+ * @param seeds Seed points
+ * @param params Settings of the trace, the level is ignored
+ * @param stats Optional output for the statistics of the trace
+ * @return The streamlines in seed order, as traceAllStreamlines returns them
+ */
+std::vector<std::vector<Point3D>> runTraceCoordinator(TraceTransport& transport, const StreamlineTracer& tracer,
+    const std::vector<Point3D>& seeds, const TracerParams& params, DistributedTraceStats* stats = nullptr);
+
+/**
+ * @brief Run a tracing rank until the coordinator stops it
+ * @param transport Transport of the rank
+ * @param tracer Tracer on the same dataset the coordinator uses
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if a message was invalid
+ */
+int runTraceRank(TraceTransport& transport, const StreamlineTracer& tracer);
@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+ * @file GLObject.h
+ * @brief Owning handle for OpenGL textures, buffers and vertex arrays
+ */
+
+/**
+ * @brief Kinds of GL objects a GLObject can hold
+ */
+enum GLObjectType {
+    GL_OBJECT_TEXTURE = 0,
+    GL_OBJECT_BUFFER,
+    GL_OBJECT_VERTEX_ARRAY
+};
+
+/**
+ * @class GLObject
+ * @brief Move-only owner of a GL object name, deleted with the handle
+ *
+ * The handle has to be destroyed (or reset) while the GL context that created the object is
+ * still current, so handles are members of objects that are released before the context
+ * goes away, never globals.
+ */
+class GLObject {
+public:
+    /**
+     * @brief Constructor, holds no object
+     */
+    GLObject() = default;
+
+    /**
+     * @brief Constructor, generates a new object of the given type
+     */
+    explicit GLObject(GLObjectType type);
+
+    /**
+     * @brief Destructor - deletes the object
+     */
+    ~GLObject();
+
+    GLObject(GLObject&& other);
+    GLObject& operator=(GLObject&& other);
+
+    /**
+     * @brief Get the object name, 0 if the handle is empty
+     */
+    unsigned int get() const { return id; }
+
+    /**
+     * @brief Delete the object, the handle is empty afterwards
+     */
+    void reset();
+
+    explicit operator bool() const { return id != 0; }
+
+    /**
+     * @brief Get the number of GL objects held by all handles, for finding leaks
+     */
+    static int getLiveCount();
+
+private:
+    GLObject(const GLObject&) = delete;
+    GLObject& operator=(const GLObject&) = delete;
+
+    GLObjectType type = GL_OBJECT_TEXTURE;
+    unsigned int id = 0;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @file InputRecorder.h
+ * @brief Recording of user actions for replaying interactive sessions as benchmarks
+ *
+ * Actions are recorded at the level of the application state the user changes (slider
+ * values, seeding clicks in voxel coordinates, view axis and dataset changes), not as raw
+ * mouse events, so a recording replays the same way at any window size.
+ *
+ * A recording is a text file with one action per line:
+ *     <seconds since the start of the recording> <action name> <value> <value> <value>
+ */
+
+/**
+ * @struct InputAction
+ * @brief One recorded user action
+ */
+struct InputAction {
+    double time = 0.0;                          ///< Seconds since the start of the recording
+    std::string name;                           ///< Name of the action, e.g. "stepSize" or "mouseSeed"
+    float values[3] = { 0.0f, 0.0f, 0.0f };     ///< Values of the action, unused values are zero
+};
+
+/**
+ * @class InputRecorder
+ * @brief Collects timestamped actions between start() and stop()
+ */
+class InputRecorder {
+public:
+    /**
+     * @brief Discard previous actions and start recording
+     * @param now Current time in seconds, used as the start of the recording
+     */
+    void start(double now);
+
+    /**
+     * @brief Stop recording, the actions are kept until the next start()
+     */
+    void stop();
+
+    /**
+     * @brief Whether actions are being recorded
+     */
+    bool isRecording() const { return recording; }
+
+    /**
+     * @brief Record an action if recording, otherwise do nothing
+     * @param now Current time in seconds
+     * @param name Name of the action
+     */
+    void record(double now, const char* name, float v0 = 0.0f, float v1 = 0.0f, float v2 = 0.0f);
+
+    /**
+     * @brief Get the recorded actions
+     */
+    const std::vector<InputAction>& getActions() const { return actions; }
+
+    /**
+     * @brief Write the recorded actions to a file
+     * @return EXIT_SUCCESS or EXIT_FAILURE
+     */
+    int save(const char* filename) const;
+
+    /**
+     * @brief Read a recording from a file
+     * @param actions Output actions, sorted by time
+     * @return EXIT_SUCCESS or EXIT_FAILURE
+     */
+    static int load(const char* filename, std::vector<InputAction>& actions);
+
+private:
+    std::vector<InputAction> actions;
+    double startTime = 0.0;
+    bool recording = false;
+};
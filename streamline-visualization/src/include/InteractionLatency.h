@@ -0,0 +1,149 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "LatencyStats.h"
+
+/**
+ * @file InteractionLatency.h
+ * @brief Input-to-display latency of user interactions, broken down by pipeline stage
+ *
+ * Every input that changes what is on screen (a slider move, a seeding click, a dataset switch)
+ * is tagged with an id when it is received. The stages that work on its result (seeding, tracing,
+ * packing the vertices, uploading them) stamp every open interaction when they finish. The next
+ * frame that draws the scene picks up the open interactions, and once that frame is presented and
+ * finished on the GPU they are closed. Inputs handled before the same frame share the stage
+ * times, since they are served by the same result. Several drawn frames may wait for the GPU at
+ * once; they are finished in the order they were drawn.
+ */
+
+/**
+ * @brief Closed interactions kept for the CSV dump and latency samples kept per statistic; a
+ *        session that runs for hours keeps only the most recent ones
+ */
+const size_t INTERACTION_HISTORY = 10000;
+
+/**
+ * @brief Pipeline stages an interaction passes through, an interaction may skip any of them
+ */
+enum InteractionStage {
+    STAGE_INPUT = 0,   ///< The input was received
+    STAGE_SEEDED,      ///< Seeds were generated
+    STAGE_TRACED,      ///< Streamlines were traced
+    STAGE_PACKED,      ///< Vertices were packed for the renderer
+    STAGE_UPLOADED,    ///< Vertices were handed to the GL
+    STAGE_DISPLAYED,   ///< The frame showing the result finished on the GPU
+    NUM_INTERACTION_STAGES
+};
+
+/**
+ * @brief Get the human readable name of a stage
+ */
+const char* getInteractionStageName(InteractionStage stage);
+
+/**
+ * @struct Interaction
+ * @brief One tagged input and the times it passed the stages
+ */
+struct Interaction {
+    uint64_t id = 0;
+    std::string name;                                                   ///< Name of the input, e.g. "stepSize" or "mouseSeed"
+    std::chrono::steady_clock::time_point times[NUM_INTERACTION_STAGES]; ///< When each stage finished
+    bool reached[NUM_INTERACTION_STAGES] = {};                          ///< Whether the stage was passed
+
+    /**
+     * @brief Time spent in a stage, from the previous stage that was passed; 0 if the stage was skipped
+     */
+    double getStageMs(InteractionStage stage) const;
+
+    /**
+     * @brief Time from the input until it was displayed
+     */
+    double getTotalMs() const;
+};
+
+/**
+ * @class InteractionTracker
+ * @brief Tags inputs, follows them through the stages and collects their latencies
+ */
+class InteractionTracker {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    InteractionTracker();
+
+    /**
+     * @brief Tag an input
+     * @param name Name of the input, latencies are also collected per name
+     * @param inputTime When the input was received
+     * @return Id of the interaction
+     */
+    uint64_t begin(const std::string& name, Clock::time_point inputTime);
+
+    /**
+     * @brief Stamp every open interaction with the end of a stage, a later stamp of the same stage replaces an earlier one
+     */
+    void mark(InteractionStage stage);
+
+    /**
+     * @brief Call once the scene of a frame was drawn: the open interactions are shown by this frame
+     * @return Whether the frame shows any interactions, it then has to be finished with finishFrame()
+     */
+    bool frameDrawn();
+
+    /**
+     * @brief Get the number of drawn frames with interactions that were not finished yet
+     */
+    size_t getFramesInFlight() const { return drawn.size(); }
+
+    /**
+     * @brief Close the interactions of the oldest drawn frame that wasn't finished yet, call once it
+     *        was presented and finished on the GPU
+     * @param displayed When the frame finished
+     */
+    void finishFrame(Clock::time_point displayed);
+
+    /**
+     * @brief Input-to-display latencies of the closed interactions (the last INTERACTION_HISTORY)
+     */
+    const LatencyStats& getTotal() const { return total; }
+
+    /**
+     * @brief Latencies of one stage over the interactions that passed it
+     */
+    const LatencyStats& getStage(InteractionStage stage) const { return stages[stage]; }
+
+    /**
+     * @brief Input-to-display latencies per input name
+     */
+    const std::map<std::string, LatencyStats>& getPerName() const { return perName; }
+
+    /**
+     * @brief Write the closed interactions (the last INTERACTION_HISTORY) with their stage times (CSV), preceded by a summary
+     * @return EXIT_SUCCESS or EXIT_FAILURE
+     */
+    int dump(const char* filename) const;
+
+    /**
+     * @brief Print the summary per input name and per stage to stdout
+     */
+    void print() const;
+
+    /**
+     * @brief Forget all closed interactions
+     */
+    void clear();
+
+private:
+    std::vector<Interaction> pending;  ///< Interactions whose result was not drawn yet
+    std::deque<std::vector<Interaction>> drawn; ///< Interactions of every drawn frame waiting to finish, oldest first
+    std::deque<Interaction> finished;  ///< Closed interactions, in the order they were displayed
+    LatencyStats total;
+    LatencyStats stages[NUM_INTERACTION_STAGES];
+    std::map<std::string, LatencyStats> perName; ///< Created with INTERACTION_HISTORY samples each
+    uint64_t nextId = 1;
+};
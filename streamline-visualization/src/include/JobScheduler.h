@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LatencyStats.h"
+
+/**
+ * @file JobScheduler.h
+ * @brief Worker threads that run interactive work ahead of background work
+ *
+ * Work is submitted as a job of a quality of service class. A job runs as a sequence of chunks:
+ * its step function does one chunk per call and tells whether more chunks remain. After every
+ * chunk the worker puts the job back at the front of its queue and takes the most urgent job that
+ * may run, so a waiting interactive job takes over a worker from a background job at the next
+ * chunk boundary, while a job that isn't outranked simply continues.
+ *
+ * Every class has a limit on the jobs it runs at once and on the OpenMP threads a chunk of it
+ * may use, so background work can't occupy all workers or all cores.
+ */
+
+/**
+ * @brief Quality of service class of a job, in order of priority
+ */
+enum JobClass {
+    JOB_INTERACTIVE = 0, ///< The user waits for the result, but not with the UI blocked on it
+    JOB_NORMAL,          ///< Requested by the user but not waited for, e.g. saving a session
+    JOB_BACKGROUND,      ///< Speculative work, e.g. preparing data the user may need next
+    NUM_JOB_CLASSES
+};
+
+/**
+ * @brief Get the human readable name of a class
+ */
+const char* getJobClassName(JobClass jobClass);
+
+/**
+ * @class ScheduledJob
+ * @brief State of a submitted job, shared between the scheduler and the submitter
+ */
+class ScheduledJob {
+public:
+    /**
+     * @brief Whether the job ran its last chunk or was cancelled
+     */
+    bool isDone() const { return done; }
+
+    /**
+     * @brief Whether the job was cancelled before it ran its last chunk
+     */
+    bool wasCancelled() const { return cancelled; }
+
+    JobClass getClass() const { return jobClass; }
+    const std::string& getName() const { return name; }
+
+private:
+    friend class JobScheduler;
+
+    JobClass jobClass = JOB_NORMAL;
+    std::string name;
+    std::function<bool()> step;
+    std::chrono::steady_clock::time_point submitTime;
+    bool started = false;
+    std::atomic<bool> cancelled{ false };
+    std::atomic<bool> done{ false };
+};
+
+typedef std::shared_ptr<ScheduledJob> JobHandle;
+
+/**
+ * @struct JobClassStats
+ * @brief What the scheduler did with the jobs of one class
+ */
+struct JobClassStats {
+    LatencyStats queueWait = LatencyStats(10000); ///< Milliseconds from submitting a job until its first chunk started, the most recent jobs
+    size_t completed = 0;    ///< Jobs that ran their last chunk
+    size_t cancelled = 0;    ///< Jobs cancelled before their last chunk
+    size_t preempted = 0;    ///< Times a job of the class gave its worker to a more urgent job
+    size_t queued = 0;       ///< Jobs waiting right now
+    size_t running = 0;      ///< Jobs running a chunk right now
+};
+
+/**
+ * @class JobScheduler
+ * @brief Fixed pool of worker threads with per class queues, limits and statistics
+ */
+class JobScheduler {
+public:
+    /**
+     * @brief Start the workers
+     * @param numWorkers Number of worker threads, at least 1
+     */
+    explicit JobScheduler(int numWorkers = 3);
+
+    /**
+     * @brief Destructor - cancels the queued jobs, lets the running chunks finish and stops the workers
+     */
+    ~JobScheduler();
+
+    /**
+     * @brief Queue a job
+     * @param jobClass Class the job is scheduled in
+     * @param name Name of the job, for the log
+     * @param step Runs one chunk and returns whether more chunks remain; called from a worker thread,
+     *             never concurrently for the same job
+     * @return Handle to wait for or cancel the job
+     */
+    JobHandle submit(JobClass jobClass, const char* name, std::function<bool()> step);
+
+    /**
+     * @brief Block until a job is done
+     */
+    void wait(const JobHandle& job);
+
+    /**
+     * @brief Cancel a job: a queued job is dropped, a running one stops at its next chunk boundary
+     */
+    void cancel(const JobHandle& job);
+
+    /**
+     * @brief Limit the jobs of a class that run at the same time
+     * @param maxRunning Limit, at least 1
+     */
+    void setConcurrencyLimit(JobClass jobClass, int maxRunning);
+
+    /**
+     * @brief Limit the OpenMP threads a chunk of a class uses
+     * @param threads Thread count, 0 for the OpenMP default
+     */
+    void setChunkThreads(JobClass jobClass, int threads);
+
+    int getWorkerCount() const { return (int)workers.size(); }
+
+    /**
+     * @brief Take the statistics a class collected since the last call, with the current queue and running counts
+     *
+     * The samples are moved out, not copied, so the workers are never held up by a reader.
+     */
+    JobClassStats takeStats(JobClass jobClass);
+
+    /**
+     * @brief Reset the statistics of all classes, the current queue and running counts are kept
+     */
+    void clearStats();
+
+    /**
+     * @brief Take the statistics of every class and print the queue wait times and counts to stdout
+     */
+    void printStats();
+
+private:
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    /**
+     * Take the most urgent job whose class is below its concurrency limit, nullptr if there is none.
+     * Called with the mutex held.
+     */
+    JobHandle takeNextJob();
+
+    /**
+     * Close a job and wake everyone waiting for it. Called with the mutex held.
+     */
+    void finishJob(const JobHandle& job, bool wasCancelled);
+
+    void workerLoop();
+
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable; ///< A job was queued or a class dropped below its limit
+    std::condition_variable jobDone;
+    std::deque<JobHandle> queues[NUM_JOB_CLASSES];
+    int running[NUM_JOB_CLASSES] = {};
+    int maxRunning[NUM_JOB_CLASSES];
+    int chunkThreads[NUM_JOB_CLASSES];
+    JobClassStats stats[NUM_JOB_CLASSES];
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+/**
+ * @brief Get the scheduler shared by the whole application, started on first use
+ */
+JobScheduler& getJobScheduler();
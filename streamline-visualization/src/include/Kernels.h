@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @file Kernels.h
+ * @brief Registry of the hot numerical kernels with runtime CPU feature dispatch
+ *
+ * Every kernel is compiled several times from the same source (core/KernelImpl.inl),
+ * once per instruction set, and the best variant supported by the CPU the program runs
+ * on is selected at startup. The scalar variant is always available.
+ *
+ * The selection can be forced with the VCP_KERNELS environment variable
+ * (e.g. VCP_KERNELS=scalar), which is useful for comparing results between machines.
+ */
+
+/**
+ * @struct CpuFeatures
+ * @brief Instruction set extensions supported by the CPU and the operating system
+ */
+struct CpuFeatures {
+    bool avx2 = false;    ///< x86 AVX2
+    bool fma = false;     ///< x86 FMA3
+    bool avx512f = false;  ///< x86 AVX-512 foundation
+    bool avx512vl = false; ///< x86 AVX-512 vector length extensions (AVX-512 instructions on XMM and YMM registers)
+    bool avx512bw = false; ///< x86 AVX-512 byte and word instructions
+    bool avx512dq = false; ///< x86 AVX-512 doubleword and quadword instructions
+    bool neon = false;    ///< ARM NEON (always present on ARM64)
+};
+
+/**
+ * @brief Detect the features of the CPU the program runs on (cached after the first call)
+ */
+const CpuFeatures& getCpuFeatures();
+
+/**
+ * @struct KernelSet
+ * @brief One implementation of every kernel, compiled for a specific instruction set
+ */
+struct KernelSet {
+    const char* name; ///< Name of the instruction set the kernels are compiled for
+
+    /**
+     * @brief Check if the current CPU can run this kernel set
+     */
+    bool (*isSupported)(const CpuFeatures& features);
+
+    /**
+     * @brief Trilinearly interpolate a vector field (3 components per voxel, index 3 * (z + dimZ * (y + dimY * x)))
+     * @param out Output vector (3 floats)
+     */
+    void (*interpolateTrilinear)(const float* data, int dimX, int dimY, int dimZ, float x, float y, float z, float* out);
+
+    /**
+     * @brief Compute the major eigenvector and fractional anisotropy of symmetric tensors
+     * @param tensors Input tensors (6 components per voxel: t11, t22, t33, t12, t13, t23)
+     * @param count Number of tensors
+     * @param vectors Output major eigenvectors (3 components per voxel), zero for zero tensors
+     * @param fa Output fractional anisotropy per voxel, may be nullptr
+     */
+    void (*decomposeTensors)(const float* tensors, size_t count, float* vectors, float* fa);
+
+    /**
+     * @brief Reorder NIfTI component-planar, x-fastest data to the interleaved, z-fastest layout used by the fields
+     * @param planar Input data, index ((v * dimZ + z) * dimY + y) * dimX + x
+     * @param interleaved Output data, index numComponents * (z + dimZ * (y + dimY * x)) + v
+     */
+    void (*transposeComponents)(const float* planar, float* interleaved, int dimX, int dimY, int dimZ, int numComponents);
+
+    /**
+     * @brief Pack the points of one streamline into the [x,y,z,r,g,b] vertex format with direction colors
+     * @param points Input points (3 floats per point)
+     * @param count Number of points
+     * @param vertices Output vertices (6 floats per point)
+     */
+    void (*packVertices)(const float* points, size_t count, float* vertices);
+
+    /**
+     * @brief Interleave scalar values and the zero mask into the two channel background texture
+     * @param texels Output texels (2 floats per voxel: intensity, alpha)
+     */
+    void (*packScalarMaskTexture)(const float* scalars, const bool* mask, float* texels, size_t count);
+
+    /**
+     * @brief Clear the mask entries whose value lies outside [minValue, maxValue]
+     * @param values Input column (one float per entry)
+     * @param mask Visibility mask (0 or 1 per entry), entries are only ever cleared
+     */
+    void (*filterRange)(const float* values, size_t count, float minValue, float maxValue, unsigned char* mask);
+
+    /**
+     * @brief Quantize vectors to octahedral 2x16 bit directions and a 16 bit magnitude (see OctahedralEncoding.h)
+     * @param vectors Input vectors (3 floats per voxel)
+     * @param maxMagnitude Magnitude that maps to the largest quantized value
+     * @param directions Output directions (2 per voxel)
+     * @param magnitudes Output magnitudes (1 per voxel), only zero for zero vectors
+     */
+    void (*encodeOctahedral16)(const float* vectors, size_t count, float maxMagnitude, short* directions, unsigned short* magnitudes);
+
+    /**
+     * @brief Quantize vectors to octahedral 2x8 bit directions and an 8 bit magnitude, see encodeOctahedral16
+     */
+    void (*encodeOctahedral8)(const float* vectors, size_t count, float maxMagnitude, signed char* directions, unsigned char* magnitudes);
+
+    /**
+     * @brief Trilinearly interpolate a vector field stored by encodeOctahedral16, decoding the 8 corners
+     * @param out Output vector (3 floats)
+     */
+    void (*interpolateTrilinearOctahedral16)(const short* directions, const unsigned short* magnitudes, float maxMagnitude,
+        int dimX, int dimY, int dimZ, float x, float y, float z, float* out);
+
+    /**
+     * @brief Trilinearly interpolate a vector field stored by encodeOctahedral8, decoding the 8 corners
+     * @param out Output vector (3 floats)
+     */
+    void (*interpolateTrilinearOctahedral8)(const signed char* directions, const unsigned char* magnitudes, float maxMagnitude,
+        int dimX, int dimY, int dimZ, float x, float y, float z, float* out);
+
+    /**
+     * @brief Convert samples to cubic B-spline coefficients along one axis, in place (mirror boundaries)
+     *
+     * Filters width independent signals at once: sample k of signal w is data[k * stride + w].
+     * Prefiltering all three axes of a volume gives coefficients that interpolateCubicBSpline
+     * evaluates to the original samples at the voxel centers.
+     *
+     * @param count Number of samples per signal
+     * @param stride Distance between two samples of a signal in floats
+     * @param width Number of contiguous signals
+     */
+    void (*prefilterBSpline)(float* data, int count, size_t stride, int width);
+
+    /**
+     * @brief Evaluate a cubic B-spline vector field (3 coefficients per voxel, index 3 * (z + dimZ * (y + dimY * x))) with 64 taps
+     * @param out Output vector (3 floats)
+     */
+    void (*interpolateCubicBSpline)(const float* coefficients, int dimX, int dimY, int dimZ, float x, float y, float z, float* out);
+};
+
+/**
+ * @brief Get the kernel set selected for this machine
+ */
+const KernelSet& getKernels();
+
+/**
+ * @brief Get all kernel sets that are compiled in and supported by this machine
+ */
+std::vector<const KernelSet*> getAvailableKernelSets();
+
+/**
+ * @brief Time every kernel of every available kernel set on synthetic data and print the results
+ */
+void runKernelBenchmarks();
+
+// Kernel sets, implemented in the instruction set specific translation units
+const KernelSet& getScalarKernels();
+#if defined(VCP_HAVE_AVX2_KERNELS)
+const KernelSet& getAVX2Kernels();
+#endif
+#if defined(VCP_HAVE_AVX512_KERNELS)
+const KernelSet& getAVX512Kernels();
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @file LatencyStats.h
+ * @brief Collection of latency samples with percentile reporting
+ */
+
+/**
+ * @class LatencyStats
+ * @brief Stores latency samples (in milliseconds) and reports percentiles over them
+ *
+ * Statistics that are collected for as long as the program runs keep only the most recent
+ * samples, so they don't grow without bound. The samples are sorted once after they changed,
+ * so reading several percentiles, e.g. every frame, doesn't sort them again. Because of that even
+ * reading is not thread safe, so collections shared between threads are read under their lock or
+ * taken out of it first.
+ */
+class LatencyStats {
+public:
+    /**
+     * @brief Constructor
+     * @param maxSamples Number of most recent samples to keep, 0 to keep all
+     */
+    explicit LatencyStats(size_t maxSamples = 0) : maxSamples(maxSamples) {}
+
+    /**
+     * @brief Add a sample, replacing the oldest one if maxSamples are kept already
+     * @param ms Latency in milliseconds
+     */
+    void add(double ms);
+
+    /**
+     * @brief Add all samples of another collection, oldest first
+     */
+    void add(const LatencyStats& other);
+
+    /**
+     * @brief Remove all samples
+     */
+    void clear();
+
+    /**
+     * @brief Get the number of samples kept
+     */
+    size_t count() const { return samples.size(); }
+
+    /**
+     * @brief Get the number of samples added since the last clear(), including the ones that were replaced
+     */
+    size_t getTotalCount() const { return totalCount; }
+
+    /**
+     * @brief Get a percentile of the samples (nearest rank)
+     * @param p Percentile in [0, 100]
+     * @return The percentile in milliseconds, 0 without samples
+     */
+    double percentile(double p) const;
+
+    /**
+     * @brief Get the mean of the samples in milliseconds, 0 without samples
+     */
+    double mean() const;
+
+    /**
+     * @brief Get the largest sample in milliseconds, 0 without samples
+     */
+    double maximum() const;
+
+    /**
+     * @brief Print the sample count, p50, p95, p99 and max to stdout
+     * @param label Label printed in front of the values
+     */
+    void print(const char* label) const;
+
+private:
+    std::vector<double> samples;         ///< Samples in the order they were added, a ring once maxSamples are kept
+    size_t maxSamples;
+    size_t oldest = 0;                   ///< Index of the oldest sample once the ring is full
+    size_t totalCount = 0;
+    mutable std::vector<double> sorted;  ///< Sorted copy of the samples for percentile()
+    mutable bool sortedValid = false;
+};
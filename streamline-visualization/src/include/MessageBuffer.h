@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @file MessageBuffer.h
+ * @brief Plain values in byte buffers, for the messages between processes
+ *
+ * Values are copied as they are in memory, so both ends have to run on machines with the same
+ * byte order and type sizes; the fixed size types of <cstdint> keep the sizes the same.
+ */
+
+/**
+ * @class MessageWriter
+ * @brief Appends plain values to a message
+ */
+class MessageWriter {
+public:
+    explicit MessageWriter(std::vector<char>& out) : out(out) {}
+
+    template <typename T>
+    void put(const T& value) { putArray(&value, 1); }
+
+    template <typename T>
+    void putArray(const T* values, size_t count)
+    {
+        const char* bytes = reinterpret_cast<const char*>(values);
+        out.insert(out.end(), bytes, bytes + count * sizeof(T));
+    }
+
+private:
+    std::vector<char>& out;
+};
+
+/**
+ * @class MessageReader
+ * @brief Reads plain values from a message, throwing std::runtime_error if it is shorter than expected
+ */
+class MessageReader {
+public:
+    explicit MessageReader(const std::vector<char>& in) : in(in) {}
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        getArray(&value, 1);
+        return value;
+    }
+
+    template <typename T>
+    void getArray(T* values, size_t count)
+    {
+        if (count > (in.size() - offset) / sizeof(T)) throw std::runtime_error("Truncated message");
+        if (count > 0) memcpy(values, in.data() + offset, count * sizeof(T));
+        offset += count * sizeof(T);
+    }
+
+    /**
+     * @brief Bytes that were not read yet
+     */
+    size_t getRemaining() const { return in.size() - offset; }
+
+private:
+    const std::vector<char>& in;
+    size_t offset = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <math.h>
+
+/**
+ * @file OctahedralEncoding.h
+ * @brief Octahedral mapping of unit vectors to two coordinates in [-1, 1]
+ *
+ * The unit sphere is projected onto the octahedron |x| + |y| + |z| = 1 and the lower half is
+ * folded over the diagonals, which maps every direction to a point of the square [-1, 1]^2.
+ * The two coordinates quantize well to 8 or 16 bit signed normalized integers.
+ *
+ * The helpers are static so that every translation unit, including the instruction set
+ * specific kernel units, gets its own copy compiled with its own flags.
+ */
+
+static inline float octSign(float a) { return a < 0.0f ? -1.0f : 1.0f; }
+static inline float octAbs(float a) { return a < 0.0f ? -a : a; }
+
+/**
+ * @brief Map a (not necessarily unit) vector to octahedral coordinates, (0, 0) for the zero vector
+ */
+static inline void octEncode(float x, float y, float z, float& u, float& v)
+{
+    float l1 = octAbs(x) + octAbs(y) + octAbs(z);
+    if (l1 == 0.0f)
+    {
+        u = v = 0.0f;
+        return;
+    }
+
+    u = x / l1;
+    v = y / l1;
+    if (z < 0.0f)
+    {
+        //fold the lower half of the octahedron over the diagonals
+        float fu = (1.0f - octAbs(v)) * octSign(u);
+        float fv = (1.0f - octAbs(u)) * octSign(v);
+        u = fu;
+        v = fv;
+    }
+}
+
+/**
+ * @brief Map octahedral coordinates back to a unit vector
+ * @param out Output vector (3 floats)
+ */
+static inline void octDecode(float u, float v, float* out)
+{
+    float x = u;
+    float y = v;
+    float z = 1.0f - octAbs(u) - octAbs(v);
+    if (z < 0.0f)
+    {
+        x = (1.0f - octAbs(v)) * octSign(u);
+        y = (1.0f - octAbs(u)) * octSign(v);
+    }
+
+    float inverseLength = 1.0f / sqrtf(x * x + y * y + z * z);
+    out[0] = x * inverseLength;
+    out[1] = y * inverseLength;
+    out[2] = z * inverseLength;
+}
+
+/**
+ * @brief Round a value in [-1, 1] to a signed normalized integer with the given maximum (127 or 32767)
+ */
+static inline int octQuantize(float a, int maxValue)
+{
+    float scaled = a * maxValue;
+    return (int)(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @file PerfCounters.h
+ * @brief Hardware performance counters for measuring cache behaviour of the tracer
+ *
+ * On Linux the counters are read through perf_event_open. On other platforms, or when
+ * the kernel does not allow access (see /proc/sys/kernel/perf_event_paranoid), the
+ * counters report themselves as unavailable and all values stay zero.
+ */
+
+/**
+ * @struct PerfCounterValues
+ * @brief Accumulated counter values of one measurement
+ */
+struct PerfCounterValues {
+    uint64_t cycles = 0;           ///< CPU cycles
+    uint64_t instructions = 0;     ///< Retired instructions
+    uint64_t l1dReadMisses = 0;    ///< L1 data cache read misses
+    uint64_t cacheReferences = 0;  ///< Last level cache references
+    uint64_t cacheMisses = 0;      ///< Last level cache misses
+    bool valid = false;            ///< Whether the counters could be read
+
+    /**
+     * @brief Add the values of another measurement (e.g. of another thread)
+     */
+    void add(const PerfCounterValues& other);
+
+    /**
+     * @brief Print the values and derived miss rates to stdout
+     * @param label Label printed in front of the values
+     */
+    void print(const char* label) const;
+};
+
+/**
+ * @class PerfCounters
+ * @brief Counts hardware events of the calling thread between start() and stop()
+ *
+ * The counters only count the thread that created them, so for a parallel region
+ * every worker thread should create its own instance and the results should be
+ * combined with PerfCounterValues::add().
+ */
+class PerfCounters {
+public:
+    PerfCounters();
+
+    /**
+     * @brief Destructor - closes the counter file descriptors
+     */
+    ~PerfCounters();
+
+    /**
+     * @brief Reset and start counting
+     */
+    void start();
+
+    /**
+     * @brief Stop counting and read the values
+     * @return The counted values, valid is false if the counters are unavailable
+     */
+    PerfCounterValues stop();
+
+private:
+    static const int NUM_COUNTERS = 5;
+    int fds[NUM_COUNTERS]; ///< Counter file descriptors, -1 if unavailable
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * @struct Point3D
+ * @brief Simple 3D point structure for streamline representation
+ */
+struct Point3D {
+    float x, y, z;
+
+    Point3D() : x(0), y(0), z(0) {}
+    Point3D(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class RenderTarget
+ * @brief Offscreen framebuffer with one or more floating point color textures
+ *
+ * Used by the rendering modes that accumulate into intermediate buffers and then resolve
+ * them onto the screen in a fullscreen pass. The textures are (re)allocated lazily when the
+ * requested size changes, so the target can be resized every frame at no cost.
+ */
+class RenderTarget {
+public:
+    /**
+     * @brief Constructor, no GL objects are created until the first resize()
+     * @param colorFormats Internal format of every color attachment (e.g. GL_RGBA16F), attached in order
+     * @param depth Whether to attach a depth buffer (24 bit depth, 8 bit stencil, like the default framebuffer)
+     */
+    RenderTarget(const std::vector<unsigned int>& colorFormats, bool depth);
+
+    /**
+     * @brief Destructor - deletes the framebuffer and its attachments
+     */
+    ~RenderTarget();
+
+    /**
+     * @brief Make sure the attachments have the given size, reallocating them if it changed
+     * @return False if the framebuffer is incomplete
+     */
+    bool resize(int width, int height);
+
+    /**
+     * @brief Bind the framebuffer for drawing into all color attachments and set the viewport to its size
+     */
+    void bind() const;
+
+    /**
+     * @brief Copy the depth buffer of another framebuffer (0 for the default one) of the same size into this target
+     */
+    void copyDepthFrom(unsigned int framebuffer) const;
+
+    /**
+     * @brief Bind every color texture to consecutive texture units, starting at firstUnit
+     */
+    void bindTextures(int firstUnit) const;
+
+    unsigned int getFramebuffer() const { return framebuffer; }
+    unsigned int getTexture(size_t attachment) const { return textures[attachment]; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    /**
+     * @brief GPU memory of the attachments in bytes
+     */
+    size_t getMemoryBytes() const;
+
+private:
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    /**
+     * Delete the GL objects.
+     */
+    void release();
+
+    std::vector<unsigned int> colorFormats; ///< Internal format of every color attachment
+    bool hasDepth;
+    unsigned int framebuffer = 0;
+    std::vector<unsigned int> textures;     ///< One texture per color attachment
+    unsigned int depthBuffer = 0;           ///< Depth/stencil renderbuffer, 0 without depth
+    int width = 0;
+    int height = 0;
+};
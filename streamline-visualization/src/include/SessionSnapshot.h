@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "StreamlineTracer.h"
+#include "StreamlineFilter.h"
+
+/**
+ * @file SessionSnapshot.h
+ * @brief Binary snapshots of a session for instant startup and restore
+ *
+ * A snapshot holds everything that is expensive to recompute: the scalar volume, the vector
+ * field with its fractional anisotropy and zero mask, the background texture, and the traced
+ * streamlines in the vertex format of the renderer together with their attributes. Next to
+ * that it stores the tracer, seeding, filter and camera settings.
+ *
+ * The file is a fixed header followed by page aligned sections, so restoring only maps the
+ * file and hands pointers into the mapping to the vector field, the texture upload and the
+ * vertex buffer upload. A snapshot is a copy of the derived data, it is not checked against
+ * the NIfTI files it was made from.
+ */
+
+/**
+ * @struct SessionState
+ * @brief Settings of a session, stored in the snapshot header
+ *
+ * Strings (integration method, seed ordering, dataset) are stored as indices, see the
+ * SESSION_* constants. The struct is copied into the file as is.
+ */
+struct SessionState {
+    // Dataset
+    int32_t dataset = 0;          ///< SESSION_DATASET_BRAIN or SESSION_DATASET_TOY
+    int32_t useTensors = 0;       ///< Vector field was computed from the tensor field
+    int32_t dimX = 0, dimY = 0, dimZ = 0;
+
+    // Tracer
+    float stepSize = 0.5f;
+    float maxLength = 500.0f;
+    int32_t maxSteps = 1;
+    float maxAngleDegrees = 45.0f;
+    int32_t integrationMethod = 0; ///< SESSION_INTEGRATION_EULER or SESSION_INTEGRATION_RK2
+    int32_t seedOrdering = 0;      ///< SESSION_SEED_ORDER_NONE, _MORTON or _HILBERT
+    int32_t flipX = 0, flipY = 0, flipZ = 0;
+
+    // Seeding
+    int32_t useMouseSeeding = 0;
+    int32_t useVolumeSeeding = 0;
+    float mouseSeedLoc[3] = { 0.0f, 0.0f, 0.0f };
+    float mouseSeedRadius = 3.0f;
+    int32_t mouseSeedDensity = 1;
+    int32_t seedsPerVoxel = 1;
+    int32_t jitter = 1;
+    int32_t maxSeeds = 0;
+
+    // View
+    int32_t selectedAxis = 2;
+    int32_t currentSliceX = 0, currentSliceY = 0, currentSliceZ = 0;
+    float xFov = 0.0f, yFov = 0.0f;
+    float cameraPos[3] = { 0.0f, 0.0f, 0.0f };
+    float cameraFront[3] = { 0.0f, 0.0f, -1.0f };
+    float cameraUp[3] = { 0.0f, 1.0f, 0.0f };
+    float lineWidth = 1.0f;
+
+    StreamlineFilter filter; ///< Filter applied to the streamlines
+};
+
+const int32_t SESSION_DATASET_BRAIN = 0;
+const int32_t SESSION_DATASET_TOY = 1;
+const int32_t SESSION_INTEGRATION_EULER = 0;
+const int32_t SESSION_INTEGRATION_RK2 = 1;
+const int32_t SESSION_SEED_ORDER_NONE = 0;
+const int32_t SESSION_SEED_ORDER_MORTON = 1;
+const int32_t SESSION_SEED_ORDER_HILBERT = 2;
+
+/**
+ * @struct SessionVolumes
+ * @brief The volumes of the loaded dataset, referenced (not copied) while a snapshot is written
+ */
+struct SessionVolumes {
+    const float* scalars = nullptr;  ///< Scalar volume, dimX * dimY * dimZ floats
+    const float* vectors = nullptr;  ///< Vector field, 3 floats per voxel
+    const float* fa = nullptr;       ///< Fractional anisotropy per voxel, may be nullptr
+    const bool* zeroMask = nullptr;  ///< Nonzero vector mask per voxel
+    std::shared_ptr<const void> owner; ///< Keeps the volumes alive until the save finished, may be nullptr
+};
+
+/**
+ * @struct SessionGeometry
+ * @brief The traced streamlines in renderer format, owned by the snapshot writer
+ */
+struct SessionGeometry {
+    std::vector<float> vertices;       ///< [x,y,z,r,g,b] per vertex
+    std::vector<int> streamlineFirsts; ///< First vertex of every streamline
+    std::vector<int> streamlineCounts; ///< Vertex count of every streamline
+    StreamlineAttributes attributes;   ///< Attributes of every streamline
+};
+
+/**
+ * @class SessionSnapshot
+ * @brief A snapshot file mapped into memory
+ *
+ * The pointers returned by the getters point into the mapping and stay valid until the
+ * snapshot is deleted. The mapping is private, so writes never reach the file.
+ */
+class SessionSnapshot {
+public:
+    /**
+     * @brief Map a snapshot file and validate its header
+     * @param filename Path of the snapshot
+     * @return The mapped snapshot, or nullptr if the file is missing or not a valid snapshot
+     */
+    static SessionSnapshot* open(const char* filename);
+
+    /**
+     * @brief Destructor - unmaps the file
+     */
+    ~SessionSnapshot();
+
+    const SessionState& getState() const { return state; }
+    float* getScalars() const;
+    float* getVectors() const;
+    float* getFA() const; ///< nullptr if the snapshot has no FA volume
+    bool* getZeroMask() const;
+    const float* getTexels() const; ///< Background texture, 2 floats per voxel
+    const float* getVertices() const;
+    size_t getVertexCount() const;
+    const int* getStreamlineFirsts() const;
+    const int* getStreamlineCounts() const;
+    size_t getStreamlineCount() const;
+
+    /**
+     * @brief Copy the streamline attribute columns out of the snapshot
+     */
+    void copyAttributes(StreamlineAttributes& attributes) const;
+
+private:
+    SessionSnapshot() = default;
+    SessionSnapshot(const SessionSnapshot&) = delete;
+    SessionSnapshot& operator=(const SessionSnapshot&) = delete;
+
+    unsigned char* section(int index) const;
+    size_t sectionBytes(int index) const;
+
+    SessionState state;
+    unsigned char* mapping = nullptr; ///< Start of the mapped file
+    size_t mappingBytes = 0;
+#if defined(_WIN32)
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+/**
+ * @brief Write a snapshot synchronously
+ * @param filename Path of the snapshot, written to a temporary file first and renamed when complete
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int writeSessionSnapshot(const char* filename, const SessionState& state, const SessionVolumes& volumes, const SessionGeometry& geometry);
+
+/**
+ * @brief Write a snapshot as a job of the normal class on the shared job scheduler
+ *
+ * The volumes are only referenced: either volumes.owner keeps them alive, or they must not
+ * be freed before waitForSessionSnapshotSave() returned. A save that is still running is
+ * waited for first.
+ */
+void saveSessionSnapshotAsync(const char* filename, const SessionState& state, const SessionVolumes& volumes, SessionGeometry geometry);
+
+/**
+ * @brief Block until a background save started with saveSessionSnapshotAsync() finished
+ */
+void waitForSessionSnapshotSave();
+
+/**
+ * @brief Check if a background save is running
+ */
+bool isSessionSnapshotSaving();
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "Point3D.h"
+
+/**
+ * @file SliceSeedIndex.h
+ * @brief Precomputed seed positions of every slice of a dataset
+ */
+
+/**
+ * @struct SeedSpan
+ * @brief Read-only view of consecutive seeds, e.g. one slice of a SliceSeedIndex
+ */
+struct SeedSpan {
+    const Point3D* data = nullptr;
+    size_t size = 0;
+
+    SeedSpan() = default;
+    SeedSpan(const Point3D* data, size_t size) : data(data), size(size) {}
+    SeedSpan(const std::vector<Point3D>& seeds) : data(seeds.data()), size(seeds.size()) {}
+
+    bool empty() const { return size == 0; }
+    const Point3D& operator[](size_t i) const { return data[i]; }
+    const Point3D* begin() const { return data; }
+    const Point3D* end() const { return data + size; }
+};
+
+/**
+ * @class SliceSeedIndex
+ * @brief Masked voxels of every slice along every axis, in compressed sparse row form
+ *
+ * For each axis the voxels of the zero mask are grouped by slice: slice s owns the points
+ * between offsets[s] and offsets[s + 1]. Slice grid seeding is then a lookup of that range
+ * instead of a scan over the slice, and the counts give seed estimates for free. Within a
+ * slice the voxels are in the order the slice grid seeding always produced (the lower of the
+ * two remaining axes outermost), so the seeds are the same as from a scan.
+ *
+ * Each axis stores one point per masked voxel, so the index takes 36 bytes per masked voxel.
+ */
+class SliceSeedIndex {
+public:
+    /**
+     * @brief Build the index for all three axes in parallel
+     * @param mask Mask of nonzero vectors, index x + y * dimX + z * dimX * dimY
+     */
+    SliceSeedIndex(const bool* mask, int dimX, int dimY, int dimZ);
+
+    /**
+     * @brief Get the masked voxels of one slice
+     * @param axis AXIS_X, AXIS_Y or AXIS_Z
+     * @param slice Slice index along the axis
+     * @return The voxels as seed points, empty for an invalid axis or slice
+     */
+    SeedSpan getSlice(int axis, int slice) const;
+
+    /**
+     * @brief Number of masked voxels in one slice, 0 for an invalid axis or slice
+     */
+    size_t getSliceCount(int axis, int slice) const { return getSlice(axis, slice).size; }
+
+    /**
+     * @brief Whether all slices in [first, last] along an axis are empty
+     */
+    bool isRangeEmpty(int axis, int first, int last) const;
+
+    /**
+     * @brief Number of masked voxels in the whole volume
+     */
+    size_t getVoxelCount() const { return points[0].size(); }
+
+    /**
+     * @brief Memory of the index in bytes
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * @brief Milliseconds it took to build the index
+     */
+    double getBuildMs() const { return buildMs; }
+
+private:
+    /**
+     * Build the slices along one axis: count per slice, prefix sum, then fill every slice on its own.
+     */
+    void buildAxis(int axis, const bool* mask);
+
+    int dims[3];
+    std::vector<size_t> offsets[3];  ///< Per axis, slice count + 1 entries
+    std::vector<Point3D> points[3];  ///< Per axis, the masked voxels grouped by slice
+    double buildMs = 0.0;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @file SpaceFillingCurve.h
+ * @brief Space-filling curve keys for ordering voxels and seed points
+ *
+ * Points that are close along a space-filling curve are also close in space,
+ * so processing them in curve order keeps neighbouring work on the same
+ * cache lines of the volume data.
+ */
+
+/**
+ * @brief Spread the lower 21 bits of a value so there are two zero bits between each bit
+ * @param v Value to spread
+ * @return The spread value
+ */
+inline uint64_t spreadBits3D(uint32_t v)
+{
+    uint64_t x = v & 0x1FFFFF;
+    x = (x | (x << 32)) & 0x1F00000000FFFFull;
+    x = (x | (x << 16)) & 0x1F0000FF0000FFull;
+    x = (x | (x << 8))  & 0x100F00F00F00F00Full;
+    x = (x | (x << 4))  & 0x10C30C30C30C30C3ull;
+    x = (x | (x << 2))  & 0x1249249249249249ull;
+    return x;
+}
+
+/**
+ * @brief Compute the 3D Morton (Z-order) code of integer coordinates
+ * @param x X coordinate (lower 21 bits are used)
+ * @param y Y coordinate (lower 21 bits are used)
+ * @param z Z coordinate (lower 21 bits are used)
+ * @return 63-bit Morton code with x in the lowest bit of each triple
+ */
+inline uint64_t mortonEncode3D(uint32_t x, uint32_t y, uint32_t z)
+{
+    return spreadBits3D(x) | (spreadBits3D(y) << 1) | (spreadBits3D(z) << 2);
+}
+
+/**
+ * @brief Compute the 3D Hilbert curve index of integer coordinates
+ *
+ * Uses Skilling's transpose algorithm ("Programming the Hilbert curve", 2004).
+ * Unlike the Morton curve, consecutive Hilbert indices are always face neighbours,
+ * which gives slightly more compact ranges of the curve.
+ *
+ * @param x X coordinate
+ * @param y Y coordinate
+ * @param z Z coordinate
+ * @param bits Number of bits per coordinate (at most 21)
+ * @return Hilbert index of the point
+ */
+inline uint64_t hilbertEncode3D(uint32_t x, uint32_t y, uint32_t z, int bits)
+{
+    uint32_t X[3] = { x, y, z };
+    uint32_t M = 1u << (bits - 1);
+
+    //inverse undo
+    for (uint32_t Q = M; Q > 1; Q >>= 1)
+    {
+        uint32_t P = Q - 1;
+        for (int i = 0; i < 3; i++)
+        {
+            if (X[i] & Q)
+            {
+                X[0] ^= P;
+            }
+            else
+            {
+                uint32_t t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+
+    //gray encode
+    X[1] ^= X[0];
+    X[2] ^= X[1];
+    uint32_t t = 0;
+    for (uint32_t Q = M; Q > 1; Q >>= 1)
+    {
+        if (X[2] & Q) t ^= Q - 1;
+    }
+    for (int i = 0; i < 3; i++) X[i] ^= t;
+
+    //interleave the transposed bits, most significant level first
+    uint64_t key = 0;
+    for (int b = bits - 1; b >= 0; b--)
+    {
+        key = (key << 3) | (((X[0] >> b) & 1u) << 2) | (((X[1] >> b) & 1u) << 1) | ((X[2] >> b) & 1u);
+    }
+    return key;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "VolumeAllocator.h"
+
+/**
+ * @class SparseBlockVolume
+ * @brief Block-sparse storage of a volume with several float components per voxel
+ *
+ * The volume is split in leaf blocks of 8x8x8 voxels, and only blocks containing a nonzero
+ * value are stored. Blocks are found through a two-level index: a dense grid of tiles (8x8x8
+ * blocks each) points to the block tables of the tiles that contain data, and every table
+ * points to the leaf blocks of its tile. Empty tiles therefore cost one index entry, empty
+ * blocks in occupied tiles one more, and lookups in empty regions stop at the first level.
+ *
+ * Voxels use the same order as the dense vector field, z fastest, both for the input and
+ * inside the leaf blocks.
+ */
+class SparseBlockVolume {
+public:
+    static const int BLOCK_BITS = 3;                     ///< Leaf blocks are 2^3 voxels wide
+    static const int BLOCK_SIZE = 1 << BLOCK_BITS;
+    static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+    static const int TILE_BITS = 3;                      ///< Tiles are 2^3 blocks wide
+    static const int TILE_SIZE = 1 << TILE_BITS;
+    static const int TILE_BLOCKS = TILE_SIZE * TILE_SIZE * TILE_SIZE;
+
+    /**
+     * @brief Build the sparse volume from dense data
+     * @param dense Dense data, index numComponents * (z + dimZ * (y + dimY * x)) + c
+     * @param numComponents Floats per voxel
+     */
+    SparseBlockVolume(const float* dense, int dimX, int dimY, int dimZ, int numComponents);
+
+    /**
+     * @brief Get the components of a voxel
+     * @return Pointer to numComponents floats, or nullptr if the voxel lies in an empty block or out of bounds
+     */
+    const float* getVoxel(int x, int y, int z) const
+    {
+        if (x < 0 || x >= dimX || y < 0 || y >= dimY || z < 0 || z >= dimZ) return nullptr;
+        int block = findBlock(x >> BLOCK_BITS, y >> BLOCK_BITS, z >> BLOCK_BITS);
+        if (block < 0) return nullptr;
+        int local = (z & (BLOCK_SIZE - 1)) + BLOCK_SIZE * ((y & (BLOCK_SIZE - 1)) + BLOCK_SIZE * (x & (BLOCK_SIZE - 1)));
+        return blocks.get() + ((size_t)block * BLOCK_VOXELS + local) * numComponents;
+    }
+
+    /**
+     * @brief Trilinearly interpolate all components, empty blocks count as zero
+     * @param out Output (numComponents floats)
+     */
+    void interpolateTrilinear(float x, float y, float z, float* out) const;
+
+    /**
+     * @brief Memory used by the index and the blocks in bytes
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * @brief Number of stored (nonempty) leaf blocks
+     */
+    size_t getBlockCount() const { return numBlocks; }
+
+    /**
+     * @brief Number of leaf blocks a dense volume of the same size would be split in
+     */
+    size_t getTotalBlockCount() const { return (size_t)blocksX * blocksY * blocksZ; }
+
+private:
+    SparseBlockVolume(const SparseBlockVolume&) = delete;
+    SparseBlockVolume& operator=(const SparseBlockVolume&) = delete;
+
+    /**
+     * Index of the leaf block at block coordinates, -1 if the block is empty.
+     */
+    int findBlock(int bx, int by, int bz) const
+    {
+        int tile = tiles[(bz >> TILE_BITS) + tilesZ * ((by >> TILE_BITS) + tilesY * (bx >> TILE_BITS))];
+        if (tile < 0) return -1;
+        int local = (bz & (TILE_SIZE - 1)) + TILE_SIZE * ((by & (TILE_SIZE - 1)) + TILE_SIZE * (bx & (TILE_SIZE - 1)));
+        return tileBlocks[(size_t)tile * TILE_BLOCKS + local];
+    }
+
+    int dimX, dimY, dimZ;
+    int numComponents;
+    int blocksX, blocksY, blocksZ; ///< Leaf blocks per axis
+    int tilesX, tilesY, tilesZ;    ///< Tiles per axis
+
+    std::vector<int> tiles;      ///< First level: table index per tile, -1 for empty tiles
+    std::vector<int> tileBlocks; ///< Second level: TILE_BLOCKS block indices per occupied tile, -1 for empty blocks
+    VolumeBuffer<float> blocks;  ///< Leaf blocks, BLOCK_VOXELS * numComponents floats each
+    size_t numBlocks = 0;        ///< Stored leaf blocks
+    std::vector<float> zeroVoxel; ///< Returned for empty voxels while interpolating
+};
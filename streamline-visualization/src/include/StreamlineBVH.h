@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "StreamlineTracer.h"
+
+/**
+ * @struct SegmentHit
+ * @brief Result of a picking or nearest-line query
+ */
+struct SegmentHit {
+    int streamline = -1;  ///< Index of the streamline the segment belongs to
+    int segment = -1;     ///< Index of the segment within the streamline (segment k joins points k and k+1)
+    float distance = 0.0f; ///< Distance between the query and the segment
+    float rayT = 0.0f;    ///< Ray parameter of the closest approach (ray queries only)
+    Point3D point;        ///< Closest point on the segment
+};
+
+/**
+ * @class StreamlineBVH
+ * @brief Bounding volume hierarchy over the segments of traced streamlines
+ *
+ * Every segment is a leaf of a linear BVH (LBVH): the segments are sorted by the Morton code
+ * of their centers and the internal nodes follow from the common prefixes of neighbouring
+ * codes (Karras, "Maximizing parallelism in the construction of BVHs, octrees and k-d trees",
+ * 2012), so every node is built independently in parallel. The boxes are then fitted bottom-up,
+ * where the second thread to arrive at a node computes its box.
+ *
+ * Appended streamlines get a tree of their own. Whenever the newest tree is at least as large
+ * as the one before, the two are merged and rebuilt, like the carries of a binary counter, so
+ * appending stays cheap and the forest never holds more than a logarithmic number of trees.
+ */
+class StreamlineBVH {
+public:
+    /**
+     * @brief Replace the hierarchy with one over the given streamlines
+     */
+    void build(const std::vector<std::vector<Point3D>>& streamlines);
+
+    /**
+     * @brief Replace the hierarchy with one over streamlines in the vertex format of the renderer
+     * @param vertices Vertices, stride floats each starting with the position
+     * @param firsts First vertex of every streamline
+     * @param counts Vertex count of every streamline
+     */
+    void build(const float* vertices, size_t stride, const int* firsts, const int* counts, size_t numStreamlines);
+
+    /**
+     * @brief Add streamlines, they get the indices following the ones already in the hierarchy
+     */
+    void append(const std::vector<std::vector<Point3D>>& streamlines);
+
+    /**
+     * @brief Add streamlines in the vertex format of the renderer, see build()
+     */
+    void append(const float* vertices, size_t stride, const int* firsts, const int* counts, size_t numStreamlines);
+
+    /**
+     * @brief Remove all streamlines
+     */
+    void clear();
+
+    /**
+     * @brief Find the segment that passes closest to the origin of a ray within a pick radius
+     *
+     * Among all segments that come within radius of the ray, the one whose closest approach lies
+     * first along the ray wins, which is the one drawn in front.
+     *
+     * @param direction Ray direction, does not need to be normalized
+     * @param radius Largest accepted distance between the ray and a segment
+     * @param visible Optional mask with one entry per streamline, streamlines with a zero entry are skipped
+     * @return True if a segment was hit
+     */
+    bool pickRay(const Point3D& origin, const Point3D& direction, float radius, SegmentHit& hit,
+        const unsigned char* visible = nullptr) const;
+
+    /**
+     * @brief Find the segment closest to a point
+     * @param maxDistance Largest accepted distance
+     * @param visible Optional visibility mask, see pickRay()
+     * @return True if a segment lies within maxDistance
+     */
+    bool nearestPoint(const Point3D& point, float maxDistance, SegmentHit& hit, const unsigned char* visible = nullptr) const;
+
+    /**
+     * @brief Collect every streamline with a segment within radius of a point
+     * @param streamlines Output streamline indices, each streamline once, in ascending order
+     * @param visible Optional visibility mask, see pickRay()
+     */
+    void findStreamlinesNear(const Point3D& point, float radius, std::vector<int>& streamlines,
+        const unsigned char* visible = nullptr) const;
+
+    /**
+     * @brief Get the points of a streamline back from its segments (empty for streamlines with less than two points)
+     */
+    void getStreamlinePoints(int streamline, std::vector<Point3D>& points) const;
+
+    /**
+     * @brief Number of streamlines added so far, including those without segments
+     */
+    size_t getStreamlineCount() const { return numStreamlines; }
+
+    /**
+     * @brief Total number of segments in all trees
+     */
+    size_t getSegmentCount() const;
+
+    /**
+     * @brief Number of trees in the forest
+     */
+    size_t getTreeCount() const { return trees.size(); }
+
+    /**
+     * @brief Memory used by the segments, nodes and lookup tables in bytes
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * @brief Duration of the last build or append in milliseconds, including merges
+     */
+    double getLastBuildMs() const { return lastBuildMs; }
+
+private:
+    /**
+     * One leaf of the hierarchy.
+     */
+    struct Segment {
+        float a[3];     ///< First point
+        float b[3];     ///< Second point
+        int streamline; ///< Index of the streamline
+        int index;      ///< Index of the segment within the streamline
+    };
+
+    /**
+     * Internal node, children with a negative index are leaves (~child is the segment).
+     */
+    struct Node {
+        float min[3];
+        float max[3];
+        int left;
+        int right;
+    };
+
+    /**
+     * One LBVH over the segments of a contiguous range of streamlines.
+     */
+    struct Tree {
+        int firstStreamline = 0;           ///< First streamline of the range
+        int numStreamlines = 0;            ///< Number of streamlines in the range
+        std::vector<Segment> segments;     ///< Segments in Morton order
+        std::vector<Node> nodes;           ///< segments.size() - 1 internal nodes, node 0 is the root
+        std::vector<int> streamlineFirst;  ///< First segment of every streamline in (streamline, index) order, numStreamlines + 1 entries
+        std::vector<int> sortedPosition;   ///< Position in segments of every segment in (streamline, index) order
+    };
+
+    /**
+     * Add a tree with unsorted segments and merge trees while the newest is at least as large as the one before.
+     */
+    void addTree(Tree&& tree);
+
+    /**
+     * Sort the segments of a tree and build its nodes and lookup tables.
+     */
+    static void buildTree(Tree& tree);
+
+    /**
+     * Bounds of a child reference of a tree, an internal node or (negative) a segment.
+     */
+    static void getBounds(const Tree& tree, int child, float* min, float* max);
+
+    std::vector<Tree> trees;
+    size_t numStreamlines = 0;
+    double lastBuildMs = 0.0;
+};
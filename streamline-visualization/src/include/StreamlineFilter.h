@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "StreamlineTracer.h"
+
+/**
+ * @file StreamlineFilter.h
+ * @brief Filtering of traced streamlines on their attributes without tracing them again
+ *
+ * The filter runs over the attribute columns computed at trace time (see StreamlineAttributes)
+ * and produces a visibility mask, which the renderer turns into its list of draw ranges.
+ */
+
+/**
+ * @struct AttributeRange
+ * @brief Inclusive range of accepted values of one attribute
+ */
+struct AttributeRange {
+    bool enabled = false; ///< Whether the range is applied at all
+    float min = 0.0f;     ///< Smallest accepted value
+    float max = 0.0f;     ///< Largest accepted value
+};
+
+/**
+ * @struct StreamlineFilter
+ * @brief Predicates a streamline has to satisfy to be drawn
+ */
+struct StreamlineFilter {
+    AttributeRange length = { false, 0.0f, 1000.0f };   ///< Arc length in voxels
+    AttributeRange stepCount = { false, 0.0f, 4000.0f }; ///< Number of segments
+    AttributeRange meanFA = { false, 0.0f, 1.0f };      ///< Mean fractional anisotropy
+    AttributeRange minFA = { false, 0.0f, 1.0f };       ///< Minimum fractional anisotropy
+    AttributeRange meanScalar = { false, 0.0f, 1.0f };  ///< Mean scalar value
+    AttributeRange curvature = { false, 0.0f, 2.0f };   ///< Mean turning angle per voxel (radians)
+
+    /// Termination reasons that are accepted, a streamline is hidden if either half stopped for a rejected reason
+    bool allowedTermination[NUM_TERMINATION_REASONS] = { true, true, true, true, true, true };
+};
+
+/**
+ * @brief Get a human readable name of a termination reason
+ */
+const char* getTerminationReasonName(TerminationReason reason);
+
+/**
+ * @brief Evaluate the filter on the attributes of every streamline
+ * @param attributes Attribute columns of the traced streamlines
+ * @param filter Predicates to apply
+ * @param visible Output mask with one entry per streamline, 1 if the streamline passes the filter
+ */
+void computeVisibleStreamlines(const StreamlineAttributes& attributes, const StreamlineFilter& filter, std::vector<unsigned char>& visible);
@@ -1,8 +1,27 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include "StreamlineTracer.h"
 #include "Shader.h"
+#include "GLObject.h"
+
+class RenderTarget;
+
+/**
+ * @brief How the streamlines are composited
+ */
+enum StreamlineRenderMode {
+    RENDER_MODE_OPAQUE,           ///< Opaque lines with depth testing, the front layer hides everything behind it
+    RENDER_MODE_WEIGHTED_BLENDED, ///< Transparent lines with weighted blended order-independent transparency
+    RENDER_MODE_DENSITY,          ///< Heat map of the number of lines covering every pixel
+    NUM_RENDER_MODES
+};
+
+/**
+ * @brief Get a human readable name of a render mode
+ */
+const char* getStreamlineRenderModeName(StreamlineRenderMode mode);
 
 /**
  * @class StreamlineRenderer
@@ -35,9 +54,128 @@ public:
     void prepareStreamlines(const std::vector<std::vector<Point3D>>& streamlines, bool isToyDataset = false);
 
     /**
-     * @brief Render the streamlines
+     * @brief Pack streamlines into the vertex format of uploadVertices(), the first half of prepareStreamlines()
+     * @param streamlines Streamlines to pack
+     * @param vertices Output vertices, 6 floats per vertex: [x,y,z,r,g,b]
+     * @param firsts Output first vertex of every streamline
+     * @param counts Output vertex count of every streamline, 0 for empty streamlines
      */
-    void render() const;
+    static void packStreamlines(const std::vector<std::vector<Point3D>>& streamlines, std::vector<float>& vertices,
+        std::vector<int>& firsts, std::vector<int>& counts);
+
+    /**
+     * @brief Upload streamlines that are already in the vertex format, e.g. from a session snapshot
+     * @param vertices Vertices, 6 floats per vertex: [x,y,z,r,g,b]
+     * @param numVertices Number of vertices
+     * @param firsts First vertex of every streamline
+     * @param counts Vertex count of every streamline
+     * @param numStreamlines Number of streamlines
+     */
+    void uploadVertices(const float* vertices, size_t numVertices, const int* firsts, const int* counts, size_t numStreamlines);
+
+    /**
+     * @brief Read the uploaded vertices back from the GPU together with the streamline ranges
+     */
+    void readVertices(std::vector<float>& vertices, std::vector<int>& firsts, std::vector<int>& counts) const;
+
+    /**
+     * @brief Select which of the prepared streamlines are drawn, without re-uploading any vertex data
+     * @param visible One entry per streamline passed to prepareStreamlines(), nonzero to draw it
+     */
+    void setVisibleStreamlines(const std::vector<unsigned char>& visible);
+
+    /**
+     * @brief Draw one streamline on top of the others in a highlight color, e.g. the one under the mouse
+     * @param streamline Index of the streamline, -1 for none
+     */
+    void setHighlightedStreamline(int streamline) {
+        highlightedStreamline = streamline;
+    }
+
+    /**
+     * @brief Get the number of uploaded vertices
+     */
+    size_t getVertexCount() const {
+        return (size_t)vertexCount;
+    }
+
+    /**
+     * @brief Get the number of streamlines that are currently drawn
+     */
+    size_t getVisibleStreamlineCount() const {
+        return drawFirsts.size();
+    }
+
+    /**
+     * @brief Set the model, view and projection matrices of the streamline shader
+     *
+     * The density mode keeps accumulating over frames as long as the matrices stay the same.
+     */
+    void setCamera(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model);
+
+    /**
+     * @brief Render the streamlines into the bound framebuffer
+     *
+     * The matrices must be set with setCamera(). In the weighted blended mode
+     * the lines are accumulated into an offscreen target (which takes the depth of the bound
+     * framebuffer, so opaque geometry drawn before still occludes them) and composited on top
+     * of the bound framebuffer, without sorting. In the density mode the line fragments are
+     * counted per pixel in an offscreen target and the counts are drawn with a colormap.
+     */
+    void render();
+
+    /**
+     * @brief Select how the streamlines are composited
+     */
+    void setRenderMode(StreamlineRenderMode mode) {
+        renderMode = mode;
+    }
+
+    /**
+     * @brief Opacity of every line fragment in the weighted blended mode
+     */
+    void setOpacity(float alpha) {
+        opacity = alpha;
+    }
+
+    /**
+     * @brief Shader that composites the accumulation targets (shaders/fullscreen.vs and shaders/oitComposite.fs)
+     */
+    void setCompositeShader(Shader* composite) {
+        compositeShader = composite;
+    }
+
+    /**
+     * @brief Shader that draws the density counts with a colormap (shaders/fullscreen.vs and shaders/densityResolve.fs)
+     */
+    void setDensityResolveShader(Shader* resolve) {
+        densityResolveShader = resolve;
+    }
+
+    /**
+     * @brief Settings of the density mode
+     * @param resolution Resolution of the density target relative to the screen, e.g. 0.5 for half resolution
+     * @param saturation Number of overlapping lines that maps to the top of the colormap
+     * @param frames Number of frames a full accumulation is spread over, every frame adds an evenly spread subset of the streamlines
+     */
+    void setDensitySettings(float resolution, float saturation, int frames);
+
+    /**
+     * @brief Part of the visible streamlines accumulated into the density target so far, in [0, 1]
+     */
+    float getDensityProgress() const;
+
+    /**
+     * @brief Start the density accumulation over in the next frame
+     */
+    void resetDensity() {
+        densityRestart = true;
+    }
+
+    /**
+     * @brief GPU memory of the offscreen targets in bytes
+     */
+    size_t getRenderTargetBytes() const;
 
     /**
      * @brief Set the line width for streamline rendering
@@ -48,11 +186,63 @@ public:
     }
 
 private:
-    unsigned int VAO;         ///< OpenGL Vertex Array Object
-    unsigned int VBO;         ///< OpenGL Vertex Buffer Object
-    unsigned int EBO;         ///< OpenGL element array buffer object
+    GLObject VAO;             ///< OpenGL Vertex Array Object
+    GLObject VBO;             ///< OpenGL Vertex Buffer Object
     Shader* shader;           ///< Shader program for rendering
     int vertexCount;          ///< Number of vertices in the streamlines
-    int bufferIndexCount;      ///< number of indices of vertices to be drawn through the EBO
+    std::vector<int> streamlineFirsts; ///< First vertex of every prepared streamline
+    std::vector<int> streamlineCounts; ///< Vertex count of every prepared streamline
+    std::vector<int> drawFirsts;       ///< First vertex of every visible streamline, passed to glMultiDrawArrays
+    std::vector<int> drawCounts;       ///< Vertex count of every visible streamline, passed to glMultiDrawArrays
     float lineWidth;          ///< Width of streamlines in pixels
+    int highlightedStreamline = -1; ///< Streamline drawn in the highlight color, -1 for none
+
+    /**
+     * Accumulate the visible streamlines into the transparency targets and composite them onto the bound framebuffer.
+     * @return False if the targets couldn't be created, nothing is drawn then
+     */
+    bool renderWeightedBlended();
+
+    /**
+     * Add the next subset of streamlines to the density counts and draw them with the colormap.
+     * @return False if the target couldn't be created, nothing is drawn then
+     */
+    bool renderDensity();
+
+    /**
+     * Split the visible streamlines in interleaved subsets for progressive accumulation.
+     */
+    void buildDensityBatches();
+
+    /**
+     * Draw the highlighted streamline on top of everything.
+     */
+    void renderHighlight();
+
+    /**
+     * Draw a triangle covering the viewport, for the composite and resolve passes.
+     */
+    void drawFullscreenTriangle();
+
+    StreamlineRenderMode renderMode = RENDER_MODE_OPAQUE;
+    float opacity = 0.2f;             ///< Fragment opacity in the weighted blended mode
+    Shader* compositeShader = nullptr;
+    std::unique_ptr<RenderTarget> transparencyTarget; ///< Accumulation (RGBA16F) and weight (R16F) targets, created on first use
+    GLObject emptyVAO;                ///< Vertex array for the fullscreen pass, which has no vertex attributes
+
+    glm::mat4 camera = glm::mat4(1.0f); ///< projection * view * model of the last setCamera()
+
+    Shader* densityResolveShader = nullptr;
+    std::unique_ptr<RenderTarget> densityTarget; ///< Line count per pixel (R32F), created on first use
+    float densityResolution = 1.0f;
+    float densitySaturation = 32.0f;
+    int densityFrames = 1;
+    std::vector<int> batchFirsts;      ///< Visible streamline ranges grouped by density batch
+    std::vector<int> batchCounts;
+    std::vector<size_t> batchOffsets;  ///< Start of every batch in batchFirsts, densityFrames + 1 entries
+    bool densityRestart = true;        ///< Clear the counts and rebuild the batches before the next accumulation
+    int accumulatedBatches = 0;        ///< Batches in the density target
+    size_t accumulatedStreamlines = 0; ///< Streamlines in the density target
+    glm::mat4 accumulatedCamera = glm::mat4(0.0f); ///< Camera the density target was accumulated with
+    float accumulatedLineWidth = 0.0f;
 };
\ No newline at end of file
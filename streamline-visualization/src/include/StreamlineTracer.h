@@ -1,93 +1,410 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <memory>
 #include <random>
 #include "VectorField.h"
+#include "DatasetSnapshot.h"
 #include "Constants.h"
+#include "PerfCounters.h"
+#include "Point3D.h"
+#include "SliceSeedIndex.h"
 
 #include <glm/vec3.hpp>
 #include <glm/vector_relational.hpp>
 #include <glm/geometric.hpp>
 
 /**
- * @struct Point3D
- * @brief Simple 3D point structure for streamline representation
+ * @brief Reason why the integration of a streamline in one direction stopped
  */
-struct Point3D {
-    float x, y, z;
+enum TerminationReason : unsigned char {
+    TERMINATED_MAX_STEPS = 0,   ///< Reached the maximum number of integration steps
+    TERMINATED_MAX_LENGTH,      ///< Reached the maximum streamline length
+    TERMINATED_ANGLE,           ///< The angle between two steps exceeded the maximum angle
+    TERMINATED_MASK,            ///< Left the nonzero part of the volume
+    TERMINATED_ZERO_VECTOR,     ///< Hit a zero vector
+    TERMINATED_INVALID,         ///< Invalid seed or integration method
+    NUM_TERMINATION_REASONS
+};
+
+/**
+ * @struct StreamlineAttributeValues
+ * @brief The attributes of a single streamline, see StreamlineAttributes
+ */
+struct StreamlineAttributeValues {
+    float length = 0.0f;
+    float stepCount = 0.0f;
+    float meanFA = 0.0f;
+    float minFA = 0.0f;
+    float meanScalar = 0.0f;
+    float curvature = 0.0f;
+    unsigned char backwardTermination = TERMINATED_INVALID;
+    unsigned char forwardTermination = TERMINATED_INVALID;
+};
+
+/**
+ * @struct StreamlineAttributes
+ * @brief Per-streamline attributes computed at trace time, stored as columns
+ *
+ * Entry i of every column belongs to streamline i of the traced set. The numeric columns
+ * are all floats so they can be filtered by the same SIMD kernel (see StreamlineFilter.h).
+ */
+struct StreamlineAttributes {
+    std::vector<float> length;       ///< Arc length in voxels
+    std::vector<float> stepCount;    ///< Number of segments
+    std::vector<float> meanFA;       ///< Mean fractional anisotropy along the streamline (0 without tensors)
+    std::vector<float> minFA;        ///< Minimum fractional anisotropy along the streamline (0 without tensors)
+    std::vector<float> meanScalar;   ///< Mean scalar value along the streamline
+    std::vector<float> curvature;    ///< Mean turning angle per unit length (radians per voxel)
+    std::vector<unsigned char> backwardTermination; ///< TerminationReason of the backward half
+    std::vector<unsigned char> forwardTermination;  ///< TerminationReason of the forward half
+
+    size_t size() const { return length.size(); }
+
+    void clear()
+    {
+        length.clear(); stepCount.clear(); meanFA.clear(); minFA.clear();
+        meanScalar.clear(); curvature.clear(); backwardTermination.clear(); forwardTermination.clear();
+    }
+
+    void reserve(size_t n)
+    {
+        length.reserve(n); stepCount.reserve(n); meanFA.reserve(n); minFA.reserve(n);
+        meanScalar.reserve(n); curvature.reserve(n); backwardTermination.reserve(n); forwardTermination.reserve(n);
+    }
+
+    void push_back(const StreamlineAttributeValues& values)
+    {
+        length.push_back(values.length);
+        stepCount.push_back(values.stepCount);
+        meanFA.push_back(values.meanFA);
+        minFA.push_back(values.minFA);
+        meanScalar.push_back(values.meanScalar);
+        curvature.push_back(values.curvature);
+        backwardTermination.push_back(values.backwardTermination);
+        forwardTermination.push_back(values.forwardTermination);
+    }
+
+    void append(const StreamlineAttributes& other)
+    {
+        length.insert(length.end(), other.length.begin(), other.length.end());
+        stepCount.insert(stepCount.end(), other.stepCount.begin(), other.stepCount.end());
+        meanFA.insert(meanFA.end(), other.meanFA.begin(), other.meanFA.end());
+        minFA.insert(minFA.end(), other.minFA.begin(), other.minFA.end());
+        meanScalar.insert(meanScalar.end(), other.meanScalar.begin(), other.meanScalar.end());
+        curvature.insert(curvature.end(), other.curvature.begin(), other.curvature.end());
+        backwardTermination.insert(backwardTermination.end(), other.backwardTermination.begin(), other.backwardTermination.end());
+        forwardTermination.insert(forwardTermination.end(), other.forwardTermination.begin(), other.forwardTermination.end());
+    }
+};
+
+/**
+ * @struct VolumeSeedingOptions
+ * @brief Settings for seeding streamlines throughout the whole volume
+ */
+struct VolumeSeedingOptions {
+    const bool* roiMask = nullptr;  ///< Optional region of interest (same layout as the zero mask), nullptr for the whole volume
+    int seedsPerVoxel = 1;          ///< Number of seeds placed in every accepted voxel
+    bool jitter = true;             ///< Randomly offset the seeds within their voxel
+    bool useScalarThreshold = false;///< Only seed voxels with scalar value > scalarThreshold
+    float scalarThreshold = 0.0f;
+    bool useFAThreshold = false;    ///< Only seed voxels with FA > faThreshold (tensor fields only)
+    float faThreshold = 0.2f;
+    int maxSeeds = 0;               ///< Global seed budget, 0 for no limit
+    unsigned int randomSeed = 0;    ///< Seed for the jitter so results are reproducible
+};
+
+/**
+ * @struct SlabHalf
+ * @brief One half of a streamline traced slab by slab, see StreamlineTracer::traceHalvesInSlab
+ *
+ * The fields up to currentPos are all a rank needs to continue a half another rank started.
+ */
+struct SlabHalf {
+    uint32_t seedIndex = 0;
+    int32_t direction = 1;    ///< 1 forward, -1 backward
+    int32_t step = 0;         ///< Points traced so far, 0 before the first step
+    Point3D prevPos;          ///< Point before currentPos, the seed after the first step
+    Point3D currentPos;       ///< Last point traced so far, the seed before the first step
 
-    Point3D() : x(0), y(0), z(0) {}
-    Point3D(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+    std::vector<Point3D> points; ///< Output: the points traced in the slab
+    bool stopped = false;        ///< Output: whether the half terminated, otherwise it left the slab
+    TerminationReason reason = TERMINATED_INVALID; ///< Output: why the half terminated
 };
 
+struct TracerParams;
+struct TraceState;
+struct TracedHalf;
+
 /**
  * @class StreamlineTracer
  * @brief Generates streamlines from vector fields
  *
  * This class handles the generation of streamlines from a 3D vector field,
  * including seed point generation, numerical integration, and termination criteria.
+ *
+ * The tracer only reads an immutable dataset snapshot and takes the settings of every trace
+ * as a TracerParams value, so one tracer can be used by several threads at once.
  */
 class StreamlineTracer {
 public:
     /**
-     * @brief Constructor with streamline generation parameters
-     * 
-     * @param field Vector field to trace streamlines through
-     * @param step Step size for numerical integration
-     * @param steps Maximum number of steps per streamline
-     * @param minMag Minimum vector magnitude before termination
-     * @param maxLen Maximum length of a streamline
+     * @brief Constructor
+     * @param dataset Dataset to trace in, kept alive as long as the tracer exists
      */
-    StreamlineTracer(VectorField* field, float step = 0.5f, int steps = 2000, float maxLen = 100.0f, float maxAngle = 0.01f, const char* integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER);
+    explicit StreamlineTracer(std::shared_ptr<const DatasetSnapshot> dataset);
 
     /**
      * @brief Trace a single streamline from a seed point
      * 
      * @param seed Starting point for the streamline
+     * @param params Integration settings, the level is ignored
      * 
      * @return Vector of points representing the streamline
      */
-    std::vector<Point3D> traceStreamline(const Point3D& seed);
+    std::vector<Point3D> traceStreamline(const Point3D& seed, const TracerParams& params) const;
 
     /**
      * @brief Trace streamlines from all provided seed points
-     * @param seeds Vector of seed points
+     *
+     * Unless params.seedOrdering is SEED_ORDER_NONE the seeds are first sorted along a
+     * space-filling curve, so every worker thread traces a compact region of the volume. The
+     * output is in the order of the seeds (streamlines with too few points are left out) and
+     * bitwise identical for any number of threads.
+     *
+     * When params.level is above 0 the streamlines are traced on that level of the vector field
+     * pyramid (see VectorField::buildPyramid) with the same step size in level voxels, so every
+     * step covers 2^level voxels. Seeds and points stay in the coordinates of the full field.
+     *
+     * @param seeds Seed points, a vector or a span such as a slice of the seed index
+     * @param params Settings of this trace
+     * @param attributes Optional output for the per-streamline attributes, in the order of the returned streamlines
+     * @param seedIndices Optional output for the index of the seed of every returned streamline
+     * @param counters Optional output for the hardware counters of the trace, summed over all threads
+     * @param state Optional output for where every half ended and why, for updateStreamlines
      * @return Vector of streamlines (each a vector of points)
      */
-    std::vector<std::vector<Point3D>> traceAllStreamlines(const std::vector<Point3D>& seeds);
+    std::vector<std::vector<Point3D>> traceAllStreamlines(SeedSpan seeds, const TracerParams& params,
+        StreamlineAttributes* attributes = nullptr, std::vector<size_t>* seedIndices = nullptr, PerfCounterValues* counters = nullptr,
+        TraceState* state = nullptr) const;
 
-    std::vector<Point3D> generateSliceGridSeeds(int currentSliceX, int currentSliceY, int currentSliceZ, int axis);
+    /**
+     * @brief Whether updateStreamlines can bring a recorded trace to new settings
+     *
+     * That is the case if the state was recorded on the dataset of this tracer from the same
+     * seeds, and the settings differ at most in maxSteps, maxLength, maxAngle and the seed order.
+     */
+    bool canUpdateStreamlines(const TraceState& state, SeedSpan seeds, const TracerParams& params) const;
 
-    std::vector<Point3D> generateMouseSeeds(int sliceX, int sliceY, int sliceZ, int axis, glm::vec3 seedLoc, float seedRadius, float density);
+    /**
+     * @brief Bring a recorded trace to new limits without tracing it again from the seeds
+     *
+     * The recorded steps of every half are replayed against the new limits: a half is cut where
+     * a lowered limit or the recorded turning angles would have stopped it, and a half that
+     * stopped at a limit that was raised is traced further from its endpoint. Halves that
+     * stopped at the mask or a zero vector stay as they are. The result is bitwise identical to
+     * traceAllStreamlines with the new settings, and the state is updated to them.
+     *
+     * @param state Recorded trace, canUpdateStreamlines must hold for it
+     * @param params New settings
+     * @param attributes Optional output for the per-streamline attributes, recomputed only for the streamlines that changed
+     * @param seedIndices Optional output for the index of the seed of every returned streamline
+     * @param resumed Optional output for the number of halves that were traced further
+     * @return Vector of streamlines, as traceAllStreamlines returns them
+     */
+    std::vector<std::vector<Point3D>> updateStreamlines(TraceState& state, const TracerParams& params,
+        StreamlineAttributes* attributes = nullptr, std::vector<size_t>* seedIndices = nullptr, size_t* resumed = nullptr) const;
+
+    /**
+     * @brief Trace halves of streamlines while they stay in a slab of the volume, for the distributed tracer
+     *
+     * Every half starts at its seed (step 0) or continues from where it left another slab, and
+     * runs until it terminates or is about to take a step from a point outside [xBegin, xEnd).
+     * A half traced slab by slab gets the same points as one traced by traceAllStreamlines.
+     * Always traces on the full resolution field.
+     *
+     * @param params Settings of the trace, the level is ignored
+     * @param halves Halves to trace, updated to where they stopped or left the slab
+     * @param xBegin First x coordinate of the slab
+     * @param xEnd End of the slab along x (exclusive)
+     */
+    void traceHalvesInSlab(const TracerParams& params, std::vector<SlabHalf>& halves, float xBegin, float xEnd) const;
+
+    /**
+     * @brief Hash the points (and attributes) of a set of streamlines bit for bit, for comparing runs
+     * @param streamlines Traced streamlines
+     * @param attributes Optional attributes to include in the hash
+     * @return 64-bit FNV-1a hash
+     */
+    static uint64_t hashStreamlines(const std::vector<std::vector<Point3D>>& streamlines, const StreamlineAttributes* attributes = nullptr);
 
-    std::vector<std::vector<Point3D>> StreamlineTracer::traceVectors(std::vector<Point3D> seeds);
+    /**
+     * @brief Compute the order in which the seeds are dispatched to the worker threads
+     * @param seeds Seed points
+     * @param seedOrdering One of the SEED_ORDER_* constants
+     * @return Permutation of the seed indices according to seedOrdering
+     */
+    std::vector<size_t> computeSeedOrder(SeedSpan seeds, const char* seedOrdering) const;
 
-    float stepSize;            ///< Step size for numerical integration
-    int maxSteps;              ///< Maximum number of steps per streamline
-    float maxLength;           ///< Maximum length of a streamline
-    float maxAngle;         ///< Cosine of the max angle between vectors in the integration step
-    const char* integrationMethod;
+    /**
+     * @brief Get a seed in every masked voxel of a slice without copying them
+     *
+     * The seeds are looked up in the seed index of the dataset, so the span stays valid as
+     * long as the dataset does.
+     *
+     * @return The seeds of the slice along axis, empty for an invalid axis or slice
+     */
+    SeedSpan getSliceSeeds(int currentSliceX, int currentSliceY, int currentSliceZ, int axis) const;
+
+    /**
+     * @brief Copy of getSliceSeeds(), for callers that need to own the seeds
+     */
+    std::vector<Point3D> generateSliceGridSeeds(int currentSliceX, int currentSliceY, int currentSliceZ, int axis) const;
+
+    std::vector<Point3D> generateMouseSeeds(int sliceX, int sliceY, int sliceZ, int axis, glm::vec3 seedLoc, float seedRadius, float density) const;
+
+    /**
+     * @brief Generate seeds in every masked voxel of the volume
+     *
+     * The volume is processed in parallel in bricks of SEED_BRICK_SIZE^3 voxels and the
+     * resulting seeds are returned in Morton order for locality during tracing. Bricks whose
+     * slices hold no masked voxel according to the seed index are skipped without a scan.
+     *
+     * @param options Seeding density, thresholds and budget
+     * @return Vector of seed points in Morton order
+     */
+    std::vector<Point3D> generateVolumeSeeds(const VolumeSeedingOptions& options) const;
+
+    std::vector<std::vector<Point3D>> traceVectors(std::vector<Point3D> seeds);
+
+    /**
+     * @brief Get the dataset the tracer reads
+     */
+    const std::shared_ptr<const DatasetSnapshot>& getDataset() const { return dataset; }
 
     //constants for the integration methods
-    static constexpr char* const EULER = "Euler";
-    static constexpr char* const RUNGE_KUTTA_2ND_ORDER = "Runge Kutta 2nd order";
+    static constexpr const char* EULER = "Euler";
+    static constexpr const char* RUNGE_KUTTA_2ND_ORDER = "Runge Kutta 2nd order";
+
+    //constants for the seed orderings
+    static constexpr const char* SEED_ORDER_NONE = "Generator order";
+    static constexpr const char* SEED_ORDER_MORTON = "Morton curve";
+    static constexpr const char* SEED_ORDER_HILBERT = "Hilbert curve";
 
 private:
-    VectorField* vectorField;  ///< Reference to the vector field
-    bool* zeroMask;            ///< the zero mask of the vector field
+    /**
+     * The field a trace runs on (the full field or a pyramid level) and how it is sampled.
+     */
+    struct TracedField {
+        const VectorField* field;
+        const bool* zeroMask;
+        InterpolationMode interpolation;
+        glm::vec3 flipSign;   ///< -1 for the flipped components
+    };
+
+    std::shared_ptr<const DatasetSnapshot> dataset; ///< Keeps the volumes alive
+    const VectorField* vectorField;  ///< Reference to the vector field
+    const bool* zeroMask;            ///< the zero mask of the vector field
+    const SliceSeedIndex* sliceSeeds; ///< the masked voxels per slice, owned by the dataset
+
+    /**
+     * Set up sampling a pyramid level of the field with the given settings.
+     */
+    TracedField getTracedField(int level, const TracerParams& params) const;
+
+    /**
+     * Set up the field traceAllStreamlines traces for params.level, with the limits of levelParams
+     * in level voxels and levelScale the size of a level voxel in full voxels.
+     */
+    TracedField getLevelField(const TracerParams& params, TracerParams& levelParams, float& levelScale) const;
 
     /**
      * Returns wether the rounded vector is in the zeromask.
      */
-    bool inZeroMask(glm::vec3 v);
+    static bool inZeroMask(const TracedField& traced, glm::vec3 v);
+
+    /**
+     * @brief Trace a single streamline from a seed point and report why both halves stopped
+     * @param backwardReason Output reason the backward half stopped
+     * @param forwardReason Output reason the forward half stopped
+     */
+    static std::vector<Point3D> traceStreamline(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+        TerminationReason& backwardReason, TerminationReason& forwardReason);
 
     /**
      * @brief Trace a streamline in one direction from a seed point
      * @param seed Starting point
      * @param direction Direction multiplier (1 or -1)
+     * @param reason Output reason the integration stopped
+     * @param angles Optional output for the turning angle at every point, 0 for the first one
      * @return Vector of points representing the directional streamline
      */
-    std::vector<Point3D> traceStreamlineDirection(const Point3D& seed, int direction);
+    static std::vector<Point3D> traceStreamlineDirection(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+        int direction, TerminationReason& reason, std::vector<float>* angles = nullptr);
+
+    /**
+     * @brief The first step of traceStreamlineDirection, from the seed
+     * @param nextPos Output first point
+     * @param reason Output reason the integration stopped, if it did
+     * @return Whether the step was taken
+     */
+    static bool firstStreamlineStep(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+        int direction, glm::vec3& nextPos, TerminationReason& reason);
+
+    /**
+     * @brief The integration loop of traceStreamlineDirection, from a point onwards
+     * @param prevPos Point before currentPos, updated as the integration goes
+     * @param currentPos Last point so far, updated as the integration goes
+     * @param step Number of points so far, updated as the integration goes
+     * @param path The new points are appended
+     * @param angles Optional output, the turning angles of the new points are appended
+     * @param reason Output reason the integration stopped, if it did
+     * @param xBegin, xEnd Stop before a step from a point outside [xBegin, xEnd), -FLT_MAX and FLT_MAX for no bounds
+     * @return Whether the integration stopped, false if it left [xBegin, xEnd)
+     */
+    static bool integrateStreamlineDirection(const TracedField& traced, const TracerParams& params, int direction,
+        glm::vec3& prevPos, glm::vec3& currentPos, int& step, std::vector<Point3D>& path, std::vector<float>* angles,
+        TerminationReason& reason, float xBegin, float xEnd);
+
+    /**
+     * @brief Continue tracing a directional streamline from its last point
+     * @param path Points traced so far, at least the first one
+     * @param angles Optional turning angles of path, extended with those of the new points
+     * @param reason Output reason the integration stopped
+     */
+    static void continueStreamlineDirection(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+        int direction, std::vector<Point3D>& path, std::vector<float>* angles, TerminationReason& reason);
+
+    /**
+     * @brief Bring a recorded half to new limits, see updateStreamlines
+     * @param previousMaxAngle Angle limit the half was recorded with
+     * @param resumed Output whether the half was traced further
+     * @return Whether the points or the termination reason of the half changed
+     */
+    static bool limitStreamlineDirection(const TracedField& traced, const TracerParams& params, const Point3D& seed,
+        int direction, float previousMaxAngle, TracedHalf& half, bool& resumed);
+
+    /**
+     * @brief Join the backward half, the seed and the forward half, empty if both halves are
+     */
+    static std::vector<Point3D> joinStreamline(const Point3D& seed, const std::vector<Point3D>& backwardPath, const std::vector<Point3D>& forwardPath);
+
+    /**
+     * @brief Move the kept streamlines and their attributes out of the per seed slots, in seed order
+     */
+    static std::vector<std::vector<Point3D>> compactStreamlines(std::vector<std::vector<Point3D>>& slots,
+        const std::vector<StreamlineAttributeValues>& attributeSlots, StreamlineAttributes* attributes, std::vector<size_t>* seedIndices);
+
+    /**
+     * @brief Compute the attributes of a traced streamline, in the coordinates of the full field
+     */
+    StreamlineAttributeValues computeAttributes(const std::vector<Point3D>& streamline, TerminationReason backwardReason, TerminationReason forwardReason) const;
+
+    /**
+     * @brief Sample the field, with the flips applied
+     */
+    static glm::vec3 sampleVector(const TracedField& traced, glm::vec3 pos);
 
     /**
      * @brief Perform Euler integration step
@@ -95,7 +412,7 @@ private:
      * @param step Step size (can be negative for backward tracing)
      * @return Next position
      */
-    glm::vec3 eulerIntegrate(glm::vec3 pos, float step);
+    static glm::vec3 eulerIntegrate(const TracedField& traced, glm::vec3 pos, float step);
 
     /**
      * @brief Perform 2th-order Runge-Kutta integration step
@@ -103,5 +420,92 @@ private:
      * @param step Step size (can be negative for backward tracing)
      * @return Next position
      */
-    glm::vec3 rk2Integrate(glm::vec3 pos, float step);
-};
\ No newline at end of file
+    static glm::vec3 rk2Integrate(const TracedField& traced, glm::vec3 pos, float step);
+};
+
+/**
+ * @struct TracerParams
+ * @brief Settings of a trace
+ *
+ * Passed by value to every trace, so a trace running on another thread never sees the
+ * settings change halfway and two traces with different settings can run at the same time.
+ */
+struct TracerParams {
+    float stepSize = 0.5f;     ///< Step size for numerical integration
+    int maxSteps = 2000;       ///< Maximum number of steps per streamline
+    float maxLength = 100.0f;  ///< Maximum length of a streamline
+    float maxAngle = 0.01f;    ///< Max angle between two integration steps in radians
+    const char* integrationMethod = StreamlineTracer::RUNGE_KUTTA_2ND_ORDER;
+    const char* seedOrdering = StreamlineTracer::SEED_ORDER_HILBERT; ///< Space-filling curve used to order the seeds before tracing
+    InterpolationMode interpolation = INTERPOLATION_NEAREST;
+    int level = 0;             ///< Pyramid level traced by traceAllStreamlines, 0 for full resolution
+
+    //some nifti files have the axis flipped
+    bool flipX = false;
+    bool flipY = false;
+    bool flipZ = false;
+
+    bool operator==(const TracerParams& other) const
+    {
+        return stepSize == other.stepSize && maxSteps == other.maxSteps && maxLength == other.maxLength && maxAngle == other.maxAngle
+            && integrationMethod == other.integrationMethod && seedOrdering == other.seedOrdering && interpolation == other.interpolation
+            && level == other.level && flipX == other.flipX && flipY == other.flipY && flipZ == other.flipZ;
+    }
+    bool operator!=(const TracerParams& other) const { return !(*this == other); }
+};
+
+/**
+ * @struct TracedHalf
+ * @brief One direction of a streamline as the tracer left it, see TraceState
+ */
+struct TracedHalf {
+    std::vector<Point3D> points;  ///< From the seed outwards without the seed, in the voxels of the traced level
+    std::vector<float> angles;    ///< Turning angle at every point in radians, 0 for the first point which isn't checked
+    TerminationReason reason = TERMINATED_INVALID;
+};
+
+/**
+ * @struct TraceState
+ * @brief Where every streamline of a trace ended and why, so the trace can follow changed limits
+ *
+ * Recorded by traceAllStreamlines and brought to new limits by updateStreamlines: raising
+ * maxSteps, maxLength or maxAngle resumes the halves from their endpoints, lowering them cuts
+ * the halves in place. The state holds a copy of every traced point plus an angle per point.
+ */
+struct TraceState {
+    std::weak_ptr<const DatasetSnapshot> dataset; ///< Dataset the trace ran on
+    TracerParams params;                          ///< Settings of the trace
+    std::vector<Point3D> seeds;                   ///< Seeds of the trace, in the coordinates of the full field
+    std::vector<TracedHalf> backward;             ///< Backward half per seed
+    std::vector<TracedHalf> forward;              ///< Forward half per seed
+    std::vector<StreamlineAttributeValues> attributeValues; ///< Attributes per seed if they were requested, valid for the kept streamlines
+
+    bool empty() const { return seeds.empty(); }
+
+    void clear()
+    {
+        dataset.reset();
+        seeds.clear(); seeds.shrink_to_fit();
+        backward.clear(); backward.shrink_to_fit();
+        forward.clear(); forward.shrink_to_fit();
+        attributeValues.clear(); attributeValues.shrink_to_fit();
+    }
+
+    /**
+     * @brief Get the bytes held by the state
+     */
+    size_t getMemoryBytes() const
+    {
+        size_t bytes = seeds.capacity() * sizeof(Point3D) + attributeValues.capacity() * sizeof(StreamlineAttributeValues)
+            + (backward.capacity() + forward.capacity()) * sizeof(TracedHalf);
+        for (size_t i = 0; i < backward.size(); i++)
+        {
+            bytes += backward[i].points.capacity() * sizeof(Point3D) + backward[i].angles.capacity() * sizeof(float);
+        }
+        for (size_t i = 0; i < forward.size(); i++)
+        {
+            bytes += forward[i].points.capacity() * sizeof(Point3D) + forward[i].angles.capacity() * sizeof(float);
+        }
+        return bytes;
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "TraceProtocol.h"
+
+/**
+ * @file TraceClient.h
+ * @brief Blocking client of the tracing daemon, for tools that want streamlines without loading the dataset
+ */
+
+/**
+ * @class TraceClient
+ * @brief One connection to the daemon, used by one thread at a time
+ */
+class TraceClient {
+public:
+    TraceClient() = default;
+
+    /**
+     * @brief Destructor - closes the connection
+     */
+    ~TraceClient();
+
+    /**
+     * @brief Connect to the daemon
+     * @return EXIT_SUCCESS, or EXIT_FAILURE with the reason in getError()
+     */
+    int connect(const std::string& socketPath = DEFAULT_TRACE_SOCKET);
+
+    /**
+     * @brief Trace seeds on a dataset of the daemon and wait for all streamlines
+     * @param dataset Name of the dataset, see listDatasets()
+     * @param params Settings of the trace
+     * @param seeds Seed points
+     * @param result Output, the streamlines with the index of their seed
+     * @return EXIT_SUCCESS, or EXIT_FAILURE with the reason in getError()
+     */
+    int trace(const std::string& dataset, const TracerParams& params, const std::vector<Point3D>& seeds, TraceResult& result);
+
+    /**
+     * @brief Get the datasets the daemon keeps resident
+     * @return EXIT_SUCCESS, or EXIT_FAILURE with the reason in getError()
+     */
+    int listDatasets(std::vector<TraceDatasetInfo>& datasets);
+
+    /**
+     * @brief Get why the last call failed
+     */
+    const std::string& getError() const { return error; }
+
+private:
+    TraceClient(const TraceClient&) = delete;
+    TraceClient& operator=(const TraceClient&) = delete;
+
+    /**
+     * @brief Send a request and read frames until the answer is complete
+     */
+    int exchange(uint16_t type, const std::vector<char>& request, TraceResult* result, std::vector<char>* answer);
+
+    int socket = -1;
+    uint32_t nextRequestId = 1;
+    std::string error;
+};
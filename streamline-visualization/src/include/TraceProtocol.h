@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Point3D.h"
+#include "StreamlineTracer.h"
+
+/**
+ * @file TraceProtocol.h
+ * @brief Binary protocol between the tracing daemon (vcp-traced) and its clients
+ *
+ * Clients connect to the Unix domain socket of the daemon and exchange frames: a
+ * TraceFrameHeader followed by `bytes` bytes of payload. All values are little endian (the
+ * daemon only talks to clients on the same machine), floats are IEEE 754 single precision.
+ *
+ * A client may send several requests without waiting for the results; the daemon answers every
+ * request with frames carrying the request id of the client, but not necessarily in the order
+ * of the requests. The payloads are:
+ *
+ * - TRACE_MESSAGE_TRACE (client): TraceRequestParams, the dataset name (datasetNameLength
+ *   bytes, no terminator) and numSeeds seeds of three floats (x, y, z in voxels).
+ * - TRACE_MESSAGE_RESULT (daemon): one or more chunks of the streamlines of a trace, the last
+ *   one has TRACE_RESULT_LAST set. A chunk is a TraceResultChunkHeader, the index of the seed
+ *   of every streamline in the chunk (uint32), the point count of every streamline (uint32) and
+ *   the points (three floats each). As in the viewer, streamlines with two points or less are
+ *   left out, so the seed indices tell which seed a streamline belongs to.
+ * - TRACE_MESSAGE_ERROR (daemon): a message without terminator, the request failed.
+ * - TRACE_MESSAGE_LIST_DATASETS (client): empty.
+ * - TRACE_MESSAGE_DATASETS (daemon): the dataset count (uint32) and per dataset the name length
+ *   (uint32), the name and the dimensions (three int32).
+ */
+
+const uint32_t TRACE_PROTOCOL_MAGIC = 0x54504356; ///< "VCPT"
+const uint16_t TRACE_PROTOCOL_VERSION = 1;
+
+//Socket the daemon listens on unless it is given another one
+const char* const DEFAULT_TRACE_SOCKET = "/tmp/vcp-traced.sock";
+
+//Largest payload a frame may have, larger frames are rejected
+const uint32_t TRACE_MAX_FRAME_BYTES = 256u * 1024 * 1024;
+
+//Points after which the daemon starts a new result chunk
+const size_t TRACE_RESULT_CHUNK_POINTS = 1 << 16;
+
+/**
+ * @brief Kinds of frames
+ */
+enum TraceMessageType {
+    TRACE_MESSAGE_TRACE = 1,
+    TRACE_MESSAGE_RESULT,
+    TRACE_MESSAGE_ERROR,
+    TRACE_MESSAGE_LIST_DATASETS,
+    TRACE_MESSAGE_DATASETS
+};
+
+/**
+ * @struct TraceFrameHeader
+ * @brief Start of every frame
+ */
+struct TraceFrameHeader {
+    uint32_t magic = TRACE_PROTOCOL_MAGIC;
+    uint16_t version = TRACE_PROTOCOL_VERSION;
+    uint16_t type = 0;       ///< TraceMessageType
+    uint32_t requestId = 0;  ///< Chosen by the client, repeated in the answers
+    uint32_t bytes = 0;      ///< Payload size
+};
+static_assert(sizeof(TraceFrameHeader) == 16, "TraceFrameHeader is part of the protocol");
+
+/**
+ * @struct TraceRequestParams
+ * @brief Tracer settings of a trace request, see TracerParams
+ */
+struct TraceRequestParams {
+    float stepSize = 0.5f;
+    int32_t maxSteps = 2000;
+    float maxLength = 100.0f;
+    float maxAngle = 0.01f;        ///< Radians
+    uint8_t integrationMethod = 0; ///< 0 Runge Kutta 2nd order, 1 Euler
+    uint8_t interpolation = 0;     ///< InterpolationMode
+    uint8_t flips = 0;             ///< Bit 0 flips x, bit 1 y, bit 2 z
+    uint8_t level = 0;             ///< Pyramid level, 0 for full resolution
+    uint32_t numSeeds = 0;
+    uint32_t datasetNameLength = 0;
+};
+static_assert(sizeof(TraceRequestParams) == 28, "TraceRequestParams is part of the protocol");
+
+//Set in TraceResultChunkHeader::flags on the last chunk of a result
+const uint32_t TRACE_RESULT_LAST = 1;
+
+/**
+ * @struct TraceResultChunkHeader
+ * @brief Start of every chunk of a result
+ */
+struct TraceResultChunkHeader {
+    uint32_t numStreamlines = 0; ///< Streamlines in this chunk
+    uint32_t numPoints = 0;      ///< Points of all streamlines in this chunk
+    uint32_t flags = 0;
+    uint32_t reserved = 0;
+};
+static_assert(sizeof(TraceResultChunkHeader) == 16, "TraceResultChunkHeader is part of the protocol");
+
+/**
+ * @struct TraceResult
+ * @brief Streamlines of a trace request
+ */
+struct TraceResult {
+    std::vector<std::vector<Point3D>> streamlines;
+    std::vector<uint32_t> seedIndices; ///< Index of the seed of every streamline in the request
+    std::string error;                 ///< Empty if the trace succeeded
+};
+
+/**
+ * @struct TraceDatasetInfo
+ * @brief A dataset the daemon keeps resident
+ */
+struct TraceDatasetInfo {
+    std::string name;
+    int dimX = 0, dimY = 0, dimZ = 0;
+};
+
+/**
+ * @brief Convert the settings of a request to tracer settings
+ * @throws std::runtime_error for settings the tracer doesn't accept
+ */
+TracerParams toTracerParams(const TraceRequestParams& request);
+
+/**
+ * @brief Convert tracer settings to the settings of a request, the seed count and name length are left 0
+ */
+TraceRequestParams toRequestParams(const TracerParams& params);
+
+/**
+ * @brief Build the payload of a trace request
+ */
+void encodeTraceRequest(const std::string& dataset, const TracerParams& params, const Point3D* seeds, size_t numSeeds, std::vector<char>& out);
+
+/**
+ * @brief Read the payload of a trace request
+ * @throws std::runtime_error if the payload is malformed or the settings are invalid
+ */
+void decodeTraceRequest(const std::vector<char>& in, std::string& dataset, TracerParams& params, std::vector<Point3D>& seeds);
+
+/**
+ * @brief Build the payload of one result chunk
+ * @param result Result to take the streamlines from
+ * @param first Index of the first streamline in the chunk
+ * @return Index after the last streamline in the chunk, TRACE_RESULT_LAST is set if that is the end of the result
+ */
+size_t encodeTraceResultChunk(const TraceResult& result, size_t first, std::vector<char>& out);
+
+/**
+ * @brief Append the streamlines of a result chunk to a result
+ * @return Whether this was the last chunk
+ * @throws std::runtime_error if the payload is malformed
+ */
+bool decodeTraceResultChunk(const std::vector<char>& in, TraceResult& result);
+
+void encodeDatasetList(const std::vector<TraceDatasetInfo>& datasets, std::vector<char>& out);
+std::vector<TraceDatasetInfo> decodeDatasetList(const std::vector<char>& in);
+
+/**
+ * @brief Write a whole frame to a blocking socket
+ * @return false if the connection failed, always on Windows which has no Unix domain sockets here
+ */
+bool writeTraceFrame(int socket, uint16_t type, uint32_t requestId, const std::vector<char>& payload);
+
+/**
+ * @brief Read a whole frame from a blocking socket
+ * @return false if the connection closed or failed or the frame is invalid
+ */
+bool readTraceFrame(int socket, TraceFrameHeader& header, std::vector<char>& payload);
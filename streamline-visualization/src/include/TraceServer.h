@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "TraceService.h"
+
+/**
+ * @file TraceServer.h
+ * @brief Unix domain socket front end of the tracing daemon, see TraceProtocol.h
+ *
+ * Every client connection gets a reader thread, which decodes the requests and submits them to
+ * the TraceService, and a writer thread, which sends the results back in chunks as the service
+ * finishes them. The dispatcher of the service only hands the results over, so a slow client
+ * never holds up the traces of the others.
+ */
+
+/**
+ * @class TraceServer
+ * @brief Accepts clients on a Unix domain socket and passes their requests to a TraceService
+ */
+class TraceServer {
+public:
+    /**
+     * @param service Service the requests go to, has to outlive the server
+     */
+    explicit TraceServer(TraceService& service);
+
+    /**
+     * @brief Destructor - stops the server
+     */
+    ~TraceServer();
+
+    /**
+     * @brief Listen on a socket path, replacing a stale socket file, and start accepting clients
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if the socket couldn't be opened (always on Windows)
+     */
+    int start(const std::string& socketPath);
+
+    /**
+     * @brief Close the socket and all connections, results that are still being traced are dropped
+     */
+    void stop();
+
+    /**
+     * @brief Get the number of clients that are connected right now
+     */
+    int getClientCount() const { return clientCount; }
+
+private:
+    struct Connection;
+
+    void acceptClients();
+    void readRequests(std::shared_ptr<Connection> connection);
+    void writeResults(std::shared_ptr<Connection> connection);
+    void reapConnections(bool all);
+
+    TraceService& service;
+    std::string socketPath;
+    int listenSocket = -1;
+    std::atomic<bool> stopping{ false };
+    std::atomic<int> clientCount{ 0 };
+    std::thread acceptor;
+    std::mutex connectionsMutex;
+    std::list<std::shared_ptr<Connection>> connections;
+};
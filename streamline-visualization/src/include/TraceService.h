@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StreamlineTracer.h"
+#include "TraceProtocol.h"
+#include "LatencyStats.h"
+
+/**
+ * @file TraceService.h
+ * @brief Resident datasets and batched tracing for the tracing daemon
+ *
+ * Requests from all clients go into one queue. A dispatcher thread takes the oldest request and
+ * traces it together with every queued request on the same dataset with the same settings in a
+ * single traceAllStreamlines call. Requests that queued up while the previous batch was traced
+ * would have waited anyway, so joining them costs nothing; a few thousand seeds are not enough
+ * to keep all cores busy and every trace has a fixed cost (sorting the seeds, starting the
+ * OpenMP team, gathering the output). Optionally the dispatcher waits a batch window for more
+ * requests, but only when others are queued already, so a lone request on an idle daemon never
+ * waits. The result of every request is the same as if it was traced alone.
+ */
+
+/**
+ * @struct TraceServiceOptions
+ * @brief How requests are batched
+ */
+struct TraceServiceOptions {
+    double batchWindowMs = 0.0;   ///< How long the oldest request waits for more to join its batch when others are queued, 0 to never wait
+    size_t maxBatchSeeds = 50000; ///< No more requests join a batch with this many seeds, 0 to trace every request alone
+};
+
+/**
+ * @struct TraceServiceStats
+ * @brief What the service did since the statistics were last taken
+ */
+struct TraceServiceStats {
+    size_t requests = 0;     ///< Requests traced
+    size_t batches = 0;      ///< Traces run for them
+    size_t seeds = 0;        ///< Seeds traced
+    size_t streamlines = 0;  ///< Streamlines returned
+    LatencyStats queueMs;    ///< Per request, from submitting until its batch started tracing
+    LatencyStats traceMs;    ///< Per batch, tracing time
+
+    /**
+     * @brief Print the counts and latencies to stdout
+     */
+    void print() const;
+};
+
+/**
+ * @class TraceService
+ * @brief Keeps datasets resident and traces batched requests on a dispatcher thread
+ */
+class TraceService {
+public:
+    /**
+     * @brief Called with the result of a request, on the dispatcher thread
+     */
+    typedef std::function<void(TraceResult&)> TraceCallback;
+
+    /**
+     * @brief Start the dispatcher
+     */
+    explicit TraceService(const TraceServiceOptions& options = TraceServiceOptions());
+
+    /**
+     * @brief Destructor - traces the queued requests and stops the dispatcher
+     */
+    ~TraceService();
+
+    /**
+     * @brief Make a dataset available to requests, replacing one with the same name
+     */
+    void addDataset(const std::string& name, std::shared_ptr<const DatasetSnapshot> dataset);
+
+    /**
+     * @brief Get the names and dimensions of the datasets
+     */
+    std::vector<TraceDatasetInfo> getDatasets() const;
+
+    /**
+     * @brief Queue a trace request
+     *
+     * Requests for an unknown dataset fail right away, the callback is called before submit returns.
+     *
+     * @param dataset Name of the dataset
+     * @param params Settings of the trace
+     * @param seeds Seed points
+     * @param done Called with the result
+     */
+    void submit(const std::string& dataset, const TracerParams& params, std::vector<Point3D> seeds, TraceCallback done);
+
+    /**
+     * @brief Get the statistics and start new ones, so a long running daemon doesn't collect samples forever
+     */
+    TraceServiceStats takeStats();
+
+private:
+    struct Request {
+        std::shared_ptr<const StreamlineTracer> tracer;
+        TracerParams params;
+        std::vector<Point3D> seeds;
+        TraceCallback done;
+        std::chrono::steady_clock::time_point submitTime;
+    };
+
+    void run();
+    void traceBatch(std::vector<Request>& batch);
+
+    TraceServiceOptions options;
+    mutable std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::map<std::string, std::shared_ptr<const StreamlineTracer>> tracers;
+    std::deque<Request> queue;
+    size_t queuedSeeds = 0;
+    bool stopping = false;
+    TraceServiceStats stats;
+    std::thread dispatcher;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @file TraceTransport.h
+ * @brief Message passing between the processes of a distributed trace
+ *
+ * The processes of a distributed trace are numbered 0 to size - 1, rank 0 coordinates and the
+ * others trace. Two transports are available: Unix domain sockets between processes started on
+ * one machine by spawnSocketRanks, for developing and testing on a single box, and MPI when the
+ * program is built with VCP_WITH_MPI and started with mpirun.
+ */
+
+/**
+ * @brief Tag of the empty message receive() returns when the connection to a rank closed
+ */
+const int TRACE_RANK_CLOSED = -1;
+
+/**
+ * @class TraceTransport
+ * @brief Tagged messages between ranks, delivered in order per pair of ranks
+ */
+class TraceTransport {
+public:
+    virtual ~TraceTransport() {}
+
+    virtual int getRank() const = 0;
+    virtual int getSize() const = 0;
+
+    /**
+     * @brief Queue a message, never blocks on the receiver
+     * @param destination Rank to send to
+     * @param tag Kind of message, interpreted by the receiver
+     * @param payload Contents of the message, moved out
+     */
+    virtual void send(int destination, int tag, std::vector<char>& payload) = 0;
+
+    /**
+     * @brief Get the next message from any rank
+     * @param wait Block until a message arrives
+     * @return Whether a message was received
+     * @throws std::runtime_error if all other ranks are gone while waiting
+     */
+    virtual bool receive(int& source, int& tag, std::vector<char>& payload, bool wait) = 0;
+
+    /**
+     * @brief Block until all queued messages are handed to the system
+     */
+    virtual void flush() = 0;
+
+    uint64_t getBytesSent() const { return bytesSent; }
+    uint64_t getMessagesSent() const { return messagesSent; }
+
+protected:
+    uint64_t bytesSent = 0;
+    uint64_t messagesSent = 0;
+};
+
+/**
+ * @brief Start numRanks tracing processes on this machine, connected by Unix domain sockets
+ *
+ * Every process gets a socket to every other one. The processes run the executable again
+ * (OpenMP doesn't survive a fork without exec) with the arguments
+ * `--trace-rank <rank> <size> <sockets> <extraArgs...>`, which connectSocketRank() takes.
+ *
+ * @param executable Path of the program, normally argv[0]
+ * @param numRanks Number of tracing processes
+ * @param extraArgs Passed on to the tracing processes
+ * @return The transport of rank 0, which waits for the processes when destroyed; nullptr if they couldn't be started
+ */
+std::unique_ptr<TraceTransport> spawnSocketRanks(const char* executable, int numRanks, const std::vector<std::string>& extraArgs);
+
+/**
+ * @brief Connect a process started by spawnSocketRanks
+ * @param rank, size, sockets The arguments after --trace-rank
+ * @return The transport, nullptr for invalid arguments
+ */
+std::unique_ptr<TraceTransport> connectSocketRank(int rank, int size, const char* sockets);
+
+#if defined(VCP_WITH_MPI)
+/**
+ * @brief Initialize MPI and get a transport over MPI_COMM_WORLD, finalized when destroyed
+ */
+std::unique_ptr<TraceTransport> createMpiTransport(int* argc, char*** argv);
+#endif
@@ -1,7 +1,52 @@
 #pragma once
 
 #include <string>
-#include <Eigen/Dense>
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include "VolumeAllocator.h"
+
+class SparseBlockVolume;
+
+/**
+ * @enum VectorFieldStorage
+ * @brief How the vectors of a field are stored in memory
+ *
+ * The quantized modes store every vector as an octahedral encoded direction (two signed
+ * normalized integers, see OctahedralEncoding.h) and an unsigned normalized magnitude relative
+ * to the largest magnitude in the field. They are decoded on every lookup.
+ *
+ * The sparse mode keeps the float vectors, but only of the 8x8x8 blocks that contain a nonzero
+ * vector (see SparseBlockVolume.h), which pays off for masked volumes like the brain dataset.
+ */
+enum VectorFieldStorage {
+    VECTOR_STORAGE_FLOAT32 = 0,   ///< 3 floats per voxel (12 bytes)
+    VECTOR_STORAGE_OCTAHEDRAL16,  ///< 2x16 bit direction and 16 bit magnitude (6 bytes)
+    VECTOR_STORAGE_OCTAHEDRAL8,   ///< 2x8 bit direction and 8 bit magnitude (3 bytes)
+    VECTOR_STORAGE_SPARSE_BLOCKS  ///< 3 floats per voxel of the nonempty 8x8x8 blocks only
+};
+
+/**
+ * @brief Get a human readable name of a storage mode
+ */
+const char* getVectorFieldStorageName(VectorFieldStorage storage);
+
+/**
+ * @enum InterpolationMode
+ * @brief How vectors between voxel centers are reconstructed
+ */
+enum InterpolationMode {
+    INTERPOLATION_NEAREST = 0,   ///< Vector of the nearest voxel
+    INTERPOLATION_TRILINEAR,     ///< Trilinear interpolation of the 8 surrounding voxels (C0)
+    INTERPOLATION_CUBIC_BSPLINE  ///< Cubic B-spline on prefiltered coefficients, 64 voxels (C2)
+};
+
+/**
+ * @brief Get a human readable name of an interpolation mode
+ */
+const char* getInterpolationModeName(InterpolationMode mode);
 
 /**
  * @class VectorField
@@ -13,21 +58,44 @@
 class VectorField {
 public:
 
-    const bool SIMPLE_INTERPOLATION = true;
-
     /**
      * @brief Constructor that loads vector field from file
      * @param filename Path to the vector field file (NIFTI format)
+     * @param storage How the vectors are stored, the file is read as floats and quantized afterwards
      */
-    VectorField(const char* filename);
+    VectorField(const char* filename, VectorFieldStorage storage = VECTOR_STORAGE_FLOAT32);
 
     /**
      * Construct vector field from the eigenvectors of the tensor field.
+     * With a quantized storage mode the eigenvectors are quantized per chunk, so no full float copy is made.
      */
-    VectorField(float* tensorField, int dimX, int dimY, int dimZ);
+    VectorField(float* tensorField, int dimX, int dimY, int dimZ, VectorFieldStorage storage = VECTOR_STORAGE_FLOAT32);
 
     /**
-     * @brief Destructor - frees allocated memory
+     * @brief Construct a vector field that decomposes the tensors lazily, one brick at a time
+     *
+     * Only the zero mask is computed up front (a voxel is masked where its tensor is nonzero).
+     * The eigenvectors and FA of a brick of TENSOR_BRICK_SIZE^3 voxels are computed the first
+     * time any lookup touches the brick, so a trace only pays for the region it explores. Every
+     * brick has an atomic state: the first thread to touch it decomposes it while others that
+     * need the same brick wait for it, there is no lock shared between bricks. The results are
+     * bitwise identical to the eager decomposition. Float storage only.
+     *
+     * @param tensorField Tensors (6 components per voxel), owned and kept resident by the field
+     */
+    VectorField(VolumeBuffer<float> tensorField, int dimX, int dimY, int dimZ);
+
+    /**
+     * @brief Construct a vector field on top of existing volumes, e.g. a mapped session snapshot
+     * @param vectorData Vector data (3 components per voxel)
+     * @param faData Fractional anisotropy per voxel, may be nullptr
+     * @param zeroMask Mask of nonzero vectors, index x + y * dimX + z * dimX * dimY, computed from the vectors if nullptr
+     * @param ownsData If true the field takes ownership of the volumes (allocated with allocateVolume()), otherwise they have to outlive it
+     */
+    VectorField(float* vectorData, float* faData, bool* zeroMask, int dimX, int dimY, int dimZ, bool ownsData);
+
+    /**
+     * @brief Destructor - the owned volumes, levels and coefficients free themselves
      */
     ~VectorField();
 
@@ -47,11 +115,22 @@ public:
      * @param x X coordinate
      * @param y Y coordinate
      * @param z Z coordinate
+     * @param mode How the field is reconstructed, prepareInterpolation() must have been called for it
      * @param vx Output X component of vector
      * @param vy Output Y component of vector
      * @param vz Output Z component of vector
      */
-    void interpolateVector(float x, float y, float z, float& vx, float& vy, float& vz) const;
+    void interpolateVector(float x, float y, float z, InterpolationMode mode, float& vx, float& vy, float& vz) const;
+
+    /**
+     * @brief Compute what an interpolation mode needs, if that wasn't done before
+     *
+     * The B-spline coefficients are computed the first time the cubic mode is prepared and
+     * kept afterwards (3 floats per voxel). They are computed from the decoded vectors, so the
+     * cubic mode works with every storage mode. Thread safe, concurrent callers wait for the
+     * first one, so a field shared between threads can be prepared by any of them.
+     */
+    void prepareInterpolation(InterpolationMode mode) const;
 
     /**
      * @brief Check if a point is within the field bounds
@@ -63,21 +142,200 @@ public:
     bool isInBounds(float x, float y, float z) const;
 
     // Accessor methods
-    bool* getZeroMask(int dimX, int dimY, int dimZ);
+    const bool* getZeroMask(int dimX, int dimY, int dimZ) const;
+
+    /**
+     * @brief Whether a fractional anisotropy volume is available
+     * @return True if the field was constructed from a tensor field
+     */
+    bool hasFA() const { return faData != nullptr; }
+
+    /**
+     * @brief Get the fractional anisotropy at integer grid indices
+     * @param x X index
+     * @param y Y index
+     * @param z Z index
+     * @return FA in [0, 1], or 0 if out of bounds or no FA is available
+     */
+    float getFA(int x, int y, int z) const;
 
+    /**
+     * @brief Get the raw vector data (3 components per voxel, index 3 * (z + dimZ * (y + dimY * x)))
+     *
+     * A lazily decomposed field decomposes all remaining bricks first.
+     *
+     * @return The data, or nullptr if the field uses a quantized or sparse storage mode
+     */
+    const float* getData() const { decomposeAll(); return data; }
 
-    //some nifti files have the axis flipped
-    bool flipX = false;
-    bool flipY = false;
-    bool flipZ = false;
+    /**
+     * @brief Get how the vectors are stored
+     */
+    VectorFieldStorage getStorage() const { return storage; }
+
+    /**
+     * @brief Memory used by the vectors, the FA volume and the zero mask in bytes
+     */
+    size_t getStorageBytes() const;
+
+    /**
+     * @brief Mean angle between the original and the quantized vectors in degrees, 0 for float storage
+     */
+    double getMeanAngularError() const { return meanAngularError; }
+
+    /**
+     * @brief Largest angle between an original and its quantized vector in degrees, 0 for float storage
+     */
+    double getMaxAngularError() const { return maxAngularError; }
+
+    /**
+     * @brief Get the raw fractional anisotropy volume, nullptr if not available
+     *
+     * A lazily decomposed field decomposes all remaining bricks first.
+     */
+    const float* getFAData() const { decomposeAll(); return faData; }
+
+    /**
+     * @brief Whether the tensors are decomposed on first touch (see the lazy constructor)
+     */
+    bool isLazy() const { return brickStates != nullptr; }
+
+    /**
+     * @brief Number of bricks decomposed so far, equal to getBrickCount() for an eager field
+     */
+    size_t getDecomposedBrickCount() const { return isLazy() ? decomposedBricks.load() : getBrickCount(); }
+
+    /**
+     * @brief Number of TENSOR_BRICK_SIZE^3 bricks of the field
+     */
+    size_t getBrickCount() const
+    {
+        return (size_t)((dimX + TENSOR_BRICK_SIZE - 1) / TENSOR_BRICK_SIZE) * ((dimY + TENSOR_BRICK_SIZE - 1) / TENSOR_BRICK_SIZE)
+            * ((dimZ + TENSOR_BRICK_SIZE - 1) / TENSOR_BRICK_SIZE);
+    }
+
+
+    /**
+     * @brief Build a mip pyramid of coarser versions of the field
+     *
+     * Every level halves the resolution of the previous one; a level voxel covers 2x2x2 voxels
+     * of the level below. With a tensor field the tensors are averaged and decomposed again,
+     * otherwise the vectors are sign aligned (eigenvectors have no sign), averaged and scaled
+     * to the mean magnitude. The levels are stored as dense float fields owned by this field.
+     *
+     * @param numLevels Total number of levels including this one
+     * @param tensorField Tensors this field was decomposed from (6 components per voxel), or nullptr
+     */
+    void buildPyramid(int numLevels, const float* tensorField = nullptr);
+
+    /**
+     * @brief Number of pyramid levels, 1 if no pyramid was built
+     */
+    int getLevelCount() const { return 1 + (int)coarseLevels.size(); }
+
+    /**
+     * @brief Get a pyramid level, level 0 is this field
+     *
+     * Level coordinates relate to this field as x = (xLevel + 0.5) * 2^level - 0.5.
+     */
+    const VectorField* getLevel(int level) const;
 
     short dimX, dimY, dimZ;  ///< Dimensions of the vector field
 
+    static const int TENSOR_BRICK_SIZE = 8; ///< Edge length of the bricks a lazy field decomposes at once
+
 private:
-    float* data;         ///< Vector data (3 components per voxel)
-    bool* zeroMask; ///Mask of zero vectors
+    const float* data = nullptr;      ///< Vector data (3 components per voxel), points into ownedData or borrowed volumes
+    const bool* zeroMask = nullptr;   ///< Mask of zero vectors, points into ownedZeroMask or a borrowed mask
+    const float* faData = nullptr;    ///< Fractional anisotropy per voxel in the same order as data (tensor fields only)
+    VolumeBuffer<float> ownedData;    ///< Vector data allocated by this field, empty if borrowed or quantized
+    VolumeBuffer<float> ownedFA;
+    VolumeBuffer<bool> ownedZeroMask;
+
+    // Quantized storage, only the arrays of the active mode are allocated
+    VectorFieldStorage storage = VECTOR_STORAGE_FLOAT32;
+    VolumeBuffer<short> directions16;          ///< Octahedral directions (2 per voxel, same order as data)
+    VolumeBuffer<unsigned short> magnitudes16; ///< Magnitudes relative to maxMagnitude
+    VolumeBuffer<signed char> directions8;
+    VolumeBuffer<unsigned char> magnitudes8;
+    float maxMagnitude = 0.0f;                 ///< Magnitude of the largest quantized value
+    std::unique_ptr<SparseBlockVolume> sparseData;          ///< Vectors of the nonempty blocks (sparse storage only)
+    std::vector<std::unique_ptr<VectorField>> coarseLevels; ///< Pyramid levels 1, 2, ... (see buildPyramid)
+    mutable VolumeBuffer<float> cubicCoefficients;          ///< Cubic B-spline coefficients, same layout as data (see prepareInterpolation)
+    mutable std::once_flag cubicOnce;
+    double meanAngularError = 0.0;
+    double maxAngularError = 0.0;
+
+    // Lazy tensor decomposition, the vectors and FA of a brick are written once by the thread that claims it
+    enum BrickState : unsigned char { BRICK_PENDING = 0, BRICK_DECOMPOSING, BRICK_READY };
+    VolumeBuffer<float> lazyTensors;                                      ///< Tensors of a lazy field (6 components per voxel)
+    mutable std::unique_ptr<std::atomic<unsigned char>[]> brickStates;    ///< BrickState per brick, nullptr for an eager field
+    mutable std::atomic<size_t> decomposedBricks{ 0 };
+    int bricksX = 0, bricksY = 0, bricksZ = 0;
+
+    /**
+     * Make sure the brick holding a voxel is decomposed, cheap once it is.
+     */
+    void touch(int x, int y, int z) const
+    {
+        if (!brickStates) return;
+        size_t brick = (size_t)(x / TENSOR_BRICK_SIZE) + bricksX * ((size_t)(y / TENSOR_BRICK_SIZE) + (size_t)bricksY * (z / TENSOR_BRICK_SIZE));
+        if (brickStates[brick].load(std::memory_order_acquire) != BRICK_READY) decomposeBrick(brick);
+    }
+
+    /**
+     * Make sure the bricks of the 8 voxels around a position are decomposed.
+     */
+    void touchAround(float x, float y, float z) const;
+
+    /**
+     * Decompose a brick, or wait until the thread that claimed it has.
+     */
+    void decomposeBrick(size_t brick) const;
 
-    bool* calculateZeroMask();
+    /**
+     * Decompose every brick that wasn't touched yet.
+     */
+    void decomposeAll() const;
+
+    /**
+     * Build the mask of nonzero vectors from the stored vectors.
+     */
+    void calculateZeroMask();
+
+    /**
+     * Allocate the arrays of a quantized storage mode.
+     */
+    void allocateQuantized(VectorFieldStorage storage, float maxMagnitude);
+
+    /**
+     * Quantize count vectors starting at voxel start and accumulate the angular error of the nonzero vectors.
+     */
+    void quantize(const float* vectors, size_t start, size_t count, double& errorSum, double& errorMax, size_t& numNonzero);
+
+    /**
+     * Quantize the whole float field, free the float data and report the error.
+     */
+    void quantizeAll();
+
+    /**
+     * Print the memory use and angular error after quantization.
+     */
+    void reportQuantization(double errorSum, double errorMax, size_t numNonzero);
+
+    /**
+     * Move the float field into sparse blocks and free the dense data.
+     */
+    void buildSparse();
+
+    /**
+     * Compute the cubic B-spline coefficients of the field.
+     */
+    void prefilterCubic() const;
+
+    /**
+     * Decode one quantized voxel (index z + dimZ * (y + dimY * x)).
+     */
+    void decodeVector(size_t index, float* out) const;
 
-    Eigen::Vector3f getMajorEigenVector(float* tensorField, int x, int y, int z);
 };
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+/**
+ * @file VolumeAllocator.h
+ * @brief Allocation of the large volume buffers (vector data, masks, texture staging)
+ *
+ * The volumes are loaded by a single thread, so with the default first-touch policy of
+ * the operating system all of their pages end up on the memory of one NUMA node and the
+ * tracing threads on the other sockets read remote memory. This allocator can spread the
+ * pages over all nodes and back the buffers with huge pages to reduce TLB misses.
+ *
+ * The policy is read from the VCP_VOLUME_ALLOCATION environment variable
+ * (default, hugepages, interleave or interleave-hugepages) and falls back to
+ * VOLUME_ALLOCATION_POLICY in Constants.h. Buffers allocated here must be released
+ * with freeVolume(); owners hold them in a VolumeBuffer so that happens automatically.
+ */
+
+/**
+ * @brief Placement policies for volume buffers
+ */
+enum VolumeAllocationPolicy {
+    ALLOCATE_DEFAULT = 0,             ///< Regular allocation, pages are placed on first touch
+    ALLOCATE_HUGE_PAGES,              ///< Explicit huge pages if reserved, transparent huge pages otherwise
+    ALLOCATE_NUMA_INTERLEAVE,         ///< Pages interleaved round-robin over all NUMA nodes
+    ALLOCATE_NUMA_INTERLEAVE_HUGE_PAGES ///< Interleaved huge pages
+};
+
+/**
+ * @brief Get the human readable name of a policy, as accepted by VCP_VOLUME_ALLOCATION
+ */
+const char* getVolumeAllocationPolicyName(VolumeAllocationPolicy policy);
+
+/**
+ * @brief Get the policy used for new allocations
+ */
+VolumeAllocationPolicy getVolumeAllocationPolicy();
+
+/**
+ * @brief Set the policy used for new allocations, existing buffers are not moved
+ */
+void setVolumeAllocationPolicy(VolumeAllocationPolicy policy);
+
+/**
+ * @brief Get the number of NUMA nodes of the machine (1 if unknown)
+ */
+int getNumaNodeCount();
+
+/**
+ * @brief Allocate a volume buffer with the current policy
+ * @param bytes Size of the buffer in bytes
+ * @return Pointer to the (uninitialized) buffer, aligned to at least 64 bytes
+ */
+void* allocateVolume(size_t bytes);
+
+/**
+ * @brief Free a buffer allocated with allocateVolume(), nullptr is ignored
+ */
+void freeVolume(void* ptr);
+
+/**
+ * @brief Typed helper for allocateVolume()
+ * @param count Number of elements
+ */
+template <typename T>
+T* allocateVolumeArray(size_t count)
+{
+    return static_cast<T*>(allocateVolume(count * sizeof(T)));
+}
+
+/**
+ * @brief Deleter that releases a buffer with freeVolume()
+ */
+struct VolumeDeleter {
+    void operator()(void* ptr) const { freeVolume(ptr); }
+};
+
+/**
+ * @brief Owning pointer to a buffer from allocateVolume()
+ */
+template <typename T>
+using VolumeBuffer = std::unique_ptr<T[], VolumeDeleter>;
+
+/**
+ * @brief Allocate a volume buffer that frees itself
+ * @param count Number of elements
+ */
+template <typename T>
+VolumeBuffer<T> allocateVolumeBuffer(size_t count)
+{
+    return VolumeBuffer<T>(allocateVolumeArray<T>(count));
+}
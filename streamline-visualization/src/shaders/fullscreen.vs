@@ -0,0 +1,11 @@
+#version 330 core
+
+// Fullscreen triangle generated from the vertex index, drawn without vertex attributes
+out vec2 texCoord;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    texCoord = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+in vec2 texCoord;
+
+// Output color, blended over the opaque scene
+out vec4 FragColor;
+
+// Weighted color sum (rgb) and revealage (a), and the sum of the weights
+uniform sampler2D accumulationTexture;
+uniform sampler2D weightTexture;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 accumulation = texelFetch(accumulationTexture, texel, 0);
+    float revealage = accumulation.a;
+    if (revealage >= 0.999) discard; // nothing drawn here
+
+    float weight = texelFetch(weightTexture, texel, 0).r;
+    FragColor = vec4(accumulation.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
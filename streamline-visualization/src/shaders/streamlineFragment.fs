@@ -3,11 +3,40 @@
 // Input from vertex shader
 in vec3 vertColor;
 
-// Output color
-out vec4 FragColor;
+// Output color, and the sum of the weights in the weighted blended mode
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 WeightSum;
+
+// Draw in the highlight color instead of the vertex color (picked streamline)
+uniform bool highlight;
+
+// Weighted blended order-independent transparency (McGuire and Bavoil 2013)
+uniform bool weightedBlended;
+uniform float opacity;
+
+// Count the lines covering every pixel, each fragment adds one
+uniform bool density;
 
 void main()
 {
-    // Output the vertex color with full opacity
-    FragColor = vec4(vertColor, 1.0);
-}
\ No newline at end of file
+    if (density)
+    {
+        FragColor = vec4(1.0);
+        WeightSum = vec4(0.0);
+        return;
+    }
+
+    vec3 color = highlight ? vec3(1.0, 1.0, 0.0) : vertColor;
+    if (!weightedBlended)
+    {
+        // Output the vertex color with full opacity
+        FragColor = vec4(color, 1.0);
+        WeightSum = vec4(0.0);
+        return;
+    }
+
+    // Fragments closer to the camera get a larger weight, so the front layers dominate the average color
+    float weight = opacity * clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);
+    FragColor = vec4(color * opacity * weight, opacity);
+    WeightSum = vec4(opacity * weight);
+}